@@ -511,6 +511,13 @@ public:
     void blocking_mode(bool blk=true) {
         blocking_in = blocking_out = blk;
     }
+    void spinpark_mode(bool sp=true) {
+        spinpark = sp;
+        for(size_t i=0;i<workers1.size();++i)
+            workers1[i]->spinpark_mode(sp);
+        for(size_t i=0;i<workers2.size();++i)
+            workers2[i]->spinpark_mode(sp);
+    }
 
     void no_mapping() {
         default_mapping = false;
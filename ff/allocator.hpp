@@ -109,9 +109,9 @@
 // #include <ff/atomic/atomic.h>
 // #endif
 #include <atomic>
-
-#if defined(ALLOCATOR_STATS)
 #include <iostream>
+#if defined(__linux__)
+#include <sys/mman.h>
 #endif
 
 
@@ -137,19 +137,58 @@ namespace ff {
      *
      */
     enum { N_SLABBUFFER=9, MAX_SLABBUFFER_SIZE=8192};
+
+    // Large size classes (from 16KB up to 1MB). They are not preallocated and
+    // the number of buffers per segment cannot be changed by the user, their
+    // segments are sized to a multiple of the huge page size (see
+    // SegmentAllocator).
+    enum { N_SLABBUFFER_LARGE=7, N_SLABCLASSES=N_SLABBUFFER+N_SLABBUFFER_LARGE,
+           MAX_SLABCLASS_SIZE=1048576 };
     static const int POW2_MIN  = 5;
-    static const int POW2_MAX  = 13;
+    static const int POW2_MAX  = 20;
 
     // array containing different possbile sizes for a slab buffer
-    static const int buffersize[N_SLABBUFFER] = 
-        { 32, 64,128,256,512,1024,2048,4096,8192  };
+    static const int buffersize[N_SLABCLASSES] = 
+        { 32, 64,128,256,512,1024,2048,4096,8192,
+          16384,32768,65536,131072,262144,524288,1048576 };
 
     // array containing the allowed numbers (quantity) of buffers. These values will be 
     // used together with the array of possible sizes for buffers: they will be paired 
     // with a specific buffer size and will denote the number of buffers of that size, 
     // present inside the cache.
-    static const int nslabs_default[N_SLABBUFFER] =
-        { 512,512,512,512,128,  64,  32,  16,   8 };
+    // The values of the large classes fill 2MB (up to 256KB) or 4MB segments.
+    static const int nslabs_default[N_SLABCLASSES] =
+        { 512,512,512,512,128,  64,  32,  16,   8,
+          127, 63, 31, 15,  7,   7,   3 };
+
+#if !defined(ALLOCATOR_HUGEPAGE_SIZE)
+#define ALLOCATOR_HUGEPAGE_SIZE 2097152
+#endif
+
+    /*
+     * Per size-class counters, always available (see ff_allocator::getstats).
+     * They are updated only by the thread owning the allocator, therefore
+     * no atomic read-modify-write instruction is used.
+     *   hit    = requests served without allocating a new segment
+     *   miss   = requests that required a new segment
+     *   remote = chunks of buffers freed by other threads and returned to
+     *            the owner
+     */
+    struct slab_stats {
+        std::atomic<size_t> hit{0}, miss{0}, remote{0};
+
+        static inline void inc(std::atomic<size_t> &c) {
+            c.store(c.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+        }
+    };
+
+    // a snapshot of the slab_stats of a size class
+    struct slab_counters {
+        size_t size;
+        size_t hit;
+        size_t miss;
+        size_t remote;
+    };
 
 #if defined(ALLOCATOR_STATS)
     
@@ -254,6 +293,17 @@ namespace ff {
         void * newsegment(size_t segment_size) {
             //void * ptr = ::malloc(segment_size);
             void * ptr=NULL;
+#if defined(MADV_HUGEPAGE) && !defined(ALLOCATOR_NO_HUGEPAGES)
+            /*
+             * Large segments are aligned to the huge page size and the kernel
+             * is asked to back them with transparent huge pages.
+             */
+            if (segment_size >= ALLOCATOR_HUGEPAGE_SIZE) {
+                const size_t sz = hugesize(segment_size);
+                ptr = getAlignedMemory(ALLOCATOR_HUGEPAGE_SIZE, sz);
+                if (ptr) madvise(ptr, sz, MADV_HUGEPAGE);
+            } else
+#endif
             // MA: Check if this does not lead to a page swap
 #if defined (_SC_PAGESIZE)
             ptr = getAlignedMemory(sysconf(_SC_PAGESIZE),segment_size);
@@ -297,6 +347,11 @@ namespace ff {
          * \return Returns the amount of allocated memory
          */
         size_t getallocated() const { return memory_allocated; }
+
+        // size of a segment rounded up to a multiple of the huge page size
+        static inline size_t hugesize(size_t segment_size) {
+            return (segment_size + ALLOCATOR_HUGEPAGE_SIZE - 1) & ~((size_t)ALLOCATOR_HUGEPAGE_SIZE - 1);
+        }
     
     private:
         size_t       memory_allocated;
@@ -347,34 +402,28 @@ namespace ff {
     /*
      * \struct xThreadData
      *
-     * \brief A buffer shared among threads (i.e. leak queue)
-     *
-     * A buffer that is used as a channel for exchanging shared data among threads.
-     * It is built upon FastFlow's unbounded Single-Writer / Single-Reader queues
-     * (\p uSWSR_Ptr_Buffer). These buffers guarantee deadlock avoidance and
-     * scalability in stream-oriented applications.
+     * \brief The per-thread free list of a SlabCache (i.e. leak queue)
      *
+     * Each thread freeing buffers of a SlabCache it does not own has its own
+     * xThreadData, the freed buffers are linked together (the link is stored
+     * in the data part of the buffer) in the \p pending list.
+     * The thread pushes the buffers with a CAS on its own \p pending list,
+     * the owner of the SlabCache takes the whole list (a chunk of buffers) at
+     * once with an atomic exchange, hence there is no ABA problem and neither
+     * the freeing threads nor the owner ever wait.
      *
+     * The xThreadData entries are kept in a lock-free list, an entry is never
+     * removed until the SlabCache is destroyed.
      */
     struct xThreadData {
-        enum { LEAK_CHUNK=4096 };
-    
-        xThreadData(const bool /*allocator*/, size_t /*nslabs*/, const pthread_t key)
-            : leak(0), key(key) {
-            //leak = (uSWSR_Ptr_Buffer*)::malloc(sizeof(uSWSR_Ptr_Buffer));
-            leak = (uSWSR_Ptr_Buffer*)getAlignedMemory(128,sizeof(uSWSR_Ptr_Buffer));
-            if (!leak) abort();
-            new (leak) uSWSR_Ptr_Buffer(LEAK_CHUNK);
-            if (!leak->init()) abort();
-        }
-
-        ~xThreadData() {
-            if (leak) { leak->~uSWSR_Ptr_Buffer(); freeAlignedMemory(leak); } // free(leak)
-        }
-    
-        uSWSR_Ptr_Buffer * leak;   //
-        const pthread_t    key;    // used to identify a thread (threadID)
-        long padding[longxCacheLine-((sizeof(const pthread_t)+sizeof(uSWSR_Ptr_Buffer*))/sizeof(long))]; //
+        xThreadData(const bool allocator, const pthread_t key)
+            : pending(NULL), next(NULL), key(key), allocator(allocator) { }
+
+        std::atomic<Buf_ctl *> pending;    // chunk of freed buffers
+        xThreadData          * next;       // next entry in the list
+        const pthread_t        key;        // used to identify a thread (threadID)
+        const bool             allocator;  // true if 'key' owns the SlabCache
+        long padding[longxCacheLine-((sizeof(Buf_ctl*)+sizeof(xThreadData*)+sizeof(pthread_t)+sizeof(long))/sizeof(long))]; //
     };
 
     /* 
@@ -441,6 +490,11 @@ namespace ff {
             return *((Seg_ctl **)buf);
         }
 
+        // link to the next free buffer, stored in the data part of the buffer
+        static inline Buf_ctl *& nextbuf(Buf_ctl * buf) {
+            return *((Buf_ctl **)(buf+1));
+        }
+
         /*
          * This method creates a new slab, that is, it allocates a new segment of
          * large and possibly aligned memory.
@@ -531,58 +585,49 @@ namespace ff {
             return r;
         }
 
-        inline void checkReclaimD(Seg_ctl  * seg) {
-            if (++(seg->availbuffers) == (unsigned long)nslabs) {
-                freeslab(seg); /* Free the given segment of memory (a slab) */
+        // reclaims all the buffers of the list 'buf'
+        inline bool checkReclaimList(Buf_ctl * buf) {
+            bool r=false;
+            while(buf) {
+                Buf_ctl * next = nextbuf(buf);
+                r |= checkReclaim(getsegctl(buf));
+                buf = next;
             }
+            return r;
         }
 
-
-        // REW
-        // TODO: The following have to be checked if it can use the last queue
-        //       index  as in the getfrom_fb() method !!!!!
-        //
-
-        inline void * getfrom_fb_delayed() {
-            if (fb_size==1) return 0;
-            for(unsigned i=1;i<fb_size;++i) {
-                if (fb[i]->leak->length()<(unsigned)delayedReclaim)  {
-                    return 0; // cache is empty
-                }
-            }
-
-            union { Buf_ctl * buf; void * ptr; } b={NULL};
-
-            for(unsigned i=2;i<fb_size;++i) {
-                fb[i]->leak->pop(&b.ptr);
-                DBG(assert(b.ptr));
-                checkReclaimD(getsegctl(b.buf));
-            }
-
-            fb[1]->leak->pop(&b.ptr);
+        inline bool getchunk(xThreadData * x) {
+            if (!x->pending.load(std::memory_order_relaxed)) return false;
+            Buf_ctl * chunk = x->pending.exchange(NULL, std::memory_order_acquire);
+            if (!chunk) return false;
             ALLSTATS(all_stats::instance()->leakremoved.fetch_add(1));
-            return b.ptr;
+            slab_stats::inc(stats->remote);
+            freelist  = chunk;
+            lastqueue = x->next;
+            return true;
         }
 
-        inline void * getfrom_fb() {
-            void * buf = 0;
-            for(unsigned i=0;i<fb_size;++i) {
-                unsigned k=(lastqueue+i)%fb_size;
-                if (fb[k]->leak->pop((void **)&buf)) {
-                    ALLSTATS(all_stats::instance()->leakremoved.fetch_add(1));
-                    lastqueue=k;
-                    return buf;
-                }
-            }
+        /*
+         * Moves into the local free list the first non-empty chunk of buffers
+         * freed by the other threads, starting from the entry following the
+         * last one used.
+         */
+        inline bool getfrom_fb() {
+            xThreadData * const head  = fb.load(std::memory_order_acquire);
+            xThreadData * const start = lastqueue ? lastqueue : head;
+            for(xThreadData * x=start; x; x=x->next)
+                if (getchunk(x)) return true;
+            for(xThreadData * x=head; x!=start; x=x->next)
+                if (getchunk(x)) return true;
 
             // the free buffers are empty
-            return 0;
+            return false;
         }
 
-        inline int searchfb(const pthread_t key) {
-            for(unsigned i=0;i<fb_size;++i)
-                if (fb[i]->key == key) return (int)i;
-            return -1;
+        inline xThreadData * searchfb(const pthread_t key) {
+            for(xThreadData * x=fb.load(std::memory_order_acquire); x; x=x->next)
+                if (pthread_equal(x->key, key)) return x;
+            return NULL;
         }
 
     public: 
@@ -598,13 +643,15 @@ namespace ff {
          *  \param ns number of buffers (slabs) in each segment (note that, as the
          *  size of each buffer increases, the number of buffers in each segment
          *  decreases).
+         *  \param stats the counters of the size class
          *
          */
         SlabCache( ff_allocator * const mainalloc, const int delayedReclaim,
-                   SegmentAllocator * const alloc, size_t sz, int ns )
-            : size(sz), nslabs(ns), fb(0), fb_capacity(0), fb_size(0),
-              buffptr(0), availbuffers(0), alloc(alloc),
-              mainalloc(mainalloc), delayedReclaim(delayedReclaim),lastqueue(0) { }
+                   SegmentAllocator * const alloc, size_t sz, int ns,
+                   slab_stats * const stats )
+            : size(sz), nslabs(ns), fb(NULL),
+              buffptr(0), availbuffers(0), freelist(0), stats(stats), alloc(alloc),
+              mainalloc(mainalloc), delayedReclaim(delayedReclaim),lastqueue(NULL) { }
     
         /**
          * Destructor
@@ -617,24 +664,20 @@ namespace ff {
                 freeslab(*b,false); // seglist_rem = false: nothing is removed
             }
             seglist.clear();        // clear the list
-            if (fb) {
-                for(unsigned i=0;i<fb_size;++i)
-                    if (fb[i]) {
-                        fb[i]->~xThreadData();
-                        ::free(fb[i]);
-                    }
-                ::free(fb);
+            xThreadData * x = fb.load();
+            while(x) {
+                xThreadData * next = x->next;
+                x->~xThreadData();
+                freeAlignedMemory(x);
+                x = next;
             }
         }
 
         /*
          * Initialise a new SlabCache.
          *
-         * This method creates a new slab, that is,
-         * it allocates space for an unbounded buffer built upon the
-         * uSWSR_Ptr_Buffer. Then it creates a new segment of large and (possibly)
-         * aligned memory. The initial size of the buffer - set to a minimum value
-         * equal to 32 - can be later increased, if necessary.
+         * This method creates a new slab, that is, it allocates a new segment
+         * of large and (possibly) aligned memory.
          *
          * \param prealloc flag that act as a mask against the creation of a new
          * Slab. By default it is set to \p true.
@@ -650,60 +693,41 @@ namespace ff {
 
             init_unlocked(lock);
 
-            /* Allocate space for leak queue */
-            fb = (xThreadData**)::malloc(MIN_FB_CAPACITY*sizeof(xThreadData*));
-            if (!fb) return -1;
-
-            fb_capacity = MIN_FB_CAPACITY;            
             if ( prealloc && (newslab()<0) ) return -1;
             return 0;
         }
     
         /*
-         * Register the calling thread into the shared buffer (leak queue).\n
-         * In case the thread (ID) is already registered in the buffer, it returns a
-         * pointer to its position in the buffer. If it is not registered, then
-         * allocates space for a new thread's buffer and initialise the new buffer
-         * with the key of the new thread. The \p allocator flag is set to false.
+         * Register the calling thread into the list of the threads freeing
+         * buffers of this cache (leak queues).\n
+         * In case the thread (ID) is already registered, it returns a pointer
+         * to its entry. If it is not registered, then allocates space for a new
+         * entry, initialises it with the key of the new thread and pushes it
+         * on the list with a CAS operation (no lock is acquired).
          *
          * \param allocator \p true if the calling thread is the allocator thread;
          * \p false by default.
-         * \returns a pointer to the allocated thread in the buffer.
+         * \returns a pointer to the entry of the calling thread.
          */
         inline xThreadData * register4free(const bool allocator=false) {
             DBG(assert(nslabs>0));
         
             pthread_t key= pthread_self();  // obtain ID of the calling thread
-            int entry = searchfb(key);      // search for threadID in leak queue
-            if (entry<0) {                  // if threadID not found
-                // allocate a new buffer for thread 'key'
-                xThreadData * xtd = (xThreadData*)::malloc(sizeof(xThreadData));
-                if (!xtd) return NULL;
-                new (xtd) xThreadData(allocator, nslabs, key);
-
-                /*
-                 * REW
-                 * if the size of the existing leak queue has reached the max
-                 * capacity, allocate more space (::realloc) and update the queue's
-                 * capacity. These operations are thread safe (mutual exclusion).
-                 */
-                spin_lock(lock);
-                if (fb_size==fb_capacity) {
-                    xThreadData ** fb_new = (xThreadData**)::realloc( fb,
-                                                                      (fb_capacity+MIN_FB_CAPACITY) * sizeof(xThreadData*) );
-                    if (!fb_new) {
-                        spin_unlock(lock);
-                        return NULL;
-                    }
-                    fb = fb_new;
-                    fb_capacity += MIN_FB_CAPACITY;
-                }
-                // add the new buffer to the leak queue and release lock
-                fb[entry=(int) fb_size++] = xtd;
-                spin_unlock(lock);
-            }
-            DBG(assert(fb[entry]->key == key));
-            return fb[entry];                   // position of new entry in buffer
+            xThreadData * xtd = searchfb(key);
+            if (xtd) return xtd;
+
+            xtd = (xThreadData*)getAlignedMemory(CACHE_LINE_SIZE, sizeof(xThreadData));
+            if (!xtd) return NULL;
+            new (xtd) xThreadData(allocator, key);
+
+            // only the thread 'key' can insert its own entry
+            xThreadData * head = fb.load(std::memory_order_relaxed);
+            do {
+                xtd->next = head;
+            } while(!fb.compare_exchange_weak(head, xtd,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+            return xtd;
         }
 
         /*
@@ -717,17 +741,13 @@ namespace ff {
             // and prevented from allocating
             nomoremalloc.store(1);
 
-            // try to reclaim some memory
-            for(unsigned i=0;i<fb_size;++i) {
-                DBG(assert(fb[i]));
-                if (reclaim) {
-                    union { Buf_ctl * buf2; void * ptr; } b={NULL};
+            if (!reclaim) return;
 
-                    while(fb[i]->leak->pop(&b.ptr)) {   // while pop  succeedes
-                        checkReclaim(getsegctl(b.buf2));
-                    }
-                }
-            }
+            // try to reclaim some memory
+            checkReclaimList(freelist);
+            freelist = 0;
+            for(xThreadData * x=fb.load(); x; x=x->next)
+                checkReclaimList(x->pending.exchange(NULL));
         }
 
         /*
@@ -741,6 +761,7 @@ namespace ff {
 
             /* try to get one item from the available ones */
             if (availbuffers) {
+                slab_stats::inc(stats->hit);
             avail:
                 Seg_ctl * seg = *((Seg_ctl **)buffptr);
                 DBG(assert(seg));
@@ -762,19 +783,22 @@ namespace ff {
                 return item;
             }
 
-            // else, try to get a free item from cache
-            item = delayedReclaim ? getfrom_fb_delayed() : getfrom_fb();
-
-            if (item) {
+            // else, try to get a free item from the local free list or from
+            // the chunks freed by the other threads
+            if (freelist || getfrom_fb()) {
+                Buf_ctl * buf = freelist;
+                freelist = nextbuf(buf);
                 ALLSTATS(all_stats::instance()->hit.fetch_add(1));
-                DBG(if ((getsegctl((Buf_ctl *)item))->allocator == NULL) abort());
-                return ((char *)item + BUFFER_OVERHEAD);
+                slab_stats::inc(stats->hit);
+                DBG(if ((getsegctl(buf))->allocator == NULL) abort());
+                return ((char *)buf + BUFFER_OVERHEAD);
             }
 
             ALLSTATS(all_stats::instance()->miss.fetch_add(1));
 
             /* if there are not available items try to allocate a new slab */
             if (newslab()<0) return NULL;
+            slab_stats::inc(stats->miss);
             goto avail;
             return NULL; // not reached
         }
@@ -794,22 +818,33 @@ namespace ff {
              * reclaimed.
              */
             if (nomoremalloc.load()) {
-                // NOTE: if delayedReclaim is set, freeing threads cannot pass here
-                DBG(assert(delayedReclaim==0));
-
                 Seg_ctl  * seg = *(Seg_ctl **)buf;
                 return checkReclaim(seg);   // true if some memory can be reclaimed
             }
 
+            xThreadData * xtd = searchfb(pthread_self());   // look for calling thread
+            if (!xtd) xtd = register4free();                // if not present, register it
+            DBG(if (!xtd) abort());
+
+            // the owner puts the buffer directly in its local free list
+            if (xtd->allocator) {
+                nextbuf(buf) = freelist;
+                freelist     = buf;
+                return false;
+            }
+
+            // the other threads push the buffer in their own chunk
+            Buf_ctl * head = xtd->pending.load(std::memory_order_relaxed);
+            do {
+                nextbuf(buf) = head;
+            } while(!xtd->pending.compare_exchange_weak(head, buf));
+
             /*
-             * If nomorealloc is 0,
+             * If in the meantime the allocator has been deregistered, the
+             * chunk may have not been seen by deregisterAllocator.
              */
-            int entry = searchfb(pthread_self());   // look for calling thread
-            xThreadData * xtd = NULL;
-            if (entry<0) xtd = register4free();     // if not present, register it
-            else xtd = fb[entry];                   // else, point to its position
-            DBG(if (!xtd) abort());
-            xtd->leak->push((void *)buf);           // push the item in the buffer
+            if (nomoremalloc.load() && !delayedReclaim)
+                return checkReclaimList(xtd->pending.exchange(NULL));
             return false;
         }
 
@@ -825,13 +860,13 @@ namespace ff {
         size_t                     size;            /* size of slab buffer */
         size_t                     nslabs;          /* num of buffers in segment */
 
-        xThreadData            **  fb;              /* leak queue */
-        size_t                     fb_capacity;     /* Min is 32 */
-        size_t                     fb_size;
+        std::atomic<xThreadData *> fb;              /* leak queues */
         lock_t                     lock;
             
         Buf_ctl *             buffptr;
         size_t                availbuffers;
+        Buf_ctl *             freelist;             /* owner's free buffers */
+        slab_stats * const    stats;
 
     private:
         std::atomic_long            nomoremalloc;
@@ -839,7 +874,7 @@ namespace ff {
         SegmentAllocator * const alloc;
         ff_allocator     * const mainalloc;     // the main allocator
         const int                delayedReclaim;
-        unsigned                 lastqueue;
+        xThreadData            * lastqueue;
         svector<void *>          seglist;       // list of pointers to mem segments
     };
 
@@ -859,7 +894,7 @@ namespace ff {
      * standard allocators' performance in a multi-threaded envirnoment. When it is
      * initialised, it creates a (predefined) number of SlabCaches, each one
      * containing a (predefined) number of buffers of different sizes, from 32 to
-     * 8192 bytes. The thread that calls first the allocator object and wants to
+     * 1MB bytes. The thread that calls first the allocator object and wants to
      * allocate memory has to register itself to the shared leak queue. Only one
      * thread can perform this operation. The allocator obtains memory from the
      * pre-allocated SlabCache: if there is a slab (i.e. a buffer) big enough to
@@ -949,8 +984,10 @@ namespace ff {
         // FIX: we have to implement max_size !!!!
         /// Default Constructor
 
-        ff_allocator(size_t /*max_size*/=0, const int delayedReclaim=0) :
-            alloc(0), /* max_size(max_size), */ delayedReclaim(delayedReclaim) { 
+        ff_allocator(size_t /*max_size*/=0, const int delayedReclaim=0,
+                     slab_stats * stats=NULL) :
+            alloc(0), /* max_size(max_size), */ delayedReclaim(delayedReclaim),
+            stats(stats?stats:classstats) { 
         }
 
         /*
@@ -978,8 +1015,8 @@ namespace ff {
          * Initialise the allocator. This method is called by one ff_node for
          * each data-path. (e.g. the Emitter in a Farm skeleton).
          * It creates a number of SlabCaches objects, a number specified by the
-         * \p N_SLABBUFFER constant. The size of each created segment
-         * goes from 32 (the first one created) to 8192 (the last).
+         * \p N_SLABCLASSES constant. The size of each created segment
+         * goes from 32 (the first one created) to 1MB (the last).
          * Typically the number of buffers in a slab segment
          * decreases as the size of the slab increases.
          *
@@ -990,6 +1027,9 @@ namespace ff {
          * const int nslabs_default[N_SLABBUFFER] = { 512,512,512,512,128,  64,  32,  16,   8 };
          * \endcode
          *
+         * The \p N_SLABBUFFER_LARGE classes from 16KB to 1MB always use
+         * the default number of buffers and are never preallocated.
+         *
          * The number of nslabs is dynamically increased if needed recaliming more
          * memory from OS. This is a reltevely slow and not lock-free path of the code.
          *
@@ -1008,6 +1048,8 @@ namespace ff {
             else
                 for (int i=0;i<N_SLABBUFFER; ++i)
                     nslabs.push_back(nslabs_default[i]);
+            for (int i=N_SLABBUFFER;i<N_SLABCLASSES; ++i)
+                nslabs.push_back(nslabs_default[i]);
 
             /*
              * Allocate space for a SegmenAllocator object and
@@ -1018,21 +1060,21 @@ namespace ff {
             new (alloc) SegmentAllocator();
 
             SlabCache * s = 0;
-            slabcache.reserve(N_SLABBUFFER);
+            slabcache.reserve(N_SLABCLASSES);
 
 
             /*
-             * Allocate space for 'N_SLABBUFFER' caches and create SlabCache
-             * objects. Buffers size within a cache size grows from 32 to 8192. if
+             * Allocate space for 'N_SLABCLASSES' caches and create SlabCache
+             * objects. Buffers size within a cache size grows from 32 to 1MB. if
              * not otherwise specified, the number of slab buffers in a segment
              * decreases as the size of the slab increases.
              */
-            for(int i=0; i<N_SLABBUFFER; ++i) {
+            for(int i=0; i<N_SLABCLASSES; ++i) {
                 s = (SlabCache*)::malloc(sizeof(SlabCache));
                 if (!s) return -1;
                 new (s) SlabCache( this, delayedReclaim, alloc,
-                                   buffersize[i], nslabs[i] );
-                if (s->init(prealloc)<0) {
+                                   buffersize[i], nslabs[i], &stats[i] );
+                if (s->init(prealloc && i<N_SLABBUFFER)<0) {
                     error("ff_allocator:init: slab init fails!\n");
                     return -1;
                 }
@@ -1128,7 +1170,7 @@ namespace ff {
              * use standard allocator if the size is too big or
              * we don't want to use the ff_allocator for that size
              */
-            if ( size>MAX_SLABBUFFER_SIZE ||
+            if ( size>MAX_SLABCLASS_SIZE ||
                  (slabcache[getslabs(size)]->getnslabs()==0) ) {
                 ALLSTATS(all_stats::instance()->sysmalloc.fetch_add(1));
                 void * ptr = ::malloc(size+sizeof(Buf_ctl));
@@ -1169,7 +1211,7 @@ namespace ff {
              * if the size is too big or we don't want to use the ff_allocator
              * for that size, use the standard allocator and force alignment
              */
-            if (realsize > MAX_SLABBUFFER_SIZE ||
+            if (realsize > MAX_SLABCLASS_SIZE ||
                 (slabcache[getslabs(realsize)]->getnslabs()==0)) {
                 ALLSTATS(all_stats::instance()->sysmalloc.fetch_add(1));
                 void * ptr = ::malloc(realsize+sizeof(Buf_ctl));
@@ -1202,7 +1244,7 @@ namespace ff {
 
 
         // BUG 2 FIX: free fails if memory has been previously allocated using the
-        // posix_memalign method with a size grater than MAX_SLABBUFFER_SIZE!!!!
+        // posix_memalign method with a size grater than MAX_SLABCLASS_SIZE!!!!
         /**
          * \brief free
          *
@@ -1314,6 +1356,36 @@ namespace ff {
             return this->malloc(newsize);
         }
 
+        /**
+         * \brief counters of the size class \p cls (0..N_SLABCLASSES-1)
+         *
+         * They can be read by any thread while the allocator is in use.
+         */
+        inline slab_counters getstats(int cls) const {
+            slab_counters c = { (size_t)buffersize[cls],
+                                stats[cls].hit.load(std::memory_order_relaxed),
+                                stats[cls].miss.load(std::memory_order_relaxed),
+                                stats[cls].remote.load(std::memory_order_relaxed) };
+            return c;
+        }
+
+        inline void printclassstats(std::ostream & out = std::cout) const {
+            printclassstats(out, stats);
+        }
+
+        static inline void printclassstats(std::ostream & out, const slab_stats * stats) {
+            out << "\n--- Allocator size classes ---\n"
+                << "      size         hit        miss      remote\n";
+            for(int i=0;i<N_SLABCLASSES;++i) {
+                char line[64];
+                snprintf(line, sizeof(line), "%10d %11zu %11zu %11zu\n", buffersize[i],
+                         stats[i].hit.load(std::memory_order_relaxed),
+                         stats[i].miss.load(std::memory_order_relaxed),
+                         stats[i].remote.load(std::memory_order_relaxed));
+                out << line;
+            }
+        }
+
         ALLSTATS( void printstats(std::ostream & out) {
                 all_stats::instance()->print(out); }
             )
@@ -1323,6 +1395,8 @@ namespace ff {
         SegmentAllocator     * alloc;
         /* const size_t           max_size; */  // TODO
         const int              delayedReclaim;
+        slab_stats             classstats[N_SLABCLASSES];
+        slab_stats     * const stats;          // the counters used (classstats by default)
     };
 
     // forward decl
@@ -1358,8 +1432,9 @@ namespace ff {
         friend void FFAkeyDestructorHandler(void * kv);
 
 
-        ffa_wrapper(size_t max_size=0,const int delayedReclaim=0) :
-            ff_allocator(max_size,delayedReclaim) {
+        ffa_wrapper(size_t max_size=0,const int delayedReclaim=0,
+                    slab_stats * stats=NULL) :
+            ff_allocator(max_size,delayedReclaim,stats) {
             nomorealloc.store(0);
         }
 
@@ -1397,10 +1472,19 @@ namespace ff {
     };
 
 
+    /*
+     * An entry of the list of allocators of the FFAllocator.
+     * The entries are never removed from the list, the entry of a deleted
+     * allocator is reused by the next allocator created, the counters of
+     * the size classes are kept in the entry so that they are accumulated
+     * over the whole execution.
+     */
     struct FFAxThreadData {
-        FFAxThreadData(ffa_wrapper * f): f(f) { }
-        ffa_wrapper * f;
-        long padding[longxCacheLine-(sizeof(ffa_wrapper*)/sizeof(long))];
+        FFAxThreadData(): f(NULL), inuse(0), next(NULL) { }
+        std::atomic<ffa_wrapper *> f;
+        std::atomic_long           inuse;
+        FFAxThreadData           * next;
+        slab_stats                 stats[N_SLABCLASSES];
     };
 
     /**
@@ -1410,8 +1494,13 @@ namespace ff {
      *
      * Based on the \p ff_allocator, the FFAllocator might be used by any number
      * of \ref ff:ff_node (i.e. threads) to dynamically allocate/deallocate memory. It consists on
-     * a network of  \p ff_allocator per \ref ff_node. It uses \ref ff::uSWSR_Ptr_Buffer
-     * to avoid deadlocks.
+     * a network of  \p ff_allocator per \ref ff_node. The buffers freed by a thread
+     * different from the owner of the \p ff_allocator are returned to the owner
+     * in chunks (see \ref xThreadData).
+     *
+     * The allocators are registered in a lock-free list, no lock is acquired
+     * neither when a thread calls malloc the first time nor when it frees
+     * memory allocated by other threads.
      *
      * FFAllocator will be created as a static object on the first call to \ref FFAllocator::instance()
      *
@@ -1425,57 +1514,85 @@ namespace ff {
      * \example perf_test_alloc2.cpp
      */
     class FFAllocator {
-        enum {MIN_A_CAPACITY=32};
-
     protected:
         inline Seg_ctl * getsegctl(Buf_ctl * buf) {
             return *((Seg_ctl **)buf);
         }
 
+        // gets an unused entry of the list, if there are none a new entry
+        // is pushed on the list
+        inline FFAxThreadData * getentry() {
+            for(FFAxThreadData * x=A.load(std::memory_order_acquire); x; x=x->next) {
+                long z = 0;
+                if (!x->inuse.load(std::memory_order_relaxed) &&
+                    x->inuse.compare_exchange_strong(z, 1)) return x;
+            }
+            FFAxThreadData * ffaxtd =
+                (FFAxThreadData *)getAlignedMemory(CACHE_LINE_SIZE, sizeof(FFAxThreadData));
+            if (!ffaxtd) return NULL;
+            new (ffaxtd) FFAxThreadData();
+            ffaxtd->inuse.store(1);
+
+            FFAxThreadData * head = A.load(std::memory_order_relaxed);
+            do {
+                ffaxtd->next = head;
+            } while(!A.compare_exchange_weak(head, ffaxtd,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+            return ffaxtd;
+        }
+
         inline FFAxThreadData * newAllocator( bool prealloc,
                                               int _nslabs[N_SLABBUFFER],
                                               size_t max_size )
         {
-            FFAxThreadData * ffaxtd =
-                (FFAxThreadData *)::malloc(sizeof(FFAxThreadData) +
-                                           sizeof(ffa_wrapper));
-
+            FFAxThreadData * ffaxtd = getentry();
             if (!ffaxtd) return NULL;
-            ffa_wrapper * f = (ffa_wrapper*)((char *) ffaxtd +
-                                             sizeof(FFAxThreadData));
 
-            new (f) ffa_wrapper(max_size,delayedReclaim);
-            new (ffaxtd) FFAxThreadData(f);
+            ffa_wrapper * f = (ffa_wrapper*)::malloc(sizeof(ffa_wrapper));
+            if (!f) { ffaxtd->inuse.store(0); return NULL; }
+            new (f) ffa_wrapper(max_size,delayedReclaim,ffaxtd->stats);
 
             if (f->init(_nslabs, prealloc)<0) {
                 error("FFAllocator:newAllocator: init fails!\n");
+                f->~ffa_wrapper(); ::free(f);
+                ffaxtd->inuse.store(0);
                 return NULL;
             }
             if (f->registerAllocator()<0) {     // register allocator to leak queue
                 error("FFAllocator:newAllocator: registerAllocator fails!\n");
+                f->~ffa_wrapper(); ::free(f);
+                ffaxtd->inuse.store(0);
                 return NULL;
             }
-
-            // REW -- like in register4free
-            // if more space in the SlabCache is needed, allocate more space
-            // (::realloc) and update counters. Thread-safe operation (mutex)
-            spin_lock(lock);
-            if (A_size == A_capacity) {
-                FFAxThreadData ** A_new = (FFAxThreadData**) ::realloc( A,
-                                                                        (A_capacity+MIN_A_CAPACITY)*sizeof(FFAxThreadData*) );
-
-                if (!A_new) { spin_unlock(lock); return NULL;}
-                A=A_new;
-                A_capacity += MIN_A_CAPACITY;
-            }
-            A[A_size++] = ffaxtd;
-            spin_unlock(lock);
+            ffaxtd->f.store(f, std::memory_order_release);
 
             ALLSTATS(all_stats::instance()->newallocator.fetch_add(1));
 
             return ffaxtd;
         }
 
+        // returns the allocator of the calling thread, it is created the
+        // first time
+        inline FFAxThreadData * getAllocator() {
+            FFAxThreadData * ffaxtd = (FFAxThreadData*) pthread_getspecific(A_key);
+            if (ffaxtd) return ffaxtd;
+
+            // if no thread-data is associated to the key
+            // initialise and register a new allocator
+            // REW -- why prealloc is FALSE??
+            //
+            ffaxtd = newAllocator(false,0,0);
+            if (!ffaxtd) {
+                error("FFAllocator: newAllocator fails!\n");
+                return NULL;
+            }
+            if (pthread_setspecific(A_key, ffaxtd)!=0) {
+                deleteAllocator(ffaxtd->f.load());
+                return NULL;
+            }
+            return ffaxtd;
+        }
 
     public:
 
@@ -1485,11 +1602,8 @@ namespace ff {
          * \param delayedReclaim Deferred reclamation configuration
          */
         FFAllocator(int delayedReclaim=0) :
-            A(0), A_capacity(0), A_size(0),
-            delayedReclaim(delayedReclaim)
+            A(NULL), delayedReclaim(delayedReclaim)
         {
-            init_unlocked(lock);
-
             if (pthread_key_create( &A_key,
                                     (delayedReclaim ? NULL : FFAkeyDestructorHandler) )!=0)  {
                 error("FFAllocator FATAL ERROR: pthread_key_create fails\n");
@@ -1504,10 +1618,14 @@ namespace ff {
          */
         ~FFAllocator() {
             if (delayedReclaim) {
-                if (A) {
-                    for(unsigned i=0;i<A_size;++i)
-                        if (A[i]) deleteAllocator(A[i]->f);
-                    ::free(A);
+                FFAxThreadData * x = A.load();
+                while(x) {
+                    FFAxThreadData * next = x->next;
+                    ffa_wrapper * f = x->f.load();
+                    if (f) deleteAllocator(f);
+                    x->~FFAxThreadData();
+                    freeAlignedMemory(x);
+                    x = next;
                 }
                 pthread_key_delete(A_key);
             }
@@ -1528,8 +1646,8 @@ namespace ff {
          *
          * Each time this method is called it spawns a new memory allocator. The
          * calling thread is registered as an allocator thread. Other threads
-         * willing to use this SlabCache have to register themselves to the shared
-         * leak queue of the allocator.
+         * willing to use this SlabCache are registered the first time they
+         * free a buffer of the allocator.
          *
          * \param max_size PARAMETER NOT USED!
          * \param _nslabs  array specifying the allowed quantities of buffers. By
@@ -1546,7 +1664,7 @@ namespace ff {
         {
             FFAxThreadData * ffaxtd = newAllocator(prealloc, _nslabs, max_size);
             if (!ffaxtd) return NULL;
-            return ffaxtd->f;
+            return ffaxtd->f.load();
         }
 
         /*
@@ -1559,23 +1677,19 @@ namespace ff {
         inline void deleteAllocator(ffa_wrapper * f, bool reclaimMemory=true) {
             if (!f) return;
 
-            spin_lock(lock);
-            for (unsigned int i=0;i<A_size;++i) {
-                if (A[i]->f == f) {
+            for(FFAxThreadData * x=A.load(std::memory_order_acquire); x; x=x->next) {
+                ffa_wrapper * g = f;
+                // only one thread can delete the allocator
+                if (x->f.load(std::memory_order_relaxed) == f &&
+                    x->f.compare_exchange_strong(g, NULL)) {
                     f->deregisterAllocator(reclaimMemory);
                     f->~ffa_wrapper();
-                    A[i]->~FFAxThreadData();
-                    ::free(A[i]);
-
-                    for (unsigned int j=i+1;j<A_size;++i,++j)
-                        A[i]=A[j];
-                    --A_size;
-
+                    ::free(f);
+                    x->inuse.store(0);
+                    ALLSTATS(all_stats::instance()->deleteallocator.fetch_add(1));
                     break;
                 }
             }
-            spin_unlock(lock);
-            ALLSTATS(all_stats::instance()->deleteallocator.fetch_add(1));
         }
 
         /*
@@ -1585,7 +1699,8 @@ namespace ff {
         inline void deleteAllocator() {
             FFAxThreadData * ffaxtd = (FFAxThreadData*)pthread_getspecific(A_key);
             if (!ffaxtd) return;
-            deleteAllocator(ffaxtd->f,true);
+            pthread_setspecific(A_key, NULL);
+            deleteAllocator(ffaxtd->f.load(),true);
         }
 
         /**
@@ -1600,7 +1715,7 @@ namespace ff {
          */
         inline void * malloc(size_t size) {
             /* use standard allocator if the size is too big */
-            if (size>MAX_SLABBUFFER_SIZE) {
+            if (size>MAX_SLABCLASS_SIZE) {
                 ALLSTATS(all_stats::instance()->sysmalloc.fetch_add(1));
                 void * ptr = ::malloc(size+sizeof(Buf_ctl));
                 if (!ptr) return 0;
@@ -1608,30 +1723,9 @@ namespace ff {
                 return (char *)ptr + sizeof(Buf_ctl);
             }
 
-            FFAxThreadData * ffaxtd = (FFAxThreadData*) pthread_getspecific(A_key);
-            if (!ffaxtd) {
-                // if no thread-data is associated to the key
-                // initialise and register a new allocator
-                // REW -- why prealloc is FALSE??
-                //
-                ffaxtd = newAllocator(false,0,0);
-
-                if (!ffaxtd) {
-                    error("FFAllocator:malloc: newAllocator fails!\n");
-                    return NULL;
-                }
-
-                // REW -- ?
-                spin_lock(lock);
-                if (pthread_setspecific(A_key, ffaxtd)!=0) {
-                    deleteAllocator(ffaxtd->f);
-                    spin_unlock(lock);
-                    return NULL;
-                }
-                spin_unlock(lock);
-            }
-
-            return ffaxtd->f->malloc(size);
+            FFAxThreadData * ffaxtd = getAllocator();
+            if (!ffaxtd) return NULL;
+            return ffaxtd->f.load(std::memory_order_relaxed)->malloc(size);
         }
 
         /**
@@ -1650,7 +1744,7 @@ namespace ff {
 
             size_t realsize = size+alignment;
 
-            if (realsize > MAX_SLABBUFFER_SIZE) {
+            if (realsize > MAX_SLABCLASS_SIZE) {
                 ALLSTATS(all_stats::instance()->sysmalloc.fetch_add(1));
                 void * ptr = ::malloc(realsize+sizeof(Buf_ctl));
                 if (!ptr) return -1;
@@ -1660,27 +1754,9 @@ namespace ff {
                 *memptr = ptraligned;
                 return 0;
             }
-            FFAxThreadData * ffaxtd = (FFAxThreadData*)pthread_getspecific(A_key);
-            if (!ffaxtd) {
-                // initialise and register a new allocator
-                // REW -- why prealloc FALSE??
-                ffaxtd = newAllocator(false,0,0);
-
-                if (!ffaxtd) {
-                    error("FFAllocator:posix_memalign: newAllocator fails!\n");
-                    return -1;
-                }
-
-                spin_lock(lock);
-                if (pthread_setspecific(A_key, ffaxtd)!=0) {
-                    deleteAllocator(ffaxtd->f);
-                    spin_unlock(lock);
-                    return -1;
-                }
-                spin_unlock(lock);
-            }
-
-            return ffaxtd->f->posix_memalign(memptr,alignment,size);
+            FFAxThreadData * ffaxtd = getAllocator();
+            if (!ffaxtd) return -1;
+            return ffaxtd->f.load(std::memory_order_relaxed)->posix_memalign(memptr,alignment,size);
         }
 
         /**
@@ -1730,9 +1806,9 @@ namespace ff {
                     return (char *)newptr + sizeof(Buf_ctl);
                 }
 
-                ffa_wrapper * f = (ffa_wrapper*) pthread_getspecific(A_key);
-                if (!f) return NULL;
-                return f->realloc(ptr,newsize);
+                FFAxThreadData * ffaxtd = (FFAxThreadData*) pthread_getspecific(A_key);
+                if (!ffaxtd) return NULL;
+                return ffaxtd->f.load(std::memory_order_relaxed)->realloc(ptr,newsize);
             }
             return this->malloc(newsize);
         }
@@ -1748,23 +1824,43 @@ namespace ff {
                     return (char *)newptr + sizeof(Buf_ctl);
                 }
 
-                ffa_wrapper * f = (ffa_wrapper*)pthread_getspecific(A_key);
-                if (!f) return NULL;
-                return f->growsup(ptr,newsize);
+                FFAxThreadData * ffaxtd = (FFAxThreadData*) pthread_getspecific(A_key);
+                if (!ffaxtd) return NULL;
+                return ffaxtd->f.load(std::memory_order_relaxed)->growsup(ptr,newsize);
             }
             return this->malloc(newsize);
         }
 
+        /**
+         * \brief counters of the size class \p cls summed over all the
+         * allocators created so far
+         */
+        inline slab_counters getstats(int cls) const {
+            slab_counters c = { (size_t)buffersize[cls], 0, 0, 0 };
+            for(FFAxThreadData * x=A.load(std::memory_order_acquire); x; x=x->next) {
+                c.hit    += x->stats[cls].hit.load(std::memory_order_relaxed);
+                c.miss   += x->stats[cls].miss.load(std::memory_order_relaxed);
+                c.remote += x->stats[cls].remote.load(std::memory_order_relaxed);
+            }
+            return c;
+        }
+
+        inline void printclassstats(std::ostream & out = std::cout) const {
+            slab_stats S[N_SLABCLASSES];
+            for(int i=0;i<N_SLABCLASSES;++i) {
+                const slab_counters c = getstats(i);
+                S[i].hit.store(c.hit); S[i].miss.store(c.miss); S[i].remote.store(c.remote);
+            }
+            ff_allocator::printclassstats(out, S);
+        }
+
         ALLSTATS(void printstats(std::ostream & out) {
                 all_stats::instance()->print(out);
             })
 
         private:
-        FFAxThreadData **A;             // ffa_wrapper : ff_allocator
-        size_t          A_capacity;     //
-        size_t          A_size;         //
+        std::atomic<FFAxThreadData *> A;    // list of ffa_wrapper : ff_allocator
 
-        lock_t          lock;
         pthread_key_t   A_key;
         const int       delayedReclaim;
     };
@@ -1772,8 +1868,10 @@ namespace ff {
     /* REW - Document these? */
     static void FFAkeyDestructorHandler(void * kv) {
         FFAxThreadData * ffaxtd = (FFAxThreadData*)kv;
-        ffaxtd->f->nomoremalloc();
-        ffaxtd->f->deregisterAllocator();
+        ffa_wrapper * f = ffaxtd->f.load();
+        if (!f) return;
+        f->nomoremalloc();
+        f->deregisterAllocator();
     }
     static inline void killMyself(ffa_wrapper * ptr) {
         FFAllocator::instance()->deleteAllocator(ptr);
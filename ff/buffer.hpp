@@ -61,6 +61,7 @@
 
 #include <ff/sysdep.h>
 #include <ff/config.hpp>
+#include <ff/mapping_utils.hpp>
 
 #if defined(__APPLE__)
 #include <AvailabilityMacros.h>
@@ -161,24 +162,55 @@ public:
      *  It initialise the buffer. Allocate space (\p size) of possibly aligned
      *  memory and reset the pointers (read pointer and write pointer) by
      *  placing them at the beginning of the buffer.
+     *  If \p node is not negative, the memory is placed on that NUMA node
+     *  before being touched.
      *
      *  \return TODO
      */
-    bool init(const bool startatlineend=false) {
+    bool init(const bool startatlineend=false, const int node=-1) {
         if (buf || (size==0)) return false;
 
 #if defined(SWSR_MULTIPUSH)
         if (size<MULTIPUSH_BUFFER_SIZE) return false;
 #endif
         // getAlignedMemory is a function defined in 'sysdep.h'
+#if defined(FF_NUMA_PLACEMENT) && defined(_SC_PAGESIZE)
+        // whole pages, only those can be placed (see ff_numaPlace)
+        buf=(void**)getAlignedMemory(sysconf(_SC_PAGESIZE),placedBytes());
+#else
         buf=(void**)getAlignedMemory(longxCacheLine*sizeof(long),size*sizeof(void*));
+#endif
         if (!buf) return false;
+        if (node>=0) numa_place(node);
 
         reset(startatlineend);
 
         return true;
     }
 
+    /**
+     *  It places the memory of the buffer on the NUMA node \p node
+     *  (see ff_numaPlace). The buffer can be in use.
+     *
+     *  \return 0 if successful, -1 otherwise.
+     */
+    inline int numa_place(const int node) {
+        if (!buf) return -1;
+        return ff_numaPlace(buf, placedBytes(), node);
+    }
+
+    // bytes of the memory of the buffer, a multiple of the page size with
+    // FF_NUMA_PLACEMENT
+    inline size_t placedBytes() const {
+        const size_t bytes = size*sizeof(void*);
+#if defined(FF_NUMA_PLACEMENT) && defined(_SC_PAGESIZE)
+        const size_t pgsz = (size_t)sysconf(_SC_PAGESIZE);
+        return (bytes + pgsz-1) & ~(pgsz-1);
+#else
+        return bytes;
+#endif
+    }
+
     /** 
      * It returns true if the buffer is empty.
      */
@@ -323,7 +355,44 @@ public:
         return (mcnt ? multipush(multipush_buf,mcnt) : true);
     }
 #endif /* SWSR_MULTIPUSH */
-    
+
+    /**
+     * Pushes up to \p len elements of the array \p data in the queue.
+     * The write pointer is read and updated only once for the whole batch
+     * and a single Write Memory Barrier is issued.
+     *
+     * \return the number of elements pushed (0 if the queue is full)
+     */
+    inline size_t push_batch(void * const data[], size_t len) {
+        unsigned long w = pwrite;
+        size_t i=0;
+        WMB();
+        for(;(i<len) && (buf[w]==NULL); ++i) {
+            assert(data[i] != NULL);
+            buf[w] = data[i];
+            w = w + ((w+1 >= size) ? (1-size): 1);
+        }
+        pwrite = w;
+        return i;
+    }
+
+    /**
+     * Pops up to \p max elements from the queue storing them in \p data.
+     * The read pointer is read and updated only once for the whole batch.
+     *
+     * \return the number of elements popped (0 if the queue is empty)
+     */
+    inline size_t pop_batch(void ** data, size_t max) {
+        unsigned long r = pread;
+        size_t i=0;
+        for(;(i<max) && (buf[r]!=NULL); ++i) {
+            data[i] = buf[r];
+            buf[r]  = NULL;
+            r = r + ((r+1 >= size) ? (1-size): 1);
+        }
+        pread = r;
+        return i;
+    }
 
     /**
      * It is like pop but doesn't copy any data.
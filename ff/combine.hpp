@@ -596,6 +596,11 @@ protected:
         ff_node *n = getLast();
         if (n) n->blocking_mode(blocking_in);
     }
+    void spinpark_mode(bool sp=true) {
+        ff_minode::spinpark_mode(sp);
+        for(size_t i=0;i<comp_nodes.size();++i)
+            comp_nodes[i]->spinpark_mode(sp);
+    }
 
     void set_scheduling_ondemand(const int inbufferentries=1) {
         if (!isMultiOutput()) return;
@@ -735,6 +740,7 @@ protected:
     // uses as output channel(s) the one(s) of the second node.
     // these functions should not be called if the node is multi-output
     inline bool  get(void **ptr)                 { return comp_nodes[1]->get(ptr);}
+    inline size_t get_batch(void **ptr, size_t max) { return comp_nodes[1]->get_batch(ptr, max);}
     inline pthread_cond_t    &get_cons_c()  {
         ff_node *n = getFirst();
         if (n->isMultiInput()) return ff_minode::get_cons_c();
@@ -79,6 +79,9 @@
 /*
  * NOTE: if FF_MAPPING_STRING is "" (default), FastFlow executes a linear
  *       mapping of threads. 
+ *       If FF_MAPPING_STRING is "topology", the list produced by the
+ *       'mapping_string.sh' script is computed at start-up from sysfs
+ *       (see topology.hpp), Linux only.
  */
 #if !defined MAPPING_STRING
 #define FF_MAPPING_STRING ""
@@ -98,7 +101,7 @@
 /* 
  * It is the number of the physical cores of the machine.
  * NOTE: if FF_NUM_REAL_CORES is -1 (default), FastFlow will use 
- *       ff_realNumCores() (which is a costly function)
+ *       ff_realNumCores() (on Linux the topology is read once from sysfs)
  */
 #if !defined NUM_REAL_CORES
 #define FF_NUM_REAL_CORES -1
@@ -106,6 +109,18 @@
 #define FF_NUM_REAL_CORES NUM_REAL_CORES
 #endif
 
+/*
+ * If FF_NUMA_PLACEMENT is defined (default on Linux), the memory of the
+ * input channels of a node is placed on the NUMA node of the core the
+ * consumer thread has been pinned to (see the default mapping above).
+ * Nothing is done if the machine has a single NUMA node or if the
+ * thread is not pinned.
+ * To disable it, compile with -DNO_NUMA_PLACEMENT.
+ */
+#if defined(__linux__) && !defined(NO_NUMA_PLACEMENT) && !defined(NO_DEFAULT_MAPPING)
+#define FF_NUMA_PLACEMENT 1
+#endif
+
 
 #if defined(FF_BOUNDED_BUFFER)
 #define FF_FIXED_SIZE true
@@ -149,10 +164,21 @@
 /*
  ****** DISTRIBUTED SUPPORT PARAMETERS
  */
-#define MAX_RETRIES 1500
-#define AGGRESSIVE_TRESHOLD 1000
-
-#define MAXBACKLOG 32
+// the connections refused are retried with exponential backoff (milliseconds)
+#define CONNECT_BACKOFF_MIN 1
+#define CONNECT_BACKOFF_MAX 256
+#define CONNECT_TIMEOUT 100000
+
+// all the groups connect at the same time at startup
+#define MAXBACKLOG 512
+// messages without a specific destination: a remote group is preferred to one
+// on the same host only if its load (fraction of the credits in use) is lower
+// by more than this
+#define REMOTE_SPILL_THRESHOLD 0.5
+#define MAXPOLLEVENTS 64
+#define RECEIVER_BUFFER_SIZE 65536
+// pieces of a gathered payload, the objects having more are copied
+#define MAXDATASPANS 64
 
 /*
  ****** END DISTRIBUTED VERSION PARAMETERS
@@ -177,6 +203,28 @@
  */
 #define FF_TIMEDWAIT_NS   200000
 
+/* Used in blocking mode by the nodes using the spin-then-park waiting
+ * strategy (see parking.hpp and ff_node::spinpark_mode).
+ * FF_SPINPARK_MIN and FF_SPINPARK_MAX bound the adaptive number of polling
+ * attempts before parking, FF_SPINPARK_TIMEOUT_NS bounds the time spent
+ * parked before checking again the input queues.
+ * If BLOCKING_SPINPARK is defined, all nodes use the spin-then-park strategy.
+ */
+#if defined(BLOCKING_SPINPARK)
+#define FF_SPINPARK_MODE true
+#else
+#define FF_SPINPARK_MODE false
+#endif
+#if !defined(FF_SPINPARK_MIN)
+#define FF_SPINPARK_MIN   64
+#endif
+#if !defined(FF_SPINPARK_MAX)
+#define FF_SPINPARK_MAX   16384
+#endif
+#if !defined(FF_SPINPARK_TIMEOUT_NS)
+#define FF_SPINPARK_TIMEOUT_NS  10000000
+#endif
+
 /*
  * Used in the ordered farm pattern (ff_OFarm). 
  * It is the maximum amount of data elements buffered in the farm's collector
@@ -31,6 +31,14 @@
 #define DFF_MPI
 #endif
 
+#if defined(__linux__) && !defined(DFF_EXCLUDE_SHM)
+#define DFF_SHM
+#endif
+
+#if defined(__linux__) && !defined(DFF_EXCLUDE_URING) && __has_include(<linux/io_uring.h>)
+#define DFF_URING
+#endif
+
 #if !defined(DFF_EXCLUDE_BLOCKING)
 #define BLOCKING_MODE
 #else
@@ -51,6 +59,11 @@
 #define DEFAULT_MESSAGE_OTF     100
 #endif
 
+// payload bytes from which a batch is compressed (if the compression is enabled)
+#if !defined(DEFAULT_COMPRESSION_THRESHOLD)
+#define DEFAULT_COMPRESSION_THRESHOLD 4096
+#endif
+
 
 #include <ff/ff.hpp>
 #include <ff/distributed/ff_network.hpp>
@@ -1,50 +1,164 @@
 #ifndef FF_BATCHBUFFER_H
 #define FF_BATCHBUFFER_H
 #include "ff_network.hpp"
+#include "ff_dstats.hpp"
+#include "ff_lz.hpp"
 #include <sys/uio.h>
+#include <chrono>
+#include <vector>
+#include <cstdint>
 using namespace ff;
 
-class ff_batchBuffer {	
+/*
+ * When a batch is sent. Besides the number of messages (batchSize), a batch
+ * is flushed when its payload reaches 'bytes' or when its first message has
+ * been waiting for 'lingerUs' microseconds (the sender checks it periodically).
+ * In adaptive mode the number of messages follows the arrival rate, so that a
+ * batch fills in about the linger time: the low-rate channels send small
+ * batches, the loaded ones grow up to batchSize.
+ * The batches whose payload reaches compressAbove bytes are sent compressed
+ * (see ff_lz.hpp) if they shrink, this trades some CPU time of the sender and
+ * of the receiver for the bandwidth.
+ */
+struct ff_batchPolicy {
+    size_t bytes    = 0;     // 0 means no limit
+    long   lingerUs = 0;     // 0 means no limit
+    bool   adaptive = false;
+    size_t compressAbove = 0; // 0 means no compression
+
+    // linger time used by the adaptive mode if not given
+    static constexpr long defaultLingerUs = 1000;
+};
+
+class ff_batchBuffer {
+    using clock = std::chrono::steady_clock;
+
     std::function<bool(struct iovec*, int)> callback;
     int batchSize;
     struct iovec iov[UIO_MAXIOV];
-    std::vector<std::pair<size_t*, message_t*>> toCleanup;
+    int niov = 1;               // the header of each message and its data pieces
+    size_t    lengths[UIO_MAXIOV/4];
+    message_t* messages[UIO_MAXIOV/4];
+    ff_batchPolicy policy;
+    size_t bytes = 0;
+    int    target = 1;          // current batch size (adaptive mode)
+    long   lingerNs = 0;
+    clock::time_point first, last;
+    double interArrivalNs = 0;  // moving average (adaptive mode)
+    bool   handed = false;      // the messages of the batch are owned by the callback
+    std::vector<char> packed;   // the batch compressed (header included)
+    struct iovec      packedIov;
+
+    bool timed() const { return lingerNs > 0; }
+
+    /*
+     * Compresses the messages of the batch (all but the number of messages),
+     * false if they do not shrink.
+     */
+    bool pack(int count){
+        constexpr size_t hdr = sizeof(int) + 2*sizeof(uint32_t);
+        size_t raw = 0;
+        for(int i = 1; i < niov; i++) raw += iov[i].iov_len;
+        if (raw > UINT32_MAX) return false;
+        thread_local std::vector<char> flat;
+        flat.resize(raw);
+        size_t off = 0;
+        for(int i = 1; i < niov; off += iov[i++].iov_len)
+            memcpy(flat.data() + off, iov[i].iov_base, iov[i].iov_len);
+        packed.resize(hdr + lz::bound(raw));
+        const size_t n = lz::compress(flat.data(), raw, packed.data() + hdr);
+        if (n >= raw) return false;
+        const int      flagged = htonl(count | DFF_BATCH_COMPRESSED);
+        const uint32_t sizes[2] = { htonl((uint32_t)raw), htonl((uint32_t)n) };
+        memcpy(packed.data(), &flagged, sizeof(int));
+        memcpy(packed.data() + sizeof(int), sizes, sizeof(sizes));
+        packedIov.iov_base = packed.data();
+        packedIov.iov_len  = hdr + n;
+        return true;
+    }
+
+    void adapt(clock::time_point now) {
+        const double dt = std::chrono::duration<double, std::nano>(now - last).count();
+        last = now;
+        interArrivalNs = interArrivalNs ? 0.875*interArrivalNs + 0.125*dt : dt;
+        if (interArrivalNs <= 0) { target = batchSize; return; }
+        const double n = lingerNs / interArrivalNs;
+        target = (n >= batchSize) ? batchSize : (n < 1 ? 1 : (int)n);
+    }
+
 public:
     int size = 0;
     ChannelType ct;
+    std::shared_ptr<ff_dchannelStats> stats;
     ff_batchBuffer() {}
-    ff_batchBuffer(int _size, ChannelType ct, std::function<bool(struct iovec*, int)> cbk) : callback(cbk), batchSize(_size), ct(ct) {
+    ff_batchBuffer(int _size, ChannelType ct, std::function<bool(struct iovec*, int)> cbk, ff_batchPolicy policy = {})
+        : callback(cbk), batchSize(_size), policy(policy), target(_size), ct(ct) {
 		if (_size*4+1 > UIO_MAXIOV){
             error("Size too big!\n");
             abort();
         }
         iov[0].iov_base = &(this->size);
         iov[0].iov_len = sizeof(int);
+        if (policy.lingerUs > 0) lingerNs = policy.lingerUs*1000;
+        else if (policy.adaptive) lingerNs = ff_batchPolicy::defaultLingerUs*1000;
+        last = clock::now();
     }
 
     int push(message_t* m){
+        // a payload gathered from several pieces may not fit in the batch
+        const std::vector<struct iovec>* pieces = m->data.getPieces();
+        if (pieces && niov + 3 + (int)pieces->size() > UIO_MAXIOV && this->flush() < 0)
+            return -1;
+
         m->sender = htonl(m->sender);
         m->chid = htonl(m->chid);
-        size_t* sz = new size_t(htobe64(m->data.getLen()));
-
-
-        int indexBase = size * 4;
-        iov[indexBase+1].iov_base = &m->sender;
-        iov[indexBase+1].iov_len = sizeof(int);
-        iov[indexBase+2].iov_base = &m->chid;
-        iov[indexBase+2].iov_len = sizeof(int);
-        iov[indexBase+3].iov_base = sz;
-        iov[indexBase+3].iov_len = sizeof(size_t);
-        iov[indexBase+4].iov_base = m->data.getPtr();
-        iov[indexBase+4].iov_len = m->data.getLen();
-    
-        toCleanup.push_back(std::make_pair(sz, m));
-
-        if (++size == batchSize)
+        lengths[size] = htobe64(m->data.getLen());
+
+        iov[niov].iov_base = &m->sender;
+        iov[niov++].iov_len = sizeof(int);
+        iov[niov].iov_base = &m->chid;
+        iov[niov++].iov_len = sizeof(int);
+        iov[niov].iov_base = &lengths[size];
+        iov[niov++].iov_len = sizeof(size_t);
+        if (pieces)
+            for(const struct iovec& v : *pieces) iov[niov++] = v;
+        else {
+            iov[niov].iov_base = m->data.getPtr();
+            iov[niov++].iov_len = m->data.getLen();
+        }
+
+        messages[size] = m;
+        bytes += m->data.getLen();
+
+        if (timed()) {
+            const clock::time_point now = clock::now();
+            if (size == 0) first = now;
+            if (policy.adaptive) adapt(now);
+        }
+
+        if (++size >= target || (policy.bytes && bytes >= policy.bytes) || niov + 4 > UIO_MAXIOV)
             return this->flush();
 		return 0;
     }
 
+    // replaces the function sending the batches
+    void setCallback(std::function<bool(struct iovec*, int)> cbk) { callback = std::move(cbk); }
+
+    /*
+     * Called by the callback to take the messages of the batch being sent, an
+     * asynchronous sender keeps them until the data referred by the iovec
+     * have been written (otherwise they are deleted when the callback returns).
+     */
+    void handOver(std::vector<message_t*>& out) {
+        out.assign(messages, messages + ntohl(size));
+        handed = true;
+    }
+
+    // true if the oldest message has been waiting for more than the linger time
+    bool expired(clock::time_point now) const {
+        return size > 0 && timed() && (now - first) >= std::chrono::nanoseconds(lingerNs);
+    }
+
     int sendEOS(){
         if (push(new message_t(0,0))<0) {
 			error("pushing EOS");
@@ -53,24 +167,29 @@ public:
     }
 
     int flush(){
-		
+
         if (size == 0) return 0;
 
         int size_ = size;
         size = htonl(size);
-        
-        if (!callback(iov, size_*4+1)) {
+
+        handed = false;
+        const bool compressed = policy.compressAbove && bytes >= policy.compressAbove && pack(size_);
+        if (!(compressed ? callback(&packedIov, 1) : callback(iov, niov))) {
             error("Callback of the batchbuffer got something wrong!\n");
+            size = size_;
 			return -1;
 		}
 
-		while (!toCleanup.empty()){
-            delete toCleanup.back().first;
-            delete toCleanup.back().second;
-            toCleanup.pop_back();
-        }
+        if (stats) stats->batch(size_, bytes, target);
+
+        if (!handed)
+            for(int i = 0; i < size_; i++)
+                delete messages[i];
 
-        size = 0;
+        size  = 0;
+        niov  = 1;
+        bytes = 0;
 		return 0;
     }
 
@@ -36,6 +36,14 @@
 
 #include <numeric>
 
+#ifdef DFF_SHM
+#include <ff/distributed/ff_dreceiverSHM.hpp>
+#include <ff/distributed/ff_dsenderSHM.hpp>
+#endif
+#ifdef DFF_URING
+#include <ff/distributed/ff_dreceiverURING.hpp>
+#include <ff/distributed/ff_dsenderURING.hpp>
+#endif
 #ifdef DFF_MPI
 #include <ff/distributed/ff_dreceiverMPI.hpp>
 #include <ff/distributed/ff_dsenderMPI.hpp>
@@ -84,6 +92,23 @@ class dGroup : public ff::ff_farm {
         return new WrapperIN(n);
     }
 
+    template<typename Sender>
+    static Sender* withBatchPolicy(Sender* s, const ff_IR& ir){
+        ff_batchPolicy p;
+        p.bytes    = ir.outBatchBytes;
+        p.lingerUs = ir.outBatchLinger;
+        p.adaptive = ir.outBatchAdaptive;
+        p.compressAbove = ir.outCompressAbove;
+        s->setBatchPolicy(p);
+        return s;
+    }
+
+    template<typename Receiver>
+    static Receiver* withReceiverThreads(Receiver* r, const ff_IR& ir){
+        r->setReceiverThreads(ir.receiverThreads);
+        return r;
+    }
+
     static ff_node* buildWrapperOUT(ff_node* n, int id, int outputChannels, int feedbackChannels = 0){
         if (n->isMultiInput()) return new ff_comb(n, new WrapperOUT(new ForwarderNode(n->serializeF, n->freetaskF), id, outputChannels, feedbackChannels, true), false, true);
         return new WrapperOUT(n, id, outputChannels, feedbackChannels);
@@ -157,8 +182,15 @@ public:
 
             if (ir.hasReceiver){
                 if (ir.protocol == Proto::TCP)
-                    this->add_emitter(new ff_dreceiver(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.hasLeftChildren() ? ir.inputL : ir.inputR)));
-                
+                    this->add_emitter(withReceiverThreads(new ff_dreceiver(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.hasLeftChildren() ? ir.inputL : ir.inputR)), ir));
+#ifdef DFF_SHM
+                else if (ir.protocol == Proto::SHM)
+                    this->add_emitter(new ff_dreceiverSHM(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.hasLeftChildren() ? ir.inputL : ir.inputR)));
+#endif
+#ifdef DFF_URING
+                else if (ir.protocol == Proto::URING)
+                    this->add_emitter(new ff_dreceiverURING(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.hasLeftChildren() ? ir.inputL : ir.inputR)));
+#endif
 #ifdef DFF_MPI
                 else
                    this->add_emitter(new ff_dreceiverMPI(ir.expectedEOS, vector2Map(ir.hasLeftChildren() ? ir.inputL : ir.inputR)));
@@ -167,8 +199,15 @@ public:
 
             if (ir.hasSender){
                 if(ir.protocol == Proto::TCP)
-                    this->add_collector(new ff_dsender(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF), true);
-               
+                    this->add_collector(withBatchPolicy(new ff_dsender(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF), ir), true);
+#ifdef DFF_SHM
+                else if (ir.protocol == Proto::SHM)
+                    this->add_collector(withBatchPolicy(new ff_dsenderSHM(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF), ir), true);
+#endif
+#ifdef DFF_URING
+                else if (ir.protocol == Proto::URING)
+                    this->add_collector(withBatchPolicy(new ff_dsenderURING(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF), ir), true);
+#endif
 #ifdef DFF_MPI
                 else
                    this->add_collector(new ff_dsenderMPI(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF), true);
@@ -279,7 +318,15 @@ public:
             
             if (ir.hasReceiver){
                 if (ir.protocol == Proto::TCP)
-                    this->add_emitter(new ff_dreceiverH(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.inputL)));
+                    this->add_emitter(withReceiverThreads(new ff_dreceiverH(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.inputL)), ir));
+#ifdef DFF_SHM
+                else if (ir.protocol == Proto::SHM)
+                    this->add_emitter(new ff_dreceiverHSHM(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.inputL)));
+#endif
+#ifdef DFF_URING
+                else if (ir.protocol == Proto::URING)
+                    this->add_emitter(new ff_dreceiverHURING(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.inputL)));
+#endif
 #ifdef DFF_MPI
                 else
                    this->add_emitter(new ff_dreceiverHMPI(ir.expectedEOS, vector2Map(ir.inputL)));
@@ -288,7 +335,15 @@ public:
             
             if (ir.hasSender){
                 if(ir.protocol == Proto::TCP)
-                    this->add_collector(new ff_dsenderH(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF, ir.internalMessageOTF) , true);
+                    this->add_collector(withBatchPolicy(new ff_dsenderH(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF, ir.internalMessageOTF), ir) , true);
+#ifdef DFF_SHM
+                else if (ir.protocol == Proto::SHM)
+                    this->add_collector(withBatchPolicy(new ff_dsenderHSHM(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF, ir.internalMessageOTF), ir), true);
+#endif
+#ifdef DFF_URING
+                else if (ir.protocol == Proto::URING)
+                    this->add_collector(withBatchPolicy(new ff_dsenderHURING(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF, ir.internalMessageOTF), ir), true);
+#endif
 #ifdef DFF_MPI
                 else
                    this->add_collector(new ff_dsenderHMPI(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF, ir.internalMessageOTF), true);
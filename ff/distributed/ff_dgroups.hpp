@@ -41,6 +41,7 @@
 #include <ff/distributed/ff_dutils.hpp>
 #include <ff/distributed/ff_dintermediate.hpp>
 #include <ff/distributed/ff_dgroup.hpp>
+#include <ff/distributed/ff_dstats.hpp>
 
 #include <cereal/cereal.hpp>
 #include <cereal/archives/json.hpp>
@@ -91,12 +92,34 @@ public:
                         this->usedProtocol = Proto::TCP;
                     #endif 
 
+                } else if (tmpProtocol == "SHM"){
+                    #ifdef DFF_SHM
+                        this->usedProtocol = Proto::SHM;
+                    #else
+                        std::cout << "NO SHM support! Falling back to TCP\n";
+                        this->usedProtocol = Proto::TCP;
+                    #endif
+                } else if (tmpProtocol == "URING"){
+                    #ifdef DFF_URING
+                        this->usedProtocol = Proto::URING;
+                    #else
+                        std::cout << "NO URING support! Falling back to TCP\n";
+                        this->usedProtocol = Proto::TCP;
+                    #endif
                 } else this->usedProtocol = Proto::TCP;
             } catch (cereal::Exception&) {
                 ari.setNextName(nullptr);
                 this->usedProtocol = Proto::TCP;
             }
 
+            // where the counters of the connections are dumped (see ff_dstats.hpp)
+            try {
+                ari(cereal::make_nvp("statsPath", this->statsPath));
+            } catch (cereal::Exception&) {ari.setNextName(nullptr);}
+            try {
+                ari(cereal::make_nvp("statsInterval", this->statsInterval));
+            } catch (cereal::Exception&) {ari.setNextName(nullptr);}
+
         } catch (const cereal::Exception& e){
             std::cerr << "Error parsing the JSON config file. Check syntax and structure of the file and retry!" << std::endl;
             exit(EXIT_FAILURE);
@@ -157,6 +180,15 @@ public:
 
       // buildare il farm dalla rappresentazione intermedia del gruppo che devo rannare
       dGroup _grp(this->annotatedGroups[this->runningGroup]);
+
+      if (!statsPath.empty()){
+        std::string path = statsPath;
+        for(size_t p; (p = path.find("%g")) != std::string::npos; )
+          path.replace(p, 2, runningGroup);
+        if (!ff_dstats::instance().start(path, statsInterval))
+          ff::error("Unable to dump the stats of the group in %s\n", path.c_str());
+      }
+
       // rannere il farm come sotto!
     if (_grp.run() < 0){
       std::cerr << "Error running the group!" << std::endl;
@@ -167,6 +199,7 @@ public:
         std::cerr << "Error waiting the group!" << std::endl;
         return -1;
       }
+      ff_dstats::instance().stop();
 
       #ifdef DFF_MPI
         if (usedProtocol == Proto::MPI)
@@ -185,16 +218,24 @@ private:
     std::map<std::string, ff_IR> annotatedGroups;
     
     std::string runningGroup;
+    std::string statsPath;
+    long statsInterval = DEFAULT_STATS_INTERVAL;
 
     // helper class to parse config file Json
     struct G {
         std::string name;
         std::string address;
         std::string threadMapping;
-        int port;
+        int port = 0;
         int batchSize          = DEFAULT_BATCH_SIZE;
         int internalMessageOTF = DEFAULT_INTERNALMSG_OTF;
         int messageOTF         = DEFAULT_MESSAGE_OTF;
+        size_t batchBytes      = 0;
+        long batchLinger       = 0;
+        bool adaptiveBatch     = false;
+        size_t receiverThreads = 1;
+        bool compression       = false;
+        size_t compressionThreshold = DEFAULT_COMPRESSION_THRESHOLD;
 
         template <class Archive>
         void load( Archive & ar ){
@@ -218,6 +259,30 @@ private:
                 ar(cereal::make_nvp("messageOTF", messageOTF));
             } catch (cereal::Exception&) {ar.setNextName(nullptr);}
 
+            try {
+                ar(cereal::make_nvp("batchBytes", batchBytes));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
+            try {
+                ar(cereal::make_nvp("batchLinger", batchLinger));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
+            try {
+                ar(cereal::make_nvp("adaptiveBatch", adaptiveBatch));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
+            try {
+                ar(cereal::make_nvp("receiverThreads", receiverThreads));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
+            try {
+                ar(cereal::make_nvp("compression", compression));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
+            try {
+                ar(cereal::make_nvp("compressionThreshold", compressionThreshold));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
             try {
                 ar(cereal::make_nvp("threadMapping", threadMapping));
             } catch (cereal::Exception&) {ar.setNextName(nullptr);}
@@ -251,7 +316,7 @@ private:
 
         // throw an error if a group in the configuration has not been annotated in the current program
         if (!annotatedGroups.contains(g.name)) throw FF_Exception("present in the configuration file has not been implemented! :(");
-        auto endpoint = this->usedProtocol == Proto::TCP ? ff_endpoint(g.address, g.port) : ff_endpoint(i);
+        auto endpoint = this->usedProtocol != Proto::MPI ? ff_endpoint(g.address, g.port) : ff_endpoint(i);
         endpoint.groupName = g.name;
 
         // annotate the listen endpoint for the specified group
@@ -260,6 +325,11 @@ private:
         if (g.batchSize > 1) annotatedGroups[g.name].outBatchSize = g.batchSize;
         if (g.messageOTF) annotatedGroups[g.name].messageOTF = g.messageOTF;
         if (g.internalMessageOTF) annotatedGroups[g.name].internalMessageOTF = g.internalMessageOTF;
+        annotatedGroups[g.name].outBatchBytes    = g.batchBytes;
+        annotatedGroups[g.name].outBatchLinger   = g.batchLinger;
+        annotatedGroups[g.name].outBatchAdaptive = g.adaptiveBatch;
+        annotatedGroups[g.name].receiverThreads  = g.receiverThreads;
+        annotatedGroups[g.name].outCompressAbove = g.compression ? std::max<size_t>(g.compressionThreshold, 1) : 0;
       }
 
       // TODO check first level pipeline before strting building the groups.
@@ -570,15 +640,18 @@ static inline int DFF_Init(int& argc, char**& argv){
     
     dGroups::Instance()->parseConfig(configFile);
 
-    if (!groupName.empty())
-      dGroups::Instance()->forceProtocol(Proto::TCP);
+    if (!groupName.empty()) {
+      // launched by dff_run, MPI is replaced by TCP while SHM is kept
+      if (dGroups::Instance()->usedProtocol == Proto::MPI)
+        dGroups::Instance()->forceProtocol(Proto::TCP);
+    }
   #ifdef DFF_MPI
     else
         dGroups::Instance()->forceProtocol(Proto::MPI);
   #endif
 
 
-    if (dGroups::Instance()->usedProtocol == Proto::TCP){
+    if (dGroups::Instance()->usedProtocol != Proto::MPI){
        if (groupName.empty()){
         ff::error("Group not passed as argument!\nUse option --DFF_GName=\"group-name\"\n");
         return -1;
@@ -94,6 +94,11 @@ public:
     std::set<std::string> otherGroupsFromSameParentBB;
     size_t expectedEOS = 0;
     int outBatchSize = 1;
+    size_t outBatchBytes = 0;
+    long outBatchLinger = 0;    // microseconds
+    bool outBatchAdaptive = false;
+    size_t outCompressAbove = 0;  // payload bytes, 0 means no compression
+    size_t receiverThreads = 1;
     int messageOTF, internalMessageOTF;
     // liste degli index dei nodi input/output nel builiding block in the shared memory context. The first list: inputL will become the rouitng table
     std::vector<int> inputL, outputL, inputR, outputR;
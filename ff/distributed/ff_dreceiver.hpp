@@ -28,9 +28,14 @@
 
 #include <iostream>
 #include <sstream>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <ff/ff.hpp>
 #include <ff/distributed/ff_network.hpp>
 #include <ff/distributed/ff_dgroups.hpp>
+#include <ff/distributed/ff_dstats.hpp>
+#include <ff/distributed/ff_lz.hpp>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/types.h>
@@ -43,6 +48,33 @@
 
 using namespace ff;
 
+/*
+ * Reference counted receive buffer. The connection holds a reference to the
+ * slab it is receiving into, each message sliced out of the slab holds another
+ * one, the slab goes back to the pool when the last of them is released.
+ */
+struct ff_rxSlab {
+    static constexpr size_t header   = 64;
+    static constexpr size_t capacity = RECEIVER_BUFFER_SIZE - header;
+    // larger payloads are received in their own buffer
+    static constexpr size_t maxSlice = capacity / 4;
+    using pool_t = ff_blockPool<RECEIVER_BUFFER_SIZE, 4>;
+
+    std::atomic<long> refs{1};
+
+    static ff_rxSlab* create() { return new (pool_t::alloc()) ff_rxSlab; }
+    char* data() { return reinterpret_cast<char*>(this) + header; }
+    void acquire() { refs.fetch_add(1, std::memory_order_relaxed); }
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            this->~ff_rxSlab();
+            pool_t::release(this);
+        }
+    }
+    bool exclusive() const { return refs.load(std::memory_order_acquire) == 1; }
+};
+static_assert(sizeof(ff_rxSlab) <= ff_rxSlab::header);
+
 class ff_dreceiver: public ff_monode_t<message_t> { 
 protected:
     std::map<int, ChannelType> sck2ChannelType;
@@ -67,123 +99,550 @@ protected:
         return 0;
     }*/
 
-    virtual int handshakeHandler(const int sck){
-        // ricevo l'handshake e mi salvo che tipo di connessione è
-        size_t size;
+    // receive state of a connection: the data are consumed as soon as they are
+    // available, a partially received batch does not block the other connections
+    struct connState {
+        enum { HANDSHAKE, NAME, BATCH, HEADER, PAYLOAD, ZHEADER, ZBATCH } phase = HANDSHAKE;
+        char        hdr[2*sizeof(int)+sizeof(size_t)];
+        size_t      got = 0;         // bytes of the current item already received
+        size_t      size = 0;        // size of the group name or of the payload
+        int         pending = 0;     // messages of the current batch still to be received
+        unsigned    owed = 0;        // batches received whose credit has not been given back
+        int         id;              // connection identifier for the routing and the EOS
+        int         sender, chid;
         ChannelType t;
-        struct iovec iov[2]; 
-        iov[0].iov_base = &t; iov[0].iov_len = sizeof(ChannelType);
-        iov[1].iov_base = &size; iov[1].iov_len = sizeof(size);
-        switch (readvn(sck, iov, 2)) {
-           case -1: error("Error reading from socket\n"); // fatal error
-           case  0: return -1; // connection close
+        bool        compressed = false;  // the sender may compress the batches
+        size_t      rawSize = 0;     // size of the compressed batch once decompressed
+        char*       buff = nullptr;  // large payload (or compressed batch) being received
+        std::string groupName;
+        ff_rxSlab*  slab = nullptr;  // data received and not yet consumed
+        size_t      inStart = 0, inEnd = 0;
+        // next read, for the receivers completing the reads asynchronously
+        char*       wantDst = nullptr;
+        size_t      wantLen = 0;
+        bool        wantSlab = false;
+        std::shared_ptr<ff_dchannelStats> stats;
+    };
+    static_assert(sizeof(ChannelType)+sizeof(size_t) <= sizeof(connState::hdr));
+
+    // what a connection produces for the routing of the node
+    struct rxEvent {
+        enum { CHANNEL, MESSAGE, LOGICAL_EOS, EOS } kind;
+        int        id;       // connection identifier
+        int        value;    // channel type or sender
+        message_t* m;
+    };
+
+    /*
+     * The connections served by one thread. The node serves its own
+     * connections handling the events immediately, the shards collect them in
+     * the outbox (see rxShard).
+     */
+    struct rxLoop {
+        std::map<int, connState> connections;
+        std::vector<int> creditsPending;  // connections with credits to give back
+        ff_poller poller;
+        std::vector<rxEvent>* outbox = nullptr;
+    };
+
+    /*
+     * With more than one receiver thread the connections are distributed among
+     * the shards when accepted: each shard receives and parses the data of its
+     * connections, the node only routes the messages and counts the EOS, so
+     * that the ordering of each connection is preserved. The events are passed
+     * to the node in bunches, once per wakeup of the shard.
+     */
+    struct rxShard {
+        rxLoop      loop;
+        ff_notifier wakeup;                       // new connections or stop
+        std::thread thread;
+        std::mutex  mtx;
+        std::vector<std::pair<int,int>> inbox;    // accepted connections (fd, id)
+        std::vector<rxEvent> ready;               // events not yet taken by the node
+        std::vector<rxEvent> produced;
+        bool stop = false;
+    };
+    rxLoop loop;
+    std::vector<std::unique_ptr<rxShard>> shards;
+    ff_notifier wakeup;                           // events ready in the shards
+    size_t receiverThreads = 1;
+    size_t nextShard = 0;
+    int    lastId = 0;
+
+    /*
+     * Copies in dst the missing part of an item of n bytes. It returns 1 if the
+     * item is complete, 0 if there are no more data available on the socket,
+     * -1 if the connection has been closed.
+     */
+    int fetch(int sck, connState& c, char* dst, size_t n){
+        while(c.got < n){
+            if (c.inStart < c.inEnd){
+                size_t k = std::min(n - c.got, c.inEnd - c.inStart);
+                memcpy(dst + c.got, c.slab->data() + c.inStart, k);
+                c.got += k; c.inStart += k;
+                continue;
+            }
+            // large items are received in place, the small ones in the slab
+            ssize_t r;
+            if ((n - c.got) >= ff_rxSlab::capacity) {
+                if ((r = receive(sck, c, dst + c.got, n - c.got, false)) > 0) { c.got += r; continue; }
+            } else {
+                if (c.inEnd == ff_rxSlab::capacity || c.slab->exclusive()) makeRoom(c);
+                if ((r = receive(sck, c)) > 0) continue;
+            }
+            if (r == 0) return -1; // connection close
+            if (r == -2) return 0;
+            error("Error reading from socket errno=%d\n", errno);
+            return -1;
         }
+        c.got = 0;
+        return 1;
+    }
 
-        size = be64toh(size);
-
-        char groupName[size];
-        if (readn(sck, groupName, size) < 0){
-            error("Error reading from socket groupName\n"); return -1;
+    /*
+     * Makes the next n bytes of the connection available contiguously in the
+     * slab, at offset inStart. The same return values of fetch.
+     */
+    int fetchSlice(int sck, connState& c, size_t n){
+        if (c.inStart + n > ff_rxSlab::capacity) makeRoom(c);
+        while(c.inEnd - c.inStart < n){
+            ssize_t r = receive(sck, c);
+            if (r > 0) continue;
+            if (r == 0) return -1; // connection close
+            if (r == -2) return 0;
+            error("Error reading from socket errno=%d\n", errno);
+            return -1;
         }
-        
-        sck2ChannelType[sck] = t;
+        return 1;
+    }
 
-        return 0; //this->sendRoutingTable(sck, reachableDestinations);
+    // moves the data not yet consumed at the beginning of a slab owned only by
+    // the connection, a new one if some messages still refer to the current slab
+    void makeRoom(connState& c){
+        const size_t len = c.inEnd - c.inStart;
+        if (c.slab->exclusive()) {
+            if (len && c.inStart) memmove(c.slab->data(), c.slab->data() + c.inStart, len);
+        } else {
+            ff_rxSlab* s = ff_rxSlab::create();
+            if (len) memcpy(s->data(), c.slab->data() + c.inStart, len);
+            c.slab->release();
+            c.slab = s;
+        }
+        c.inStart = 0;
+        c.inEnd   = len;
     }
 
-    virtual void registerLogicalEOS(int sender){
-        for(size_t i = 0; i < this->get_num_outchannels(); i++)
-                ff_send_out_to(new message_t(sender, i), i);
+    /*
+     * Reads at most n bytes in dst (-2 if there are no data available), dst is
+     * the end of the slab if toSlab. An asynchronous receiver records the read
+     * in c.want* and returns -2, at its completion the data are accounted as
+     * the caller would have done (c.inEnd or c.got) and handleInput is called
+     * again.
+     */
+    virtual ssize_t receive(int sck, connState& c, char* dst, size_t n, bool toSlab){
+        for(;;){
+            ssize_t r = recv(sck, dst, n, 0);
+            if (r >= 0) return r;
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? -2 : -1;
+        }
     }
 
-    virtual void registerEOS(int sck){
-        neos++;
+    // a single recv of all the data fitting in the slab
+    ssize_t receive(int sck, connState& c){
+        ssize_t r = receive(sck, c, c.slab->data() + c.inEnd, ff_rxSlab::capacity - c.inEnd, true);
+        if (r > 0) c.inEnd += r;
+        return r;
     }
 
-    virtual void forward(message_t* task, int){
-        if (task->chid == -1) ff_send_out(task);
-        else ff_send_out_to(task, this->routingTable[task->chid]); // assume the routing table is consistent WARNING!!!
+    /*
+     * Consumes all the data available on the connection. It returns -1 when the
+     * connection has to be closed (physical EOS, connection closed or error).
+     */
+    virtual int handleInput(rxLoop& l, int sck, connState& c){
+        int r;
+        for(;;){
+            switch(c.phase){
+            case connState::HANDSHAKE: {
+                if ((r = fetch(sck, c, c.hdr, sizeof(ChannelType)+sizeof(size_t))) <= 0) return r;
+                int type;
+                memcpy(&type, c.hdr, sizeof(type));
+                c.compressed = type & DFF_HANDSHAKE_COMPRESSION;
+                c.t = (ChannelType)(type & ~DFF_HANDSHAKE_COMPRESSION);
+                memcpy(&c.size, c.hdr+sizeof(c.t), sizeof(size_t));
+                c.groupName.resize(be64toh(c.size));
+                deliver(l, {rxEvent::CHANNEL, c.id, (int)c.t, nullptr});
+                c.phase = connState::NAME;
+            } break;
+            case connState::NAME: {
+                if ((r = fetch(sck, c, c.groupName.data(), c.groupName.size())) <= 0) return r;
+                c.stats = ff_dstats::instance().channel(acceptAddr.groupName, c.groupName, c.t, false);
+                c.phase = connState::BATCH;
+            } break;
+            case connState::BATCH: {
+                if ((r = fetch(sck, c, c.hdr, sizeof(int))) <= 0) return r;
+                // the credit is given back by grantCredits
+                if (c.owed++ == 0) l.creditsPending.push_back(sck);
+                ff_dchannelStats::add(c.stats->batches, 1);
+                c.stats->setDepth(c.owed);
+                int requestSize;
+                memcpy(&requestSize, c.hdr, sizeof(int));
+                c.pending = ntohl(requestSize);
+                if (c.pending & DFF_BATCH_COMPRESSED) {
+                    if (!c.compressed) {
+                        error("Compressed batch not announced by the sender %s\n", c.groupName.c_str());
+                        return -1;
+                    }
+                    c.pending &= ~DFF_BATCH_COMPRESSED;
+                    c.phase = connState::ZHEADER;
+                } else if (c.pending > 0) c.phase = connState::HEADER;
+            } break;
+            case connState::ZHEADER: {
+                if ((r = fetch(sck, c, c.hdr, 2*sizeof(uint32_t))) <= 0) return r;
+                uint32_t sizes[2];
+                memcpy(sizes, c.hdr, sizeof(sizes));
+                c.rawSize = ntohl(sizes[0]);
+                c.size    = ntohl(sizes[1]);
+                c.buff    = new char [c.size];
+                c.phase   = connState::ZBATCH;
+            } break;
+            case connState::ZBATCH: {
+                if ((r = fetch(sck, c, c.buff, c.size)) <= 0) return r;
+                std::unique_ptr<char[]> z(c.buff);
+                c.buff  = nullptr;
+                c.phase = connState::BATCH;
+                if (unpack(l, c, z.get(), c.size) < 0) return -1;
+            } break;
+            case connState::HEADER: {
+                if ((r = fetch(sck, c, c.hdr, sizeof(c.hdr))) <= 0) return r;
+                memcpy(&c.sender, c.hdr, sizeof(int));
+                memcpy(&c.chid, c.hdr+sizeof(int), sizeof(int));
+                memcpy(&c.size, c.hdr+2*sizeof(int), sizeof(size_t));
+                // convert values to host byte order
+                c.sender = ntohl(c.sender);
+                c.chid   = ntohl(c.chid);
+                c.size   = be64toh(c.size);
+                if (c.size > 0){
+                    if (c.size > ff_rxSlab::maxSlice) {
+                        c.buff = new char [c.size];
+                        assert(c.buff);
+                    }
+                    c.phase = connState::PAYLOAD;
+                    break;
+                }
+                if (--c.pending == 0) c.phase = connState::BATCH;
+                //logical EOS
+                if (c.chid == -2){
+                    deliver(l, {rxEvent::LOGICAL_EOS, c.id, c.sender, nullptr});
+                    break;
+                }
+                //pyshical EOS
+                deliver(l, {rxEvent::EOS, c.id, 0, nullptr});
+                return -1;
+            }
+            case connState::PAYLOAD: {
+                message_t* out;
+                if (c.buff) {
+                    if ((r = fetch(sck, c, c.buff, c.size)) <= 0) return r;
+                    out = new message_t(c.buff, c.size, true);
+                } else {
+                    // the message refers to the data in the slab
+                    if ((r = fetchSlice(sck, c, c.size)) <= 0) return r;
+                    ff_rxSlab* s = c.slab;
+                    s->acquire();
+                    out = new message_t;
+                    out->data.lend(s->data() + c.inStart, c.size, [s](void*) { s->release(); });
+                    c.inStart += c.size;
+                }
+                assert(out);
+                out->feedback = c.t == ChannelType::FBK;
+                out->sender = c.sender;
+                out->chid   = c.chid;
+                c.buff = nullptr;
+                c.stats->message(c.size);
+                c.phase = (--c.pending == 0) ? connState::BATCH : connState::HEADER;
+                deliver(l, {rxEvent::MESSAGE, c.id, 0, out});
+            } break;
+            }
+        }
     }
 
-    virtual int handleBatch(int sck){
-        int requestSize;
-        switch(readn(sck, reinterpret_cast<char*>(&requestSize), sizeof(requestSize))) {
-		case -1: {			
-			perror("readn");
-			error("Something went wrong in receiving the number of tasks!\n");
-			return -1;
-		} break;
-		case 0: return -1;
+    /*
+     * Delivers the messages of a compressed batch, they refer to the data
+     * decompressed. It returns -1 at the physical EOS or if the data are
+     * corrupted.
+     */
+    int unpack(rxLoop& l, connState& c, const char* src, size_t n){
+        std::shared_ptr<char[]> data(new char[c.rawSize]);
+        if (!lz::decompress(src, n, data.get(), c.rawSize)){
+            error("Corrupted compressed batch from %s\n", c.groupName.c_str());
+            return -1;
         }
-		// always sending back the acknowledgement
-        if (writen(sck, reinterpret_cast<char*>(&ACK), sizeof(ack_t)) < 0){
-            if (errno != ECONNRESET && errno != EPIPE) {
-                error("Error sending back ACK to the sender (errno=%d)\n",errno);
+        size_t off = 0;
+        for(; c.pending > 0; --c.pending){
+            if (c.rawSize - off < sizeof(c.hdr)) break;
+            int sender, chid;
+            size_t size;
+            memcpy(&sender, data.get() + off, sizeof(int));
+            memcpy(&chid, data.get() + off + sizeof(int), sizeof(int));
+            memcpy(&size, data.get() + off + 2*sizeof(int), sizeof(size_t));
+            off   += sizeof(c.hdr);
+            sender = ntohl(sender);
+            chid   = ntohl(chid);
+            size   = be64toh(size);
+            if (size > c.rawSize - off) break;
+            if (size == 0){
+                //logical EOS
+                if (chid == -2){
+                    deliver(l, {rxEvent::LOGICAL_EOS, c.id, sender, nullptr});
+                    continue;
+                }
+                //pyshical EOS
+                c.pending = 0;
+                deliver(l, {rxEvent::EOS, c.id, 0, nullptr});
                 return -1;
             }
+            message_t* out = new message_t;
+            out->data.lend(data.get() + off, size, [data](void*) {});
+            out->feedback = c.t == ChannelType::FBK;
+            out->sender = sender;
+            out->chid   = chid;
+            off += size;
+            c.stats->message(size);
+            deliver(l, {rxEvent::MESSAGE, c.id, 0, out});
         }
-		ChannelType t = sck2ChannelType[sck];
-        requestSize = ntohl(requestSize);
-        for(int i = 0; i < requestSize; i++)
-            if (handleRequest(sck, t)<0) return -1;
-        
+        if (c.pending == 0 && off == c.rawSize) return 0;
+        error("Malformed compressed batch from %s\n", c.groupName.c_str());
+        return -1;
+    }
+
+    bool downstreamFull(){
+        ff_loadbalancer* lb = this->getlb();
+        for(size_t i = 0; i < lb->getNWorkers(); i++)
+            if (lb->is_channel_full(i)) return true;
+        return false;
+    }
+
+    /*
+     * Credit-based flow control: each sender can have a window of batches not
+     * yet credited (messageOTF). The credits of the batches received are given
+     * back coalesced, once per wakeup, and only if none of the output queues is
+     * full, so that the senders are throttled precisely when the downstream
+     * nodes cannot keep up (full tells it, the shards read the queues lengths
+     * approximately). The feedback channels are never throttled.
+     */
+    void grantCredits(rxLoop& l, bool full){
+        size_t k = 0;
+        for(int sck : l.creditsPending){
+            auto it = l.connections.find(sck);
+            if (it == l.connections.end() || it->second.owed == 0) continue;
+            if (full && it->second.t != ChannelType::FBK) {
+                l.creditsPending[k++] = sck;
+                continue;
+            }
+            sendCredits(sck, it->second);
+        }
+        l.creditsPending.resize(k);
+    }
+
+    // each ack_t grants up to 255 batches
+    void sendCredits(int sck, connState& c){
+        ack_t a[16];
+        while(c.owed){
+            int n = 0;
+            for(; n < 16 && c.owed; ++n){
+                const unsigned g = std::min(c.owed, 255u);
+                a[n].ack = (char)g;
+                c.owed  -= g;
+            }
+            if (writen(sck, reinterpret_cast<char*>(a), n*sizeof(ack_t)) < 0){
+                if (errno != ECONNRESET && errno != EPIPE)
+                    error("Error sending back the credits to the sender (errno=%d)\n",errno);
+                c.owed = 0;
+            }
+        }
+        if (c.stats) c.stats->setDepth(0);
+    }
+
+    static int addConnection(rxLoop& l, int sck, int id){
+        if (setNonBlocking(sck) < 0 || l.poller.add(sck) < 0) return -1;
+        connState& c = l.connections[sck];
+        c.id   = id;
+        c.slab = ff_rxSlab::create();
         return 0;
     }
 
-    virtual int handleRequest(int sck, ChannelType t){
-   		int sender;
-		int chid;
-        size_t sz;
-        struct iovec iov[3];
-        iov[0].iov_base = &sender;
-        iov[0].iov_len = sizeof(sender);
-        iov[1].iov_base = &chid;
-        iov[1].iov_len = sizeof(chid);
-        iov[2].iov_base = &sz;
-        iov[2].iov_len = sizeof(sz);
-
-        switch (readvn(sck, iov, 3)) {
-		case -1: error("Error reading from socket errno=%d\n",errno); // fatal error
-		case  0: return -1; // connection close
+    static void closeConnection(rxLoop& l, int sck){
+        l.poller.del(sck);
+        close(sck);
+        auto it = l.connections.find(sck);
+        if (it == l.connections.end()) return;
+        if (it->second.stats) it->second.stats->setDepth(0);
+        delete [] it->second.buff;
+        it->second.slab->release();
+        l.connections.erase(it);
+    }
+
+    static void closeConnections(rxLoop& l){
+        while(!l.connections.empty()) closeConnection(l, l.connections.begin()->first);
+    }
+
+    void deliver(rxLoop& l, const rxEvent& e){
+        if (l.outbox) l.outbox->push_back(e);
+        else process(e);
+    }
+
+    void process(const rxEvent& e){
+        switch(e.kind){
+        case rxEvent::CHANNEL:     sck2ChannelType[e.id] = (ChannelType)e.value; break;
+        case rxEvent::MESSAGE:     this->forward(e.m, e.id); break;
+        case rxEvent::LOGICAL_EOS: registerLogicalEOS(e.value); break;
+        case rxEvent::EOS:         registerEOS(e.id); break;
         }
+    }
 
-        // convert values to host byte order
-        sender = ntohl(sender);
-        chid   = ntohl(chid);
-        sz     = be64toh(sz);
-
-        if (sz > 0){
-            char* buff = new char [sz];
-			assert(buff);
-            if(readn(sck, buff, sz) < 0){
-                error("Error reading from socket in handleRequest\n");
-                delete [] buff;
-                return -1;
+    // serves the connections of a shard, it runs in its own thread
+    void runShard(rxShard& s){
+        rxLoop& l = s.loop;
+        l.outbox = &s.produced;
+        std::vector<std::pair<int,int>> accepted;
+        int ready[MAXPOLLEVENTS];
+        for(;;){
+            int n = l.poller.wait(ready, MAXPOLLEVENTS, l.creditsPending.empty() ? -1 : 1);
+            if (n < 0){
+                error("Error on polling the sockets\n");
+                break;
+            }
+            for(int i = 0; i < n; i++){
+                const int sck = ready[i];
+                if (sck == s.wakeup.fd()){
+                    s.wakeup.drain();
+                    bool stop;
+                    {
+                        std::lock_guard<std::mutex> lk(s.mtx);
+                        accepted.swap(s.inbox);
+                        stop = s.stop;
+                    }
+                    if (stop) { closeConnections(l); return; }
+                    for(auto [fd, id] : accepted)
+                        if (addConnection(l, fd, id) < 0){
+                            error("Error registering the connection\n");
+                            close(fd);
+                        }
+                    accepted.clear();
+                    continue;
+                }
+                auto it = l.connections.find(sck);
+                if (it != l.connections.end() && this->handleInput(l, sck, it->second) < 0)
+                    closeConnection(l, sck);
             }
-			message_t* out = new message_t(buff, sz, true);
-			assert(out);
-            out->feedback = t == ChannelType::FBK;
-			out->sender = sender;
-			out->chid   = chid;
-            this->forward(out, sck);
-
-            return 0;
+            // the node not keeping up with the shard is a full queue as well
+            size_t backlog = 0;
+            if (!s.produced.empty()){
+                std::lock_guard<std::mutex> lk(s.mtx);
+                if (s.ready.empty()) s.ready.swap(s.produced);
+                else {
+                    s.ready.insert(s.ready.end(), s.produced.begin(), s.produced.end());
+                    s.produced.clear();
+                }
+                backlog = s.ready.size();
+                wakeup.notify();
+            }
+            if (!l.creditsPending.empty())
+                grantCredits(l, backlog > DEFAULT_BUFFER_CAPACITY || downstreamFull());
         }
-        //logical EOS
-        if (chid == -2){
-            registerLogicalEOS(sender);
-            return 0;
+        closeConnections(l);
+    }
+
+    void startShards(){
+        for(size_t i = 0; i < receiverThreads; i++){
+            shards.emplace_back(new rxShard);
+            rxShard& s = *shards.back();
+            if (!s.wakeup.valid() || s.loop.poller.add(s.wakeup.fd()) < 0){
+                error("Error creating the receiver threads\n");
+                shards.pop_back();
+                break;
+            }
+            s.thread = std::thread([this, &s]{ runShard(s); });
         }
+    }
 
-        //pyshical EOS
-        registerEOS(sck);
-        return -1;
+    void stopShards(){
+        for(auto& s : shards){
+            {
+                std::lock_guard<std::mutex> lk(s->mtx);
+                s->stop = true;
+                for(auto [fd, _] : s->inbox) close(fd);
+                s->inbox.clear();
+            }
+            s->wakeup.notify();
+            s->thread.join();
+            for(rxEvent& e : s->ready) if (e.kind == rxEvent::MESSAGE) delete e.m;
+        }
+        shards.clear();
+    }
+
+    // routes the events of all the shards, in the order they were produced by each of them
+    void collect(){
+        std::vector<rxEvent> events;
+        for(auto& s : shards){
+            {
+                std::lock_guard<std::mutex> lk(s->mtx);
+                events.swap(s->ready);
+            }
+            for(const rxEvent& e : events) process(e);
+            events.clear();
+        }
+    }
+
+    void acceptConnections(){
+        for(;;){
+            int connfd = accept(this->listen_sck, (struct sockaddr*)NULL ,NULL);
+            if (connfd == -1){
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    error("Error accepting client\n");
+                return;
+            }
+            if (!shards.empty()){
+                // the connections are assigned to the shards in round-robin
+                rxShard& s = *shards[nextShard++ % shards.size()];
+                {
+                    std::lock_guard<std::mutex> lk(s.mtx);
+                    s.inbox.emplace_back(connfd, ++lastId);
+                }
+                s.wakeup.notify();
+                continue;
+            }
+            if (addConnection(loop, connfd, connfd) < 0){
+                error("Error registering the connection\n");
+                close(connfd);
+            }
+        }
+    }
+    virtual void registerLogicalEOS(int sender){
+        for(size_t i = 0; i < this->get_num_outchannels(); i++)
+                ff_send_out_to(new message_t(sender, i), i);
+    }
+
+    virtual void registerEOS(int sck){
+        neos++;
+    }
+
+    virtual void forward(message_t* task, int){
+        if (task->chid == -1) ff_send_out(task);
+        else ff_send_out_to(task, this->routingTable[task->chid]); // assume the routing table is consistent WARNING!!!
     }
 
 public:
     ff_dreceiver(ff_endpoint acceptAddr, size_t input_channels, std::map<int, int> routingTable = {std::make_pair(0,0)}, int coreid=-1)
 		: input_channels(input_channels), acceptAddr(acceptAddr), routingTable(routingTable), coreid(coreid) {}
 
+    ~ff_dreceiver() { stopShards(); }
+
+    // number of threads receiving from the connections (1 means the node itself)
+    void setReceiverThreads(size_t n) { receiverThreads = n ? n : 1; }
+
     int svc_init() {
   		if (coreid!=-1)
 			ff_mapThreadToCpu(coreid);
@@ -227,11 +686,19 @@ public:
             error("Error listening\n");
             return -1;
         }
+
+        // the connections are accepted until EAGAIN
+        if (setNonBlocking(listen_sck) < 0){
+            error("Error setting the listening socket non-blocking\n");
+            return -1;
+        }
         
         return 0;
     }
 
     void svc_end() {
+        stopShards();
+        closeConnections(loop);
         close(this->listen_sck);		
 #ifdef LOCAL
 		unlink(this->acceptAddr.address.c_str());
@@ -241,59 +708,44 @@ public:
         Here i should not care of input type nor input data since they come from a socket listener.
         Everything will be handled inside a while true in the body of this node where data is pulled from network
     */
-    message_t *svc(message_t* task) {        
-        fd_set set, tmpset;
-        // intialize both sets (master, temp)
-        FD_ZERO(&set);
-        FD_ZERO(&tmpset);
-
-        // add the listen socket to the master set
-        FD_SET(this->listen_sck, &set);
-
-        // hold the greater descriptor
-        int fdmax = this->listen_sck; 
-
+    message_t *svc(message_t* task) {
+        if (loop.poller.add(this->listen_sck) < 0){
+            error("Error registering the listening socket\n");
+            return EOS;
+        }
+        if (receiverThreads > 1){
+            if (!wakeup.valid() || loop.poller.add(wakeup.fd()) < 0){
+                error("Error registering the receiver threads\n");
+                return EOS;
+            }
+            startShards();
+        }
+        int ready[MAXPOLLEVENTS];
         while(neos < input_channels){
-            // copy the master set to the temporary
-            tmpset = set;
-
-            switch(select(fdmax+1, &tmpset, NULL, NULL, NULL)){
-                case -1: error("Error on selecting socket\n"); return EOS;
-                case  0: continue;
+            // the withheld credits are checked again every millisecond
+            int n = loop.poller.wait(ready, MAXPOLLEVENTS, loop.creditsPending.empty() ? -1 : 1);
+            if (n < 0){
+                error("Error on polling the sockets\n");
+                return EOS;
             }
-
-            for(int idx=0; idx <= fdmax; idx++){
-	            if (FD_ISSET(idx, &tmpset)){
-                    if (idx == this->listen_sck) {
-                        int connfd = accept(this->listen_sck, (struct sockaddr*)NULL ,NULL);
-                        if (connfd == -1){
-                            error("Error accepting client\n");
-                        } else {
-                            FD_SET(connfd, &set);
-                            if(connfd > fdmax) fdmax = connfd;
-
-                            this->handshakeHandler(connfd);
-                        }
-                        continue;
-                    }
-                    
-                    if (this->handleBatch(idx) < 0){
-                        close(idx);
-                        FD_CLR(idx, &set);
-
-                        // update the maximum file descriptor
-                        if (idx == fdmax)
-                            for(int ii=(fdmax-1);ii>=0;--ii)
-                                if (FD_ISSET(ii, &set)){
-                                    fdmax = ii;
-                                    break;
-                                }
-						
-                    }
-					
+            for(int i = 0; i < n; i++){
+                const int sck = ready[i];
+                if (sck == this->listen_sck){
+                    acceptConnections();
+                    continue;
                 }
+                if (sck == wakeup.fd()){
+                    wakeup.drain();
+                    collect();
+                    continue;
+                }
+                auto it = loop.connections.find(sck);
+                if (it != loop.connections.end() && this->handleInput(loop, sck, it->second) < 0)
+                    closeConnection(loop, sck);
             }
+            if (!loop.creditsPending.empty()) grantCredits(loop, downstreamFull());
         }
+        stopShards();
 		
         return this->EOS;
     }
@@ -305,12 +757,11 @@ protected:
     ff_endpoint acceptAddr;	
     std::map<int, int> routingTable;
 	int coreid;
-    ack_t ACK;
 };
 
 
 class ff_dreceiverH : public ff_dreceiver {
-
+protected:
     //std::map<int, bool> isInternalConnection;
     size_t internalNEos = 0, externalNEos = 0;
     long next_rr_destination = 0;
@@ -0,0 +1,200 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_DRECEIVER_SHM_H
+#define FF_DRECEIVER_SHM_H
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/distributed/ff_network.hpp>
+#include <ff/distributed/ff_shmchannel.hpp>
+#include <ff/distributed/ff_dreceiver.hpp>
+
+using namespace ff;
+
+/*
+ * Receiver using the shared-memory channels (see ff_shmchannel.hpp).
+ * The routing and the EOS management are those of the base receiver
+ * (ff_dreceiver or ff_dreceiverH), each input channel is identified by its
+ * control connection. The messages fitting in one slot are forwarded without
+ * copying the data, the slot is given back as soon as the message has been
+ * deserialized (the wrappers delete the message before running the node).
+ */
+template<typename Base>
+class ff_dreceiverSHM_t: public Base {
+protected:
+    struct conn_t {
+        std::shared_ptr<shmChannel> ch;
+        std::shared_ptr<ff_dchannelStats> stats;
+        bool eos = false;
+    };
+    std::map<int, conn_t> conns;   // control connection -> channel
+
+    int handshakeSHM(int sck) {
+        shmHandshake h;
+        int fds[3];
+        if (recvFds(sck, &h, sizeof(h), fds, 3) != (int)sizeof(h)) {
+            error("Error receiving the handshake from the control socket\n");
+            return -1;
+        }
+        std::vector<char> groupName(h.size);
+        if (h.size && readn(sck, groupName.data(), h.size) <= 0) {
+            error("Error reading from socket groupName\n");
+            for(int fd : fds) close(fd);
+            return -1;
+        }
+        shmChannel* ch = shmChannel::attach(fds[0], fds[1], fds[2]);
+        if (!ch) {
+            error("Error mapping the shared-memory channel\n");
+            return -1;
+        }
+        ch->setCtrl(sck);
+        conns[sck].ch.reset(ch);
+        conns[sck].stats = ff_dstats::instance().channel(this->acceptAddr.groupName, std::string(groupName.begin(), groupName.end()), h.t, false);
+        this->sck2ChannelType[sck] = h.t;
+        return 0;
+    }
+
+    // as ff_dreceiver::handleRequest, it returns -1 at the physical EOS
+    int handleMessage(int sck, message_t* m) {
+        const ChannelType t = this->sck2ChannelType[sck];
+        if (m->data.getLen() > 0) {
+            m->feedback = t == ChannelType::FBK;
+            this->forward(m, sck);
+            return 0;
+        }
+        const int sender = m->sender, chid = m->chid;
+        delete m;
+        //logical EOS
+        if (chid == -2) {
+            this->registerLogicalEOS(sender);
+            return 0;
+        }
+        //physical EOS
+        this->registerEOS(sck);
+        return -1;
+    }
+
+    // receives at most 'max' messages from the channel
+    bool drain(int sck, conn_t& c, size_t max) {
+        bool r = false;
+        message_t* m;
+        for(size_t i=0; i<max && !c.eos && (m = c.ch->receive(c.ch)); ++i) {
+            r = true;
+            if (m->data.getLen()) c.stats->message(m->data.getLen());
+            if (handleMessage(sck, m) < 0) c.eos = true;
+        }
+        return r;
+    }
+
+    bool anyReady() {
+        for(auto& [_, c] : conns)
+            if (!c.eos && c.ch->ready()) return true;
+        return false;
+    }
+
+public:
+    using Base::Base;
+
+    int svc_init() {
+        if (this->coreid!=-1)
+            ff_mapThreadToCpu(this->coreid);
+
+        if ((this->listen_sck=socket(AF_LOCAL, SOCK_STREAM|SOCK_CLOEXEC, 0)) < 0){
+            error("Error creating the socket\n");
+            return -1;
+        }
+        struct sockaddr_un serv_addr;
+        const socklen_t len = shmChannel::ctrlAddress(this->acceptAddr, serv_addr);
+        if (bind(this->listen_sck, (struct sockaddr*)&serv_addr, len) < 0){
+            error("Error binding %s\n", shmChannel::ctrlName(this->acceptAddr).c_str());
+            return -1;
+        }
+        if (listen(this->listen_sck, MAXBACKLOG) < 0){
+            error("Error listening\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    void svc_end() {
+        close(this->listen_sck);
+        // the channels are unmapped when the last message using them is deleted
+        conns.clear();
+    }
+
+    message_t *svc(message_t*) {
+        std::vector<struct pollfd> pfds;
+        while(this->neos < this->input_channels){
+            bool progress = false;
+            for(auto& [sck, c] : conns)
+                progress |= drain(sck, c, DEFAULT_SHM_SLOTS);
+            if (progress) continue;
+
+            for(int i=0; i<SHM_SPIN_ROUNDS && !anyReady(); ++i) PAUSE();
+
+            // prepare to wait on all channels
+            pfds.clear();
+            pfds.push_back({this->listen_sck, POLLIN, 0});
+            bool wait = true;
+            for(auto& [sck, c] : conns) {
+                if (c.eos) continue;
+                wait = wait && c.ch->prepareWait();
+                pfds.push_back({sck, POLLIN, 0});
+                pfds.push_back({c.ch->getDataFd(), POLLIN, 0});
+            }
+            if (wait && poll(pfds.data(), pfds.size(), -1) < 0 && errno != EINTR) {
+                error("Error on polling the channels\n");
+                return this->EOS;
+            }
+            for(auto& [_, c] : conns)
+                if (!c.eos) c.ch->clearWait();
+            if (!wait) continue;
+
+            if (pfds[0].revents & POLLIN) {
+                int connfd = accept4(this->listen_sck, NULL, NULL, SOCK_CLOEXEC);
+                if (connfd == -1) error("Error accepting client\n");
+                else if (handshakeSHM(connfd) < 0) close(connfd);
+            }
+            // a closed control connection before the EOS means the sender has gone
+            for(size_t i=1; i<pfds.size(); i+=2) {
+                if (!(pfds[i].revents & (POLLIN|POLLHUP|POLLERR))) continue;
+                const int sck = pfds[i].fd;
+                char c;
+                const ssize_t r = recv(sck, &c, 1, MSG_DONTWAIT|MSG_PEEK);
+                if (r > 0 || (r < 0 && (errno == EAGAIN || errno == EINTR))) continue;
+                conn_t& conn = conns[sck];
+                while(drain(sck, conn, (size_t)-1));
+                if (!conn.eos) {
+                    conn.eos = true;
+                    this->registerEOS(sck);
+                }
+            }
+        }
+        return this->EOS;
+    }
+};
+
+using ff_dreceiverSHM  = ff_dreceiverSHM_t<ff_dreceiver>;
+using ff_dreceiverHSHM = ff_dreceiverSHM_t<ff_dreceiverH>;
+
+#endif
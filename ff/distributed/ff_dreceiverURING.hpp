@@ -0,0 +1,209 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_DRECEIVER_URING_H
+#define FF_DRECEIVER_URING_H
+
+#include <memory>
+#include <climits>
+#include <fcntl.h>
+#include <ff/ff.hpp>
+#include <ff/distributed/ff_network.hpp>
+#include <ff/distributed/ff_uring.hpp>
+#include <ff/distributed/ff_dreceiver.hpp>
+
+using namespace ff;
+
+/*
+ * Receiver of the URING transport. The connections and the wire format are
+ * those of TCP, the parsing, the routing and the credits are those of the base
+ * receiver (ff_dreceiver or ff_dreceiverH). Instead of waiting for the sockets
+ * to be readable and then reading them, the accept and one receive for each
+ * connection (in the slab or directly in a large payload) are kept pending in
+ * the ring: the completions of all the connections are collected and the new
+ * receives submitted with one system call per round.
+ * If the kernel does not provide io_uring the node works as the base receiver.
+ * There is only one receiver thread (see setReceiverThreads).
+ */
+template<typename Base>
+class ff_dreceiverURING_t: public Base {
+protected:
+    using connState = typename Base::connState;
+
+    static constexpr __u64 ACCEPT = ~0ull;
+    static constexpr __u64 CANCEL = ~1ull;
+
+    std::unique_ptr<ff_uring> ring;
+    size_t inflight = 0;        // requests submitted and not yet completed
+    bool   acceptArmed = false;
+    bool   stopping = false;
+
+    // the read is completed by the ring
+    ssize_t receive(int sck, connState& c, char* dst, size_t n, bool toSlab) override {
+        if (!ring) return Base::receive(sck, c, dst, n, toSlab);
+        c.wantDst  = dst;
+        c.wantLen  = n;
+        c.wantSlab = toSlab;
+        return -2;
+    }
+
+    struct io_uring_sqe* request(__u8 opcode, int fd, __u64 data) {
+        struct io_uring_sqe* e = ring->sqe(opcode, fd, data);
+        if (!e && ring->submit() >= 0) e = ring->sqe(opcode, fd, data);
+        if (e) ++inflight;
+        return e;
+    }
+
+    bool armAccept() {
+        struct io_uring_sqe* e = request(IORING_OP_ACCEPT, this->listen_sck, ACCEPT);
+        if (!e) return false;
+        e->accept_flags = SOCK_CLOEXEC;
+        acceptArmed = true;
+        return true;
+    }
+
+    bool armReceive(int sck, connState& c) {
+        struct io_uring_sqe* e = request(IORING_OP_RECV, sck, (__u64)sck);
+        if (!e) return false;
+        e->addr = (__u64)(uintptr_t)c.wantDst;
+        e->len  = (__u32)std::min(c.wantLen, (size_t)INT_MAX);
+        return true;
+    }
+
+    void cancel(__u64 data) {
+        struct io_uring_sqe* e = request(IORING_OP_ASYNC_CANCEL, -1, CANCEL);
+        if (e) e->addr = data;
+    }
+
+    // parses the data received so far and arms the next receive
+    void serve(int sck, connState& c) {
+        c.wantDst = nullptr;
+        if (this->handleInput(this->loop, sck, c) < 0 || !c.wantDst || !armReceive(sck, c)) {
+            c.wantDst = nullptr;
+            this->closeConnection(this->loop, sck);
+        }
+    }
+
+    void completed(__u64 data, int res) {
+        --inflight;
+        if (data == CANCEL) return;
+        if (data == ACCEPT) {
+            acceptArmed = false;
+            if (stopping) {
+                if (res >= 0) close(res);
+                return;
+            }
+            if (res >= 0) {
+                connState& c = this->loop.connections[res];
+                c.id   = res;
+                c.slab = ff_rxSlab::create();
+                serve(res, c);
+            } else if (res != -EINTR && res != -EAGAIN)
+                error("Error accepting client (errno=%d)\n", -res);
+            if (!armAccept()) error("Error arming the accept on the ring\n");
+            return;
+        }
+        const int sck = (int)data;
+        auto it = this->loop.connections.find(sck);
+        if (it == this->loop.connections.end()) return;
+        connState& c = it->second;
+        if (res == -EINTR || res == -EAGAIN) {
+            if (!stopping && armReceive(sck, c)) return;
+            res = -ECANCELED;
+        }
+        if (res <= 0 || stopping) {
+            // connection closed (before the EOS if not stopping) or error
+            if (res < 0 && !stopping && res != -ECONNRESET)
+                error("Error reading from socket errno=%d\n", -res);
+            c.wantDst = nullptr;
+            this->closeConnection(this->loop, sck);
+            return;
+        }
+        if (c.wantSlab) c.inEnd += res;
+        else c.got += res;
+        serve(sck, c);
+    }
+
+    // cancels the pending requests and waits for their completion
+    void drain() {
+        stopping = true;
+        if (acceptArmed) cancel(ACCEPT);
+        for(auto& [sck, c] : this->loop.connections)
+            if (c.wantDst) cancel((__u64)sck);
+        for(int i = 0; inflight && i < 100; ++i) {
+            if (ring->submit(1, 10000000) < 0) break;
+            ring->reap([this](__u64 data, int res) { completed(data, res); });
+        }
+        if (inflight) error("%zu requests still pending on the ring\n", inflight);
+    }
+
+public:
+    using Base::Base;
+
+    int svc_init() {
+        if (Base::svc_init() < 0) return -1;
+        // the ring is waited only by this thread
+#if defined(IORING_SETUP_COOP_TASKRUN)
+        ring.reset(new ff_uring(URING_ENTRIES, IORING_SETUP_COOP_TASKRUN));
+#else
+        ring.reset(new ff_uring(URING_ENTRIES));
+#endif
+        if (!ring->valid()) {
+            ring.reset();
+            return 0;
+        }
+        // a non-blocking listening socket would fail the accept instead of waiting
+        const int flags = fcntl(this->listen_sck, F_GETFL, 0);
+        if (flags < 0 || fcntl(this->listen_sck, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+            error("Error setting the listening socket blocking\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    void svc_end() {
+        Base::svc_end();
+        ring.reset();
+    }
+
+    message_t *svc(message_t* task) {
+        if (!ring) return Base::svc(task);
+        if (!armAccept()) {
+            error("Error arming the accept on the ring\n");
+            return this->EOS;
+        }
+        while(this->neos < this->input_channels){
+            // the withheld credits are checked again every millisecond
+            if (ring->submit(1, this->loop.creditsPending.empty() ? -1 : 1000000) < 0) {
+                error("Error waiting on the ring (errno=%d)\n", errno);
+                break;
+            }
+            ring->reap([this](__u64 data, int res) { completed(data, res); });
+            if (!this->loop.creditsPending.empty()) this->grantCredits(this->loop, this->downstreamFull());
+        }
+        drain();
+        return this->EOS;
+    }
+};
+
+using ff_dreceiverURING  = ff_dreceiverURING_t<ff_dreceiver>;
+using ff_dreceiverHURING = ff_dreceiverURING_t<ff_dreceiverH>;
+
+#endif
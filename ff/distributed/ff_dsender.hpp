@@ -30,6 +30,7 @@
 #include <ff/ff.hpp>
 #include <ff/distributed/ff_network.hpp>
 #include <ff/distributed/ff_batchbuffer.hpp>
+#include <ff/distributed/ff_dstats.hpp>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/uio.h>
@@ -38,6 +39,8 @@
 #include <netdb.h>
 #include <cmath>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <cereal/cereal.hpp>
 #include <cereal/archives/portable_binary.hpp>
@@ -55,19 +58,69 @@ protected:
     std::map<std::pair<int, ChannelType>, int> dest2Socket;
     std::vector<int> sockets;
     int last_rr_socket = -1;
+    int currentSck[2] = {-1, -1};         // batch being filled without a specific destination (forward, feedback)
+    std::map<int, bool> localDestinations;
+    bool withAcks = false;                // the receivers give back the credits
     std::map<int, unsigned int> socketsCounters;
     std::map<int, ff_batchBuffer> batchBuffers;
     std::string gName;
     int batchSize;
     int messageOTF;
     int coreid;
-    fd_set set, tmpset;
-    int fdmax = -1;
+    ff_poller poller;
+    ff_batchPolicy batchPolicy;
+    std::recursive_mutex batchLock;     // taken only if the batches have a linger time
+    std::thread lingerThread;
+    std::mutex lingerMtx;
+    std::condition_variable lingerCV;
+    bool lingerStop = false;
+
+    bool lingering() const { return batchPolicy.lingerUs > 0 || batchPolicy.adaptive; }
+
+    std::unique_lock<std::recursive_mutex> batchGuard(){
+        std::unique_lock<std::recursive_mutex> lk(batchLock, std::defer_lock);
+        if (lingering()) lk.lock();
+        return lk;
+    }
+
+    // the batches waiting for more than the linger time are flushed by a helper
+    // thread, which checks them every half linger time
+    void startLinger(){
+        if (!lingering()) return;
+        const long us = batchPolicy.lingerUs > 0 ? batchPolicy.lingerUs : ff_batchPolicy::defaultLingerUs;
+        const auto period = std::chrono::microseconds(std::max(us/2, 50L));
+        lingerThread = std::thread([this, period] {
+            std::unique_lock<std::mutex> lk(lingerMtx);
+            while(!lingerCV.wait_for(lk, period, [this] { return lingerStop; })) {
+                lk.unlock();
+                {
+                    auto guard = batchGuard();
+                    const auto now = std::chrono::steady_clock::now();
+                    for(auto& [_, buffer] : batchBuffers)
+                        if (buffer.expired(now) && buffer.flush() < 0)
+                            error("flushing a batch after the linger time\n");
+                }
+                lk.lock();
+            }
+        });
+    }
+
+    void stopLinger(){
+        if (!lingerThread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lk(lingerMtx);
+            lingerStop = true;
+        }
+        lingerCV.notify_one();
+        lingerThread.join();
+    }
 
     virtual int handshakeHandler(const int sck, ChannelType t){
         size_t sz = htobe64(gName.size());
+        int type = t | (batchPolicy.compressAbove ? DFF_HANDSHAKE_COMPRESSION : 0);
+        static_assert(sizeof(type) == sizeof(ChannelType));
         struct iovec iov[3];
-        iov[0].iov_base = &t;
+        iov[0].iov_base = &type;
         iov[0].iov_len = sizeof(ChannelType);
         iov[1].iov_base = &sz;
         iov[1].iov_len = sizeof(sz);
@@ -82,25 +135,17 @@ protected:
         return 0;
     }
 	
-    int create_connect(const ff_endpoint& destination){
-        int socketFD;
-
+    // the addresses of the destination, empty if it cannot be resolved
+    std::vector<ff_sockaddr> resolve(const ff_endpoint& destination){
+        std::vector<ff_sockaddr> addrs;
 #ifdef LOCAL
-            socketFD = socket(AF_LOCAL, SOCK_STREAM, 0);
-            if (socketFD < 0){
-                error("\nError creating socket \n");
-                return socketFD;
-            }
-            struct sockaddr_un serv_addr;
-            memset(&serv_addr, '0', sizeof(serv_addr));
-            serv_addr.sun_family = AF_LOCAL;
-
-            strncpy(serv_addr.sun_path, destination.address.c_str(), destination.address.size()+1);
-
-            if (connect(socketFD, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0){
-                close(socketFD);
-                return -1;
-            }
+            ff_sockaddr a;
+            memset(&a, 0, sizeof(a));
+            struct sockaddr_un* serv_addr = reinterpret_cast<struct sockaddr_un*>(&a.addr);
+            serv_addr->sun_family = AF_LOCAL;
+            strncpy(serv_addr->sun_path, destination.address.c_str(), sizeof(serv_addr->sun_path)-1);
+            a.len = sizeof(struct sockaddr_un);
+            addrs.push_back(a);
 #endif
 
 #ifdef REMOTE
@@ -114,43 +159,38 @@ protected:
             hints.ai_protocol = IPPROTO_TCP;          /* Allow only TCP */
 
             // resolve the address 
-            if (getaddrinfo(destination.address.c_str() , std::to_string(destination.port).c_str() , &hints, &result) != 0)
-                return -1;
+            if (getaddrinfo(destination.address.c_str() , std::to_string(destination.port).c_str() , &hints, &result) != 0){
+                error("Error resolving the address %s\n", destination.address.c_str());
+                return addrs;
+            }
 
-            // try to connect to a possible one of the resolution results
+            // the results are tried in order when connecting
             for (rp = result; rp != NULL; rp = rp->ai_next) {
-               socketFD = socket(rp->ai_family, rp->ai_socktype,
-                            rp->ai_protocol);
-               if (socketFD == -1)
-                   continue;
-
-               if (connect(socketFD, rp->ai_addr, rp->ai_addrlen) != -1)
-                   break;                  /* Success */
-
-               close(socketFD);
-           }
-		   free(result);
-			
-           if (rp == NULL)  {          /* No address succeeded */
-               return -1;
-		   }
+                ff_sockaddr a;
+                memset(&a, 0, sizeof(a));
+                memcpy(&a.addr, rp->ai_addr, rp->ai_addrlen);
+                a.len = rp->ai_addrlen;
+                addrs.push_back(a);
+            }
+            freeaddrinfo(result);
 #endif
-
-        // receive the reachable destination from this sockets
-        return socketFD;
+        return addrs;
     }
 
-    int tryConnect(const ff_endpoint &destination){
-        int fd = -1, retries = 0;
-
-        while((fd = this->create_connect(destination)) < 0 && ++retries < MAX_RETRIES)
-            if (retries < AGGRESSIVE_TRESHOLD)
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            else
-                std::this_thread::sleep_for(std::chrono::milliseconds(200));
-                //std::this_thread::sleep_for(std::chrono::milliseconds((long)std::pow(2, retries - AGGRESSIVE_TRESHOLD)));
-
-        return fd;
+    /*
+     * Connects to all the destinations at once (see connectAll), so that the
+     * startup time does not grow with the number of destinations. The node
+     * starts sending only when all of them are reachable. It returns the
+     * sockets in the order of dest_endpoints, empty on failure.
+     */
+    std::vector<int> connectDestinations(){
+        std::vector<std::vector<ff_sockaddr>> addrs;
+        for(const auto& [_, ep] : this->dest_endpoints)
+            addrs.push_back(resolve(ep));
+        std::vector<int> scks = connectAll(addrs);
+        if (scks.empty())
+            error("Error connecting to the destinations of group %s\n", gName.c_str());
+        return scks;
     }
 
     int sendToSck(int sck, message_t* task){
@@ -158,17 +198,23 @@ protected:
         task->chid = htonl(task->chid);
 
         size_t sz = htobe64(task->data.getLen());
-        struct iovec iov[4];
+        struct iovec iov[3+MAXDATASPANS];
         iov[0].iov_base = &task->sender;
         iov[0].iov_len = sizeof(task->sender);
         iov[1].iov_base = &task->chid;
         iov[1].iov_len = sizeof(task->chid);
         iov[2].iov_base = &sz;
         iov[2].iov_len = sizeof(sz);
-        iov[3].iov_base = task->data.getPtr();
-        iov[3].iov_len = task->data.getLen();
+        int n = 3;
+        if (auto pieces = task->data.getPieces())
+            for(const struct iovec& v : *pieces) iov[n++] = v;
+        else {
+            iov[3].iov_base = task->data.getPtr();
+            iov[3].iov_len = task->data.getLen();
+            n = 4;
+        }
 
-        if (writevn(sck, iov, 4) < 0){
+        if (writevn(sck, iov, n) < 0){
             error("Error writing on socket\n");
             return -1;
         }
@@ -176,48 +222,189 @@ protected:
         return 0;
     }
 
-     int waitAckFrom(int sck){
+    // reads all the credits available on the socket (each ack_t grants up to
+    // 255 batches), -1 if the connection has been closed
+    int readAcks(int sck){
+        ack_t a[64];
+        for(;;){
+            ssize_t r = recv(sck, reinterpret_cast<char*>(a), sizeof(a), MSG_DONTWAIT);
+            if (r > 0) {
+                auto& counter = socketsCounters[sck];
+                for(size_t i = 0; i < r/sizeof(ack_t); i++)
+                    counter += (unsigned char)a[i].ack;
+                continue;
+            }
+            if (r == 0) return -1;
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                updateDepth(sck);
+                return 0;
+            }
+            perror("recv ack");
+            return -1;
+        }
+    }
+
+    // batches not yet acknowledged (see ff_dstats.hpp)
+    void updateDepth(int sck){
+        auto it = batchBuffers.find(sck);
+        if (it != batchBuffers.end() && it->second.stats)
+            it->second.stats->setDepth(maxOTF(sck) - socketsCounters[sck]);
+    }
+
+    void accountWait(int sck, std::chrono::steady_clock::time_point since){
+        auto it = batchBuffers.find(sck);
+        if (it != batchBuffers.end() && it->second.stats)
+            ff_dchannelStats::add(it->second.stats->waitNs, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+    }
+
+    int waitAckFrom(int sck){
+        int ready[MAXPOLLEVENTS];
+        if (socketsCounters[sck]) return 1;
+        const auto since = std::chrono::steady_clock::now();
         while (socketsCounters[sck] == 0){
-            for(auto& [sck_, counter] : socketsCounters){
-                int r; ack_t a;
-                if ((r = recvnnb(sck_, reinterpret_cast<char*>(&a), sizeof(ack_t))) != sizeof(ack_t)){
-                    if (errno == EWOULDBLOCK){
-                        assert(r == -1);
-                        continue;
-                    }
-                    perror("recvnnb ack");
-                    return -1;
-                } else 
-                    counter++;
-                
+            int n = poller.wait(ready, MAXPOLLEVENTS);
+            if (n < 0){
+                perror("epoll_wait");
+                return -1;
             }
-			
-            if (socketsCounters[sck] == 0){
-                tmpset = set;
-                if (select(fdmax + 1, &tmpset, NULL, NULL, NULL) == -1){
-                    perror("select");
-                    return -1;
+            for(int i = 0; i < n; i++)
+                if (readAcks(ready[i]) < 0) {
+                    if (ready[i] == sck) return -1;
+                    poller.del(ready[i]);
                 }
-            }
         }
+        accountWait(sck, since);
         return 1;
     }
 
-    int getMostFilledBufferSck(bool feedback){
-        int sckMax = 0;
-        int sizeMax = 0;
-        for(auto& [sck, buffer] : batchBuffers){
-            if ((feedback && buffer.ct != ChannelType::FBK) || (!feedback && buffer.ct != ChannelType::FWD)) continue; 
-            if (buffer.size > sizeMax) sckMax = sck;
+    // maximum number of messages on-the-fly on the connection
+    virtual unsigned int maxOTF(int sck){
+        return messageOTF;
+    }
+
+    // closes the sending side of the connection after the EOS
+    virtual void shutdownOutput(int sck){
+        shutdown(sck, SHUT_WR);
+    }
+
+    // here we wait all acks from all connections
+    void waitAllAcks(){
+        size_t totalack = 0, currentack = 0;
+        for(auto& [sck, counter] : socketsCounters){
+            totalack += maxOTF(sck);
+            // the acks already arrived do not generate a new notification
+            if (readAcks(sck) < 0) {
+                counter = maxOTF(sck);
+                updateDepth(sck);
+                poller.del(sck);
+            }
+            currentack += counter;
         }
-    
-        if (sckMax > 0) return sckMax;
-        
-        do {
-        last_rr_socket = (last_rr_socket + 1) % this->sockets.size();
-        } while (batchBuffers[sockets[last_rr_socket]].ct != (feedback ? ChannelType::FBK : ChannelType::FWD));
-        return sockets[last_rr_socket];
-        
+        int ready[MAXPOLLEVENTS];
+        while(currentack<totalack) {
+            int n = poller.wait(ready, MAXPOLLEVENTS);
+            if (n < 0){
+                perror("epoll_wait");
+                return;
+            }
+            for(int i = 0; i < n; i++){
+                auto scit = socketsCounters.find(ready[i]);
+                if (scit == socketsCounters.end()) continue;
+                const unsigned int before = scit->second;
+                if (readAcks(ready[i]) < 0) {
+                    // connection closed, no more acks from it
+                    scit->second = maxOTF(ready[i]);
+                    updateDepth(ready[i]);
+                    poller.del(ready[i]);
+                }
+                currentack += scit->second - before;
+            }
+        }
+    }
+
+    // the destination runs on this machine, computed once per connection
+    bool isLocal(int sck){
+        auto it = localDestinations.find(sck);
+        if (it == localDestinations.end())
+            it = localDestinations.emplace(sck, isSameHost(sck)).first;
+        return it->second;
+    }
+
+    // fraction of the credits in use (batches not yet acknowledged), the
+    // batch being filled counts for its part, 1 means no credits
+    virtual double load(int sck){
+        const double otf = maxOTF(sck);
+        return (otf - socketsCounters[sck] + (double)batchBuffers[sck].size / batchSize) / otf;
+    }
+
+    // reads the credits arrived, waiting for at most timeout milliseconds
+    int pollAcks(int timeout){
+        int ready[MAXPOLLEVENTS];
+        int n = poller.wait(ready, MAXPOLLEVENTS, timeout);
+        if (n < 0){
+            perror("epoll_wait");
+            return -1;
+        }
+        for(int i = 0; i < n; i++)
+            if (readAcks(ready[i]) < 0) {
+                // connection closed, the error is reported when sending
+                socketsCounters[ready[i]] = maxOTF(ready[i]);
+                updateDepth(ready[i]);
+                poller.del(ready[i]);
+            }
+        return n;
+    }
+
+    /*
+     * Destination of a message without a specific one (e.g. ondemand a2a).
+     * The batch being filled is completed first, then the least loaded of
+     * the eligible destinations is chosen (ties in round-robin). The load
+     * follows the receivers: they withhold the credits while their nodes
+     * are busy. If no destination has credits, the first one giving them
+     * back is chosen. The destinations on the same host are preferred, a
+     * remote one is chosen only if it is less loaded by more than
+     * REMOTE_SPILL_THRESHOLD, or if all the local ones have no credits.
+     */
+    template<typename Pred>
+    int leastLoaded(const std::vector<int>& candidates, Pred eligible, int& current, int& rr){
+        if (current >= 0 && batchBuffers[current].size > 0) return current;
+        const size_t n = candidates.size();
+        if (n == 0) return -1;
+        rr = (rr + 1) % n;
+        // the credits given back since the last choice
+        if (withAcks && pollAcks(0) < 0) return -1;
+        int sck;
+        std::chrono::steady_clock::time_point since{};
+        for(;;){
+            int    best[2]     = {-1, -1};   // local, remote
+            double bestLoad[2] = {0, 0};
+            for(size_t k = 0; k < n; ++k){
+                const int s = candidates[(rr + k) % n];
+                if (!eligible(s)) continue;
+                const int where = isLocal(s) ? 0 : 1;
+                const double l  = load(s);
+                if (best[where] < 0 || l < bestLoad[where]) {
+                    best[where]     = s;
+                    bestLoad[where] = l;
+                }
+            }
+            sck = best[0];
+            if (best[1] >= 0 && (sck < 0 || bestLoad[0] - bestLoad[1] > REMOTE_SPILL_THRESHOLD ||
+                                 (bestLoad[0] >= 1 && bestLoad[1] < 1)))
+                sck = best[1];
+            if (sck < 0 || !withAcks || socketsCounters[sck] > 0) break;
+            if (since == std::chrono::steady_clock::time_point{}) since = std::chrono::steady_clock::now();
+            if (pollAcks(-1) < 0) return -1;
+        }
+        if (since != std::chrono::steady_clock::time_point{}) accountWait(sck, since);
+        current = sck;
+        return sck;
+    }
+
+    int getLeastLoadedSck(bool feedback){
+        const ChannelType ct = feedback ? ChannelType::FBK : ChannelType::FWD;
+        return leastLoaded(sockets, [&](int sck) { return batchBuffers[sck].ct == ct; }, currentSck[feedback], last_rr_socket);
     }
 
     
@@ -228,22 +415,27 @@ public:
 
     ff_dsender( std::vector<std::pair<ChannelType, ff_endpoint>> dest_endpoints_, precomputedRT_t* rt, std::string gName = "", int batchSize = DEFAULT_BATCH_SIZE, int messageOTF = DEFAULT_MESSAGE_OTF, int coreid=-1) : dest_endpoints(std::move(dest_endpoints_)), precomputedRT(rt), gName(gName), batchSize(batchSize), messageOTF(messageOTF), coreid(coreid) {}
 
+    ~ff_dsender() { stopLinger(); }
+
+    // to be set before running the node
+    void setBatchPolicy(const ff_batchPolicy& p) { batchPolicy = p; }
+
     
 
     int svc_init() {
 		if (coreid!=-1)
 			ff_mapThreadToCpu(coreid);
         
-        FD_ZERO(&set);
-        FD_ZERO(&tmpset);
 		
         //sockets.resize(dest_endpoints.size());
-        for(auto& [ct, ep] : this->dest_endpoints){
-            int sck = tryConnect(ep);
-            if (sck <= 0) return -1;
+        const std::vector<int> connected = connectDestinations();
+        if (connected.size() != this->dest_endpoints.size()) return -1;
+        for(size_t i = 0; i < this->dest_endpoints.size(); ++i){
+            auto& [ct, ep] = this->dest_endpoints[i];
+            int sck = connected[i];
             sockets.push_back(sck);
             socketsCounters[sck] = messageOTF;
-            batchBuffers.emplace(std::piecewise_construct, std::forward_as_tuple(sck), std::forward_as_tuple(this->batchSize, ct, [this, sck](struct iovec* v, int size) -> bool {
+            auto& buffer = batchBuffers.emplace(std::piecewise_construct, std::forward_as_tuple(sck), std::forward_as_tuple(this->batchSize, ct, [this, sck](struct iovec* v, int size) -> bool {
                 
                 if (this->socketsCounters[sck] == 0 && this->waitAckFrom(sck) == -1){
                     error("Errore waiting ack from socket inside the callback\n");
@@ -256,9 +448,11 @@ public:
                 }
 
                 this->socketsCounters[sck]--;
+                this->updateDepth(sck);
 
                 return true;
-            }));
+            }, batchPolicy)).first->second;
+            buffer.stats = ff_dstats::instance().channel(gName, ep.groupName, ct, true);
 
             // compute the routing table!
             for(int dest : precomputedRT->operator[](ep.groupName).first)
@@ -269,23 +463,32 @@ public:
 				return -1;
 			}
 
-            FD_SET(sck, &set);
-            if (sck > fdmax) fdmax = sck;
+            if (poller.add(sck) < 0) {
+                error("Error registering the socket for the acks\n");
+                return -1;
+            }
+            withAcks = true;
         }
 
         // we can erase the list of endpoints
         this->dest_endpoints.clear();
 
+        startLinger();
         return 0;
     }
 
     message_t *svc(message_t* task) {
+        auto guard = batchGuard();
         int sck;
         //if (task->chid == -1) task->chid = 0;
         if (task->chid != -1)
             sck = dest2Socket[{task->chid, (task->feedback ? ChannelType::FBK : ChannelType::FWD)}];
         else {
-            sck = getMostFilledBufferSck(task->feedback); // get the most filled buffer socket or a rr socket
+            sck = getLeastLoadedSck(task->feedback);
+            if (sck < 0) {
+                error("No destination for the message (ff_dsender)\n");
+                return EOS;
+            }
         }
 
         if (batchBuffers[sck].push(task) == -1) {
@@ -296,6 +499,7 @@ public:
     }
 
     void eosnotify(ssize_t id) {
+        auto guard = batchGuard();
         for (const auto& sck : sockets)
             batchBuffers[sck].push(new message_t(id, -2));
 
@@ -305,48 +509,24 @@ public:
 				if (batchBuffers[sck].sendEOS()<0) {
 					error("sending EOS to external connections (ff_dsender)\n");
 				}										 
-				shutdown(sck, SHUT_WR);
+				shutdownOutput(sck);
 			}
 		}
     }
 
 	void svc_end() {
-		// here we wait all acks from all connections
-		size_t totalack = sockets.size()*messageOTF;
-		size_t currentack = 0;
-		for(const auto& [_, counter] : socketsCounters)
-			currentack += counter;
-
-		ack_t a;
-		while(currentack<totalack) {
-			for(auto scit = socketsCounters.begin(); scit != socketsCounters.end();) {
-				auto sck      = scit->first;
-				auto& counter = scit->second;
-				
-				switch(recvnnb(sck, (char*)&a, sizeof(a))) {
-				case 0:
-				case -1:
-					if (errno==EWOULDBLOCK) { ++scit; continue; }
-					currentack += (messageOTF-counter);
-					socketsCounters.erase(scit++);
-					break;
-				default: {
-					currentack++;
-					counter++;
-					++scit;
-				}
-				}
-			}
-		}
+		stopLinger();
+		waitAllAcks();
 		for(auto& sck : sockets) close(sck);
 	}
 };
 
 
 class ff_dsenderH : public ff_dsender {
-
+protected:
     std::vector<int> internalSockets;
     int last_rr_socket_Internal = -1;
+    int currentInternal = -1;
     int internalMessageOTF;
     bool squareBoxEOS = false;
 
@@ -375,20 +555,15 @@ class ff_dsenderH : public ff_dsender {
         return sck;
     }*/
 
-    int getMostFilledInternalBufferSck(){
-         int sckMax = 0;
-        int sizeMax = 0;
-        for(int sck : internalSockets){
-            auto& b = batchBuffers[sck];
-            if (b.size > sizeMax) {
-                sckMax = sck;
-                sizeMax = b.size;
-            }
-        }
-        if (sckMax > 0) return sckMax;
+    unsigned int maxOTF(int sck){
+        if (std::find(internalSockets.begin(), internalSockets.end(), sck) != internalSockets.end())
+            return internalMessageOTF;
+        return messageOTF;
+    }
 
-        last_rr_socket_Internal = (last_rr_socket_Internal + 1) % this->internalSockets.size();
-        return internalSockets[last_rr_socket_Internal];
+    // the other groups of the a2a, the local ones first (see leastLoaded)
+    int getLeastLoadedInternalSck(){
+        return leastLoaded(internalSockets, [](int) { return true; }, currentInternal, last_rr_socket_Internal);
     }
 
 public:
@@ -401,17 +576,16 @@ public:
         if (coreid!=-1)
 			ff_mapThreadToCpu(coreid);
 
-        FD_ZERO(&set);
-        FD_ZERO(&tmpset);
-		
-        for(const auto& [ct, endpoint] : this->dest_endpoints){
-            int sck = tryConnect(endpoint);
-            if (sck <= 0) return -1;
+        const std::vector<int> connected = connectDestinations();
+        if (connected.size() != this->dest_endpoints.size()) return -1;
+        for(size_t i = 0; i < this->dest_endpoints.size(); ++i){
+            const auto& [ct, endpoint] = this->dest_endpoints[i];
+            int sck = connected[i];
             bool isInternal = ct == ChannelType::INT;
             if (isInternal) internalSockets.push_back(sck);
             else sockets.push_back(sck);
             socketsCounters[sck] = isInternal ? internalMessageOTF : messageOTF;
-            batchBuffers.emplace(std::piecewise_construct, std::forward_as_tuple(sck), std::forward_as_tuple(this->batchSize, ct, [this, sck](struct iovec* v, int size) -> bool {
+            auto& buffer = batchBuffers.emplace(std::piecewise_construct, std::forward_as_tuple(sck), std::forward_as_tuple(this->batchSize, ct, [this, sck](struct iovec* v, int size) -> bool {
                 
                 if (this->socketsCounters[sck] == 0 && this->waitAckFrom(sck) == -1){
                     error("Errore waiting ack from socket inside the callback\n");
@@ -424,33 +598,45 @@ public:
                 }
 
                 this->socketsCounters[sck]--;
+                this->updateDepth(sck);
 
                 return true;
-            })); // change with the correct size
+            }, batchPolicy)).first->second; // change with the correct size
+            buffer.stats = ff_dstats::instance().channel(gName, endpoint.groupName, ct, true);
 
              for(int dest : precomputedRT->operator[](endpoint.groupName).first)
                 dest2Socket[std::make_pair(dest, ct)] = sck;
 
             if (handshakeHandler(sck, ct) < 0) return -1;
 
-            FD_SET(sck, &set);
-            if (sck > fdmax) fdmax = sck;
+            if (poller.add(sck) < 0) {
+                error("Error registering the socket for the acks\n");
+                return -1;
+            }
+            withAcks = true;
         }
 
         // we can erase the list of endpoints
         this->dest_endpoints.clear();
 
+        startLinger();
         return 0;
     }
 
     message_t *svc(message_t* task) {
+        auto guard = batchGuard();
         if (this->get_channel_id() == (ssize_t)(this->get_num_inchannels() - 1)){
             int sck;
             // pick destination from the list of internal connections!
             if (task->chid != -1){ // roundrobin over the destinations
                 sck = dest2Socket[{task->chid, ChannelType::INT}];
-            } else
-                sck = getMostFilledInternalBufferSck();
+            } else {
+                sck = getLeastLoadedInternalSck();
+                if (sck < 0) {
+                    error("No destination for the message (ff_dsenderH)\n");
+                    return EOS;
+                }
+            }
 
 
             if (batchBuffers[sck].push(task) == -1) {
@@ -464,6 +650,7 @@ public:
     }
 
      void eosnotify(ssize_t id) {
+         auto guard = batchGuard();
          if (id == (ssize_t)(this->get_num_inchannels() - 1)){
             // send the EOS to all the internal connections
             if (squareBoxEOS) return;
@@ -472,7 +659,7 @@ public:
                 if (batchBuffers[sck].sendEOS()<0) {
 					error("sending EOS to internal connections\n");
 				}					
-				shutdown(sck, SHUT_WR);
+				shutdownOutput(sck);
 			}
 		 }
 		 if (++neos >= this->get_num_inchannels()) {
@@ -482,7 +669,7 @@ public:
 				 if (batchBuffers[sck].sendEOS()<0) {
 					 error("sending EOS to external connections (ff_dsenderH)\n");
 				 }										 
-				 shutdown(sck, SHUT_WR);
+				 shutdownOutput(sck);
 			 }
 		 }
 
@@ -490,43 +677,8 @@ public:
 	 }
 
 	void svc_end() {
-		// here we wait all acks from all connections
-		size_t totalack  = internalSockets.size()*internalMessageOTF;
-		totalack        += sockets.size()*messageOTF;
-		size_t currentack = 0;
-		for(const auto& [sck, counter] : socketsCounters) {
-			currentack += counter;
-		}
-		
-		ack_t a;
-		while(currentack<totalack) {
-			for(auto scit = socketsCounters.begin(); scit != socketsCounters.end();) {
-				auto sck      = scit->first;
-				auto& counter = scit->second;
-
-				switch(recvnnb(sck, (char*)&a, sizeof(a))) {
-				case 0:
-				case -1: {
-					if (errno == EWOULDBLOCK) {
-						++scit;
-						continue;
-					}
-					decltype(internalSockets)::iterator it;
-					it = std::find(internalSockets.begin(), internalSockets.end(), sck);
-					if (it != internalSockets.end())
-						currentack += (internalMessageOTF-counter);
-					else
-						currentack += (messageOTF-counter);
-					socketsCounters.erase(scit++);
-				} break;
-				default: {
-					currentack++;
-					counter++;
-					++scit;					
-				}					
-				}
-			}
-		}
+		stopLinger();
+		waitAllAcks();
 		for(const auto& [sck, _] : socketsCounters) close(sck);
 	}
 	
@@ -50,7 +50,11 @@ protected:
             headers[idx+2] = m->chid;
             headers[idx+3] = m->data.getLen();
 
-            buffer.insert(buffer.end(), m->data.getPtr(), m->data.getPtr() + m->data.getLen());
+            if (auto pieces = m->data.getPieces())
+                for(const struct iovec& v : *pieces)
+                    buffer.insert(buffer.end(), (char*)v.iov_base, (char*)v.iov_base + v.iov_len);
+            else
+                buffer.insert(buffer.end(), m->data.getPtr(), m->data.getPtr() + m->data.getLen());
 
             delete m;
             if (actualSize == size_) {
@@ -98,6 +102,7 @@ protected:
             }
             int push(message_t* m){
                 waitCompletion();
+                m->data.flatten();
                 currHeader[1] = m->sender; currHeader[2] = m->chid; currHeader[3] = m->data.getLen();
                 MPI_Isend(currHeader, 4, MPI_LONG, this->rank, DFF_HEADER_TAG, MPI_COMM_WORLD, &this->headersR);
                 if (m->data.getLen() > 0)
@@ -0,0 +1,165 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_DSENDER_SHM_H
+#define FF_DSENDER_SHM_H
+
+#include <map>
+#include <thread>
+#include <type_traits>
+#include <ff/ff.hpp>
+#include <ff/distributed/ff_network.hpp>
+#include <ff/distributed/ff_shmchannel.hpp>
+#include <ff/distributed/ff_dsender.hpp>
+
+using namespace ff;
+
+/*
+ * Sender using the shared-memory channels (see ff_shmchannel.hpp).
+ * The routing, the batching and the EOS management are those of the base
+ * sender (ff_dsender or ff_dsenderH), the socket of each destination is
+ * replaced by the control connection of the channel and the batches are
+ * written in the slots of the channel. The back-pressure is given by the
+ * number of slots, hence no ack is exchanged.
+ */
+template<typename Base>
+class ff_dsenderSHM_t: public Base {
+protected:
+    std::map<int, shmChannel*> channels;   // control connection -> channel
+
+    // the control connections of all the destinations, at once (see connectAll)
+    std::vector<int> connectSHM() {
+        std::vector<std::vector<ff_sockaddr>> addrs;
+        for(const auto& [_, ep] : this->dest_endpoints) {
+            ff_sockaddr a;
+            memset(&a, 0, sizeof(a));
+            a.len = shmChannel::ctrlAddress(ep, *reinterpret_cast<struct sockaddr_un*>(&a.addr));
+            addrs.push_back({a});
+        }
+        return connectAll(addrs);
+    }
+
+    int handshakeSHM(int sck, shmChannel* ch, ChannelType t) {
+        shmHandshake h;
+        h.t    = t;
+        h.size = this->gName.size();
+        const int fds[3] = { ch->getMemFd(), ch->getDataFd(), ch->getSpaceFd() };
+        if (sendFds(sck, &h, sizeof(h), fds, 3) < 0 ||
+            writen(sck, this->gName.c_str(), h.size) < 0) {
+            error("Error sending the handshake on the control socket\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // writes in the channel the messages of a batch (see ff_batchBuffer), the
+    // data of a message can be in more pieces
+    static bool sendBatch(shmChannel* ch, struct iovec* v, int size) {
+        for(int i = 1; i+3 < size; ) {
+            const int    sender = ntohl(*reinterpret_cast<int*>(v[i].iov_base));
+            const int    chid   = ntohl(*reinterpret_cast<int*>(v[i+1].iov_base));
+            const size_t sz     = be64toh(*reinterpret_cast<size_t*>(v[i+2].iov_base));
+            const int    first  = i+3;
+            size_t got = v[first].iov_len;
+            for(i = first+1; got < sz; ++i) got += v[i].iov_len;
+            if (!ch->send(sender, chid, &v[first], sz))
+                return false;
+        }
+        return true;
+    }
+
+    // the slots of the channel in place of the credits
+    double load(int sck) override {
+        return channels[sck]->occupancy();
+    }
+
+public:
+    using Base::Base;
+
+    ~ff_dsenderSHM_t() {
+        for(auto& [_, ch] : channels) delete ch;
+    }
+
+    int svc_init() {
+        if (this->coreid!=-1)
+            ff_mapThreadToCpu(this->coreid);
+
+        // the data are copied in the memory of this host, compressing them does not pay
+        this->batchPolicy.compressAbove = 0;
+
+        const std::vector<int> connected = connectSHM();
+        if (connected.size() != this->dest_endpoints.size()) {
+            error("Error connecting to the destinations of group %s\n", this->gName.c_str());
+            return -1;
+        }
+        for(size_t i = 0; i < this->dest_endpoints.size(); ++i){
+            auto& [ct, ep] = this->dest_endpoints[i];
+            const int sck = connected[i];
+            shmChannel* ch = shmChannel::create();
+            if (!ch) {
+                error("Error creating the shared-memory channel\n");
+                return -1;
+            }
+            ch->setCtrl(sck);
+            channels[sck] = ch;
+
+            if constexpr (std::is_base_of_v<ff_dsenderH, Base>) {
+                if (ct == ChannelType::INT) this->internalSockets.push_back(sck);
+                else this->sockets.push_back(sck);
+            } else this->sockets.push_back(sck);
+
+            auto& buffer = this->batchBuffers.emplace(std::piecewise_construct, std::forward_as_tuple(sck), std::forward_as_tuple(this->batchSize, ct, [this, ch, sck](struct iovec* v, int size) -> bool {
+                if (!sendBatch(ch, v, size)) {
+                    error("Error writing on the shared-memory channel, the receiver has gone\n");
+                    return false;
+                }
+                this->batchBuffers[sck].stats->setDepth(ch->inUse());
+                return true;
+            }, this->batchPolicy)).first->second;
+            buffer.stats = ff_dstats::instance().channel(this->gName, ep.groupName, ct, true);
+
+            for(int dest : this->precomputedRT->operator[](ep.groupName).first)
+                this->dest2Socket[std::make_pair(dest, ct)] = sck;
+
+            if (handshakeSHM(sck, ch, ct) < 0) {
+                error("svc_init ff_dsenderSHM failed");
+                return -1;
+            }
+        }
+
+        // we can erase the list of endpoints
+        this->dest_endpoints.clear();
+
+        this->startLinger();
+        return 0;
+    }
+
+    // all the messages (and the EOS) are already in the channels
+    void svc_end() {
+        this->stopLinger();
+        for(auto& [_, ch] : channels) delete ch;
+        channels.clear();
+    }
+};
+
+using ff_dsenderSHM  = ff_dsenderSHM_t<ff_dsender>;
+using ff_dsenderHSHM = ff_dsenderSHM_t<ff_dsenderH>;
+
+#endif
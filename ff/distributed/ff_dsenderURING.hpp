@@ -0,0 +1,221 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_DSENDER_URING_H
+#define FF_DSENDER_URING_H
+
+#include <map>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/distributed/ff_network.hpp>
+#include <ff/distributed/ff_uring.hpp>
+#include <ff/distributed/ff_dsender.hpp>
+
+using namespace ff;
+
+/*
+ * Sender of the URING transport. The connections, the wire format and the
+ * credits are those of TCP, the routing, the batching and the EOS management
+ * are those of the base sender (ff_dsender or ff_dsenderH). The batches are
+ * written by the ring: the node does not wait for a batch to be written, it
+ * keeps the messages of the batch until the completion, which is collected
+ * without system calls when the next batch is sent. There is at most one
+ * write in flight per connection, the following batches are queued.
+ * Before waiting for the credits of a connection and before closing it all its
+ * batches are written.
+ * If the kernel does not provide io_uring the node works as the base sender.
+ */
+template<typename Base>
+class ff_dsenderURING_t: public Base {
+protected:
+    // a batch being written, it owns the data referred by its iovec
+    struct txBatch {
+        int                       count;       // header of the batch (network order)
+        std::vector<size_t>       lengths;
+        std::vector<struct iovec> iov;
+        std::vector<message_t*>   messages;
+        std::vector<char>         packed;      // a compressed batch (see ff_batchPolicy)
+        struct msghdr             mh;
+        size_t                    left = 0;    // bytes still to be written
+        size_t                    first = 0;   // first iovec not completely written
+
+        ~txBatch() { for(message_t* m : messages) delete m; }
+    };
+    struct txQueue {
+        std::deque<std::unique_ptr<txBatch>> batches;  // the first one is in flight
+        bool failed = false;
+    };
+    std::map<int, txQueue>    queues;
+    std::unique_ptr<ff_uring> ring;
+
+    // copies the header fields of the batch, the data stay in the messages
+    static txBatch* makeBatch(struct iovec* v, int size) {
+        txBatch* b = new txBatch;
+        if (size == 1) {
+            // compressed, the messages are no more needed
+            const char* p = static_cast<const char*>(v[0].iov_base);
+            b->packed.assign(p, p + v[0].iov_len);
+            b->iov.push_back({b->packed.data(), b->packed.size()});
+            b->left = b->packed.size();
+            memset(&b->mh, 0, sizeof(b->mh));
+            return b;
+        }
+        b->count = *reinterpret_cast<int*>(v[0].iov_base);
+        b->lengths.resize(ntohl(b->count));
+        b->iov.assign(v, v + size);
+        b->iov[0].iov_base = &b->count;
+        for(int i = 1, j = 0; i+3 < size; ++j) {
+            b->lengths[j] = *reinterpret_cast<size_t*>(v[i+2].iov_base);
+            b->iov[i+2].iov_base = &b->lengths[j];
+            const size_t sz  = be64toh(b->lengths[j]);
+            const int    first = i+3;
+            size_t got = v[first].iov_len;
+            for(i = first+1; got < sz; ++i) got += v[i].iov_len;
+        }
+        for(const struct iovec& x : b->iov) b->left += x.iov_len;
+        memset(&b->mh, 0, sizeof(b->mh));
+        return b;
+    }
+
+    // submits the write of the first batch of the queue (from the first byte not written)
+    bool start(int sck, txQueue& t) {
+        txBatch& b = *t.batches.front();
+        b.mh.msg_iov    = &b.iov[b.first];
+        b.mh.msg_iovlen = b.iov.size() - b.first;
+        struct io_uring_sqe* e = ring->sqe(IORING_OP_SENDMSG, sck, (__u64)sck);
+        if (!e && ring->submit() >= 0) e = ring->sqe(IORING_OP_SENDMSG, sck, (__u64)sck);
+        if (!e) {
+            error("Error submitting a batch on the ring\n");
+            t.failed = true;
+            return false;
+        }
+        e->addr = (__u64)(uintptr_t)&b.mh;
+        // the kernel completes the write of the whole batch
+        e->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        return true;
+    }
+
+    void completed(int sck, int res) {
+        txQueue& t = queues[sck];
+        if (t.batches.empty()) return;
+        if (res == -EINTR || res == -EAGAIN) {
+            start(sck, t);
+            return;
+        }
+        if (res < 0) {
+            error("Error sending a batch (errno=%d)\n", -res);
+            t.failed = true;
+            t.batches.clear();
+            return;
+        }
+        txBatch& b = *t.batches.front();
+        b.left -= res;
+        if (b.left) {
+            // partial write, the rest is written from where it stopped
+            size_t n = res;
+            while(n >= b.iov[b.first].iov_len) n -= b.iov[b.first++].iov_len;
+            b.iov[b.first].iov_base = static_cast<char*>(b.iov[b.first].iov_base) + n;
+            b.iov[b.first].iov_len -= n;
+            start(sck, t);
+            return;
+        }
+        t.batches.pop_front();
+        if (!t.batches.empty()) start(sck, t);
+    }
+
+    // submits the writes prepared and collects the completions, waiting for one if wait
+    bool progress(bool wait) {
+        if (ring->submit(wait ? 1 : 0) < 0) {
+            error("Error submitting on the ring (errno=%d)\n", errno);
+            return false;
+        }
+        ring->reap([this](__u64 data, int res) { completed((int)data, res); });
+        return true;
+    }
+
+    // waits for all the batches of the connection to be written
+    bool flushQueue(int sck) {
+        txQueue& t = queues[sck];
+        while(!t.batches.empty() && !t.failed)
+            if (!progress(true)) return false;
+        return !t.failed;
+    }
+
+    bool sendBatch(int sck, struct iovec* v, int size) {
+        txQueue& t = queues[sck];
+        if (t.failed) return false;
+        // the receiver gives back the credits of the batches it has received
+        if (this->socketsCounters[sck] == 0 && (!flushQueue(sck) || this->waitAckFrom(sck) == -1)) {
+            error("Error waiting ack from socket inside the callback\n");
+            return false;
+        }
+        t.batches.emplace_back(makeBatch(v, size));
+        if (size > 1) this->batchBuffers[sck].handOver(t.batches.back()->messages);
+        if (t.batches.size() == 1 && !start(sck, t)) return false;
+        if (!progress(false)) return false;
+        this->socketsCounters[sck]--;
+        this->updateDepth(sck);
+        return true;
+    }
+
+    void shutdownOutput(int sck) override {
+        if (ring) flushQueue(sck);
+        Base::shutdownOutput(sck);
+    }
+
+public:
+    using Base::Base;
+
+    int svc_init() {
+        if (Base::svc_init() < 0) return -1;
+        // the thread sleeps also on its input queue and on the acks, hence
+        // the requests have to progress without waiting on the ring
+        ring.reset(new ff_uring(URING_ENTRIES));
+        if (!ring->valid()) {
+            ring.reset();
+            return 0;
+        }
+        auto guard = this->batchGuard();
+        for(auto& [sck, buffer] : this->batchBuffers) {
+            queues[sck];
+            const int s = sck;
+            buffer.setCallback([this, s](struct iovec* v, int size) -> bool {
+                return sendBatch(s, v, size);
+            });
+        }
+        return 0;
+    }
+
+    void svc_end() {
+        this->stopLinger();
+        if (ring)
+            for(auto& [sck, _] : queues) flushQueue(sck);
+        Base::svc_end();
+        queues.clear();
+        ring.reset();
+    }
+};
+
+using ff_dsenderURING  = ff_dsenderURING_t<ff_dsender>;
+using ff_dsenderHURING = ff_dsenderURING_t<ff_dsenderH>;
+
+#endif
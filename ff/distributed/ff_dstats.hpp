@@ -0,0 +1,259 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_DSTATS_H
+#define FF_DSTATS_H
+
+/*
+ * Counters of the connections of a group, always collected. Each connection
+ * has its own counters, written only by the thread serving it (no atomic
+ * read-modify-write), they are read and aggregated only when dumped.
+ *
+ * The dump is enabled in the configuration file:
+ *
+ *     "statsPath"     : "/tmp/dff.%g.stats",   (%g is the name of the group)
+ *     "statsInterval" : 1000                    (milliseconds)
+ *
+ * the file is rewritten at each interval and at the end of the run. With
+ * "unix:<path>" the group listens on a Unix socket instead, each connection
+ * receives the dump (e.g. socat - UNIX-CONNECT:<path>). The rates are
+ * computed from the previous dump.
+ *
+ * One line per connection:
+ *   <group> >|< <peer> <channel type> msgs= bytes= batches= msg/s= B/s=
+ *   fill=      messages per batch over the batch size (sender only)
+ *   wait_ms=   time spent waiting for the credits (sender only)
+ *   depth=     batches not yet acknowledged (slots in use with SHM) on the
+ *              sender, batches whose credit is withheld on the receiver
+ */
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <ff/distributed/ff_network.hpp>
+
+// milliseconds between two dumps in a file
+#if !defined(DEFAULT_STATS_INTERVAL)
+#define DEFAULT_STATS_INTERVAL 1000
+#endif
+
+namespace ff {
+
+struct ff_dchannelStats {
+    using counter = std::atomic<uint64_t>;
+
+    std::string group, peer;
+    ChannelType ct;
+    bool        out;               // sender side
+
+    counter messages{0}, bytes{0}, batches{0};
+    counter slots{0};              // sum of the batch sizes, for the fill ratio
+    counter waitNs{0};
+    std::atomic<int64_t> depth{0};
+
+    ff_dchannelStats(const std::string& group, const std::string& peer, ChannelType ct, bool out)
+        : group(group), peer(peer), ct(ct), out(out) {}
+
+    // single writer
+    static void add(counter& c, uint64_t v) {
+        c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+    void batch(uint64_t m, uint64_t b, uint64_t size) {
+        add(messages, m); add(bytes, b); add(batches, 1); add(slots, size);
+    }
+    void message(uint64_t b) { add(messages, 1); add(bytes, b); }
+    void setDepth(int64_t d) { depth.store(d, std::memory_order_relaxed); }
+};
+
+class ff_dstats {
+    using clock = std::chrono::steady_clock;
+
+public:
+    static ff_dstats& instance() {
+        static ff_dstats s;
+        return s;
+    }
+
+    ~ff_dstats() { stop(); }
+
+    // the counters of a new connection, kept until the end of the process
+    std::shared_ptr<ff_dchannelStats> channel(const std::string& group, const std::string& peer, ChannelType ct, bool out) {
+        auto s = std::make_shared<ff_dchannelStats>(group, peer, ct, out);
+        std::lock_guard<std::mutex> lk(mtx);
+        channels.push_back({s, 0, 0});
+        return s;
+    }
+
+    void dump(std::ostream& os) {
+        std::lock_guard<std::mutex> lk(mtx);
+        const clock::time_point now = clock::now();
+        const double dt = std::chrono::duration<double>(now - (last.time_since_epoch().count() ? last : started)).count();
+        last = now;
+        os << "# dff stats, " << std::fixed << std::setprecision(3)
+           << std::chrono::duration<double>(now - started).count() << "s\n";
+        for(entry& e : channels) {
+            const ff_dchannelStats& s = *e.stats;
+            const uint64_t m = s.messages.load(std::memory_order_relaxed);
+            const uint64_t b = s.bytes.load(std::memory_order_relaxed);
+            const uint64_t n = s.batches.load(std::memory_order_relaxed);
+            const uint64_t k = s.slots.load(std::memory_order_relaxed);
+            os << s.group << (s.out ? " > " : " < ") << s.peer << ' ' << typeName(s.ct)
+               << " msgs=" << m << " bytes=" << b << " batches=" << n
+               << std::setprecision(1)
+               << " msg/s=" << (dt > 0 ? (m - e.messages) / dt : 0.0)
+               << " B/s="   << (dt > 0 ? (b - e.bytes) / dt : 0.0)
+               << std::setprecision(3);
+            if (s.out)
+                os << " fill=" << (k ? (double)m / k : 0.0)
+                   << " wait_ms=" << s.waitNs.load(std::memory_order_relaxed) / 1e6;
+            os << " depth=" << s.depth.load(std::memory_order_relaxed) << '\n';
+            e.messages = m;
+            e.bytes    = b;
+        }
+    }
+
+    /*
+     * Starts the thread dumping the counters in path ("unix:<path>" for a Unix
+     * socket) every intervalMs milliseconds.
+     */
+    bool start(const std::string& path, long intervalMs) {
+        if (path.empty() || worker.joinable()) return false;
+        interval = intervalMs > 0 ? intervalMs : DEFAULT_STATS_INTERVAL;
+        if (path.rfind("unix:", 0) == 0) {
+            sockPath = path.substr(5);
+            if (!listenOn(sockPath)) return false;
+        } else filePath = path;
+        if (!stopper.valid()) return false;
+        worker = std::thread([this] { run(); });
+        return true;
+    }
+
+    // the last dump is written before returning
+    void stop() {
+        if (!worker.joinable()) return;
+        stopper.notify();
+        worker.join();
+        if (listenSck >= 0) {
+            close(listenSck);
+            unlink(sockPath.c_str());
+            listenSck = -1;
+        }
+        if (!filePath.empty()) writeFile();
+    }
+
+private:
+    struct entry {
+        std::shared_ptr<ff_dchannelStats> stats;
+        uint64_t messages, bytes;   // at the previous dump
+    };
+
+    std::mutex        mtx;
+    std::list<entry>  channels;
+    clock::time_point started = clock::now(), last;
+    std::thread       worker;
+    ff_notifier       stopper;
+    std::string       filePath, sockPath;
+    int               listenSck = -1;
+    long              interval = DEFAULT_STATS_INTERVAL;
+
+    static const char* typeName(ChannelType ct) {
+        switch(ct) {
+        case ChannelType::FWD: return "FWD";
+        case ChannelType::INT: return "INT";
+        case ChannelType::FBK: return "FBK";
+        }
+        return "?";
+    }
+
+    bool listenOn(const std::string& p) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_LOCAL;
+        if (p.size() >= sizeof(addr.sun_path)) {
+            error("Stats socket path too long: %s\n", p.c_str());
+            return false;
+        }
+        strncpy(addr.sun_path, p.c_str(), sizeof(addr.sun_path)-1);
+        unlink(p.c_str());
+        if ((listenSck = socket(AF_LOCAL, SOCK_STREAM|SOCK_CLOEXEC, 0)) < 0 ||
+            bind(listenSck, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenSck, 8) < 0) {
+            error("Error listening on the stats socket %s\n", p.c_str());
+            if (listenSck >= 0) close(listenSck);
+            listenSck = -1;
+            return false;
+        }
+        return true;
+    }
+
+    // the readers never see a partial file
+    void writeFile() {
+        const std::string tmp = filePath + ".tmp";
+        {
+            std::ofstream f(tmp, std::ios::trunc);
+            if (!f) return;
+            dump(f);
+        }
+        if (rename(tmp.c_str(), filePath.c_str()) < 0)
+            error("Error writing the stats file %s\n", filePath.c_str());
+    }
+
+    void serve() {
+        const int c = accept(listenSck, nullptr, nullptr);
+        if (c < 0) return;
+        std::ostringstream os;
+        dump(os);
+        const std::string s = os.str();
+        if (writen(c, s.data(), s.size()) < 0) {} // the reader has gone
+        close(c);
+    }
+
+    void run() {
+        struct pollfd pfd[2] = {{stopper.fd(), POLLIN, 0}, {listenSck, POLLIN, 0}};
+        const int n = listenSck >= 0 ? 2 : 1;
+        clock::time_point next = clock::now() + std::chrono::milliseconds(interval);
+        for(;;) {
+            const long ms = std::chrono::duration_cast<std::chrono::milliseconds>(next - clock::now()).count();
+            const int r = poll(pfd, n, (filePath.empty() ? -1 : std::max(ms, 0L)));
+            if (r < 0 && errno != EINTR) return;
+            if (pfd[0].revents) return;
+            if (n > 1 && (pfd[1].revents & POLLIN)) serve();
+            if (!filePath.empty() && clock::now() >= next) {
+                writeFile();
+                next += std::chrono::milliseconds(interval);
+            }
+        }
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,198 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_LZ_H
+#define FF_LZ_H
+
+/*
+ * Small LZ77 codec (the block format of LZ4) used to compress the batches of
+ * the distributed channels (see ff_batchPolicy). Fast rather than effective:
+ * one hash probe per position, the repeated text of JSON-like payloads is
+ * found anyway.
+ *
+ * A block is a sequence of
+ *    token (literals length << 4 | match length - 4)
+ *    [more literals length] literals offset(2 bytes, LE) [more match length]
+ * the last one has only the literals. A length of 15 in the token continues
+ * in the following bytes (255 means more bytes follow).
+ */
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+namespace ff {
+namespace lz {
+
+// size of the hash table of the compressor (entries as power of 2)
+#if !defined(LZ_HASH_LOG)
+#define LZ_HASH_LOG 12
+#endif
+
+static constexpr size_t minMatch  = 4;
+static constexpr size_t lastLits  = 5;    // the block ends with literals
+static constexpr size_t matchLimit = 12;  // no match starts in the last bytes
+static constexpr size_t maxOffset = 65535;
+
+// maximum size of n bytes compressed
+static inline size_t bound(size_t n) { return n + n/255 + 16; }
+
+namespace detail {
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+static inline unsigned char* putLength(unsigned char* op, size_t v) {
+    for(; v >= 255; v -= 255) *op++ = 255;
+    *op++ = (unsigned char)v;
+    return op;
+}
+
+static inline bool getLength(const unsigned char*& ip, const unsigned char* iend, size_t& v) {
+    unsigned char b;
+    do {
+        if (ip == iend) return false;
+        b  = *ip++;
+        v += b;
+    } while(b == 255);
+    return true;
+}
+
+// length of the common prefix of a and b, at most n bytes
+static inline size_t common(const unsigned char* a, const unsigned char* b, size_t n) {
+    size_t len = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while(len + 8 <= n) {
+        uint64_t x, y;
+        memcpy(&x, a + len, 8);
+        memcpy(&y, b + len, 8);
+        if (x != y) return len + (__builtin_ctzll(x ^ y) >> 3);
+        len += 8;
+    }
+#endif
+    while(len < n && a[len] == b[len]) ++len;
+    return len;
+}
+
+static inline unsigned char* sequence(unsigned char* op, const unsigned char* lit, size_t nlit) {
+    unsigned char* token = op++;
+    *token = (unsigned char)(std::min<size_t>(nlit, 15) << 4);
+    if (nlit >= 15) op = putLength(op, nlit - 15);
+    if (nlit) memcpy(op, lit, nlit);
+    return op + nlit;
+}
+
+} // namespace detail
+
+/*
+ * Compresses the n bytes of src in dst, which has room for bound(n) bytes.
+ * It returns the size of the compressed data.
+ */
+static inline size_t compress(const char* src, size_t n, char* dst) {
+    using namespace detail;
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+    unsigned char*       op = reinterpret_cast<unsigned char*>(dst);
+    size_t anchor = 0;
+
+    if (n > matchLimit) {
+        uint32_t table[1 << LZ_HASH_LOG] = {0};
+        const size_t limit  = n - matchLimit;
+        const size_t mlimit = n - lastLits;
+        size_t ip = 1;
+        while(ip < limit) {
+            const uint32_t seq = read32(in + ip);
+            const uint32_t h   = hash(seq);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip;
+            if (ref >= ip || ip - ref > maxOffset || read32(in + ref) != seq) {
+                // the data not compressing are skipped faster and faster
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            while(ip > anchor && ref > 0 && in[ip-1] == in[ref-1]) { --ip; --ref; }
+            const size_t len = minMatch + common(in + ip + minMatch, in + ref + minMatch, mlimit - ip - minMatch);
+
+            unsigned char* token = op;
+            op = sequence(op, in + anchor, ip - anchor);
+            const size_t off = ip - ref;
+            *op++ = (unsigned char)(off & 0xff);
+            *op++ = (unsigned char)(off >> 8);
+            const size_t ml = len - minMatch;
+            *token |= (unsigned char)std::min<size_t>(ml, 15);
+            if (ml >= 15) op = putLength(op, ml - 15);
+
+            ip += len;
+            anchor = ip;
+            if (ip < limit) table[hash(read32(in + ip - 2))] = (uint32_t)(ip - 2);
+        }
+    }
+    op = detail::sequence(op, in + anchor, n - anchor);
+    return op - reinterpret_cast<unsigned char*>(dst);
+}
+
+/*
+ * Decompresses the n bytes of src in dst, which must be exactly len bytes.
+ * It returns false if the data are corrupted.
+ */
+static inline bool decompress(const char* src, size_t n, char* dst, size_t len) {
+    using namespace detail;
+    const unsigned char* ip   = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* iend = ip + n;
+    unsigned char*       op   = reinterpret_cast<unsigned char*>(dst);
+    unsigned char*       oend = op + len;
+
+    for(;;) {
+        if (ip == iend) return false;
+        const unsigned token = *ip++;
+        size_t nlit = token >> 4;
+        if (nlit == 15 && !getLength(ip, iend, nlit)) return false;
+        if (nlit > (size_t)(iend - ip) || nlit > (size_t)(oend - op)) return false;
+        if (nlit) memcpy(op, ip, nlit);
+        op += nlit;
+        ip += nlit;
+        if (ip == iend) return op == oend;
+
+        if (iend - ip < 2) return false;
+        const size_t off = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t ml = token & 15;
+        if (ml == 15 && !getLength(ip, iend, ml)) return false;
+        ml += minMatch;
+        if (off == 0 || off > (size_t)(op - reinterpret_cast<unsigned char*>(dst)) || ml > (size_t)(oend - op))
+            return false;
+        const unsigned char* ref = op - off;
+        if (off >= ml) memcpy(op, ref, ml);
+        else for(size_t i = 0; i < ml; ++i) op[i] = ref[i];   // the match repeats itself
+        op += ml;
+    }
+}
+
+} // namespace lz
+} // namespace ff
+
+#endif
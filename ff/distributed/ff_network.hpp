@@ -30,12 +30,28 @@
 #include <exception>
 #include <string>
 #include <utility>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <chrono>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <poll.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
 
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ff/config.hpp>
+#include <ff/utils.hpp>
 
 #define REMOTE
 
@@ -61,9 +77,18 @@
     #endif
 #endif
 
-enum Proto {TCP , MPI};
+enum Proto {TCP , MPI, SHM, URING};
 enum ChannelType {FWD, INT, FBK};
 
+/*
+ * Batch compression (see ff_batchPolicy). The sender tells it in the
+ * handshake (flag of the channel type), the batches actually compressed have
+ * the flag in the number of messages, followed by the sizes of the data
+ * before and after the compression (uint32_t, network order).
+ */
+#define DFF_HANDSHAKE_COMPRESSION 0x100
+#define DFF_BATCH_COMPRESSED      0x40000000
+
 class dataBuffer: public std::stringbuf {
 public:	
     dataBuffer()
@@ -94,7 +119,8 @@ public:
 
 	size_t getLen() const {
 		if (len>=0) return len;
-		return str().length();
+		// what has been written so far, without copying it as str() does
+		return std::max(pptr(), egptr()) - eback();
 	}
 	char* getPtr() const {
 		return eback();
@@ -104,15 +130,143 @@ public:
 		cleanup = false;
 	}
 
+	/*
+	 * The memory is owned by the transport (e.g. a slot of a shared-memory
+	 * channel, see ff_shmchannel.hpp), releaseF gives it back when the
+	 * buffer is destroyed.
+	 */
+	void lend(char p[], size_t len, std::function<void(void*)> releaseF) {
+		setg(p, p, p+len);
+		this->len = len;
+		this->cleanup = true;
+		this->borrowed = true;
+		freetaskF = std::move(releaseF);
+	}
+	bool isBorrowed() const { return borrowed; }
+
+	/*
+	 * Payload gathered from the memory of the object it has been serialized
+	 * from (see ff_zerocopy.hpp): the transport writes the pieces as they are
+	 * and the object is freed (freetaskF) when the buffer is destroyed.
+	 * getPtr() is the object, not the data.
+	 */
+	void gather(char* owner, std::vector<struct iovec>&& pieces, std::vector<uint64_t>&& sizes, size_t len) {
+		setg(owner, owner, owner);
+		this->len = len;
+		this->cleanup = true;
+		gathered.reset(new gathered_t{std::move(pieces), std::move(sizes)});
+	}
+	// the pieces of a gathered payload, NULL if the payload is contiguous
+	const std::vector<struct iovec>* getPieces() const {
+		return gathered ? &gathered->pieces : nullptr;
+	}
+
+	// makes a gathered payload contiguous, for the transports writing one buffer
+	void flatten() {
+		if (!gathered) return;
+		char* p = new char[len];
+		size_t off = 0;
+		for(const struct iovec& v : gathered->pieces) {
+			memcpy(p + off, v.iov_base, v.iov_len);
+			off += v.iov_len;
+		}
+		gathered.reset();
+		if (cleanup && freetaskF) freetaskF(getPtr());
+		freetaskF = nullptr;
+		setBuffer(p, len, true);
+	}
+
+	// copies a borrowed buffer into memory owned by the buffer itself so that
+	// it can be kept by the deserialized object (datacopied=false)
+	void own() {
+		if (!borrowed) return;
+		char* p = new char[len];
+		memcpy(p, getPtr(), len);
+		auto releaseF = std::move(freetaskF);
+		freetaskF = nullptr;
+		releaseF(getPtr());
+		setg(p, p, p+len);
+		borrowed = false;
+	}
+
 	std::function<void(void*)> freetaskF;
 	
 protected:	
+	struct gathered_t {
+		std::vector<struct iovec> pieces;
+		std::vector<uint64_t>     sizes;    // the pieces may refer to them
+	};
 	ssize_t len=-1;
 	bool cleanup = false;
+	bool borrowed = false;
+	std::unique_ptr<gathered_t> gathered;
 };
 
 using ffDbuffer = std::pair<char*, size_t>;
 
+/*
+ * Process-wide pool of memory blocks of Size bytes. Each thread keeps a cache
+ * of at most 2*Batch free blocks, the blocks in excess are moved Batch at a
+ * time to a global list from which the other threads refill their cache (the
+ * blocks are typically allocated by the receiver and released by the threads
+ * consuming the messages). The memory is never given back to the system.
+ */
+template<size_t Size, size_t Batch>
+class ff_blockPool {
+    struct block_t { block_t* next; };
+    struct list_t  { block_t* head; size_t n; };
+    struct global_t {
+        std::mutex m;
+        std::vector<list_t> lists;
+    };
+    struct cache_t {
+        list_t l = {nullptr, 0};
+        ~cache_t() { if (l.n) ff_blockPool::put(l); }
+    };
+    static_assert(Size >= sizeof(block_t) && Batch > 0);
+
+    static global_t& global() { static global_t* g = new global_t; return *g; }
+    static cache_t&  cache()  { thread_local cache_t c; return c; }
+
+    static void put(list_t l) {
+        global_t& g = global();
+        std::lock_guard<std::mutex> lk(g.m);
+        g.lists.push_back(l);
+    }
+    static bool get(list_t& l) {
+        global_t& g = global();
+        std::lock_guard<std::mutex> lk(g.m);
+        if (g.lists.empty()) return false;
+        l = g.lists.back();
+        g.lists.pop_back();
+        return true;
+    }
+public:
+    static void* alloc() {
+        list_t& l = cache().l;
+        if (!l.head && !get(l)) return ::operator new(Size);
+        block_t* b = l.head;
+        l.head = b->next;
+        --l.n;
+        return b;
+    }
+
+    static void release(void* p) {
+        list_t& l = cache().l;
+        block_t* b = static_cast<block_t*>(p);
+        b->next = l.head;
+        l.head  = b;
+        if (++l.n < 2*Batch) return;
+        block_t* last = l.head;
+        for(size_t i = 1; i < Batch; ++i) last = last->next;
+        list_t out = {l.head, Batch};
+        l.head = last->next;
+        l.n   -= Batch;
+        last->next = nullptr;
+        put(out);
+    }
+};
+
 struct message_t {
 	message_t(){}
     message_t(int sender, int chid) : sender(sender), chid(chid) {}
@@ -122,6 +276,17 @@ struct message_t {
 	int           chid;
     bool          feedback = false;
 	dataBuffer    data;
+
+	// the messages are recycled, they are allocated and deleted at high rate
+	// by different threads
+	static void* operator new(size_t sz) {
+		if (sz != sizeof(message_t)) return ::operator new(sz);
+		return ff_blockPool<sizeof(message_t), 256>::alloc();
+	}
+	static void operator delete(void* p, size_t sz) {
+		if (sz != sizeof(message_t)) return ::operator delete(p);
+		ff_blockPool<sizeof(message_t), 256>::release(p);
+	}
 };
 
 struct ack_t {
@@ -215,6 +380,269 @@ static inline ssize_t recvnnb(int fd, char *buf, size_t size) {
     return (size-left);
 }
 
+static inline int setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static inline int setBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+}
+
+/*
+ * True if the peer of the connection runs on this machine: Unix sockets,
+ * loopback addresses or the same address at both ends.
+ */
+static inline bool isSameHost(int sck) {
+    struct sockaddr_storage l, p;
+    socklen_t ll = sizeof(l), pl = sizeof(p);
+    if (getsockname(sck, (struct sockaddr*)&l, &ll) < 0 || getpeername(sck, (struct sockaddr*)&p, &pl) < 0)
+        return false;
+    switch(p.ss_family) {
+    case AF_LOCAL: return true;
+    case AF_INET: {
+        const struct sockaddr_in* a = reinterpret_cast<const struct sockaddr_in*>(&l);
+        const struct sockaddr_in* b = reinterpret_cast<const struct sockaddr_in*>(&p);
+        return (ntohl(b->sin_addr.s_addr) >> 24) == 127 || a->sin_addr.s_addr == b->sin_addr.s_addr;
+    }
+    case AF_INET6: {
+        const struct sockaddr_in6* a = reinterpret_cast<const struct sockaddr_in6*>(&l);
+        const struct sockaddr_in6* b = reinterpret_cast<const struct sockaddr_in6*>(&p);
+        if (IN6_IS_ADDR_LOOPBACK(&b->sin6_addr)) return true;
+        if (IN6_IS_ADDR_V4MAPPED(&b->sin6_addr) && b->sin6_addr.s6_addr[12] == 127) return true;
+        return memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(b->sin6_addr)) == 0;
+    }
+    }
+    return false;
+}
+
+// an address to connect to
+struct ff_sockaddr {
+    struct sockaddr_storage addr;
+    socklen_t len;
+};
+
+/*
+ * Connects to all the destinations concurrently, each one with the first of
+ * its addresses accepting the connection (e.g. the IPv6 and the IPv4 ones).
+ * The connections refused, because the receiver is not listening yet, are
+ * retried with an exponential backoff from CONNECT_BACKOFF_MIN to
+ * CONNECT_BACKOFF_MAX milliseconds, for at most CONNECT_TIMEOUT milliseconds.
+ * It returns the sockets (blocking) in the order of the destinations, an
+ * empty vector if some destination is not reachable.
+ */
+static inline std::vector<int> connectAll(const std::vector<std::vector<ff_sockaddr>>& dests) {
+    using clock = std::chrono::steady_clock;
+    struct attempt_t {
+        int    fd = -1;
+        size_t next = 0;                    // address tried
+        long   backoff = CONNECT_BACKOFF_MIN;
+        clock::time_point retryAt;
+    };
+    const size_t n = dests.size();
+    std::vector<attempt_t> at(n);
+    std::vector<int> sockets(n, -1);
+    std::vector<struct pollfd> pfds;
+    std::vector<size_t> waiting;
+    const clock::time_point deadline = clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT);
+    size_t left = n;
+
+    auto cleanup = [&]() {
+        for(size_t i = 0; i < n; ++i) {
+            if (at[i].fd >= 0) close(at[i].fd);
+            if (sockets[i] >= 0) close(sockets[i]);
+        }
+        return std::vector<int>();
+    };
+    auto connected = [&](size_t i) {
+        if (setBlocking(at[i].fd) < 0) return false;
+        sockets[i] = at[i].fd;
+        at[i].fd = -1;
+        --left;
+        return true;
+    };
+    // the next address is tried immediately, the first one after the backoff
+    auto failed = [&](size_t i, clock::time_point now) {
+        attempt_t& a = at[i];
+        close(a.fd);
+        a.fd = -1;
+        if (++a.next < dests[i].size()) {
+            a.retryAt = now;
+            return;
+        }
+        a.next    = 0;
+        a.retryAt = now + std::chrono::milliseconds(a.backoff);
+        a.backoff = std::min(2*a.backoff, (long)CONNECT_BACKOFF_MAX);
+    };
+
+    for(size_t i = 0; i < n; ++i)
+        if (dests[i].empty()) return cleanup();
+
+    while(left) {
+        clock::time_point now = clock::now();
+        if (now >= deadline) {
+            ff::error("Timeout connecting to the destinations\n");
+            return cleanup();
+        }
+        // starts the attempts due
+        for(size_t i = 0; i < n; ++i) {
+            attempt_t& a = at[i];
+            if (sockets[i] >= 0 || a.fd >= 0 || now < a.retryAt) continue;
+            const ff_sockaddr& d = dests[i][a.next];
+            if ((a.fd = socket(d.addr.ss_family, SOCK_STREAM, 0)) < 0 || setNonBlocking(a.fd) < 0) {
+                ff::error("Error creating socket\n");
+                return cleanup();
+            }
+            if (connect(a.fd, (const struct sockaddr*)&d.addr, d.len) == 0) {
+                if (!connected(i)) return cleanup();
+            } else if (errno != EINPROGRESS)
+                failed(i, now);
+        }
+        if (!left) break;
+
+        // waits for the connections in progress or for the next retry
+        pfds.clear();
+        waiting.clear();
+        clock::time_point wake = deadline;
+        for(size_t i = 0; i < n; ++i) {
+            if (sockets[i] >= 0) continue;
+            if (at[i].fd >= 0) {
+                pfds.push_back({at[i].fd, POLLOUT, 0});
+                waiting.push_back(i);
+            } else wake = std::min(wake, at[i].retryAt);
+        }
+        const long ms = std::chrono::ceil<std::chrono::milliseconds>(wake - now).count();
+        if (poll(pfds.data(), pfds.size(), (int)std::max(ms, 0L)) < 0 && errno != EINTR) {
+            ff::error("Error polling the connections\n");
+            return cleanup();
+        }
+        now = clock::now();
+        for(size_t k = 0; k < pfds.size(); ++k) {
+            if (!pfds[k].revents) continue;
+            const size_t i = waiting[k];
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(at[i].fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) err = errno;
+            if (err == 0) {
+                if (!connected(i)) return cleanup();
+            } else failed(i, now);
+        }
+    }
+    return sockets;
+}
+
+/*
+ * Readiness notification for a set of descriptors: epoll in edge-triggered
+ * mode on Linux, poll elsewhere. The users must consume all the data of a
+ * ready descriptor (i.e. until EAGAIN) before waiting again, so that the
+ * same code is correct with both the notification modes.
+ */
+class ff_poller {
+public:
+    ff_poller() {
+#if defined(__linux__)
+        efd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+    }
+    ~ff_poller() {
+#if defined(__linux__)
+        if (efd >= 0) close(efd);
+#endif
+    }
+    ff_poller(const ff_poller&) = delete;
+    ff_poller& operator=(const ff_poller&) = delete;
+
+    int add(int fd) {
+#if defined(__linux__)
+        struct epoll_event ev;
+        ev.events  = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = fd;
+        return epoll_ctl(efd, EPOLL_CTL_ADD, fd, &ev);
+#else
+        pfds.push_back({fd, POLLIN, 0});
+        return 0;
+#endif
+    }
+
+    int del(int fd) {
+#if defined(__linux__)
+        return epoll_ctl(efd, EPOLL_CTL_DEL, fd, NULL);
+#else
+        for(auto it = pfds.begin(); it != pfds.end(); ++it)
+            if (it->fd == fd) { pfds.erase(it); return 0; }
+        return -1;
+#endif
+    }
+
+    // fills fds with at most max ready descriptors, it returns their number
+    // (0 if interrupted or on timeout) or -1 on error
+    int wait(int* fds, int max, int timeout = -1) {
+#if defined(__linux__)
+        struct epoll_event evs[MAXPOLLEVENTS];
+        int n = epoll_wait(efd, evs, std::min(max, MAXPOLLEVENTS), timeout);
+        if (n < 0) return (errno == EINTR) ? 0 : -1;
+        for(int i = 0; i < n; ++i) fds[i] = evs[i].data.fd;
+        return n;
+#else
+        int n = poll(pfds.data(), pfds.size(), timeout);
+        if (n < 0) return (errno == EINTR) ? 0 : -1;
+        n = 0;
+        for(auto& p : pfds)
+            if (p.revents && n < max) fds[n++] = p.fd;
+        return n;
+#endif
+    }
+
+private:
+#if defined(__linux__)
+    int efd = -1;
+#else
+    std::vector<struct pollfd> pfds;
+#endif
+};
+
+/*
+ * Wakes up a thread waiting on a ff_poller from another thread: the read end
+ * is registered in the poller, notify can be called any number of times before
+ * the waiting thread drains the notifications.
+ */
+class ff_notifier {
+public:
+    ff_notifier() {
+        if (pipe(fds) < 0 || setNonBlocking(fds[0]) < 0 || setNonBlocking(fds[1]) < 0)
+            fds[0] = fds[1] = -1;
+    }
+    ~ff_notifier() {
+        if (fds[0] >= 0) { close(fds[0]); close(fds[1]); }
+    }
+    ff_notifier(const ff_notifier&) = delete;
+    ff_notifier& operator=(const ff_notifier&) = delete;
+
+    bool valid() const { return fds[0] >= 0; }
+    int  fd() const { return fds[0]; }
+
+    // a full pipe means there is already a notification pending
+    void notify() {
+        const char c = 0;
+        while(write(fds[1], &c, 1) < 0 && errno == EINTR);
+    }
+
+    void drain() {
+        char buf[64];
+        for(;;){
+            ssize_t r = read(fds[0], buf, sizeof(buf));
+            if (r > 0 || (r < 0 && errno == EINTR)) continue;
+            return;
+        }
+    }
+
+private:
+    int fds[2] = {-1, -1};
+};
+
 
 /*
     MPI DEFINES 
@@ -0,0 +1,400 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * Shared-memory channel between two groups running on the same host
+ * (protocol "SHM" in the JSON configuration file), Linux only.
+ *
+ * The sender creates a ring of fixed-size slots in an anonymous memory file
+ * (memfd) and two eventfds, and passes the three file descriptors to the
+ * receiver through the control connection (an abstract AF_UNIX socket whose
+ * name is derived from the endpoint of the receiving group).
+ *
+ * Each slot has a state: FREE -> FULL (written by the sender) -> BUSY (owned
+ * by a message of the receiver) -> FREE (the message has been deleted).
+ * A message fitting in one slot is not copied by the receiver, its
+ * dataBuffer points to the slot (see dataBuffer::lend), larger messages are
+ * split by the sender over consecutive slots and reassembled by the receiver.
+ *
+ * The eventfds are written only if the other side declared to be waiting
+ * (consWaiting/prodWaiting), so that in the common case no system call is
+ * executed on the data path.
+ */
+
+#ifndef FF_SHMCHANNEL_H
+#define FF_SHMCHANNEL_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <ff/config.hpp>
+#include <ff/sysdep.h>
+#include <ff/distributed/ff_network.hpp>
+
+// number of slots of a channel
+#if !defined(DEFAULT_SHM_SLOTS)
+#define DEFAULT_SHM_SLOTS       128
+#endif
+// size of a slot in bytes (header included)
+#if !defined(DEFAULT_SHM_SLOTSIZE)
+#define DEFAULT_SHM_SLOTSIZE    16384
+#endif
+// polling attempts before waiting on the eventfd
+#define SHM_SPIN_ROUNDS         1024
+// prefix of the (abstract) name of the control socket
+#define SHM_CTRL_PREFIX         "ffdff."
+
+class shmChannel {
+public:
+    enum { SLOT_FREE=0, SLOT_FULL=1, SLOT_BUSY=2 };
+
+    struct slot_t {
+        std::atomic<uint32_t> state;
+        uint32_t len;    // payload bytes in this slot
+        uint64_t size;   // total size of the message
+        int32_t  sender;
+        int32_t  chid;
+        char     padding[8];
+    };
+
+    struct header_t {
+        uint32_t nslots;
+        uint32_t slotsize;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> consWaiting;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> prodWaiting;
+        char padding[CACHE_LINE_SIZE-sizeof(std::atomic<uint32_t>)];
+    };
+
+    ~shmChannel() {
+        if (base) munmap(base, length);
+        if (memfd  >= 0) close(memfd);
+        if (dataFd >= 0) close(dataFd);
+        if (spaceFd>= 0) close(spaceFd);
+        if (ctrl   >= 0) close(ctrl);
+    }
+
+    // sender side, creates the memory of the channel
+    static shmChannel* create(size_t nslots=DEFAULT_SHM_SLOTS, size_t slotsize=DEFAULT_SHM_SLOTSIZE) {
+        slotsize = (slotsize + sizeof(slot_t)-1) & ~(sizeof(slot_t)-1);
+        if (slotsize <= sizeof(slot_t) || nslots == 0) return nullptr;
+        shmChannel* c = new shmChannel;
+        c->length  = sizeof(header_t) + nslots*slotsize;
+        c->memfd   = memfd_create("ffdff", MFD_CLOEXEC);
+        c->dataFd  = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        c->spaceFd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (c->memfd<0 || c->dataFd<0 || c->spaceFd<0 ||
+            ftruncate(c->memfd, c->length) < 0 || !c->map()) {
+            delete c;
+            return nullptr;
+        }
+        c->hdr->nslots   = (uint32_t)nslots;
+        c->hdr->slotsize = (uint32_t)slotsize;
+        c->hdr->consWaiting.store(0);
+        c->hdr->prodWaiting.store(0);
+        for(size_t i=0;i<nslots;++i) c->slot(i)->state.store(SLOT_FREE);
+        return c;
+    }
+
+    // receiver side, maps the memory received from the sender
+    static shmChannel* attach(int memfd, int dataFd, int spaceFd) {
+        shmChannel* c = new shmChannel;
+        c->memfd = memfd; c->dataFd = dataFd; c->spaceFd = spaceFd;
+        struct stat st;
+        if (fstat(memfd, &st) < 0 || (size_t)st.st_size < sizeof(header_t)) {
+            delete c;
+            return nullptr;
+        }
+        c->length = st.st_size;
+        if (!c->map() ||
+            c->length < sizeof(header_t) + (size_t)c->hdr->nslots*c->hdr->slotsize) {
+            delete c;
+            return nullptr;
+        }
+        return c;
+    }
+
+    // the name of the control socket of the group listening on 'ep'
+    static std::string ctrlName(const ff_endpoint& ep) {
+        if (ep.address.empty()) return SHM_CTRL_PREFIX + ep.groupName;
+        return SHM_CTRL_PREFIX + ep.address + ":" + std::to_string(ep.port);
+    }
+    static socklen_t ctrlAddress(const ff_endpoint& ep, struct sockaddr_un& addr) {
+        const std::string name = ctrlName(ep);
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_LOCAL;
+        const size_t n = std::min(name.size(), sizeof(addr.sun_path)-1);
+        memcpy(addr.sun_path+1, name.c_str(), n); // abstract namespace
+        return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + n);
+    }
+
+    int getMemFd()   const { return memfd;   }
+    int getDataFd()  const { return dataFd;  }
+    int getSpaceFd() const { return spaceFd; }
+    int getCtrl()    const { return ctrl;    }
+    void setCtrl(int fd)   { ctrl = fd;      }
+
+    inline size_t payload() const { return hdr->slotsize - sizeof(slot_t); }
+
+    /* ------------------------- sender side ------------------------- */
+
+    // returns false if the receiver has gone
+    bool send(int sender, int chid, const char* data, size_t size) {
+        struct iovec v = { const_cast<char*>(data), size };
+        return send(sender, chid, &v, size);
+    }
+
+    // the data are gathered from the pieces in v, size bytes in total
+    bool send(int sender, int chid, const struct iovec* v, size_t size) {
+        size_t off = 0, voff = 0;
+        do {
+            slot_t* s = slot(head);
+            if (s->state.load(std::memory_order_acquire) != SLOT_FREE && !waitSpace(s))
+                return false;
+            const size_t len = std::min(size-off, payload());
+            for(size_t k = 0; k < len; ) {
+                const size_t n = std::min(len-k, v->iov_len-voff);
+                memcpy(payloadOf(s)+k, (const char*)v->iov_base+voff, n);
+                k += n; voff += n;
+                if (voff == v->iov_len) { ++v; voff = 0; }
+            }
+            s->len    = (uint32_t)len;
+            s->size   = size;
+            s->sender = sender;
+            s->chid   = chid;
+            s->state.store(SLOT_FULL, std::memory_order_seq_cst);
+            head = (head+1) % hdr->nslots;
+            off += len;
+            if (hdr->consWaiting.load(std::memory_order_seq_cst) && hdr->consWaiting.exchange(0))
+                notify(dataFd);
+        } while(off < size);
+        return true;
+    }
+
+    // slots not given back yet, approximate: the slots lent to the messages
+    // can be given back out of order
+    size_t inUse() const {
+        size_t n = 0;
+        for(size_t i = head + hdr->nslots - 1; n < hdr->nslots; --i, ++n)
+            if (slot(i % hdr->nslots)->state.load(std::memory_order_acquire) == SLOT_FREE) break;
+        return n;
+    }
+    double occupancy() const { return (double)inUse() / hdr->nslots; }
+
+    /* ------------------------ receiver side ------------------------ */
+
+    // true if there is a message to receive
+    inline bool ready() const {
+        return slot(tail)->state.load(std::memory_order_acquire) == SLOT_FULL;
+    }
+
+    /*
+     * Returns the next message (NULL if the channel is empty). If the message
+     * fits in one slot the data are not copied, the slot is given back when
+     * the message is deleted, hence 'self' has to own this channel.
+     * A message with no data is an EOS (see ff_dreceiver::handleRequest).
+     */
+    message_t* receive(const std::shared_ptr<shmChannel>& self) {
+        slot_t* s = slot(tail);
+        if (s->state.load(std::memory_order_acquire) != SLOT_FULL) return nullptr;
+        s->state.store(SLOT_BUSY, std::memory_order_relaxed);
+        tail = (tail+1) % hdr->nslots;
+
+        message_t* m = new message_t(s->sender, s->chid);
+        const size_t size = s->size;
+        if (size == 0) {
+            release(s);
+            return m;
+        }
+        if (s->len == size) {
+            m->data.lend(payloadOf(s), size, [self, s](void*) { self->release(s); });
+            return m;
+        }
+        char* buff = new char[size];
+        size_t off = s->len;
+        memcpy(buff, payloadOf(s), off);
+        release(s);
+        while(off < size) {
+            s = slot(tail);
+            if (s->state.load(std::memory_order_acquire) != SLOT_FULL && !waitData(s)) {
+                delete [] buff;
+                delete m;
+                return nullptr;
+            }
+            memcpy(buff+off, payloadOf(s), s->len);
+            off += s->len;
+            tail = (tail+1) % hdr->nslots;
+            release(s);
+        }
+        m->data.setBuffer(buff, size);
+        return m;
+    }
+
+    /*
+     * To be called before waiting on the data eventfd. It returns false if
+     * in the meantime a message arrived, in that case the receiver must not
+     * wait.
+     */
+    bool prepareWait() {
+        hdr->consWaiting.store(1, std::memory_order_seq_cst);
+        if (ready()) {
+            hdr->consWaiting.store(0, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+    void clearWait() {
+        uint64_t v;
+        hdr->consWaiting.store(0, std::memory_order_relaxed);
+        while(read(dataFd, &v, sizeof(v)) > 0);
+    }
+
+    // gives back a slot to the sender
+    void release(slot_t* s) {
+        s->state.store(SLOT_FREE, std::memory_order_seq_cst);
+        if (hdr->prodWaiting.load(std::memory_order_seq_cst) && hdr->prodWaiting.exchange(0))
+            notify(spaceFd);
+    }
+
+protected:
+    shmChannel() {}
+
+    bool map() {
+        void* p = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (p == MAP_FAILED) return false;
+        base = (char*)p;
+        hdr  = (header_t*)base;
+        return true;
+    }
+
+    inline slot_t* slot(size_t i) const {
+        return (slot_t*)(base + sizeof(header_t) + i*hdr->slotsize);
+    }
+    static inline char* payloadOf(slot_t* s) { return (char*)(s+1); }
+
+    static inline void notify(int fd) {
+        const uint64_t one = 1;
+        if (write(fd, &one, sizeof(one)) < 0) {} // the counter cannot overflow
+    }
+
+    // waits on fd until the slot is in the given state, the other side of
+    // the channel is monitored through the control connection
+    bool waitState(slot_t* s, uint32_t st, std::atomic<uint32_t>& waiting, int fd) {
+        for(int i=0;i<SHM_SPIN_ROUNDS;++i) {
+            if (s->state.load(std::memory_order_acquire) == st) return true;
+            PAUSE();
+        }
+        struct pollfd pfd[2];
+        pfd[0].fd = fd;   pfd[0].events = POLLIN;
+        pfd[1].fd = ctrl; pfd[1].events = 0;   // POLLHUP/POLLERR only
+        for(;;) {
+            waiting.store(1, std::memory_order_seq_cst);
+            if (s->state.load(std::memory_order_seq_cst) == st) {
+                waiting.store(0, std::memory_order_relaxed);
+                return true;
+            }
+            if (poll(pfd, (ctrl>=0)?2:1, 100) < 0 && errno != EINTR) return false;
+            uint64_t v;
+            while(read(fd, &v, sizeof(v)) > 0);
+            if ((ctrl>=0) && (pfd[1].revents & (POLLHUP|POLLERR)) &&
+                s->state.load(std::memory_order_acquire) != st) return false;
+        }
+        return false;
+    }
+    inline bool waitSpace(slot_t* s) { return waitState(s, SLOT_FREE, hdr->prodWaiting, spaceFd); }
+    inline bool waitData(slot_t* s)  { return waitState(s, SLOT_FULL, hdr->consWaiting, dataFd);  }
+
+protected:
+    char*     base   = nullptr;
+    header_t* hdr    = nullptr;
+    size_t    length = 0;
+    size_t    head   = 0;   // sender only
+    size_t    tail   = 0;   // receiver only
+    int       memfd  = -1;
+    int       dataFd = -1;
+    int       spaceFd= -1;
+    int       ctrl   = -1;
+};
+
+
+/*
+ * Handshake sent by the sender on the control connection together with the
+ * file descriptors of the channel, it is followed by the group name.
+ */
+struct shmHandshake {
+    ChannelType t;
+    size_t      size;
+};
+
+/*
+ * File descriptors passing over the control connection.
+ */
+static inline int sendFds(int sck, const void* buf, size_t len, const int* fds, int nfds) {
+    struct iovec iov;
+    iov.iov_base = const_cast<void*>(buf);
+    iov.iov_len  = len;
+    char cbuf[CMSG_SPACE(sizeof(int)*4)];
+    memset(cbuf, 0, sizeof(cbuf));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = cbuf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int)*nfds);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(int)*nfds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int)*nfds);
+    if (sendmsg(sck, &msg, 0) != (ssize_t)len) return -1;
+    return 0;
+}
+
+static inline int recvFds(int sck, void* buf, size_t len, int* fds, int nfds) {
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len  = len;
+    char cbuf[CMSG_SPACE(sizeof(int)*4)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = cbuf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int)*nfds);
+    ssize_t r = recvmsg(sck, &msg, MSG_CMSG_CLOEXEC|MSG_WAITALL);
+    if (r <= 0) return (int)r;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int)*nfds)) return -1;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int)*nfds);
+    return (int)r;
+}
+
+#endif /* FF_SHMCHANNEL_H */
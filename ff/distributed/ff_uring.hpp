@@ -0,0 +1,211 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_URING_H
+#define FF_URING_H
+
+/*
+ * Minimal io_uring ring (no liburing needed): the requests are prepared in
+ * the submission queue and submitted all together with one system call,
+ * which also waits for the completions. Used by the URING transport (see
+ * ff_dsenderURING.hpp and ff_dreceiverURING.hpp).
+ */
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+// entries of the submission queue
+#if !defined(URING_ENTRIES)
+#define URING_ENTRIES 256
+#endif
+
+class ff_uring {
+public:
+    /*
+     * The setup flags not supported by the kernel are dropped. With
+     * IORING_SETUP_COOP_TASKRUN the requests progress only when the thread
+     * waits on the ring, it cannot be used by a thread sleeping elsewhere
+     * with requests in flight.
+     */
+    explicit ff_uring(unsigned entries = URING_ENTRIES, unsigned flags = 0) {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        p.flags = flags;
+        fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0 && errno == EINVAL && flags) {
+            memset(&p, 0, sizeof(p));
+            fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+        }
+        if (fd < 0) return;
+        // waiting with a timeout needs EXT_ARG (Linux 5.11)
+        if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP) || !map(p)) {
+            unmap();
+            close(fd);
+            fd = -1;
+        }
+    }
+    ~ff_uring() {
+        if (fd < 0) return;
+        unmap();
+        close(fd);
+    }
+    ff_uring(const ff_uring&) = delete;
+    ff_uring& operator=(const ff_uring&) = delete;
+
+    bool valid() const { return fd >= 0; }
+
+    // false if the kernel does not support io_uring (or it is not allowed)
+    static bool available() {
+        ff_uring r(2);
+        return r.valid();
+    }
+
+    /*
+     * A new request, NULL if the submission queue is full (the requests
+     * already prepared have to be submitted first).
+     */
+    struct io_uring_sqe* sqe(__u8 opcode, int fd, __u64 data) {
+        const unsigned head = __atomic_load_n(sq.head, __ATOMIC_ACQUIRE);
+        if (sqTail - head >= *sq.entries) return nullptr;
+        const unsigned idx = sqTail & *sq.mask;
+        struct io_uring_sqe* e = &sqes[idx];
+        memset(e, 0, sizeof(*e));
+        e->opcode    = opcode;
+        e->fd        = fd;
+        e->user_data = data;
+        sq.array[idx] = idx;
+        ++sqTail;
+        return e;
+    }
+
+    // number of requests prepared and not yet submitted
+    unsigned prepared() const { return sqTail - submitted; }
+
+    /*
+     * Submits the prepared requests and waits for at least 'wait' completions,
+     * for at most timeoutNs nanoseconds if not negative. It returns the number
+     * of requests submitted or -1 on error (the timeout and the signals are
+     * not errors).
+     */
+    int submit(unsigned wait = 0, long timeoutNs = -1) {
+        __atomic_store_n(sq.tail, sqTail, __ATOMIC_RELEASE);
+        const unsigned n = prepared();
+        unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        void*  argp = nullptr;
+        size_t argsz = 0;
+        if (wait && timeoutNs >= 0) {
+            ts.tv_sec  = timeoutNs / 1000000000L;
+            ts.tv_nsec = timeoutNs % 1000000000L;
+            memset(&arg, 0, sizeof(arg));
+            arg.sigmask_sz = _NSIG/8;
+            arg.ts = (__u64)(uintptr_t)&ts;
+            argp  = &arg;
+            argsz = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+        for(;;) {
+            int r = (int)syscall(__NR_io_uring_enter, fd, n, wait, flags, argp, argsz);
+            if (r >= 0) { submitted += r; return r; }
+            if (errno == EINTR || errno == ETIME) return 0;
+            // no resources for the completions, they have to be reaped first
+            if (errno == EBUSY || errno == EAGAIN) return 0;
+            return -1;
+        }
+    }
+
+    // calls f(user_data, res) for each completion available, it returns their number
+    template<typename F>
+    unsigned reap(F&& f) {
+        unsigned head = *cq.head, n = 0;
+        for(;;) {
+            const unsigned tail = __atomic_load_n(cq.tail, __ATOMIC_ACQUIRE);
+            if (head == tail) break;
+            for(; head != tail; ++head, ++n) {
+                const struct io_uring_cqe& c = cq.cqes[head & *cq.mask];
+                f(c.user_data, c.res);
+            }
+            __atomic_store_n(cq.head, head, __ATOMIC_RELEASE);
+        }
+        return n;
+    }
+
+private:
+    struct {
+        unsigned *head, *tail, *mask, *entries, *array;
+    } sq;
+    struct {
+        unsigned *head, *tail, *mask;
+        struct io_uring_cqe* cqes;
+    } cq;
+    struct io_uring_sqe* sqes = nullptr;
+    void*    sqRing = MAP_FAILED;
+    void*    cqRing = MAP_FAILED;
+    size_t   sqSize = 0, cqSize = 0, sqesSize = 0;
+    unsigned sqTail = 0, submitted = 0;
+    int      fd = -1;
+
+    bool map(const struct io_uring_params& p) {
+        sqSize = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+        cqSize = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+        const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqSize = cqSize = std::max(sqSize, cqSize);
+        sqRing = mmap(nullptr, sqSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        cqRing = single ? sqRing : mmap(nullptr, cqSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) return false;
+        sqesSize = p.sq_entries*sizeof(struct io_uring_sqe);
+        void* s = mmap(nullptr, sqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (s == MAP_FAILED) return false;
+        sqes = reinterpret_cast<struct io_uring_sqe*>(s);
+
+        char* sb = reinterpret_cast<char*>(sqRing);
+        sq.head    = reinterpret_cast<unsigned*>(sb + p.sq_off.head);
+        sq.tail    = reinterpret_cast<unsigned*>(sb + p.sq_off.tail);
+        sq.mask    = reinterpret_cast<unsigned*>(sb + p.sq_off.ring_mask);
+        sq.entries = reinterpret_cast<unsigned*>(sb + p.sq_off.ring_entries);
+        sq.array   = reinterpret_cast<unsigned*>(sb + p.sq_off.array);
+        char* cb = reinterpret_cast<char*>(cqRing);
+        cq.head    = reinterpret_cast<unsigned*>(cb + p.cq_off.head);
+        cq.tail    = reinterpret_cast<unsigned*>(cb + p.cq_off.tail);
+        cq.mask    = reinterpret_cast<unsigned*>(cb + p.cq_off.ring_mask);
+        cq.cqes    = reinterpret_cast<struct io_uring_cqe*>(cb + p.cq_off.cqes);
+        sqTail = submitted = *sq.tail;
+        return true;
+    }
+
+    void unmap() {
+        if (sqes) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqSize);
+        sqes = nullptr;
+        sqRing = cqRing = MAP_FAILED;
+    }
+};
+
+#endif
@@ -261,9 +261,12 @@ public:
 				mi->set_input_channelid(channelid, !msg->feedback);
 			}
 			bool datacopied=true;
-			out = n->svc(this->n->deserializeF(msg->data, datacopied));
+			void* inputData = this->n->deserializeF(msg->data, datacopied);
 			if (!datacopied) msg->data.doNotCleanup();
+			// the memory lent by the transport (e.g. a slot of a shared-memory
+			// channel) is given back before running the node
 			delete msg;
+			out = n->svc(inputData);
 		}  else // it can happen if we have a feedback channel
 			out = n->svc(nullptr);
         serialize(out, defaultDestination);
@@ -0,0 +1,232 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_ZEROCOPY_H
+#define FF_ZEROCOPY_H
+
+/*
+ * Serialization without archives for the tasks whose memory can be sent as it
+ * is. The sender writes the task memory directly (writev), the task is freed
+ * once it has been sent; the receiver copies the data in the new task.
+ *
+ *  - trivially copyable types opt in to be sent as raw bytes specializing
+ *    ff::traits::is_raw_copyable:
+ *
+ *        template<> struct ff::traits::is_raw_copyable<point_t>: std::true_type {};
+ *
+ *    (not the default: the padding, the pointers and the byte order of the
+ *    host would become the wire format of the type);
+ *
+ *  - other types opt in exposing their contiguous pieces:
+ *
+ *        struct record {
+ *            header_t            h;
+ *            std::vector<double> values;
+ *            template<class S> void spans(S& s) { s(h, values); }
+ *        };
+ *
+ *    the pieces can be trivially copyable objects and std::vector or
+ *    std::basic_string of trivially copyable elements (whose size is sent).
+ *
+ * The data are in the representation of the host, the groups exchanging these
+ * tasks must run on machines with the same data layout.
+ */
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <type_traits>
+#include <ff/config.hpp>
+#include <ff/distributed/ff_network.hpp>
+
+namespace ff {
+
+class spanWriter;
+class spanReader;
+
+namespace traits {
+
+// to be specialized as std::true_type, see above
+template<class T>
+struct is_raw_copyable: std::false_type {};
+
+template<class T>
+inline constexpr bool is_raw_copyable_v = is_raw_copyable<T>::value &&
+                                          std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>;
+
+template<class T, class = void>
+struct has_spans: std::false_type {};
+
+template<class T>
+struct has_spans<T, std::void_t<decltype(std::declval<T&>().spans(std::declval<spanWriter&>())),
+                                decltype(std::declval<T&>().spans(std::declval<spanReader&>()))>>: std::true_type {};
+
+template<class T>
+inline constexpr bool has_spans_v = has_spans<T>::value;
+
+// the task is sent with zerocopySerialize/zerocopyDeserialize
+template<class T>
+inline constexpr bool is_zerocopy_v = has_spans_v<T> || is_raw_copyable_v<T>;
+
+template<class T>
+struct is_span_container: std::false_type {};
+template<class T, class A>
+struct is_span_container<std::vector<T, A>>: std::bool_constant<std::is_trivially_copyable_v<T>> {};
+template<class C, class Tr, class A>
+struct is_span_container<std::basic_string<C, Tr, A>>: std::true_type {};
+
+}
+
+// collects the pieces of an object to be sent
+class spanWriter {
+public:
+    template<typename... Ts>
+    void operator()(Ts&... xs) { (put(xs), ...); }
+
+    /*
+     * Sets the payload of the buffer. It returns false if the buffer refers to
+     * the object (the object has to be kept until the buffer is destroyed),
+     * true if the data have been copied because they are too fragmented.
+     */
+    bool finish(char* owner, dataBuffer& b) {
+        std::vector<struct iovec> v;
+        v.reserve(pieces.size());
+        for(const piece_t& p : pieces) {
+            const char* base = p.sizeIdx < 0 ? p.base : reinterpret_cast<const char*>(&sizes[p.sizeIdx]);
+            // adjacent fields are written at once
+            if (!v.empty() && (const char*)v.back().iov_base + v.back().iov_len == base)
+                v.back().iov_len += p.len;
+            else
+                v.push_back({const_cast<char*>(base), p.len});
+        }
+        if (v.size() <= MAXDATASPANS) {
+            b.gather(owner, std::move(v), std::move(sizes), len);
+            return false;
+        }
+        char* data = new char[len];
+        size_t off = 0;
+        for(const struct iovec& p : v) {
+            memcpy(data + off, p.iov_base, p.iov_len);
+            off += p.iov_len;
+        }
+        b.setBuffer(data, len);
+        return true;
+    }
+
+private:
+    struct piece_t {
+        const char* base;
+        size_t      len;
+        long        sizeIdx;    // the piece is a size (sizes may be reallocated)
+    };
+
+    template<typename T>
+    void put(T& x) {
+        if constexpr (traits::is_span_container<std::remove_cv_t<T>>::value) {
+            sizes.push_back(htobe64((uint64_t)x.size()));
+            pieces.push_back({nullptr, sizeof(uint64_t), (long)sizes.size()-1});
+            len += sizeof(uint64_t);
+            add(x.data(), x.size()*sizeof(typename T::value_type));
+        } else {
+            static_assert(std::is_trivially_copyable_v<T>, "spans: the pieces must be trivially copyable or vectors of trivially copyable elements");
+            add(&x, sizeof(T));
+        }
+    }
+    void add(const void* p, size_t n) {
+        if (n == 0) return;
+        pieces.push_back({reinterpret_cast<const char*>(p), n, -1});
+        len += n;
+    }
+
+    std::vector<piece_t>  pieces;
+    std::vector<uint64_t> sizes;
+    size_t len = 0;
+};
+
+// fills an object with the pieces received, in the order they have been sent
+class spanReader {
+public:
+    spanReader(const char* p, size_t len): p(p), left(len) {}
+
+    template<typename... Ts>
+    void operator()(Ts&... xs) { (get(xs), ...); }
+
+    // all the data have been consumed, and only them
+    bool done() const { return ok && left == 0; }
+
+private:
+    template<typename T>
+    void get(T& x) {
+        if constexpr (traits::is_span_container<std::remove_cv_t<T>>::value) {
+            uint64_t n;
+            if (!take(&n, sizeof(n))) return;
+            n = be64toh(n);
+            if (n > left/sizeof(typename T::value_type)) { ok = false; return; }
+            x.resize(n);
+            take(x.data(), n*sizeof(typename T::value_type));
+        } else {
+            take(&x, sizeof(T));
+        }
+    }
+    bool take(void* dst, size_t n) {
+        if (!ok || n > left) return ok = false;
+        if (n) memcpy(dst, p, n);
+        p += n; left -= n;
+        return true;
+    }
+
+    const char* p;
+    size_t      left;
+    bool        ok = true;
+};
+
+/*
+ * The serializeF/deserializeF of the nodes (see ff_node_t) for the types sent
+ * without archives. They have the same return values of the user defined
+ * serialize (true if the data have been copied) and deserialize.
+ */
+template<typename T>
+bool zerocopySerialize(T* in, dataBuffer& b) {
+    if constexpr (traits::has_spans_v<T>) {
+        spanWriter w;
+        in->spans(w);
+        return w.finish(reinterpret_cast<char*>(in), b);
+    } else {
+        b.setBuffer(reinterpret_cast<char*>(in), sizeof(T));
+        return false;
+    }
+}
+
+template<typename T>
+bool zerocopyDeserialize(dataBuffer& b, T* out) {
+    if constexpr (traits::has_spans_v<T>) {
+        spanReader r(b.getPtr(), b.getLen());
+        out->spans(r);
+        return r.done();
+    } else {
+        if (b.getLen() != sizeof(T)) return false;
+        memcpy(reinterpret_cast<void*>(out), b.getPtr(), sizeof(T));
+        return true;
+    }
+}
+
+}
+
+#endif
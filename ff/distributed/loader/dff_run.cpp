@@ -30,6 +30,7 @@
 #include <sys/wait.h>
 #include <sys/param.h>
 #include <fcntl.h>
+#include <poll.h>
 
 
 #include <cereal/cereal.hpp>
@@ -272,15 +273,27 @@ int main(int argc, char** argv) {
 
     if (usedProtocol == Proto::TCP){
         auto Tstart = getusec();
+        // the groups are all started before reading their output, so that
+        // their startups (and the ssh connections) overlap
         for (G& g : parsedGroups)
             g.run();
         
+        std::vector<struct pollfd> pfds;
         while(!allTerminated(parsedGroups)){
+            // waits for the output (or the termination) of any group
+            pfds.clear();
+            for(G& g : parsedGroups)
+                if (g.file != nullptr) pfds.push_back({g.fd, POLLIN, 0});
+            if (poll(pfds.data(), pfds.size(), -1) < 0 && errno != EINTR){
+                perror("poll");
+                break;
+            }
+
             for(G& g : parsedGroups){
                 if (g.file != nullptr){
                     char buff[1024] = { 0 };
                     
-                    ssize_t result = read(g.fd, buff, sizeof(buff));
+                    ssize_t result = read(g.fd, buff, sizeof(buff)-1);
                     if (result == -1){
                         if (errno == EAGAIN)
                             continue;
@@ -299,8 +312,6 @@ int main(int argc, char** argv) {
                     }
                 }
             }
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(15));
         }
         std::cout << "Elapsed time: " << (getusec()-(Tstart))/1000 << " ms" << std::endl;
     }
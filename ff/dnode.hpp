@@ -285,6 +285,20 @@ protected:
         return pop(ptr);
     }
 
+    // the batched versions move one message at a time on the network channel
+    virtual inline size_t push_batch(void * const ptr[], size_t n) {
+        if (skipdnode || !P) return ff_node::push_batch(ptr,n);
+        return (n && push(ptr[0])) ? 1 : 0;
+    }
+    virtual inline size_t pop_batch(void ** ptr, size_t max) {
+        if (skipdnode || P) return ff_node::pop_batch(ptr,max);
+        return (max && pop(ptr)) ? 1 : 0;
+    }
+    virtual inline size_t Pop_batch(void **ptr, size_t max, unsigned long retry=((unsigned long)-1), unsigned long ticks=(ff_node::TICKS2WAIT)) {
+        if (skipdnode || P) return ff_node::Pop_batch(ptr,max,retry,ticks);
+        return (max && pop(ptr)) ? 1 : 0;
+    }
+
 public:
     /**
      *  \brief Initializes distributed communication channel
@@ -489,6 +503,9 @@ protected:
     virtual inline bool push(void * ptr) { 
         return ff_dnode<CommImplIn>::internal_push(ptr, comOut);
     }
+    virtual inline size_t push_batch(void * const ptr[], size_t n) {
+        return (n && push(ptr[0])) ? 1 : 0;
+    }
     
 public:
     /**
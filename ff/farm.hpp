@@ -67,6 +67,7 @@
 #include <ff/node.hpp>
 #include <ff/multinode.hpp>
 #include <ff/ordering_policies.hpp>
+#include <ff/workstealing.hpp>
 #include <ff/all2all.hpp>
 
 namespace ff {
@@ -119,24 +120,13 @@ protected:
             const svector<ff_node*> &W = getWorkers();
             if (blocking_out) {
                 size_t nw = getnworkers();
+                ff_blkwait w(prod_m, prod_c, spinpark, FF_TIMEDWAIT_NS);
                 for(size_t i=victim;i<nw;++i) {
-                    while (!W[i]->put(task)) {
-                        pthread_mutex_lock(prod_m);
-                        struct timespec tv;
-                        timedwait_timeout(tv);
-                        pthread_cond_timedwait(prod_c, prod_m,&tv);
-                        pthread_mutex_unlock(prod_m); 
-                    }
+                    while (!W[i]->put(task)) w.wait();
                     put_done(i);
                 }
                 for(size_t i=0;i<victim;++i) {
-                    while (!W[i]->put(task)) {
-                        pthread_mutex_lock(prod_m);
-                        struct timespec tv;
-                        timedwait_timeout(tv);
-                        pthread_cond_timedwait(prod_c, prod_m,&tv);
-                        pthread_mutex_unlock(prod_m); 
-                    }
+                    while (!W[i]->put(task)) w.wait();
                     put_done(i);
                 }     
 #if defined(FF_TASK_CALLBACK)
@@ -191,7 +181,9 @@ protected:
         }
         int svc_init() {
             for(size_t i=0;i<dead.size();++i) dead[i]=false;
-            return ff_gatherer::svc_init();
+            int r = ff_gatherer::svc_init();
+            batch.resize(0);  // strict round-robin, no batches
+            return r;
         }
         void thaw(bool freeze=false, ssize_t nw=-1) {
             if (nw < (ssize_t)victim) victim = 0;
@@ -236,6 +228,24 @@ protected:
             }
         }
         
+        // work-stealing
+        if (workstealing) {
+            if (lb->masterworker()) {
+                error("FARM: work-stealing scheduling is not supported in the master-worker configuration\n");
+                return -1;
+            }
+            for(size_t i=0;i<nworkers;++i) {
+                if (workers[i]->isFarm() || workers[i]->isPipe() || workers[i]->isMultiInput()
+                    || workers[i]->isMultiOutput() || workers[i]->isAll2All() || workers[i]->isComp() ) {
+                    error("FARM: work-stealing scheduling is currently supported only for standard node!\n");
+                    return -1;
+                }
+            }
+        }
+
+        // work-stealing: max number of consecutive tasks the emitter hands to a worker
+        const size_t wsrange = workstealing ? (std::max)(1, workstealing/4) : 0;
+
         // ordering
         if (ordered) {
 
@@ -246,11 +256,17 @@ protected:
                 return -1;
             }
             
-            if (ondemand) {                                   
+            // with the work-stealing scheduling a task can be executed by any worker,
+            // so the ordering is the same used for the on-demand scheduling
+            if (ondemand || workstealing) {                                   
                 ordered_lb* _lb= new ordered_lb(nworkers);
                 ordered_gt* _gt= new ordered_gt(nworkers);
                 assert(_lb); assert(_gt);
-                ordering_Memory.resize(nworkers * (2*ff_farm::ondemand_buffer()+3)+ordering_memsize);
+                // tasks in the input channel and in the deque of each worker
+                // (and kept by the emitter, see ff_loadbalancer::schedule_batch)
+                const size_t inflight = ondemand ? 2*ff_farm::ondemand_buffer() : 
+                    workstealing + ff_wsdeque::capacity(workstealing) + wsrange;
+                ordering_Memory.resize(nworkers * (inflight+3)+ordering_memsize);
                 _lb->init(ordering_Memory.begin(), ordering_Memory.size());
                 _gt->init(ordering_memsize);
                 setlb(_lb, true);
@@ -270,6 +286,19 @@ protected:
             }        
         }
 
+        if (workstealing) {
+            ws_deques.resize(nworkers);
+            for(size_t i=0;i<nworkers;++i) {
+                ws_deques[i] = new ff_wsdeque(workstealing);
+                workers[i]   = new ff_wsworker(workers[i], i, &ws_deques, worker_cleanup);
+                assert(ws_deques[i] && workers[i]);
+            }
+            worker_cleanup = true;
+            lb->wsrange = wsrange;
+        }
+        // bounded input channels for the workers
+        const int sched_entries = ondemand ? ondemand : workstealing;
+
         // accelerator
         if (has_input_channel) { 
             if (create_input_buffer(in_buffer_entries, fixedsizeIN)<0) {
@@ -316,16 +345,16 @@ protected:
 
 
                 
-                if (a2a_first->create_input_buffer((int) (ondemand ? ondemand: in_buffer_entries), 
-                                             (ondemand ? true: fixedsizeIN))<0) return -1;
+                if (a2a_first->create_input_buffer((int) (sched_entries ? sched_entries: in_buffer_entries), 
+                                             (sched_entries ? true: fixedsizeIN))<0) return -1;
                 
                 const svector<ff_node*>& W1 = a2a_first->getFirstSet();
                 for(size_t i=0;i<W1.size();++i) {
                     lb->register_worker(W1[i]);
                 }
             } else {
-                if (workers[i]->create_input_buffer((int) (ondemand ? ondemand: in_buffer_entries), 
-                                                    (ondemand ? true: fixedsizeIN))<0) return -1;
+                if (workers[i]->create_input_buffer((int) (sched_entries ? sched_entries: in_buffer_entries), 
+                                                    (sched_entries ? true: fixedsizeIN))<0) return -1;
 
                 lb->register_worker(workers[i]);
             }
@@ -747,7 +776,7 @@ public:
     ff_farm(const std::vector<ff_node*>& W, ff_node *const Emitter=NULL, ff_node *const Collector=NULL, bool input_ch=false):
         has_input_channel(input_ch),collector_removed(false),ordered(false),fixedsizeIN(FF_FIXED_SIZE),fixedsizeOUT(FF_FIXED_SIZE),
         myownlb(true),myowngt(true),worker_cleanup(false),emitter_cleanup(false),
-        collector_cleanup(false),ondemand(0),
+        collector_cleanup(false),ondemand(0),workstealing(0),
         in_buffer_entries(DEFAULT_BUFFER_CAPACITY),
         out_buffer_entries(DEFAULT_BUFFER_CAPACITY),
         max_nworkers(DEF_MAX_NUM_WORKERS),ordering_memsize(0),
@@ -796,7 +825,7 @@ public:
                      bool fixedsize=FF_FIXED_SIZE): 
         has_input_channel(input_ch),collector_removed(false), ordered(false), fixedsizeIN(FF_FIXED_SIZE),fixedsizeOUT(FF_FIXED_SIZE),
         myownlb(true),myowngt(true),worker_cleanup(worker_cleanup),emitter_cleanup(false),
-        collector_cleanup(false), ondemand(0),
+        collector_cleanup(false), ondemand(0), workstealing(0),
         in_buffer_entries(in_buffer_entries),
         out_buffer_entries(out_buffer_entries),        
         max_nworkers(max_num_workers),ordering_memsize(0),
@@ -818,6 +847,7 @@ public:
         ordered           = f.ordered;
         ordering_memsize  = f.ordering_memsize;
         ondemand = f.ondemand; in_buffer_entries = f.in_buffer_entries;
+        workstealing = f.workstealing;
         out_buffer_entries = f.out_buffer_entries;
         worker_cleanup = f.worker_cleanup; 
         emitter_cleanup = f.emitter_cleanup;
@@ -861,6 +891,8 @@ public:
         ordering_memsize  = f.ordering_memsize;
         ordering_Memory   = std::move(f.ordering_Memory);
         ondemand = f.ondemand; in_buffer_entries = f.in_buffer_entries;
+        workstealing = f.workstealing;
+        ws_deques = std::move(f.ws_deques);
         out_buffer_entries = f.out_buffer_entries;
         worker_cleanup = f.worker_cleanup; 
         emitter_cleanup = f.emitter_cleanup;
@@ -907,6 +939,7 @@ public:
         for(size_t i=0;i<internalSupportNodes.size();++i) {
             delete internalSupportNodes[i];
         }
+        for(size_t i=0;i<ws_deques.size();++i) delete ws_deques[i];
         
         if (barrier) {delete barrier; barrier=NULL;}
     }
@@ -1088,6 +1121,34 @@ public:
         if (inbufferentries<=0) ondemand=1;
         else ondemand=inbufferentries;
     }
+
+    /**
+     * \brief Sets work-stealing scheduling.
+     *
+     * Each worker owns a deque of tasks filled with the tasks the Emitter
+     * schedules to it (round-robin by default). A worker without tasks steals
+     * them from the deque of a randomly selected worker. This corrects the
+     * load imbalance without relying on the Emitter's choices.
+     * The Collector and the ordering (see \p set_ordered) are preserved.
+     * The Emitter hands the tasks to the workers in ranges of up to entries/4
+     * consecutive tasks, with one update of the input channel of the worker
+     * for each range. The tasks sent out by the Emitter are kept until there
+     * is one range for each worker or the Emitter waits for its next input.
+     * It is supported only for workers that are standard nodes, and not in the
+     * master-worker configuration.
+     * In blocking mode an idle worker looks for tasks to steal only when it
+     * wakes up (at least every FF_TIMEDWAIT_NS nanoseconds).
+     *
+     * \param entries sets the capacity of the input channel and of the deque
+     * of each worker. If it is 0 the work-stealing scheduling is NOT set.
+     */
+    void set_scheduling_workstealing(const int entries=64) {
+        if (prepared) {
+            error("FARM, set_scheduling_workstealing, farm already prepared\n");
+            return;
+        }
+        workstealing = (entries<=0) ? 0 : entries;
+    }
     /**
      * \brief Force ordering. 
      *  
@@ -1321,6 +1382,15 @@ public:
         lb->blocking_mode(blk);
         if (gt) gt->blocking_mode(blk);            
     }
+    virtual void spinpark_mode(bool sp=true) {
+        spinpark = sp;
+        lb->spinpark_mode(sp);
+        if (gt) gt->spinpark_mode(sp);
+        if (emitter) emitter->spinpark_mode(sp);
+        if (collector && (collector != (ff_node*)gt)) collector->spinpark_mode(sp);
+        for(size_t i=0;i<workers.size();++i)
+            workers[i]->spinpark_mode(sp);
+    }
     
     inline int cardinality() const { 
         int card=0;
@@ -1548,17 +1618,14 @@ public:
 
         if (inbuffer) {
             if (blocking_out) {
+                ff_blkwait w(prod_m, prod_c, spinpark, FF_TIMEDWAIT_NS);
             _retry:
                 const bool empty=inbuffer->empty();
                 if (inbuffer->push(task)) {
-                    if (empty) pthread_cond_signal(p_cons_c);
+                    ff_blkcond_signal(p_cons_c, empty);
                     return true;
                 }
-                struct timespec tv;
-                timedwait_timeout(tv);                
-                pthread_mutex_lock(prod_m);
-                pthread_cond_timedwait(prod_c, prod_m, &tv);
-                pthread_mutex_unlock(prod_m);
+                w.wait();
                 goto _retry;
             }
             for(unsigned long i=0;i<retry;++i) {
@@ -1595,6 +1662,7 @@ public:
         }
 
         if (blocking_in) {
+            ff_blkwait w(cons_m, cons_c, spinpark);
         _retry:
             if (gt->pop_nb(task)) {
                 // NOTE: the queue between collector and the main thread is forced to be unbounded
@@ -1603,11 +1671,7 @@ public:
                 if ((*task != (void *)FF_EOS)) return true;
                 else return false;
             }
-            struct timespec tv;
-            timedwait_timeout(tv);
-            pthread_mutex_lock(cons_m);
-            pthread_cond_timedwait(cons_c, cons_m,&tv);
-            pthread_mutex_unlock(cons_m);
+            w.wait();
             goto _retry;
         }
         for(unsigned long i=0;i<retry;++i) {
@@ -2120,6 +2184,7 @@ protected:
     bool worker_cleanup, emitter_cleanup,collector_cleanup;
     
     int ondemand;          // if >0, emulates on-demand scheduling
+    int workstealing;      // if >0, work-stealing scheduling (capacity of the deques)
     int in_buffer_entries;
     int out_buffer_entries;
     size_t max_nworkers;
@@ -2135,6 +2200,7 @@ protected:
     svector<ff_node*>  outputNodesFeedback;       
     svector<ff_node*>  internalSupportNodes;
     svector<ordering_pair_t>  ordering_Memory;     // used for ordering purposes
+    std::vector<ff_wsdeque*>  ws_deques;           // used by the work-stealing scheduling
 };
 
 
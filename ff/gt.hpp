@@ -81,10 +81,10 @@ protected:
         if (cons_m == nullptr) {
             assert(cons_c==nullptr);
             cons_m = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-            cons_c = (pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+            cons_c = (pthread_cond_t*)malloc(sizeof(ff_blkcond_t));
             assert(cons_m); assert(cons_c);
             if (pthread_mutex_init(cons_m, NULL) != 0) return false;
-            if (pthread_cond_init(cons_c, NULL) != 0)  return false;
+            if (ff_blkcond_init(cons_c) != 0)  return false;
         } 
         m = cons_m,  c = cons_c;
         return true;
@@ -101,10 +101,10 @@ protected:
         if (prod_m == nullptr) {
             assert(prod_c == nullptr);
             prod_m = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-            prod_c = (pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+            prod_c = (pthread_cond_t*)malloc(sizeof(ff_blkcond_t));
             assert(prod_m); assert(prod_c);
             if (pthread_mutex_init(prod_m, NULL) != 0) return false;
-            if (pthread_cond_init(prod_c, NULL) != 0)  return false;
+            if (ff_blkcond_init(prod_c) != 0)  return false;
         } 
         m = prod_m, c = prod_c;
         return true;
@@ -195,24 +195,32 @@ protected:
      * is returned.
      */
     virtual ssize_t gather_task(void ** task) {
+        // tasks already gathered from the channel batchr
+        if (!batch.empty()) {
+            *task = batch.next();
+            return (nextr = batchr);
+        }
         unsigned int cnt;
+        ff_blkwait w(cons_m, cons_c, blocking_in && spinpark);
         do {
             cnt=0;
             do {
                 nextr = selectworker();
                 //assert(offline[nextr]==false);
-                if (workers[nextr]->get(task)) {
+                if (batch.size()) {
+                    const size_t n = workers[nextr]->get_batch(batch.data(), batch.size());
+                    if (n) {
+                        batch.fill(n);
+                        *task  = batch.next();
+                        return (batchr = nextr);
+                    }
+                } else if (workers[nextr]->get(task)) {
                     return nextr;
                 }
-                else if (++cnt == nattempts()) break;
+                if (++cnt == nattempts()) break;
             } while(1);
-            if (blocking_in) {
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(cons_m);
-                pthread_cond_timedwait(cons_c, cons_m, &tv);
-                pthread_mutex_unlock(cons_m);
-            } else losetime_in();
+            if (blocking_in) w.wait();
+            else losetime_in();
         } while(1);
         return -1;
     }
@@ -224,28 +232,21 @@ protected:
      */
     inline bool push(void * task, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
         if (blocking_out) {
+            ff_blkwait w(prod_m, prod_c, spinpark, FF_TIMEDWAIT_NS);
             if (!filter) {
                 bool empty=buffer->empty();
                 while(!buffer->push(task)) {
                     empty = false;
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(prod_m);
-                    pthread_cond_timedwait(prod_c,prod_m, &tv);
-                    pthread_mutex_unlock(prod_m);  
+                    w.wait();
                 }
-                if (empty) pthread_cond_signal(p_cons_c);
+                ff_blkcond_signal(p_cons_c, empty);
             } else {
                 bool empty=filter->get_out_buffer()->empty();
                 while(!filter->push(task)) {
                     empty=false;
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(prod_m);
-                    pthread_cond_timedwait(prod_c,prod_m,&tv);
-                    pthread_mutex_unlock(prod_m);      
+                    w.wait();
                 }
-                if (empty) pthread_cond_signal(p_cons_c);
+                ff_blkcond_signal(p_cons_c, empty);
             }
             return true;
         }
@@ -262,6 +263,40 @@ protected:
         return false;        
     }
 
+    /**
+     * \brief Pushes \p n tasks in the tasks queue.
+     *
+     * Batched version of \p push, it waits until all the tasks are pushed.
+     */
+    inline bool push_batch(void * const tasks[], size_t n, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
+        size_t i=0;
+        if (blocking_out) {
+            ff_blkwait w(prod_m, prod_c, spinpark, FF_TIMEDWAIT_NS);
+            bool empty = filter ? filter->get_out_buffer()->empty() : buffer->empty();
+            while((i += (filter ? filter->push_batch(tasks+i, n-i) : buffer->push_batch(tasks+i, n-i))) < n) {
+                // the tasks already pushed can be consumed while waiting
+                ff_blkcond_signal(p_cons_c, empty);
+                empty = false;
+                w.wait();
+            }
+            ff_blkcond_signal(p_cons_c, empty);
+            return true;
+        }
+        for(unsigned long k=0;k<retry;++k) {
+            if ((i += (filter ? filter->push_batch(tasks+i, n-i) : buffer->push_batch(tasks+i, n-i))) == n)
+                return true;
+            losetime_out(ticks);
+        }
+        return false;
+    }
+
+    // sends the tasks kept in outbatch (see svc)
+    inline void flush_out() {
+        if (outbatch.empty()) return;
+        push_batch(outbatch.data(), outbatch.size());
+        outbatch.clear();
+    }
+
     /**
      * \brief Pop a task out of the queue.
      *
@@ -297,6 +332,7 @@ protected:
                                       unsigned long retry, 
                                       unsigned long ticks, void *obj) {
         (void)id;
+        ((ff_gatherer *)obj)->flush_out();
         bool r = ((ff_gatherer *)obj)->push(task, retry, ticks);
 #if defined(FF_TASK_CALLBACK)
         if (r) ((ff_gatherer *)obj)->callbackOut(obj);
@@ -331,6 +367,7 @@ public:
         offline.resize(max_nworkers);
 
         blocking_in = blocking_out = FF_RUNTIME_MODE;
+        spinpark    = FF_SPINPARK_MODE;
 
         FFTRACE(taskcnt=0;lostpushticks=0;pushwait=0;lostpopticks=0;popwait=0;ticksmin=(ticks)-1;ticksmax=0;tickstot=0);
     }
@@ -347,6 +384,8 @@ public:
         buffer         = gtin.buffer;
         blocking_in    = gtin.blocking_in;
         blocking_out   = gtin.blocking_out;
+        spinpark       = gtin.spinpark;
+        CPUId          = gtin.CPUId;
         skip1pop       = gtin.skip1pop;
         frominput      = gtin.frominput;
         filter         = gtin.filter;
@@ -537,15 +576,24 @@ public:
     virtual int svc_init() {
 #if !defined(HAVE_PTHREAD_SETAFFINITY_NP) && !defined(NO_DEFAULT_MAPPING)
         if (this->get_mapping()) {
-            int cpuId = filter?filter->getCPUId():-1;
+            int cpuId = getCPUId();
             if (ff_mapThreadToCpu((cpuId<0) ? (cpuId=threadMapper::instance()->getCoreId(tid)) : cpuId)!=0)
                 error("Cannot map thread %d to CPU %d, mask is %u,  size is %u,  going on...\n",tid, (cpuId<0) ? threadMapper::instance()->getCoreId(tid) : cpuId, threadMapper::instance()->getMask(), threadMapper::instance()->getCListSize());            
             if (filter) filter->setCPUId(cpuId);
         }
 #endif        
+#if defined(FF_NUMA_PLACEMENT)
+        const int node = numa_node();
+        if (node>=0)
+            for(ssize_t i=0;i<running;++i)
+                if (workers[i]->get_out_buffer())
+                    workers[i]->get_out_buffer()->numa_place(node);
+#endif
         gettimeofday(&tstart,NULL);
         for(ssize_t i=0;i<running;++i)  offline[i]=false;
         if (filter) {
+            if (batch.empty()) batch.resize(filter->in_batch);
+            outbatch.reserve(batch.size());
             if (filter->isComp() && !filter->isMultiInput())
                 filter->set_neos(running);
             return filter->svc_init();
@@ -587,9 +635,10 @@ public:
         gettimeofday(&wtstart,NULL);
         do {
             task = NULL;
-            if (!skipfirstpop) 
+            if (!skipfirstpop) {
+                if (batch.empty()) flush_out();
                 nextr = gather_task(&task); 
-            else skipfirstpop=false;
+            } else skipfirstpop=false;
 
             if (task == FF_GO_ON) continue;
             channelid = (nextr-feedbackid);
@@ -643,13 +692,18 @@ public:
                 }
 
                 if (filter_outpresent) filter->ff_send_out(task);
-                else  if (outpresent) push(task);
+                else  if (outpresent) {
+                    // the results of a batch are pushed all together
+                    if (batch.size()) outbatch.push_back(task);
+                    else push(task);
+                }
 #if defined(FF_TASK_CALLBACK)
                 else 
                     if (filter) callbackOut(this);
 #endif
             }
         } while((neos<(size_t)running) && (neosnofreeze<(size_t)running));
+        flush_out();
 
         // GO_OUT, EOS_NOFREEZE and EOSW are not propagated !
         if (ret == FF_EOS) {
@@ -695,6 +749,8 @@ public:
 
             assert(blocking_in==blocking_out);
             filter->blocking_mode(blocking_in);
+            // the collector node may have selected the spin-then-park strategy
+            if (filter->spinpark) spinpark = true;
         }
         return 0;
     }
@@ -709,7 +765,7 @@ public:
     int run(bool=false) {
         ff_gatherer::dryrun();
         
-        if (this->spawn(filter?filter->getCPUId():-1)== -2) {
+        if (this->spawn(getCPUId())== -2) {
             error("GT, spawning GT thread\n");
             return -1; 
         }
@@ -720,10 +776,23 @@ public:
         blocking_in = blocking_out = blk;
     }
 
+    void spinpark_mode(bool sp=true) {
+        spinpark = sp;
+    }
+
     void no_mapping() {
         default_mapping = false;
     }
 
+    /*
+     * Core used to pin the thread if the filter does not have one
+     * (e.g. the default emitter/collector of the farm).
+     */
+    inline void setAffinity(int cpuID) { CPUId = cpuID; }
+    inline int  getCPUId() const {
+        return (filter && filter->getCPUId()>=0) ? filter->getCPUId() : CPUId;
+    }
+
     
     inline int wait_freezing() {
         int r = ff_thread::wait_freezing();
@@ -752,6 +821,7 @@ public:
             else _workers.push_back(nullptr);
         }
         svector<size_t> retry(nw);
+        ff_blkwait w(cons_m, cons_c, blocking_in && spinpark);
 
         for(ssize_t i=0;i<running;++i) {
             if(i != channelid) {
@@ -766,13 +836,8 @@ public:
                 retry.pop_back();
             }
             else {
-                if (blocking_in) {
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(cons_m);
-                    pthread_cond_timedwait(cons_c, cons_m, &tv);
-                    pthread_mutex_unlock(cons_m);
-                } else losetime_in();
+                if (blocking_in) w.wait();
+                else losetime_in();
             }
         }
         bool eos=false;
@@ -918,6 +983,14 @@ protected:
 
     bool               blocking_in;
     bool               blocking_out;
+    bool               spinpark;
+
+    // tasks gathered in batches from the channel batchr (see ff_node::set_input_batch)
+    ff_taskbatch       batch;
+    ssize_t            batchr = -1;
+    // results of the tasks of batch waiting to be pushed (see flush_out)
+    std::vector<void*> outbatch;
+    int                CPUId = -1;
 
 #if defined(TRACE_FASTFLOW)
     unsigned long taskcnt;
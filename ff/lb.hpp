@@ -79,9 +79,9 @@ public:
     enum {TICKS2WAIT=1000};
 protected:
 
-    inline void put_done(int id) {
+    inline void put_done(int id, bool wasempty=true) {
         // here we access the cond variable of the worker, that must be initialized
-        pthread_cond_signal(&workers[id]->get_cons_c());
+        ff_blkcond_signal(&workers[id]->get_cons_c(), wasempty);
     }
     
     inline bool init_input_blocking(pthread_mutex_t   *&m,
@@ -90,10 +90,10 @@ protected:
         if (cons_m == nullptr) {
             assert(cons_c == nullptr);
             cons_m = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-            cons_c = (pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+            cons_c = (pthread_cond_t*)malloc(sizeof(ff_blkcond_t));
             assert(cons_m); assert(cons_c);
             if (pthread_mutex_init(cons_m, NULL) != 0) return false;
-            if (pthread_cond_init(cons_c, NULL) != 0)  return false;
+            if (ff_blkcond_init(cons_c) != 0)  return false;
         } 
         m = cons_m,  c = cons_c;
         return true;
@@ -105,10 +105,10 @@ protected:
         if (prod_m == nullptr) {
             assert(prod_c == nullptr);
             prod_m = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-            prod_c = (pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+            prod_c = (pthread_cond_t*)malloc(sizeof(ff_blkcond_t));
             assert(prod_m); assert(prod_c);
             if (pthread_mutex_init(prod_m, NULL) != 0) return false;
-            if (pthread_cond_init(prod_c, NULL) != 0)  return false;
+            if (ff_blkcond_init(prod_c) != 0)  return false;
         } 
         m = prod_m, c = prod_c;
         return true;
@@ -234,15 +234,27 @@ protected:
      * \parm retry is the number of tries to schedule a task
      * \parm ticks are the number of ticks to be lost
      *
+     * With the work-stealing scheduling (see \p wsrange) the tasks are kept
+     * and handed to the workers in ranges by \p flush_out.
+     *
      * \return \p true, if successful, or \p false if not successful.
      *
      */
     virtual inline bool schedule_task(void * task, 
                                       unsigned long retry=((unsigned long)-1), 
                                       unsigned long ticks=TICKS2WAIT) {
+        if (wsrange) {
+            if ((task < FF_TAG_MIN) && (retry == ((unsigned long)-1))) {
+                outbatch.push_back(task);
+                if (outbatch.size() >= wsrange*(size_t)running) flush_out();
+                return true;
+            }
+            flush_out();
+        }
         unsigned long cnt;
         if (blocking_out) {
             unsigned long r = 0;
+            ff_blkwait w(prod_m, prod_c, spinpark, FF_TIMEDWAIT_NS);
             do {
                 cnt=0;
                 do {
@@ -254,7 +266,7 @@ protected:
                     bool empty=workers[nextw]->get_in_buffer()->empty();
                     if(workers[nextw]->put(task)) {
                         FFTRACE(++taskcnt);
-                        if (empty) put_done(nextw);
+                        put_done(nextw, empty);
                         return true;
                     } 
                     ++cnt;
@@ -263,11 +275,7 @@ protected:
 
                 if (++r >= retry) return false;
                 
-                struct timespec tv;
-                timedwait_timeout(tv);                
-                pthread_mutex_lock(prod_m);
-                pthread_cond_timedwait(prod_c, prod_m, &tv);
-                pthread_mutex_unlock(prod_m);
+                w.wait();
             } while(1);
             return true;
         } // blocking 
@@ -292,6 +300,49 @@ protected:
         return false;
     }
 
+    /**
+     * \brief Scheduling of a range of tasks
+     *
+     * The \p n tasks are handed to the workers selected by \p selectworker
+     * in ranges of at most \p wsrange consecutive tasks, each range with a
+     * single update of the input channel of the worker. It is used with the
+     * work-stealing scheduling, the workers balance the load among them.
+     */
+    virtual inline void schedule_batch(void ** tasks, size_t n) {
+        ff_blkwait w(prod_m, prod_c, blocking_out && spinpark, FF_TIMEDWAIT_NS);
+        size_t i=0;
+        while(i<n) {
+            size_t cnt=0;
+            do {
+                nextw = selectworker();
+                assert(nextw>=0);
+                const size_t m = (std::min)(wsrange, n-i);
+#if defined(LB_CALLBACK)
+                for(size_t k=0;k<m;++k) tasks[i+k] = callback(nextw, tasks[i+k]);
+#endif
+                const bool empty = workers[nextw]->get_in_buffer()->empty();
+                const size_t k = workers[nextw]->put_batch(tasks+i, m);
+                if (k) {
+                    FFTRACE(taskcnt+=k);
+                    if (blocking_out) put_done(nextw, empty);
+                    i += k;
+                    break;
+                }
+            } while(++cnt < nattempts());
+            if (cnt == nattempts()) {
+                if (blocking_out) w.wait();
+                else losetime_out();
+            }
+        }
+    }
+
+    // schedules the tasks kept by schedule_task
+    inline void flush_out() {
+        if (outbatch.empty()) return;
+        schedule_batch(outbatch.data(), outbatch.size());
+        outbatch.clear();
+    }
+
     /**
      * \brief Collects tasks
      *
@@ -308,6 +359,7 @@ protected:
                                                            std::deque<ff_node *>::iterator & start) {
         int cnt, nw= (int)(availworkers.end()-availworkers.begin());
         const std::deque<ff_node *>::iterator & ite(availworkers.end());
+        ff_blkwait w(cons_m, cons_c, blocking_in && spinpark);
         do {
             cnt=0;
             do {
@@ -350,13 +402,8 @@ protected:
                     }
                 }
             } while(1);
-            if (blocking_in) {
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(cons_m);
-                pthread_cond_timedwait(cons_c, cons_m, &tv);
-                pthread_mutex_unlock(cons_m);
-            } else losetime_in();
+            if (blocking_in) w.wait();
+            else losetime_in();
         } while(1);
         return ite;
     }
@@ -374,22 +421,12 @@ protected:
         //register int cnt = 0;       
         if (blocking_in) {
             if (!filter) {
-                while (! buffer->pop(task)) {
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(cons_m);
-                    pthread_cond_timedwait(cons_c, cons_m, &tv);
-                    pthread_mutex_unlock(cons_m);
-                } // while
+                ff_blkwait w(cons_m, cons_c, spinpark);
+                while (! buffer->pop(task)) w.wait();
             } else  {                
                 if (cons_m) {                
-                    while (! filter->pop(task)) {
-                        struct timespec tv;
-                        timedwait_timeout(tv);
-                        pthread_mutex_lock(cons_m);
-                        pthread_cond_timedwait(cons_c, cons_m, &tv);
-                        pthread_mutex_unlock(cons_m);
-                    } //while 
+                    ff_blkwait w(cons_m, cons_c, spinpark);
+                    while (! filter->pop(task)) w.wait();
                 } else {
                     // NOTE:
                     // it may happen that the filter has been transformed
@@ -409,6 +446,37 @@ protected:
             while (! filter->pop(task)) losetime_in();
         return true;
     }
+
+    /**
+     * \brief Pop a batch of tasks from buffer
+     *
+     * Batched version of \p pop.
+     *
+     * \return the number of tasks popped
+     */
+    size_t pop_batch(void ** task, size_t max) {
+        size_t n;
+        if (blocking_in) {
+            if (!filter) {
+                ff_blkwait w(cons_m, cons_c, spinpark);
+                while ((n = buffer->pop_batch(task, max)) == 0) w.wait();
+            } else  {                
+                if (cons_m) {                
+                    ff_blkwait w(cons_m, cons_c, spinpark);
+                    while ((n = filter->pop_batch(task, max)) == 0) w.wait();
+                } else {
+                    // see pop
+                    n = filter->Pop_batch(task, max);
+                }
+            }
+            return n;
+        }
+        if (!filter) 
+            while ((n = buffer->pop_batch(task, max)) == 0) losetime_in();
+        else 
+            while ((n = filter->pop_batch(task, max)) == 0) losetime_in();
+        return n;
+    }
     
     /**
      *
@@ -493,6 +561,7 @@ public:
         wttime=0;
 
         blocking_in = blocking_out = FF_RUNTIME_MODE;
+        spinpark    = FF_SPINPARK_MODE;
 
         FFTRACE(taskcnt=0;lostpushticks=0;pushwait=0;lostpopticks=0;popwait=0;ticksmin=(ticks)-1;ticksmax=0;tickstot=0);
     }
@@ -509,6 +578,8 @@ public:
         buffer         = lbin.buffer;
         blocking_in    = lbin.blocking_in;
         blocking_out   = lbin.blocking_out;
+        spinpark       = lbin.spinpark;
+        CPUId          = lbin.CPUId;
         skip1pop       = lbin.skip1pop;
         filter         = lbin.filter;
         workers        = lbin.workers;
@@ -656,6 +727,21 @@ public:
 
     const svector<ff_node*>& getWorkers() const { return workers; }
 
+    /**
+     * \brief Checks whether the input queue of a worker is full
+     *
+     * For unbounded queues the default capacity is taken as the nominal one.
+     * It is a rough estimation, see FFBUFFER::length().
+     *
+     * \return \p true if the queue of the worker \p idx is full
+     */
+    inline bool is_channel_full(size_t idx) const {
+        FFBUFFER* buf = workers[idx]->get_in_buffer();
+        if (!buf) return false;
+        const size_t capacity = buf->isFixedSize() ? buf->buffersize() : DEFAULT_BUFFER_CAPACITY;
+        return buf->length() >= capacity;
+    }
+
     void set_feedbackid_threshold(size_t id) {
         feedbackid = id;
     }
@@ -681,9 +767,22 @@ public:
         blocking_in = blocking_out = blk;
     }
 
+    void spinpark_mode(bool sp=true) {
+        spinpark = sp;
+    }
+
     void no_mapping() {
         default_mapping = false;
     }
+
+    /*
+     * Core used to pin the thread if the filter does not have one
+     * (e.g. the default emitter/collector of the farm).
+     */
+    inline void setAffinity(int cpuID) { CPUId = cpuID; }
+    inline int  getCPUId() const {
+        return (filter && filter->getCPUId()>=0) ? filter->getCPUId() : CPUId;
+    }
     
     /**
      * \brief Decides master-worker schema
@@ -736,20 +835,18 @@ public:
     virtual inline bool ff_send_out_to(void *task, int id,  
                                unsigned long retry=((unsigned long)-1),
                                unsigned long ticks=(TICKS2WAIT)) {        
+        flush_out();
         if (blocking_out) {
             unsigned long r=0;
+            ff_blkwait w(prod_m, prod_c, spinpark, FF_TIMEDWAIT_NS);
         _retry:
             bool empty=workers[id]->get_in_buffer()->empty();
             if (workers[id]->put(task)) {
                 FFTRACE(++taskcnt);
-                if (empty) put_done(id);
+                put_done(id, empty);
             } else {
                 if (++r >= retry) return false;
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(prod_m);
-                pthread_cond_timedwait(prod_c, prod_m, &tv);
-                pthread_mutex_unlock(prod_m);     
+                w.wait();
                 goto _retry;
             }
 #if defined(FF_TASK_CALLBACK)
@@ -776,26 +873,22 @@ public:
      * It sends the same task to all workers.   
      */
     virtual inline void broadcast_task(void * task) {
+       flush_out();
        std::vector<size_t> retry;
        if (blocking_out) {
            for(ssize_t i=0;i<running;++i) {
                bool empty=workers[i]->get_in_buffer()->empty();
                if(!workers[i]->put(task))
                    retry.push_back(i);
-               else if (empty) put_done(i);
+               else put_done(i, empty);
            }
+           ff_blkwait w(prod_m, prod_c, spinpark, FF_TIMEDWAIT_NS);
            while(retry.size()) {
                bool empty=workers[retry.back()]->get_in_buffer()->empty();
                if(workers[retry.back()]->put(task)) {
-                   if (empty) put_done(retry.back());
+                   put_done(retry.back(), empty);
                    retry.pop_back();
-               } else {
-                   struct timespec tv;
-                   timedwait_timeout(tv);
-                   pthread_mutex_lock(prod_m);
-                   pthread_cond_timedwait(prod_c, prod_m, &tv);
-                   pthread_mutex_unlock(prod_m); 
-               }
+               } else w.wait();
            }           
 #if defined(FF_TASK_CALLBACK)
            callbackOut(this);
@@ -829,6 +922,7 @@ public:
             else _workers.push_back(nullptr);
         }
         svector<size_t> retry(_nw);
+        ff_blkwait w(cons_m, cons_c, blocking_in && spinpark);
         for(size_t i=0;i<_workers.size();++i) {
             if(i!=(size_t)input_channelid) {
                 if (_workers[i]) {
@@ -842,13 +936,8 @@ public:
                 retry.pop_back();
             }
             else {
-                if (blocking_in) {
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(cons_m);
-                    pthread_cond_timedwait(cons_c, cons_m, &tv);
-                    pthread_mutex_unlock(cons_m);
-                } else losetime_in();
+                if (blocking_in) w.wait();
+                else losetime_in();
             }
         }
         bool eos=false;
@@ -914,6 +1003,12 @@ public:
             // therefore multiple node write in that queue and so the EOS has to be
             // notified only when 'neos' EOSs have been received. By default neos = 1
             int neos = filter?filter->neos:1;
+            size_t ntasks=1;
+            void **tasks=nullptr;
+            if (inpresent && batch.empty()) {
+                if (filter) batch.resize(filter->in_batch);
+                else if (wsrange) batch.resize(wsrange*running); // one range for each worker
+            }
             
             do {
 #ifdef DFF_ENABLED
@@ -921,8 +1016,14 @@ public:
 #else
                 if (inpresent) {
 #endif
-                    if (!skipfirstpop) pop(&task);
-                    else skipfirstpop=false;
+                    tasks = nullptr;
+                    if (!skipfirstpop) {
+                        if (batch.empty()) flush_out();
+                        if (batch.size()) {
+                            if (batch.empty()) batch.fill(pop_batch(batch.data(), batch.size()));
+                            if ((task=batch.next()) < FF_TAG_MIN) tasks = batch.span(ntasks);
+                        } else pop(&task);
+                    } else skipfirstpop=false;
 
                     // ignoring EOSW in input
                     if (task == FF_EOSW) continue;                     
@@ -948,7 +1049,7 @@ public:
 #if defined(FF_TASK_CALLBACK)
                     callbackIn(this);
 #endif
-                    task = filter->svc(task);
+                    task = (tasks && (ntasks>1)) ? filter->svc_batch(tasks, ntasks) : filter->svc(task);
 
                     
 #if defined(TRACE_FASTFLOW)
@@ -969,13 +1070,19 @@ public:
                         ret = FF_EOS;
                         break;
                     }
-                } else 
+                } else {
                     if (!inpresent) { 
                         push_goon(); 
                         push_eos();
                         ret = FF_EOS; 
                         break;
                     }
+                    // work-stealing without emitter, the tasks popped together
+                    if (tasks && (ntasks>1)) {
+                        for(size_t i=0;i<ntasks-1;++i) schedule_task(tasks[i]);
+                        task = tasks[ntasks-1];
+                    }
+                }
                 
                 const bool r = schedule_task(task);
                 assert(r); (void)r;
@@ -1019,6 +1126,7 @@ public:
             std::deque<ff_node *>::iterator victim(availworkers.begin());
             do {
                 if (!skipfirstpop) {  
+                    flush_out();
                     victim=collect_task(&task, availworkers, start);
                 } else skipfirstpop=false;
                 
@@ -1102,6 +1210,7 @@ public:
                 }
             } while(1);
         }
+        flush_out();
         gettimeofday(&wtstop,NULL);
         wttime+=diffmsec(wtstop,wtstart);
 
@@ -1119,12 +1228,21 @@ public:
     virtual int svc_init() {
 #if !defined(HAVE_PTHREAD_SETAFFINITY_NP) && !defined(NO_DEFAULT_MAPPING)
         if (this->get_mapping()) {
-            int cpuId = (filter)?filter->getCPUId():-1;
+            int cpuId = getCPUId();
             if (ff_mapThreadToCpu((cpuId<0) ? (cpuId=threadMapper::instance()->getCoreId(tid)) : cpuId)!=0)
                 error("Cannot map thread %d to CPU %d, mask is %u,  size is %u,  going on...\n",tid, (cpuId<0) ? threadMapper::instance()->getCoreId(tid) : cpuId, threadMapper::instance()->getMask(), threadMapper::instance()->getCListSize());            
             if (filter) filter->setCPUId(cpuId);
         }
 #endif        
+#if defined(FF_NUMA_PLACEMENT)
+        const int node = numa_node();
+        if (node>=0) {
+            if (buffer) buffer->numa_place(node);
+            for(size_t i=0;i<multi_input.size();++i)
+                if (multi_input[i]->get_out_buffer())
+                    multi_input[i]->get_out_buffer()->numa_place(node);
+        }
+#endif
         gettimeofday(&tstart,NULL);
         if (filter) {
             if (filter->svc_init() <0) return -1;
@@ -1141,6 +1259,7 @@ public:
      */
     virtual void svc_end() {
         if (filter) filter->svc_end();        
+        flush_out();
         gettimeofday(&tstop,NULL);
     }
 
@@ -1165,6 +1284,8 @@ public:
             
             assert(blocking_in==blocking_out);
             filter->blocking_mode(blocking_in);
+            // the emitter node may have selected the spin-then-park strategy
+            if (filter->spinpark) spinpark = true;
         }        
         return 0;
     }
@@ -1180,7 +1301,7 @@ public:
         ff_loadbalancer::dryrun();        
         running = (nw<=0)?(feedbackid>0?feedbackid:workers.size()):nw;
         
-        if (this->spawn(filter?filter->getCPUId():-1) == -2) {
+        if (this->spawn(getCPUId()) == -2) {
             error("LB, spawning LB thread\n");
             running = -1;
             return -1;
@@ -1505,6 +1626,16 @@ private:
 
     bool               blocking_in;
     bool               blocking_out;
+    bool               spinpark;
+
+    // tasks popped in batches from the input channel (see ff_node::set_input_batch)
+    ff_taskbatch       batch;
+    // work-stealing scheduling: max number of consecutive tasks handed to the
+    // same worker (see schedule_batch), 0 otherwise
+    size_t             wsrange = 0;
+    // tasks waiting to be handed to the workers (see flush_out)
+    std::vector<void*> outbatch;
+    int                CPUId = -1;
 
 #ifdef DFF_ENABLED
     bool               _skipallpop = false;    
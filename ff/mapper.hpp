@@ -129,7 +129,11 @@ public:
                 CList.push_back(CList[j]);            
         }        
 #else
-        const std::string ff_mapping_string = FF_MAPPING_STRING;
+        std::string ff_mapping_string = FF_MAPPING_STRING;
+        if (ff_mapping_string == "topology") {
+            // topologically contiguous list of cores (see topology.hpp)
+            ff_mapping_string = ff_topology::instance().mapping_string();
+        }
         if (ff_mapping_string.length()) {
             num_cores = setMappingList(ff_mapping_string.c_str());
             assert(isPowerOf2(CList.size()));
@@ -228,7 +232,7 @@ public:
 				error("setMapping, invalid mapping string\n");
 				return -1;
 			}
-			if (cpuid > (num_cores - 1)) {
+			if (!validCpu(cpuid)) {
 				error("setMapping, invalid cpu id in the mapping string\n");
 				return -1;
 			}
@@ -262,7 +266,7 @@ public:
 		svector<int> List(mask + 1);
         for (size_t i=0; i<mapping.size(); ++i) {
 			auto cpuid = mapping[i];
-            if (cpuid > (num_cores - 1)) {
+            if (!validCpu(cpuid)) {
 				error("setMapping, invalid cpu id in the mapping string\n");
 				return;
             }
@@ -330,7 +334,14 @@ public:
 	 * \return It will return either \p true of \p false.
 	 */
 	inline bool checkCPUId(const int cpuId) const {
-		return ((unsigned) cpuId < num_cores);
+		return (cpuId >= 0) && validCpu((unsigned) cpuId);
+	}
+
+	/**
+	 * It returns the topology of the machine (see topology.hpp).
+	 */
+	inline const ff_topology& getTopology() const {
+		return ff_topology::instance();
 	}
 
 #if defined(FF_CUDA) 
@@ -371,6 +382,14 @@ public:
 	}
 #endif
 
+protected:
+	// a CPU id in a mapping list is valid if the CPU is online
+	inline bool validCpu(unsigned cpuid) const {
+		const ff_topology &topo = ff_topology::instance();
+		if (topo.valid()) return topo.cpu(cpuid) != nullptr;
+		return cpuid < (unsigned)ff_numCores();
+	}
+
 protected:
 	long rrcnt;
 	unsigned int mask;
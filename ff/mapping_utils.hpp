@@ -49,6 +49,7 @@
 #include <errno.h>
 #include <ff/config.hpp>
 #include <ff/utils.hpp>
+#include <ff/topology.hpp>
 #if defined(__linux__)
  #include <sched.h>
  #include <sys/types.h>
@@ -56,6 +57,8 @@
  #include <asm/unistd.h>
  #include <stdio.h>
  #include <unistd.h>
+ #include <stdint.h>
+ #include <linux/mempolicy.h>
 
 static inline int ff_gettid() { return syscall(__NR_gettid);}
 
@@ -181,10 +184,8 @@ static inline ssize_t ff_numCores() {
         return n;
     } while(0);
 #endif /* HAVE_PTHREAD_SETAFFINITY_NP */   
-    FILE       *f;    
-    f = popen("cat /proc/cpuinfo |grep processor | wc -l", "r");
-    if (fscanf(f, "%ld", &n) == EOF) { pclose(f); return n;}
-    pclose(f);
+    const ff::ff_topology &topo = ff::ff_topology::instance();
+    n = topo.valid() ? (ssize_t)topo.numCpus() : (ssize_t)sysconf(_SC_NPROCESSORS_ONLN);
 #endif // MAMMUT
 
 #elif defined(__APPLE__) // BSD
@@ -233,57 +234,10 @@ static inline ssize_t ff_realNumCores() {
     return n;    
 #else // MAMMUT
 
-#if defined(HAVE_PTHREAD_SETAFFINITY_NP)
-    // trying to understand which are the cores on which the thread can be executed
-    // so that we obtain only the cores that are currently online
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    int cnt=-1;
-    do {
-        if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0) 
-            break;        
-#if defined(CPU_COUNT_S)
-        cnt = CPU_COUNT_S(sizeof(cpu_set_t), &cpuset);
-#elif defined(CPU_COUNT)
-        cnt = CPU_COUNT(&cpuset);
-#endif
-        std::set<int> S;    
-        for(size_t i=0;i<CHAR_BIT*sizeof(cpu_set_t);++i) {
-            if (CPU_ISSET(i, &cpuset)) {
-                std::string str="cat /sys/devices/system/cpu/cpu"+std::to_string(i)+"/topology/thread_siblings_list";
-                char buf[64];
-                FILE       *f;                
-                if ((f = popen(str.c_str(), "r"))!= NULL) {
-                    if (fscanf(f, "%s", buf) == EOF) { 
-                        perror("fscanf");
-                        return -1;
-                    }
-                    pclose(f);
-                } else { perror("popen"); return -1; }
-                const std::string bufstr(buf);
-                size_t pos = bufstr.find_first_of('-');
-                int first = std::stoi(bufstr.substr(0,pos));
-                int second = std::stoi(bufstr.substr(pos+1));
-                bool found = false;
-                for(int j=first;j<=second; ++j)
-                    if (S.find(j) != S.end()) {
-                        found = true;
-                        break;
-                    }
-                if (!found) S.insert(i);                
-                if (--cnt==0) {
-                    n=0;
-                    std::for_each(S.begin(), S.end(), [&n](int const&) { ++n;});
-                    return n;
-                }
-            }
-        }
-        n=0;
-        std::for_each(S.begin(), S.end(), [&n](int const&) { ++n;});
-        return n;
-    } while(0);
-#endif // HAVE_PTHREAD_SETAFFINITY_NP
-    char inspect[]="cat /proc/cpuinfo|egrep 'core id|physical id'|tr -d '\n'|sed 's/physical/\\nphysical/g'|grep -v ^$|sort|uniq|wc -l";
+    // only the physical cores on which the process can be executed
+    const ff::ff_topology &topo = ff::ff_topology::instance();
+    if (topo.valid()) return topo.numAllowedCores();
+    return ff_numCores();
 #endif // Linux
 #elif defined(__APPLE__)
     char inspect[] = "sysctl hw.physicalcpu | awk '{print $2}'";
@@ -292,6 +246,7 @@ static inline ssize_t ff_realNumCores() {
     n=1;
 #pragma message ("ff_realNumCores not supported on this platform")
 #endif
+#if !defined(__linux__)
     if (strlen(inspect)) {
       FILE *f;
       f = popen(inspect, "r");
@@ -303,6 +258,7 @@ static inline ssize_t ff_realNumCores() {
       } else
         perror("popen");
     }
+#endif
 #endif // _WIN32
     return n;
 }
@@ -320,13 +276,14 @@ static inline ssize_t ff_numSockets() {
    n = 1;
 #else
 #if defined(__linux__)
-    char inspect[]="cat /proc/cpuinfo|grep 'physical id'|sort|uniq|wc -l";
 #if defined(MAMMUT)
     mammut::Mammut m;
     std::vector<mammut::topology::Cpu*> cpus = m.getInstanceTopology()->getCpus();
     if (cpus.size()>0) n = cpus.size();
     return n;    
 #endif // MAMMUT
+    const ff::ff_topology &topo = ff::ff_topology::instance();
+    return topo.valid() ? (ssize_t)topo.numSockets() : 1;
 #elif defined (__APPLE__)
     char inspect[]="sysctl hw.packages | awk '{print $2}'";
 #else 
@@ -334,6 +291,7 @@ static inline ssize_t ff_numSockets() {
     n=1;
 #pragma message ("ff_realNumCores not supported on this platform")
 #endif
+#if !defined(__linux__)
     FILE       *f; 
     f = popen(inspect, "r");
     if (f) {
@@ -342,6 +300,7 @@ static inline ssize_t ff_numSockets() {
         }
         pclose(f);
     } else perror("popen");
+#endif
 #endif // _WIN32
     return n;
 }
@@ -518,6 +477,55 @@ static inline ssize_t ff_mapThreadToCpu(int cpu_id, int priority_level=0) {
     return 0;
 }
 
+/**
+ *  \brief Returns the number of NUMA nodes of the system.
+ *
+ *  It works only on Linux (see ff_topology), on the other systems it
+ *  returns 1.
+ */
+static inline ssize_t ff_numaNodes() {
+    const ff::ff_topology &topo = ff::ff_topology::instance();
+    return topo.valid() ? (ssize_t)topo.numNodes() : 1;
+}
+
+/**
+ *  \brief Returns the NUMA node of the given CPU.
+ *
+ *  It works only on Linux, on the other systems it returns -1.
+ *
+ *  \return the NUMA node id, -1 if it is not found.
+ */
+static inline int ff_numaNodeOfCpu(ssize_t cpu_id) {
+    const ff::ff_cpuinfo *c = ff::ff_topology::instance().cpu(cpu_id);
+    return c ? c->node : -1;
+}
+
+/**
+ *  \brief Places the memory [addr, addr+len) on the given NUMA node.
+ *
+ *  The pages already allocated are moved to the node, the pages not yet
+ *  touched will be allocated there (preferred policy). Only the pages
+ *  entirely contained in the range are considered.
+ *  It works only on Linux, on the other systems it does nothing.
+ *
+ *  \return 0 if successful, -1 otherwise.
+ */
+static inline int ff_numaPlace(void *addr, size_t len, int node) {
+#if defined(__linux__) && defined(__NR_mbind)
+    if (!addr || node<0 || node>=(int)(sizeof(unsigned long)*8)) return -1;
+    const uintptr_t pgsz  = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t start = ((uintptr_t)addr + pgsz-1) & ~(pgsz-1);
+    const uintptr_t end   = ((uintptr_t)addr + len) & ~(pgsz-1);
+    if (end <= start) return 0;
+    unsigned long nodemask = 1UL << node;
+    if (syscall(__NR_mbind, (void*)start, end-start, MPOL_PREFERRED,
+                &nodemask, sizeof(nodemask)*8, MPOL_MF_MOVE) != 0) return -1;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 // Author: Nick Strupat
 // Date: October 29, 2010
 // Returns the cache line size (in bytes) of the processor, or 0 on failure
@@ -126,6 +126,10 @@ protected:
         blocking_in = blocking_out = blk;
         gt->blocking_mode(blk);
     }
+    void spinpark_mode(bool sp=true) {
+        ff_node::spinpark_mode(sp);
+        gt->spinpark_mode(sp);
+    }
     template<typename T>
     int all_gather(T* in, T** V) { return gt->all_gather(in,(void**)V); }
 
@@ -509,6 +513,10 @@ protected:
         blocking_in = blocking_out = blk;
         lb->blocking_mode(blk);
     }
+    void spinpark_mode(bool sp=true) {
+        ff_node::spinpark_mode(sp);
+        lb->spinpark_mode(sp);
+    }
     
     // consumer
     virtual inline bool init_input_blocking(pthread_mutex_t   *&m,
@@ -899,6 +907,10 @@ struct ff_minode_t: ff_minode {
                                b.setBuffer(p.first, p.second);
                                return datacopied;
                            };
+    } else if constexpr (traits::is_zerocopy_v<OUT_t>) {
+        this->serializeF = [](void* o, dataBuffer& b) -> bool {
+                               return zerocopySerialize<OUT_t>(reinterpret_cast<OUT_t*>(o), b);
+                           };
     } else if constexpr (cereal::traits::is_output_serializable<OUT_t, cereal::PortableBinaryOutputArchive>::value) {
         this->serializeF = [](void* o, dataBuffer& b) -> bool {
                                std::ostream oss(&b);
@@ -911,10 +923,16 @@ struct ff_minode_t: ff_minode {
     // check on Serialization capabilities on the INPUT type!
     if constexpr (traits::is_deserializable_v<IN_t>){
         this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
-                                 IN_t* ptr=(IN_t*)this->alloctaskF(b.getPtr(), b.getLen());
-                                 datacopied = deserializeWrapper<IN_t>(b.getPtr(), b.getLen(), ptr);
-                                 assert(ptr);
-                                 return ptr;
+                                 return this->template userDeserialize<IN_t>(b, datacopied);
+                             };
+    } else if constexpr (traits::is_zerocopy_v<IN_t>) {
+        this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
+                                 IN_t* o = (IN_t*)this->alloctaskF(nullptr,0);
+                                 assert(o);
+                                 if (!zerocopyDeserialize<IN_t>(b, o))
+                                     error("Malformed task received (%zu bytes)\n", b.getLen());
+                                 datacopied = true;
+                                 return o;
                              };
     } else if constexpr(cereal::traits::is_input_serializable<IN_t, cereal::PortableBinaryInputArchive>::value) {
             this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
@@ -1001,6 +1019,10 @@ struct ff_monode_t: ff_monode {
                                b.setBuffer(p.first, p.second);
                                return datacopied;
                            };
+    } else if constexpr (traits::is_zerocopy_v<OUT_t>) {
+        this->serializeF = [](void* o, dataBuffer& b) -> bool {
+                               return zerocopySerialize<OUT_t>(reinterpret_cast<OUT_t*>(o), b);
+                           };
     } else if constexpr (cereal::traits::is_output_serializable<OUT_t, cereal::PortableBinaryOutputArchive>::value) {
             this->serializeF = [](void* o, dataBuffer& b) -> bool {
                                    std::ostream oss(&b);
@@ -1013,10 +1035,16 @@ struct ff_monode_t: ff_monode {
     // check on Serialization capabilities on the INPUT type!
     if constexpr (traits::is_deserializable_v<IN_t>){
         this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
-                                 IN_t* ptr=(IN_t*)this->alloctaskF(b.getPtr(), b.getLen());
-                                 datacopied = deserializeWrapper<IN_t>(b.getPtr(), b.getLen(), ptr);
-                                 assert(ptr);
-                                 return ptr;
+                                 return this->template userDeserialize<IN_t>(b, datacopied);
+                             };
+    } else if constexpr (traits::is_zerocopy_v<IN_t>) {
+        this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
+                                 IN_t* o = (IN_t*)this->alloctaskF(nullptr,0);
+                                 assert(o);
+                                 if (!zerocopyDeserialize<IN_t>(b, o))
+                                     error("Malformed task received (%zu bytes)\n", b.getLen());
+                                 datacopied = true;
+                                 return o;
                              };
     } else if constexpr(cereal::traits::is_input_serializable<IN_t, cereal::PortableBinaryInputArchive>::value){
             this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
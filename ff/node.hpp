@@ -46,12 +46,15 @@
 #include <ff/config.hpp>
 #include <ff/svector.hpp>
 #include <ff/barrier.hpp>
+#include <ff/parking.hpp>
 #include <atomic>
+#include <vector>
 
 #ifdef DFF_ENABLED
 
 #include <ff/distributed/ff_network.hpp>
 #include <ff/distributed/ff_typetraits.hpp>
+#include <ff/distributed/ff_zerocopy.hpp>
 #include <cereal/cereal.hpp>
 #include <cereal/types/polymorphic.hpp>
 #include <cereal/archives/portable_binary.hpp>
@@ -91,6 +94,7 @@ struct OptLevel {
     bool     remove_collector{false};
     bool     merge_farms{false};
     bool     introduce_a2a{false};
+    bool     topology_mapping{false};  // see optimize.hpp
 };
 struct OptLevel1: OptLevel {
     OptLevel1() {
@@ -345,7 +349,7 @@ public:
 
         int CPUId = -1;
         if (default_mapping)
-            init_thread_affinity(attr, cpuId);
+            CPUId = init_thread_affinity(attr, cpuId);
         if (CPUId==-2) return -2;
 
         if (barrier)
@@ -430,6 +434,19 @@ public:
     inline size_t getTid() const { return tid; }
     inline size_t getOSThreadId() const { return threadid; }
 
+    /*
+     * NUMA node of the core the calling thread has been pinned to by the
+     * run-time, -1 if the thread is not pinned or the machine has a single
+     * NUMA node. The channels consumed by the thread are placed there.
+     */
+    inline int numa_node() const {
+#if defined(FF_NUMA_PLACEMENT)
+        if (default_mapping && ff_numaNodes()>1)
+            return ff_numaNodeOfCpu(ff_getMyCore());
+#endif
+        return -1;
+    }
+
 protected:
     size_t          tid;                /// unique logical id of the thread
     size_t          threadid;           /// OS specific thread ID
@@ -456,6 +473,38 @@ static void * proxy_thread_routine(void * arg) {
     return NULL;
 }
 
+/*
+ * Local buffer of the tasks received in batches from an input channel
+ * (see ff_node::set_input_batch). It is used by the run-time, only by the
+ * thread reading the channel.
+ * Tasks left in the buffer when the node exits its main loop are delivered
+ * the next time the node is run, as if they were still in the channel.
+ */
+class ff_taskbatch {
+public:
+    // n<2 disables batching
+    void resize(size_t n) { buf.resize((n>1)?n:0); pos=len=0; }
+    inline size_t size()  const { return buf.size(); }
+    inline bool   empty() const { return pos==len; }
+    inline void** data()        { return buf.data(); }
+    inline void   fill(size_t n) { pos=0; len=n; }
+    inline void*  next()        { return buf[pos++]; }
+
+    /*
+     * Returns the last task returned by next together with the regular tasks
+     * (i.e. not EOS, GO_ON, ...) following it, they are all consumed.
+     */
+    inline void** span(size_t &n) {
+        const size_t first = pos-1;
+        while(pos<len && buf[pos] < FF_TAG_MIN) ++pos;
+        n = pos-first;
+        return &buf[first];
+    }
+private:
+    std::vector<void*> buf;
+    size_t pos=0, len=0;
+};
+
 // forward declaration    
 class ff_loadbalancer;
 class ff_gatherer;
@@ -511,6 +560,7 @@ private:
     friend class ff_comb;
     friend struct internal_mo_transformer;
     friend struct internal_mi_transformer;
+    friend class ff_wsworker;
 
 #ifdef DFF_ENABLED
     friend class dGroups;
@@ -555,23 +605,21 @@ protected:
     virtual void set_neos(ssize_t n) { neos = n; }
     
     virtual inline bool push(void * ptr) { return out->push(ptr); }
+    virtual inline size_t push_batch(void * const ptr[], size_t n) { return out->push_batch(ptr, n); }
     virtual inline bool pop(void ** ptr) { 
         if (!in_active) return false; // it does not want to receive data
         return in->pop(ptr);
     }
     virtual inline bool Push(void *ptr, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
         if (blocking_out) {
+            ff_blkwait w(prod_m, prod_c, spinpark, FF_TIMEDWAIT_NS);
         retry:
             bool empty=out->empty();
             bool r = push(ptr);
             if (r) { // OK
-                if (empty) pthread_cond_signal(p_cons_c);
+                ff_blkcond_signal(p_cons_c, empty);
             } else { // FULL
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(prod_m);
-                pthread_cond_timedwait(prod_c,prod_m,&tv);
-                pthread_mutex_unlock(prod_m);
+                w.wait();
                 goto retry;
             }
             return true;
@@ -586,14 +634,11 @@ protected:
     virtual inline bool Pop(void **ptr, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
         if (blocking_in) {
             if (!in_active) { *ptr=NULL; return false; }
+            ff_blkwait w(cons_m, cons_c, spinpark);
         retry:
             bool r = in->pop(ptr);
             if (!r) { // EMPTY                
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(cons_m);
-                pthread_cond_timedwait(cons_c, cons_m,&tv);
-                pthread_mutex_unlock(cons_m);
+                w.wait();
                 goto retry;
             }
             return true;
@@ -606,6 +651,31 @@ protected:
         return true;
     }
 
+    virtual inline size_t pop_batch(void ** ptr, size_t max) {
+        if (!in_active) return 0; // it does not want to receive data
+        return in->pop_batch(ptr, max);
+    }
+
+    /*
+     * Batched version of Pop: it returns the number of tasks popped,
+     * 0 only if the node does not want to receive data (or retry expired).
+     */
+    virtual inline size_t Pop_batch(void **ptr, size_t max, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
+        size_t n;
+        if (blocking_in) {
+            if (!in_active) return 0;
+            ff_blkwait w(cons_m, cons_c, spinpark);
+            while((n = in->pop_batch(ptr, max)) == 0) w.wait();
+            return n;
+        }
+        for(unsigned long i=0;i<retry;++i) {
+            if (!in_active) return 0;
+            if ((n = pop_batch(ptr, max))) return n;
+            losetime_in(ticks);
+        }
+        return 0;
+    }
+
 
     // consumer
     virtual inline bool init_input_blocking(pthread_mutex_t   *&m,
@@ -614,10 +684,10 @@ protected:
         if (cons_m == nullptr) {
             assert(cons_c==nullptr);
             cons_m = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-            cons_c = (pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+            cons_c = (pthread_cond_t*)malloc(sizeof(ff_blkcond_t));
             assert(cons_m); assert(cons_c);
             if (pthread_mutex_init(cons_m, NULL) != 0) return false;
-            if (pthread_cond_init(cons_c, NULL) != 0)  return false;
+            if (ff_blkcond_init(cons_c) != 0)  return false;
         } 
         m = cons_m,  c = cons_c;
         return true;
@@ -629,10 +699,10 @@ protected:
         if (prod_m == nullptr) {
             assert(prod_c==nullptr);
             prod_m = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-            prod_c = (pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+            prod_c = (pthread_cond_t*)malloc(sizeof(ff_blkcond_t));
             assert(prod_m); assert(prod_c);
             if (pthread_mutex_init(prod_m, NULL) != 0) return false;
-            if (pthread_cond_init(prod_c, NULL) != 0)  return false;
+            if (ff_blkcond_init(prod_c) != 0)  return false;
         } 
         m = prod_m, c = prod_c;
         return true;
@@ -986,6 +1056,36 @@ public:
      * runtime support (can be useful for housekeeping)
      */
     virtual void  svc_end() {}
+
+    /**
+     * \brief Batched service method
+     *
+     * Called instead of \p svc when the node receives its input in batches
+     * (see \p set_input_batch). \p tasks contains \p n consecutive tasks of
+     * the input channel (no special values such as EOS).
+     * The results have to be sent out with \p ff_send_out, the returned value
+     * has the same meaning of the value returned by \p svc.
+     * The default implementation calls \p svc for each task. If \p svc
+     * returns EOS (or GO_OUT, ...) before the last task, the remaining tasks
+     * are delivered anyway and the EOS is returned after them.
+     *
+     * \return GO_ON to get the next tasks, EOS to terminate, or a task to be sent out
+     */
+    virtual void* svc_batch(void ** tasks, size_t n) {
+        void *ret = FF_GO_ON;
+        for(size_t i=0;i<n;++i) {
+            void *r = svc(tasks[i]);
+            if (r == FF_GO_ON) continue;
+            if (!r || (r >= FF_TAG_MIN)) {
+                // the tasks of the span are already out of the channel
+                if (ret == FF_GO_ON) ret = (r ? r : FF_EOS);
+                continue;
+            }
+            if ((i == n-1) && (ret == FF_GO_ON)) return r;
+            if (out || callback || isMultiOutput()) ff_send_out(r);
+        }
+        return ret;
+    }
     
 
     /**
@@ -1081,6 +1181,36 @@ public:
         CPUId=cpuID;
     }
 
+    /**
+     * \brief Selects the spin-then-park waiting strategy used in blocking mode
+     *
+     * See parking.hpp. For composite nodes (pipeline, farm, all-to-all, ...)
+     * the setting is applied to all the nodes they contain.
+     * It must be called before running the node.
+     *
+     * \param sp \p true to spin-then-park, \p false to use the timed wait
+     */
+    virtual void spinpark_mode(bool sp=true) {
+        spinpark = sp;
+    }
+
+    /**
+     * \brief Receives the input tasks in batches
+     *
+     * The run-time pops up to \p max tasks at once from the input channel
+     * and passes the regular ones to \p svc_batch. This amortizes the cost
+     * of the channel synchronization for fine-grained streams.
+     * The multi-input nodes (and the collectors) get the tasks in batches
+     * from each input channel but \p svc is called for each task.
+     * It must be called before running the node.
+     *
+     * \param max max number of tasks per batch (0 or 1 disables batching)
+     */
+    virtual void set_input_batch(size_t max) {
+        in_batch = max;
+    }
+    size_t get_input_batch() const { return in_batch; }
+
     virtual void set_barrier(BARRIER_T * const b) {
         barrier = b;
     }
@@ -1110,6 +1240,19 @@ public:
         //return in->push(ptr);
         return (in->*in->pushPMF)(ptr);
     }
+
+    /**
+     * \brief Nonblocking put of up to \p n tasks into the input channel
+     *
+     * Batched version of \p put, the channel is updated once for all the
+     * tasks. A multi-producer channel gets one task at a time.
+     *
+     * \return the number of tasks pushed
+     */
+    virtual inline size_t put_batch(void * const ptr[], size_t n) {
+        if (in->pushPMF != &FFBUFFER::push) return (n && put(ptr[0])) ? 1 : 0;
+        return in->push_batch(ptr, n);
+    }
     
     /**
      * \brief Noblocking pop from the output channel
@@ -1120,6 +1263,13 @@ public:
      *
      */
     virtual inline bool  get(void **ptr) { return out->pop(ptr);}
+
+    /**
+     * \brief Noblocking batched pop from the output channel
+     *
+     * \return the number of tasks popped
+     */
+    virtual inline size_t get_batch(void **ptr, size_t max) { return out->pop_batch(ptr, max);}
    
     virtual inline void losetime_out(unsigned long ticks=ff_node::TICKS2WAIT) {
         FFTRACE(lostpushticks+=ticks; ++pushwait);
@@ -1309,6 +1459,30 @@ protected:
     virtual std::pair<decltype(serializeF), decltype(freetaskF)> getSerializationFunction(){return std::make_pair(serializeF,freetaskF);}
     virtual std::pair<decltype(deserializeF), decltype(alloctaskF)> getDeserializationFunction(){ return std::make_pair(deserializeF,alloctaskF);}
 
+    /*
+     * Deserialization with the functions of the user (see ff_typetraits.hpp).
+     * A buffer lent by the transport (see dataBuffer::lend) has to be copied
+     * only if the object keeps it (datacopied=false), which is known after
+     * the deserialization: it is learnt from the first message. If a later
+     * object keeps a buffer that has not been copied, the message is
+     * deserialized again from a copy and that object is dropped.
+     */
+    template<typename IN_t>
+    void* userDeserialize(dataBuffer& b, bool& datacopied) {
+        if (!deserCopies.load(std::memory_order_relaxed)) b.own();
+        IN_t* ptr=(IN_t*)this->alloctaskF(b.getPtr(), b.getLen());
+        datacopied = deserializeWrapper<IN_t>(b.getPtr(), b.getLen(), ptr);
+        if (!datacopied && b.isBorrowed()) {
+            b.own();
+            ptr=(IN_t*)this->alloctaskF(b.getPtr(), b.getLen());
+            datacopied = deserializeWrapper<IN_t>(b.getPtr(), b.getLen(), ptr);
+        }
+        deserCopies.store(datacopied, std::memory_order_relaxed);
+        assert(ptr);
+        return ptr;
+    }
+    std::atomic<bool> deserCopies{false};   // the objects do not keep the buffer
+
 #endif
     // always defined, the body will implement a no-op if the distributed runtime is disabled
     GroupInterface createGroup(std::string);
@@ -1328,6 +1502,7 @@ protected:
         p_cons_c = NULL;
 
         blocking_in = blocking_out = FF_RUNTIME_MODE;
+        spinpark = FF_SPINPARK_MODE;
     };
 
     
@@ -1341,6 +1516,8 @@ protected:
         p_cons_c = n.p_cons_c;
         blocking_in = n.blocking_in;
         blocking_out = n.blocking_out;
+        spinpark = n.spinpark;
+        in_batch = n.in_batch;
         default_mapping = n.default_mapping;
         in_active = n.in_active;
         cons_m = n.cons_m;  cons_c = n.cons_c;
@@ -1426,7 +1603,10 @@ private:
             bool exit=false;            
             bool filter_outpresent = false;
             size_t neos=input_neos;
+            size_t ntasks=1;
+            void **tasks=nullptr;
 
+            if (inpresent && batch.empty()) batch.resize(filter->in_batch);
             
             // if the node is a combine where the last stage is a multi-output
             if ( filter && ( !outpresent && filter->isMultiOutput() ) ) {
@@ -1439,8 +1619,14 @@ private:
 #else
                 if (inpresent) {
 #endif
-                    if (!skipfirstpop) pop(&task); 
-                    else skipfirstpop=false;
+                    tasks = nullptr;
+                    if (!skipfirstpop) {
+                        if (batch.size()) {
+                            if (batch.empty()) batch.fill(filter->Pop_batch(batch.data(), batch.size()));
+                            if (batch.empty()) task = NULL; // the node does not want to receive data
+                            else if ((task=batch.next()) < FF_TAG_MIN) tasks = batch.span(ntasks);
+                        } else pop(&task);
+                    } else skipfirstpop=false;
                     if ((task == FF_EOS) || (task == FF_EOSW) ||
                         (task == FF_EOS_NOFREEZE)) {
                         ret = task;
@@ -1457,14 +1643,14 @@ private:
                     }
                     if (task == FF_GO_OUT) break;
                 }
-                FFTRACE(++filter->taskcnt);
+                FFTRACE(filter->taskcnt += (tasks?ntasks:1));
                 FFTRACE(ticks t0 = getticks());
 
 #if defined(FF_TASK_CALLBACK)
                 if (filter) callbackIn();
 #endif                    
 
-                ret = filter->svc(task);
+                ret = (tasks && (ntasks>1)) ? filter->svc_batch(tasks, ntasks) : filter->svc(task);
 
 #if defined(TRACE_FASTFLOW)
                 ticks diff=(getticks()-t0);
@@ -1503,6 +1689,11 @@ private:
                     error("Cannot map thread %d to CPU %d, mask is %u,  size is %u,  going on...\n",tid, (cpuId<0) ? threadMapper::instance()->getCoreId(tid) : cpuId, threadMapper::instance()->getMask(), threadMapper::instance()->getCListSize());            
                 filter->setCPUId(cpuId);
             }
+#endif
+#if defined(FF_NUMA_PLACEMENT)
+            const int node = numa_node();
+            if (node>=0 && filter->get_in_buffer())
+                filter->get_in_buffer()->numa_place(node);
 #endif
             gettimeofday(&filter->tstart,NULL);
             return filter->svc_init();
@@ -1534,6 +1725,7 @@ private:
     protected:            
         ff_node * const filter;
         const ssize_t input_neos;
+        ff_taskbatch batch;
     };
     /* ------------------------------------------------------------------------------------- */
 
@@ -1571,6 +1763,8 @@ protected:
 
     bool               FF_MEM_ALIGN(blocking_in,32); 
     bool               FF_MEM_ALIGN(blocking_out,32);
+    bool               spinpark;
+    size_t             in_batch = 0;
 
     bool                  prepared = false;
     bool                  initial_barrier = true;
@@ -1646,10 +1840,14 @@ struct ff_node_t: ff_node {
     if constexpr (traits::is_serializable_v<OUT_t>){
         this->serializeF = [](void* o, dataBuffer& b) -> bool {
                                bool datacopied = true;
-                               std::pair<char*, size_t> p = serializeWrapper<OUT_t>(reinterpret_cast<OUT_t*>(o,datacopied));
+                               std::pair<char*, size_t> p = serializeWrapper<OUT_t>(reinterpret_cast<OUT_t*>(o), datacopied);
                                b.setBuffer(p.first, p.second);
                                return datacopied;
                            };
+    } else if constexpr (traits::is_zerocopy_v<OUT_t>) {
+        this->serializeF = [](void* o, dataBuffer& b) -> bool {
+                               return zerocopySerialize<OUT_t>(reinterpret_cast<OUT_t*>(o), b);
+                           };
     } else if constexpr (cereal::traits::is_output_serializable<OUT_t, cereal::PortableBinaryOutputArchive>::value){
         this->serializeF = [](void* o, dataBuffer& b) -> bool {
                                std::ostream oss(&b);
@@ -1662,10 +1860,16 @@ struct ff_node_t: ff_node {
     // check on Serialization capabilities on the INPUT type!
     if constexpr (traits::is_deserializable_v<IN_t>) {
         this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
-                                 IN_t* ptr=(IN_t*)this->alloctaskF(b.getPtr(), b.getLen());
-                                 datacopied = deserializeWrapper<IN_t>(b.getPtr(), b.getLen(), ptr);
-                                 assert(ptr);
-                                 return ptr;
+                                 return this->template userDeserialize<IN_t>(b, datacopied);
+                             };
+    } else if constexpr (traits::is_zerocopy_v<IN_t>) {
+        this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
+                                 IN_t* o = (IN_t*)this->alloctaskF(nullptr,0);
+                                 assert(o);
+                                 if (!zerocopyDeserialize<IN_t>(b, o))
+                                     error("Malformed task received (%zu bytes)\n", b.getLen());
+                                 datacopied = true;
+                                 return o;
                              };
     } else if constexpr(cereal::traits::is_input_serializable<IN_t, cereal::PortableBinaryInputArchive>::value){
             this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
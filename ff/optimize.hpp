@@ -46,6 +46,9 @@
 #include <ff/farm.hpp>
 #include <ff/all2all.hpp>
 #include <ff/combine.hpp>
+#include <ff/topology.hpp>
+#include <vector>
+#include <functional>
 
 namespace ff {
 
@@ -62,6 +65,76 @@ static inline void opt_report(int verbose_level, reportkind_t kind, const char *
     free(p);
 }
 
+/*
+ * Topology-aware mapping (OptLevel::topology_mapping).
+ *
+ * The threads of the building block are listed in data-flow order: the
+ * stages of a pipeline one after the other, the emitter of a farm followed
+ * by its workers and by its collector, the first set of an all-to-all
+ * followed by the second one. Then they are pinned, in this order, to the
+ * cores of ff_topology::mapping(), which lists the first context of each
+ * physical core before the SMT contexts and keeps contiguous the cores
+ * sharing the L2/L3 caches.
+ * Therefore producer and consumer nodes share a cache whenever possible,
+ * the farm workers use distinct physical cores before the SMT ones and the
+ * emitter (collector) is placed next to the previous stage and the first
+ * worker (the last worker and the next stage).
+ */
+typedef std::function<void(int)> opt_pin_t;
+
+static inline void topology_threads(ff_node *n, std::vector<opt_pin_t> &T) {
+    if (n->isPipe()) {
+        const svector<ff_node*> &S = reinterpret_cast<ff_pipeline*>(n)->getStages();
+        for(size_t i=0;i<S.size();++i) topology_threads(S[i], T);
+        return;
+    }
+    if (n->isAll2All()) {
+        ff_a2a *a2a = reinterpret_cast<ff_a2a*>(n);
+        const svector<ff_node*>& W1 = a2a->getFirstSet();
+        const svector<ff_node*>& W2 = a2a->getSecondSet();
+        for(size_t i=0;i<W1.size();++i) topology_threads(W1[i], T);
+        for(size_t i=0;i<W2.size();++i) topology_threads(W2[i], T);
+        return;
+    }
+    if (n->isFarm()) {
+        ff_farm *farm = reinterpret_cast<ff_farm*>(n);
+        // the emitter (and the collector) may be replaced or wrapped when the
+        // farm is prepared, so the core is set also in the lb (gt)
+        ff_node *E = farm->getEmitter();
+        ff_loadbalancer *lb = farm->getlb();
+        T.push_back([E,lb](int cpu) { if (E) E->setAffinity(cpu); lb->setAffinity(cpu); });
+        const svector<ff_node*> &W = farm->getWorkers();
+        for(size_t i=0;i<W.size();++i) topology_threads(W[i], T);
+        if (farm->hasCollector()) {
+            ff_node *C = farm->getCollector();
+            ff_gatherer *gt = farm->getgt();
+            T.push_back([C,gt](int cpu) { if (C) C->setAffinity(cpu); if (gt) gt->setAffinity(cpu); });
+        }
+        return;
+    }
+    T.push_back([n](int cpu) { n->setAffinity(cpu); });
+}
+
+static inline int topology_mapping(ff_node *n, const OptLevel &opt) {
+    const ff_topology &topo = ff_topology::instance();
+    if (!topo.valid() || topo.mapping().empty()) {
+        opt_report(opt.verbose_level, OPT_NORMAL,
+                   "OPT: TOPOLOGY_MAPPING: topology not available, using the default mapping\n");
+        return 0;
+    }
+    std::vector<opt_pin_t> T;
+    topology_threads(n, T);
+    const std::vector<int> &M = topo.mapping();
+    for(size_t i=0;i<T.size();++i) T[i](M[i % M.size()]);
+    opt_report(opt.verbose_level, OPT_NORMAL,
+               "OPT: TOPOLOGY_MAPPING: %ld threads mapped on %ld cores (%ld physical)\n",
+               T.size(), (std::min)(T.size(), M.size()), topo.numAllowedCores());
+    if (T.size() > M.size())
+        opt_report(opt.verbose_level, OPT_NORMAL,
+                   "OPT: TOPOLOGY_MAPPING: more threads than cores, some cores are shared\n");
+    return 0;
+}
+
 /**
  *  This function looks for internal farms with default collector in a farm building block.
  *  The internal default collectors are removed.
@@ -343,6 +416,7 @@ static inline int optimize_static(ff_farm& farm, const OptLevel& opt=OptLevel1()
     iopt.blocking_mode      = false;
     iopt.no_initial_barrier = false;
     iopt.no_default_mapping = false;
+    iopt.topology_mapping   = false;
     const svector<ff_node*> &Workers = farm.getWorkers();
     for(size_t i=0;i<Workers.size();++i) {
         if (Workers[i]->isPipe()) {
@@ -451,6 +525,10 @@ static inline int optimize_static(ff_farm& farm, const OptLevel& opt=OptLevel1()
                    "OPT (farm): NO_INITIAL_BARRIER: Initial barrier disabled\n");
         farm.no_barrier();
    }
+    // pinning the threads according to the topology of the machine
+    if (opt.topology_mapping && farm.default_mapping) {
+        if (topology_mapping(&farm, opt)<0) return -1;
+    }
     return 0;
 }
     
@@ -475,6 +553,7 @@ static inline int optimize_static(ff_pipeline& pipe, const OptLevel& opt=OptLeve
    iopt.blocking_mode      = false;
    iopt.no_initial_barrier = false;
    iopt.no_default_mapping = false;
+   iopt.topology_mapping   = false;
    for(int i=0;i<nstages;++i) {
        if (pipe.nodes_list[i]->isFarm()) {
            ff_farm *farm = reinterpret_cast<ff_farm*>(pipe.nodes_list[i]);
@@ -791,6 +870,10 @@ static inline int optimize_static(ff_pipeline& pipe, const OptLevel& opt=OptLeve
                   "OPT (pipe): NO_INITIAL_BARRIER: Initial barrier disabled\n");
        pipe.no_barrier();
    }
+   // pinning the threads according to the topology of the machine
+   if (opt.topology_mapping && pipe.default_mapping) {
+       if (topology_mapping(&pipe, opt)<0) return -1;
+   }
    return 0;
 }
 
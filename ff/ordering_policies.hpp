@@ -144,6 +144,7 @@ public:
         worker(worker),cleanup(cleanup) {
         set_barrier(worker->get_barrier());
         worker->set_barrier(nullptr);
+        if (worker->getCPUId()>=0) setAffinity(worker->getCPUId());
     }
     ~OrderedWorkerWrapper() {
         if (cleanup) delete worker;
@@ -337,6 +337,116 @@ public:
             } FF_PARFOR_T_STOP(this,int);
         }
     }
+
+    /**
+     * @brief Parallel for region (step) - dynamic, auto grain
+     *
+     * Dynamic scheduling onto nw worker threads with guided chunks: the chunks
+     * taken from the range of a worker shrink towards its end down to the
+     * grain. The grain is chosen from the cost of the iterations measured in
+     * the previous calls of the same loop (the same lambda) on this object,
+     * see ff_forall_farm::setloop_auto.
+     *
+     * @param first first value of the iteration variable
+     * @param last last value of the iteration variable
+     * @param step step increment for the iteration variable
+     * @param f <b>f(const long idx)</b> body of the parallel loop
+     * @param nw number of worker threads
+     */
+    template <typename Function>
+    inline void parallel_for_auto(long first, long last, long step,
+                                  const Function& f, const long nw=FF_AUTO) {
+        if (first >= last) return;
+        setloop_auto(forall_site<Function>(), first, last, step, nw);
+        auto F = [&](const long ff_start_idx, const long ff_stop_idx, const int, const int) {
+            PRAGMA_IVDEP;
+            for(long idx=ff_start_idx;idx<ff_stop_idx;idx+=step) f(idx);
+        };
+        int res = 0;
+        if (run_auto(F, 0, res)<0) error("running ParallelFor (auto grain)\n");
+    }
+
+    /**
+     * @brief Parallel for region over a 2D iteration space - tiled, dynamic
+     *
+     * The iteration space [first0,last0(x[first1,last1( is divided in tiles
+     * whose data fit in the cache (see forall_tiles). The tiles are assigned to
+     * the worker threads in Morton order and then stolen by the threads
+     * that have completed their own tiles. j is the innermost index.
+     *
+     * @param f <b>f(const long i, const long j)</b> body of the parallel loop
+     * @param nw number of worker threads
+     * @param itembytes bytes of data accessed by one iteration
+     * @param budget bytes of data of a tile (0 means half of the L2 cache)
+     */
+    template <typename Function>
+    inline void parallel_for_2d(long first0, long last0, long first1, long last1,
+                                const Function& f, const long nw=FF_AUTO,
+                                const size_t itembytes=sizeof(double), const size_t budget=0) {
+        const forall_tiles<2>& tl = tiles2;
+        if (tiles2.setup({first0,first1}, {last0,last1}, itembytes, budget, this->loopnw(nw)) == 0) return;
+        FF_PARFOR_START_IDX(this,parforidx,0,(long)tl.size(),1,PARFOR_DYNAMIC(1),nw) {
+            tl.run(ff_start_idx, ff_stop_idx, f);
+        } FF_PARFOR_STOP(this);
+    }
+
+    /**
+     * @brief Parallel for region over a 3D iteration space - tiled, dynamic
+     *
+     * As parallel_for_2d, k is the innermost index.
+     *
+     * @param f <b>f(const long i, const long j, const long k)</b> body of the parallel loop
+     */
+    template <typename Function>
+    inline void parallel_for_3d(long first0, long last0, long first1, long last1,
+                                long first2, long last2,
+                                const Function& f, const long nw=FF_AUTO,
+                                const size_t itembytes=sizeof(double), const size_t budget=0) {
+        const forall_tiles<3>& tl = tiles3;
+        if (tiles3.setup({first0,first1,first2}, {last0,last1,last2}, itembytes, budget, this->loopnw(nw)) == 0) return;
+        FF_PARFOR_START_IDX(this,parforidx,0,(long)tl.size(),1,PARFOR_DYNAMIC(1),nw) {
+            tl.run(ff_start_idx, ff_stop_idx, f);
+        } FF_PARFOR_STOP(this);
+    }
+
+    /**
+     * @brief Parallel prefix sum (scan)
+     *
+     * out[i] = op(...op(op(identity, in[0]), in[1])..., in[i]) for the
+     * inclusive scan, the same up to in[i-1] for the exclusive one. Two-pass
+     * blocked algorithm on the worker threads of this object (see
+     * forall_scan): op must be associative. out can be first (in place).
+     *
+     * @param first,last the input (random access iterators)
+     * @param out the output (random access iterator)
+     * @param identity identity value of op
+     * @param op <b>op(const V&, const V&) -> V</b>
+     * @param inclusive inclusive or exclusive scan
+     * @param nw number of worker threads
+     */
+    template <typename InIt, typename OutIt, typename V, typename Op>
+    inline void parallel_scan(InIt first, InIt last, OutIt out, const V& identity,
+                              const Op& op, const bool inclusive=true, const long nw=FF_AUTO) {
+        forall_scan(*this, first, last, out, identity, op, inclusive, nw);
+    }
+
+    /**
+     * @brief Parallel stable sort
+     *
+     * Merge sort on the worker threads of this object (see forall_sort).
+     *
+     * @param first,last the elements to sort (random access iterators)
+     * @param comp <b>comp(const V&, const V&) -> bool</b> strict weak ordering
+     * @param nw number of worker threads
+     */
+    template <typename It, typename Compare=std::less<typename std::iterator_traits<It>::value_type> >
+    inline void parallel_sort(It first, It last, const Compare& comp=Compare(), const long nw=FF_AUTO) {
+        forall_sort(*this, first, last, comp, nw);
+    }
+
+protected:
+    forall_tiles<2> tiles2;
+    forall_tiles<3> tiles3;
 };
 
  /*!
@@ -550,6 +660,57 @@ public:
         }
     }
 
+    /**
+     * @brief Parallel for region (step) - dynamic, auto grain
+     *
+     * See ParallelFor::parallel_for_auto.
+     */
+    template <typename Function>
+    inline void parallel_for_auto(long first, long last, long step,
+                                  const Function& f, const long nw=FF_AUTO) {
+        if (first >= last) return;
+        this->setloop_auto(forall_site<Function>(), first, last, step, nw);
+        auto F = [&](const long ff_start_idx, const long ff_stop_idx, const int, const T&) {
+            PRAGMA_IVDEP;
+            for(long idx=ff_start_idx;idx<ff_stop_idx;idx+=step) f(idx);
+        };
+        T res = T();
+        if (this->run_auto(F, T(), res)<0) error("running ParallelForReduce (auto grain)\n");
+    }
+
+    /**
+     * @brief Parallel for region over a 2D iteration space - tiled, dynamic
+     *
+     * See ParallelFor::parallel_for_2d.
+     */
+    template <typename Function>
+    inline void parallel_for_2d(long first0, long last0, long first1, long last1,
+                                const Function& f, const long nw=FF_AUTO,
+                                const size_t itembytes=sizeof(double), const size_t budget=0) {
+        const forall_tiles<2>& tl = tiles2;
+        if (tiles2.setup({first0,first1}, {last0,last1}, itembytes, budget, this->loopnw(nw)) == 0) return;
+        FF_PARFOR_T_START_IDX(this,T,parforidx,0,(long)tl.size(),1,PARFOR_DYNAMIC(1),nw) {
+            tl.run(ff_start_idx, ff_stop_idx, f);
+        } FF_PARFOR_T_STOP(this,T);
+    }
+
+    /**
+     * @brief Parallel for region over a 3D iteration space - tiled, dynamic
+     *
+     * See ParallelFor::parallel_for_3d.
+     */
+    template <typename Function>
+    inline void parallel_for_3d(long first0, long last0, long first1, long last1,
+                                long first2, long last2,
+                                const Function& f, const long nw=FF_AUTO,
+                                const size_t itembytes=sizeof(double), const size_t budget=0) {
+        const forall_tiles<3>& tl = tiles3;
+        if (tiles3.setup({first0,first1,first2}, {last0,last1,last2}, itembytes, budget, this->loopnw(nw)) == 0) return;
+        FF_PARFOR_T_START_IDX(this,T,parforidx,0,(long)tl.size(),1,PARFOR_DYNAMIC(1),nw) {
+            tl.run(ff_start_idx, ff_stop_idx, f);
+        } FF_PARFOR_T_STOP(this,T);
+    }
+
     /* ------------------ parallel_reduce ------------------- */
     /**
      * \brief Parallel reduce (basic)
@@ -640,6 +801,92 @@ public:
         } FF_PARFORREDUCE_F_STOP(this, var, finalreduce);
     }
 
+    /**
+     * \brief Parallel reduce (step) - dynamic, auto grain
+     *
+     * The grain is chosen as in ParallelFor::parallel_for_auto.
+     *
+     * \param var inital value of reduction variable (accumulator)
+     * \param indentity indetity value for the reduction function
+     * \param first first value of the iteration variable
+     * \param last last value of the iteration variable
+     * \param step step increment for the iteration variable
+     * \param body reduce operation (1st phase, executed in parallel)
+     * \param finalreduce reduce operation (2nd phase, executed sequentially)
+     * \param nw number of worker threads
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_auto(T& var, const T& identity,
+                                     long first, long last, long step,
+                                     const Function& body, const FReduction& finalreduce,
+                                     const long nw=FF_AUTO) {
+        if (first >= last) return;
+        this->setloop_auto(forall_site<Function>(), first, last, step, nw);
+        auto F = [&](const long ff_start_idx, const long ff_stop_idx, const int, T& var) {
+            PRAGMA_IVDEP;
+            for(long idx=ff_start_idx;idx<ff_stop_idx;idx+=step) body(idx, var);
+        };
+        if (this->run_auto(F, identity, var)<0) error("running ParallelForReduce (auto grain)\n");
+        if (this->getnw()>1)
+            for(size_t i=0;i<this->getnw();++i) finalreduce(var, this->getres(i));
+    }
+
+    /**
+     * \brief Parallel reduce (step) - dynamic, tree final reduction
+     *
+     * As parallel_reduce, the partial results of the worker threads are
+     * combined by the workers in a binary tree (log2(nw) steps) instead of
+     * sequentially by the calling thread. It pays with many workers and
+     * large reduction variables (e.g. histograms).
+     *
+     * \param finalreduce <b>finalreduce(T& a, const T& b)</b> combines b in a
+     * \param numa the workers running on the same NUMA node are combined first
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_tree(T& var, const T& identity,
+                                     long first, long last, long step, long grain,
+                                     const Function& body, const FReduction& finalreduce,
+                                     const long nw=FF_AUTO, const bool numa=false) {
+        FF_PARFORREDUCE_START(this, var, identity, idx,first,last,step,PARFOR_DYNAMIC(grain),nw) {
+            body(idx, var);
+        } FF_PARFORREDUCE_TREE_STOP(this, var, finalreduce, numa);
+    }
+
+    /**
+     * \brief Parallel reduce (step) - deterministic
+     *
+     * The iterations are divided in blocks of \p block iterations, each
+     * block is reduced starting from identity and the results of the blocks
+     * are combined in a fixed binary tree (see forall_treecombine), as soon
+     * as both the operands are ready, by the workers. The result depends only
+     * on \p block: it is the same for any number of workers and any
+     * scheduling, also for non associative operations (e.g. floating point).
+     * The first combination is finalreduce(var, result of the tree).
+     *
+     * \param block iterations of a block (it fixes the order of the operations)
+     * \param finalreduce <b>finalreduce(T& a, const T& b)</b> combines b in a
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_det(T& var, const T& identity,
+                                    long first, long last, long step, long block,
+                                    const Function& body, const FReduction& finalreduce,
+                                    const long nw=FF_AUTO) {
+        if (first >= last) return;
+        if (block <= 0) block = 1;
+        const long n  = (last-first+step-1)/step;
+        const long nb = (n+block-1)/block;
+        std::vector<T> parts(nb, identity);
+        std::vector<std::atomic<int>> arrived(nb);
+        parallel_for(0, nb, 1, 1, [&](const long b) {
+                T& part = parts[b];
+                const long end = (std::min)(last, first+(b+1)*block*step);
+                PRAGMA_IVDEP;
+                for(long idx=first+b*block*step;idx<end;idx+=step) body(idx, part);
+                forall_treecombine(parts, arrived.data(), b, finalreduce);
+            }, nw);
+        finalreduce(var, parts[0]);
+    }
+
     template <typename Function, typename FReduction>
     inline void parallel_reduce_thid(T& var, const T& identity,
                                      long first, long last, long step, long grain,
@@ -692,7 +939,72 @@ public:
             } FF_PARFORREDUCE_F_STOP(this, var, finalreduce);
         }
     }
-    
+
+    /**
+     * \brief Parallel reduce over a 2D iteration space - tiled, dynamic
+     *
+     * The tiles are scheduled as in ParallelFor::parallel_for_2d.
+     *
+     * \param var inital value of reduction variable (accumulator)
+     * \param indentity indetity value for the reduction function
+     * \param body <b>body(const long i, const long j, T& var)</b> partial reduce
+     * \param finalreduce reduce operation of the partial results
+     * \param nw number of worker threads
+     * \param itembytes bytes of data accessed by one iteration
+     * \param budget bytes of data of a tile (0 means half of the L2 cache)
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_2d(T& var, const T& identity,
+                                   long first0, long last0, long first1, long last1,
+                                   const Function& body, const FReduction& finalreduce,
+                                   const long nw=FF_AUTO,
+                                   const size_t itembytes=sizeof(T), const size_t budget=0) {
+        const forall_tiles<2>& tl = tiles2;
+        if (tiles2.setup({first0,first1}, {last0,last1}, itembytes, budget, this->loopnw(nw)) == 0) return;
+        FF_PARFORREDUCE_START_IDX(this, var, identity, idx,0,(long)tl.size(),1,PARFOR_DYNAMIC(1),nw) {
+            tl.run(ff_start_idx, ff_stop_idx, [&](const long i, const long j) { body(i, j, var); });
+        } FF_PARFORREDUCE_F_STOP(this, var, finalreduce);
+    }
+
+    /**
+     * \brief Parallel reduce over a 3D iteration space - tiled, dynamic
+     *
+     * As parallel_reduce_2d, the body is <b>body(const long i, const long j, const long k, T& var)</b>.
+     */
+    template <typename Function, typename FReduction>
+    inline void parallel_reduce_3d(T& var, const T& identity,
+                                   long first0, long last0, long first1, long last1,
+                                   long first2, long last2,
+                                   const Function& body, const FReduction& finalreduce,
+                                   const long nw=FF_AUTO,
+                                   const size_t itembytes=sizeof(T), const size_t budget=0) {
+        const forall_tiles<3>& tl = tiles3;
+        if (tiles3.setup({first0,first1,first2}, {last0,last1,last2}, itembytes, budget, this->loopnw(nw)) == 0) return;
+        FF_PARFORREDUCE_START_IDX(this, var, identity, idx,0,(long)tl.size(),1,PARFOR_DYNAMIC(1),nw) {
+            tl.run(ff_start_idx, ff_stop_idx, [&](const long i, const long j, const long k) { body(i, j, k, var); });
+        } FF_PARFORREDUCE_F_STOP(this, var, finalreduce);
+    }
+
+    /**
+     * \brief Parallel prefix sum (scan), see ParallelFor::parallel_scan
+     */
+    template <typename InIt, typename OutIt, typename V, typename Op>
+    inline void parallel_scan(InIt first, InIt last, OutIt out, const V& identity,
+                              const Op& op, const bool inclusive=true, const long nw=FF_AUTO) {
+        forall_scan(*this, first, last, out, identity, op, inclusive, nw);
+    }
+
+    /**
+     * \brief Parallel stable sort, see ParallelFor::parallel_sort
+     */
+    template <typename It, typename Compare=std::less<typename std::iterator_traits<It>::value_type> >
+    inline void parallel_sort(It first, It last, const Compare& comp=Compare(), const long nw=FF_AUTO) {
+        forall_sort(*this, first, last, comp, nw);
+    }
+
+protected:
+    forall_tiles<2> tiles2;
+    forall_tiles<3> tiles3;
 };
 
 
@@ -778,7 +1090,7 @@ public:
         // the setloop decides the real number of worker threads that will be started
         // the n. maybe different from nw !
         pfr.setloop(first,last,step,grain,nw); 
-        pfr.setF(Map);
+        pfr.setBody(Map);
         auto donothing=[](task_t) { };
         reduce.setF(donothing);
         auto r=-1;
@@ -800,7 +1112,7 @@ public:
         // the setloop decides the real number of worker threads that will be started
         // the n. maybe different from nw !
         pfr.setloop(first,last,step,grain,nw); 
-        pfr.setF(Map);
+        pfr.setBody(Map);
         reduce.setF(Reduce);
         auto r=-1;
         if (pfr.run_then_freeze(pfr.getnw()) != -1)
@@ -59,13 +59,16 @@
 #include <atomic>
 #include <algorithm>
 #include <deque>
+#include <map>
 #include <vector>
+#include <iterator>
 #include <cmath>
 #include <functional>
 #include <ff/lb.hpp>
 #include <ff/node.hpp>
 #include <ff/farm.hpp>
 #include <ff/spin-lock.hpp>
+#include <ff/topology.hpp>
 
 enum {FF_AUTO=-1};
 
@@ -80,6 +83,35 @@ static bool globalSchedRunning;
 #define PRAGMA_IVDEP
 #endif
 
+// bytes of data of a tile of parallel_for_2d/3d when the size of the L2 cache is unknown
+#if !defined(PARFOR_TILE_BUDGET)
+#define PARFOR_TILE_BUDGET (256*1024)
+#endif
+// the tiles are made smaller to have at least this number of tiles per worker
+#if !defined(PARFOR_TILES_PER_WORKER)
+#define PARFOR_TILES_PER_WORKER 4
+#endif
+// guided chunks: a chunk is 1/PARFOR_GUIDED_DIV of the iterations left in the range
+#if !defined(PARFOR_GUIDED_DIV)
+#define PARFOR_GUIDED_DIV 4
+#endif
+// auto grain: target cost (ticks) of the smallest chunks
+#if !defined(PARFOR_AUTO_CHUNK_TICKS)
+#define PARFOR_AUTO_CHUNK_TICKS 20000
+#endif
+// parallel_scan: blocks per worker (the blocks are scheduled dynamically)
+#if !defined(PARFOR_SCAN_BLOCKS_PER_WORKER)
+#define PARFOR_SCAN_BLOCKS_PER_WORKER 4
+#endif
+// parallel_sort: parts per worker of a merge round (the parts are scheduled dynamically)
+#if !defined(PARFOR_SORT_PARTS_PER_WORKER)
+#define PARFOR_SORT_PARTS_PER_WORKER 4
+#endif
+// parallel_scan/parallel_sort: below this number of elements they run sequentially
+#if !defined(PARFOR_SEQ_THRESHOLD)
+#define PARFOR_SEQ_THRESHOLD 4096
+#endif
+
 namespace ff {
 
     /* -------------------- Parallel For/Reduce Macros -------------------- */
@@ -155,7 +187,7 @@ namespace ff {
     };                                                                            \
     {                                                                             \
       if (name.getnw()>1) {                                                       \
-        name.setF(F_##name);                                                      \
+        name.setBody(F_##name);                                                   \
         if (name.run_and_wait_end()<0) {                                          \
 			error("running parallel for\n");                                      \
         }                                                                         \
@@ -203,7 +235,7 @@ namespace ff {
         };                                                                        \
         if (name.getnw()>1) {                                                     \
           auto ovar_##name = var;                                                 \
-          name.setF(F_##name,idtt_##name);                                        \
+          name.setBody(F_##name,idtt_##name);                                     \
           if (name.run_and_wait_end()<0) {                                        \
 			error("running forall_##name\n");                                     \
           }                                                                       \
@@ -221,7 +253,7 @@ namespace ff {
         };                                                                        \
         if (name.getnw()>1) {                                                     \
           auto ovar_##name = var;                                                 \
-          name.setF(F_##name,idtt_##name);                                        \
+          name.setBody(F_##name,idtt_##name);                                     \
           if (name.run_and_wait_end()<0)                                          \
             error("running ff_forall_farm (reduce F end)\n");	                  \
           var = ovar_##name;                                                      \
@@ -317,7 +349,7 @@ namespace ff {
 #define FF_PARFOR_STOP(name)                                                             \
     };                                                                                   \
     if (name->getnw()>1) {                                                               \
-      name->setF(F_##name);                                                              \
+      name->setBody(F_##name);                                                           \
       if (name->run_then_freeze(name->getnw())<0)                                        \
 		 error("running ff_forall_farm (name)\n");                                       \
       name->wait_freezing();                                                             \
@@ -326,7 +358,7 @@ namespace ff {
 #define FF_PARFOR_T_STOP(name, type)                                                     \
     };                                                                                   \
     if (name->getnw()>1) {                                                               \
-        name->setF(F_##name, type());                                                    \
+        name->setBody(F_##name, type());                                                 \
         if (name->run_then_freeze(name->getnw())<0)                                      \
 		  error("running ff_forall_farm (name)\n");                                      \
         name->wait_freezing();                                                           \
@@ -370,7 +402,7 @@ namespace ff {
         };                                                                               \
         if (name->getnw()>1) {                                                           \
           auto ovar_##name = var;                                                        \
-          name->setF(F_##name,idtt_##name);                                              \
+          name->setBody(F_##name,idtt_##name);                                           \
           if (name->run_then_freeze(name->getnw())<0)                                    \
 			error("running ff_forall_farm (name)\n");                                    \
           name->wait_freezing();                                                         \
@@ -387,7 +419,7 @@ namespace ff {
         };                                                                               \
         if (name->getnw()>1) {                                                           \
           auto ovar_##name = var;                                                        \
-          name->setF(F_##name,idtt_##name);                                              \
+          name->setBody(F_##name,idtt_##name);                                           \
           if (name->run_then_freeze(name->getnw())<0)                                    \
 			 error("running ff_forall_farm (name)\n");                                   \
           name->wait_freezing();                                                         \
@@ -399,6 +431,22 @@ namespace ff {
             F_##name(name->startIdx(),name->stopIdx(),0,var);                            \
         }
 
+// as FF_PARFORREDUCE_F_STOP, the partial results are combined by the workers
+// in a tree (see ff_forall_farm::reduce_tree), numa pairs first the workers
+// of the same NUMA node
+#define FF_PARFORREDUCE_TREE_STOP(name, var, F, numa)                                    \
+        };                                                                               \
+        if (name->getnw()>1) {                                                           \
+          name->setBody(F_##name,idtt_##name);                                           \
+          if (name->run_then_freeze(name->getnw())<0)                                    \
+			 error("running ff_forall_farm (name)\n");                                   \
+          name->wait_freezing();                                                         \
+          if (name->reduce_tree(var, F, numa)<0)                                         \
+			 error("running ff_forall_farm (name)\n");                                   \
+        } else {                                                                         \
+            F_##name(name->startIdx(),name->stopIdx(),0,var);                            \
+        }
+
 
 
 //
@@ -553,6 +601,39 @@ protected:
 
         return ntxw;
     }    
+    // initialize the data vector for the guided scheduling: the iterations are
+    // evenly divided among the workers, each range is consumed in chunks that
+    // shrink down to _chunk (see chunkEnd)
+    virtual inline size_t init_data_guided(long start, long stop) {
+        static_scheduling = false;
+        const long numtasks = std::lrint(std::ceil((stop-start)/(double)_step));
+        const long q = numtasks / long(_nw), r = numtasks % long(_nw);
+
+        data.resize(_nw); eossent.resize(_nw);
+        taskv.resize(8*_nw);
+        skip1=false,jump=0,maxid=-1;
+
+        size_t tt = 0;
+        for(size_t i=0;i<_nw;++i) {
+            long it = q + ((long)i<r ? 1 : 0), n = 0;
+            const long end = it ? (std::min)(start+(it-1)*_step+1, stop) : start;
+            data[i].task.set(start,end);
+            for(long left=it; left>0; ++n) left -= (std::min)(left, chunkOf(left));
+            data[i].ntask = n;
+            tt   += n;
+            start = start + it*_step;
+        }
+        return tt;
+    }
+    // iterations of the next chunk of a range with 'left' iterations
+    inline long chunkOf(long left) const {
+        return _guided ? (std::max)(_chunk, left/PARFOR_GUIDED_DIV) : _chunk;
+    }
+    // end of the chunk beginning at start in a range ending at end
+    inline long chunkEnd(long start, long end) const {
+        const long c = _guided ? chunkOf((end-start+_step-1)/_step) : _chunk;
+        return (std::min)(start+(c-1)*_step+1, end);
+    }
 public:
     forall_Scheduler(ff_loadbalancer* lb, long start, long stop, long step, long chunk, size_t nw):
         lb(lb),_start(start),_stop(stop),_step(step),_chunk(chunk),totaltasks(0),_nw(nw),
@@ -578,7 +659,7 @@ public:
 
 #ifdef FF_PARFOR_PASSIVE_NOSTEALING
     inline bool canUseNoStealing(){
-        return !globalSchedRunning && !static_scheduling && _step == 1 && _chunk == 1;
+        return !globalSchedRunning && !static_scheduling && !_guided && _step == 1 && _chunk == 1;
     }
 #endif
     inline bool sendTask(const bool skipmore=false) {
@@ -592,13 +673,12 @@ public:
         }
 #endif
         size_t remaining    = totaltasks;
-        const long endchunk = (_chunk-1)*_step + 1;
 
     more:
         for(size_t wid=0;wid<_nw;++wid) {
             if (data[wid].ntask >0) {
                 long start = data[wid].task.start;
-                long end   = (std::min)(start+endchunk, data[wid].task.end);
+                long end   = chunkEnd(start, data[wid].task.end);
                 taskv[wid+jump].set(start, end);
                 lb->ff_send_out_to(&taskv[wid+jump], (int) wid);
                 --remaining, --data[wid].ntask;
@@ -646,12 +726,11 @@ public:
             return nextTaskConcurrentNoStealing(task, wid);
         }
 #endif
-        const long endchunk = (_chunk-1)*_step + 1; // next end-point
         auto id  = wid;
     L1:
         if (data[id].ntask.load(std::memory_order_acquire)>0) {
             auto oldstart = data[id].task.start.load(std::memory_order_relaxed);
-            auto end      = (std::min)(oldstart+endchunk, data[id].task.end);
+            auto end      = chunkEnd(oldstart, data[id].task.end);  // next end-point
             auto newstart = (end-1)+_step;
             
             if (!data[id].task.start.compare_exchange_weak(oldstart, newstart,
@@ -699,7 +778,7 @@ public:
         ntask  = data[_maxid].ntask.load(std::memory_order_relaxed);
         if (ntask>0) { 
             if (_maxid != maxid) maxid.store(_maxid, std::memory_order_release);
-            if (ntask<=3) { id = _maxid; goto L1; }
+            if (ntask<=3 || _guided) { id = _maxid; goto L1; }
             
             // try to steal half of the tasks remaining to _maxid
 
@@ -732,12 +811,11 @@ public:
                 return nextTaskConcurrentNoStealing(task, wid);
         }
 #endif
-        const long endchunk = (_chunk-1)*_step + 1;
         int id  = wid;
         if (data[id].ntask) {
         L1:
             long start = data[id].task.start;
-            long end = (std::min)(start+endchunk, data[id].task.end);
+            long end = chunkEnd(start, data[id].task.end);
             --data[id].ntask, (data[id].task).start = (end-1)+_step;
             task->set(start, end);
             return true;
@@ -769,7 +847,7 @@ public:
         }
         id = maxid;
         if (data[id].ntask>0) {
-            if (data[id].ntask<=3) goto L1;
+            if (data[id].ntask<=3 || _guided) goto L1;
 
             // steal half of the tasks
             auto q = data[id].ntask >> 1, r = data[id].ntask & 0x1; 
@@ -810,14 +888,17 @@ public:
         return GO_ON;
     }
 
-    inline void setloop(long start, long stop, long step, long chunk, size_t nw) {
+    // guided (only if chunk>0): the chunks shrink down to chunk, see init_data_guided
+    inline void setloop(long start, long stop, long step, long chunk, size_t nw, bool guided=false) {
         _start=start, _stop=stop, _step=step, _chunk=chunk, _nw=nw;
+        _guided = guided && chunk>0;
         
 #ifdef FF_PARFOR_PASSIVE_NOSTEALING
         _nextIteration = _start;
 #endif
-        if (_chunk<=0) totaltasks = init_data_static(start,stop);
-        else           totaltasks = init_data(start,stop);
+        if (_chunk<=0)    totaltasks = init_data_static(start,stop);
+        else if (_guided) totaltasks = init_data_guided(start,stop);
+        else              totaltasks = init_data(start,stop);
 
         assert(totaltasks>=1);        
         // adjust the number of workers that have to be started
@@ -842,6 +923,7 @@ protected:
     bool             skip1;
     bool             workersspinwait;
     bool             static_scheduling;
+    bool             _guided = false;
     std::vector<forall_task_t> taskv;
 };
 
@@ -851,7 +933,33 @@ class forallreduce_W: public ff_node {
 public:
     typedef Tres Tres_t;
     typedef std::function<void(const long,const long, const int, Tres&)> F_t;
+    // the loop over the chunks of a body set with setBody, instantiated for
+    // the type of the body: the chunks are not called through the std::function
+    typedef void (*B_t)(const void*, forallreduce_W<Tres>*, forall_task_t*, const int, const bool);
 protected:
+    template<typename Body>
+    static inline void runChunk(const Body& body, forallreduce_W<Tres>* w, const long start, const long stop, const int myid) {
+        if (!w->measure) {
+            body(start,stop,myid,w->res);
+            return;
+        }
+        const ticks t0 = getticks();
+        body(start,stop,myid,w->res);
+        w->busy += elapsed(getticks(), t0);
+        w->span += stop-start;
+    }
+    template<typename Body>
+    static void runBody(const void* b, forallreduce_W<Tres>* w, forall_task_t* task, const int myid, const bool first) {
+        const Body& body = *static_cast<const Body*>(b);
+        if (first) {
+            runChunk(body,w,task->start,task->end,myid);
+            if (w->schedRunning) return;
+        }
+        // executed only if the scheduler thread is not running
+        while(w->sched->nextTaskConcurrent(task,myid))
+            runChunk(body,w,task->start,task->end,myid);
+    }
+
     virtual inline void losetime_in(unsigned long) {
         //FFTRACE(lostpopticks+=ff_node::TICKS2WAIT; ++popwait); // FIX
         workerlosetime_in(aggressive);
@@ -869,20 +977,23 @@ public:
 
 #ifdef FF_PARFOR_PASSIVE_NOSTEALING
         forall_task_t tmptask;
-        if(t != (void*) &dummyTask || schedRunning){
-           F(task->start,task->end,myid,res);
-           if (schedRunning) return t;
-        }else{
-           task = &tmptask;
-        }
+        const bool first = (t != (void*) &dummyTask || schedRunning);
+        if (!first) task = &tmptask;
 #else
-        F(task->start,task->end,myid,res);
-        if (schedRunning) return t;
+        const bool first = true;
 #endif
-
-        // the code below is executed only if the scheduler thread is not running
-        while(sched->nextTaskConcurrent(task,myid))
-            F(task->start,task->end,myid,res);
+        if (B) {
+            B(body,this,task,myid,first);
+            if (schedRunning) return t;
+        } else {
+            if (first) {
+                F(task->start,task->end,myid,res);
+                if (schedRunning) return t;
+            }
+            // the code below is executed only if the scheduler thread is not running
+            while(sched->nextTaskConcurrent(task,myid))
+                F(task->start,task->end,myid,res);
+        }
         
         if (spinwait) {
             loopbar->doBarrier(myid);
@@ -894,9 +1005,20 @@ public:
     inline void enableSpinWait() {  spinwait=true; }
 
     inline void setF(F_t _F, const Tres& idtt, bool a=true) { 
-        F=_F, res=idtt, aggressive=a;
+        F=_F, B=nullptr, res=idtt, aggressive=a;
+    }
+    // the body is not copied, it has to live until the end of the loop
+    template<typename Body>
+    inline void setBody(const Body& _B, const Tres& idtt, bool a=true) {
+        B=&runBody<Body>, body=&_B, res=idtt, aggressive=a;
     }
     inline const Tres& getres() const { return res; }
+    inline Tres& getres() { return res; }
+
+    // the time spent in the chunks of a body set with setBody (see setloop_auto)
+    inline void setMeasure(bool m) { measure=m, busy=0, span=0; }
+    inline double busyTicks() const { return busy; }
+    inline long   busySpan()  const { return span; }
 
 protected:
     forall_Scheduler *const sched;
@@ -905,6 +1027,11 @@ protected:
 protected:
     bool spinwait,aggressive;
     F_t  F;
+    B_t  B = nullptr;
+    const void* body = nullptr;
+    bool   measure = false;
+    double busy = 0;     // ticks
+    long   span = 0;     // indexes covered by the chunks measured
     Tres res;
 };
 
@@ -924,12 +1051,17 @@ public:
         auto task = (forall_task_t*)t;
         auto myid = get_my_id();
 
-        F(task->start,task->end,myid,res);
-        if (schedRunning) return t;
-
-        // the code below is executed only if the scheduler thread is not running
-        while(sched->nextTaskConcurrent(task,myid))
+        if (B) {
+            B(body,this,task,myid,true);
+            if (schedRunning) return t;
+        } else {
             F(task->start,task->end,myid,res);
+            if (schedRunning) return t;
+
+            // the code below is executed only if the scheduler thread is not running
+            while(sched->nextTaskConcurrent(task,myid))
+                F(task->start,task->end,myid,res);
+        }
 
         if (spinwait) {
             res.ff_send_out(EOS);
@@ -942,7 +1074,12 @@ public:
     void svc_end() { res.ff_send_out(EOS); }
 
     inline void setF(F_t _F, const Tres_t&, bool a=true) { 
-        F=_F, aggressive=a;
+        F=_F, B=nullptr, aggressive=a;
+    }
+    // the results are sent out, res is not reset
+    template<typename Body>
+    inline void setBody(const Body& _B, const Tres_t&, bool a=true) {
+        B=&runBody<Body>, body=&_B, aggressive=a;
     }
 
     // The following methods are custom for this node which is not multi-output. FIX
@@ -952,6 +1089,42 @@ public:
 };
 
 
+/*
+ * Tree reduction of parts[0,n( in parts[0]: F(a,b) combines b in a. The
+ * partials are paired in a fixed binary tree (0 with 1, 2 with 3, then 0-1
+ * with 2-3, ...), the left operand is always the one with the lower index,
+ * hence the result does not depend on who combines the partials. Each leaf
+ * is given by one task: a task combines a pair only if it arrives last (the
+ * sibling subtree is complete), then it goes up, otherwise it returns.
+ * No task waits for another one. arrived has n counters set to 0.
+ */
+template<typename T, typename FReduction>
+static inline void forall_treecombine(std::vector<T>& parts, std::atomic<int>* arrived,
+                                      size_t leaf, const FReduction& F) {
+    const size_t n = parts.size();
+    // at each level a node holds the partial of w leaves, starting from leaf (k&~1)*w
+    for(size_t w=1, k=leaf; w<n; w<<=1, k>>=1) {
+        const size_t left = (k&~(size_t)1)*w, right = left+w;
+        if (right >= n) continue;   // no sibling
+        // right is an odd multiple of w: one counter per node
+        if (arrived[right].fetch_add(1, std::memory_order_acq_rel) == 0) return;
+        F(parts[left], parts[right]);
+    }
+}
+
+// the auto grain of a call site (see ff_forall_farm::setloop_auto)
+struct forall_autograin {
+    double tpi   = 0;   // ticks per iteration (moving average), 0 if never measured
+    long   grain = 0;   // the grain of the last loop
+};
+
+// the identity of a call site of the auto grain loops: the type of the body,
+// different for each lambda expression
+template<typename Function>
+inline const void* forall_site() {
+    static const char site = 0;
+    return &site;
+}
 
 template <typename Worker_t>
 class ff_forall_farm: public ff_farm {
@@ -1166,34 +1339,142 @@ public:
     }
 
     inline void setF(F_t  _F, const Tres_t& idtt=Tres_t()) { //(Tres)0) { 
-        const size_t nw                = getnw();
+        const bool mode = setSchedRunning();
         const svector<ff_node*> &nodes = getWorkers();
-        // aggressive mode enabled if the number of threads is less than
-        // or equal to the number of cores
-        const bool mode = (nw <= numCores);
-    
-        // NOTE: in case of static scheduling, the scheduler is never started !
-        schedRunning = (!removeSched && startScheduler(nw, ((forall_Scheduler*)getEmitter())->getnumtasks()));
+        for(size_t i=0;i<getnw();++i) {
+            //auto w = (forallreduce_W<Tres>*)nodes[i];
+            auto w = (Worker_t*)nodes[i];
+            w->setF(_F, idtt, mode);
+            w->setSchedRunning(schedRunning);
+            w->setMeasure(false);
+        }
+    }
 
-#ifdef FF_PARFOR_PASSIVE_NOSTEALING
-        globalSchedRunning = schedRunning;
-#endif
+    /*
+     * As setF, but the workers call the body directly, the loop over the
+     * chunks is instantiated for its type: no std::function is built nor
+     * copied and the chunks are not called through it. The body is
+     * f(start,stop,thid,res) and it has to live until the loop is completed.
+     * The FF_PARFOR* macros, hence the ParallelFor* classes, use this method.
+     */
+    template<typename Body>
+    inline void setBody(const Body& _B, const Tres_t& idtt=Tres_t()) {
+        const bool mode = setSchedRunning();
+        const svector<ff_node*> &nodes = getWorkers();
+        for(size_t i=0;i<getnw();++i) {
+            auto w = (Worker_t*)nodes[i];
+            w->setBody(_B, idtt, mode);
+            w->setSchedRunning(schedRunning);
+            w->setMeasure(autosite != nullptr);
+        }
+    }
 
-        if (schedRunning)  {
-            for(size_t i=0;i<nw;++i) {
-                //auto w = (forallreduce_W<Tres>*)nodes[i];
+    /*
+     * Auto grain. The loop of the call site 'site' (see forall_site) is
+     * scheduled with guided chunks: the chunks taken from the range of a
+     * worker shrink towards its end down to the grain. The grain is chosen
+     * so that a chunk lasts about PARFOR_AUTO_CHUNK_TICKS ticks, the cost of
+     * the iterations is measured by the workers (getticks) and remembered
+     * from one loop of the site to the next one. The first loop of a site
+     * uses a grain of 1.
+     * The loop is then run with run_auto.
+     */
+    inline void setloop_auto(const void* site, long begin, long end, long step, long nw) {
+        forall_autograin& g = autograins[site];
+        const long nwr  = (long)loopnw(nw);
+        const long n    = (end>begin) ? (end-begin+step-1)/step : 0;
+        const long gmax = (std::max)(1L, n/nwr);
+        g.grain = (g.tpi>0) ? (std::max)(1L, (std::min)(gmax, std::lrint(PARFOR_AUTO_CHUNK_TICKS/g.tpi))) : 1;
+        autosite = &g;
+        setloop(begin,end,step,g.grain,nw,true);
+    }
+
+    /*
+     * Runs the loop set by setloop_auto, the body is F(start,stop,thid,res).
+     * With more than one worker the workers start from idtt (see getres),
+     * otherwise F is called by this thread on res.
+     */
+    template<typename Body>
+    inline int run_auto(const Body& F, const Tres_t& idtt, Tres_t& res) {
+        double busy = 0;
+        long   span = 0;
+        int r = 0;
+        if (getnw()>1) {
+            setBody(F, idtt);
+            r = run_then_freeze(getnw());
+            if (r>=0) r = wait_freezing();
+            const svector<ff_node*> &nodes = getWorkers();
+            for(size_t i=0;i<getnw();++i) {
                 auto w = (Worker_t*)nodes[i];
-                w->setF(_F, idtt, mode);
-                w->setSchedRunning(true);
+                busy += w->busyTicks();
+                span += w->busySpan();
+                w->setMeasure(false);
             }
         } else {
-            for(size_t i=0;i<nw;++i) {
-                //auto w = (forallreduce_W<Tres>*)nodes[i];
-                auto w = (Worker_t*)nodes[i];
-                w->setF(_F, idtt, mode);
-                w->setSchedRunning(false);
-            }
+            const ticks t0 = getticks();
+            F(startIdx(),stopIdx(),0,res);
+            busy = elapsed(getticks(), t0);
+            span = stopIdx()-startIdx();
+        }
+        const long n = (span+stepIdx()-1)/stepIdx();
+        if (autosite && n>0 && busy>0) {
+            // moving average of the cost of an iteration
+            const double tpi = busy/n;
+            autosite->tpi = (autosite->tpi>0) ? (autosite->tpi+tpi)/2 : tpi;
         }
+        autosite = nullptr;
+        return r;
+    }
+
+    // the grain of the last loop of the site, 0 if it has never run in auto mode
+    inline long autoGrain(const void* site) const {
+        auto it = autograins.find(site);
+        return (it == autograins.end()) ? 0 : it->second.grain;
+    }
+
+    /*
+     * Combines in var the partial results of the workers of the last loop
+     * (see getres) with a tree reduction done by the workers themselves (see
+     * forall_treecombine): log2(getnw()) combines on the critical path instead
+     * of getnw() on this thread. The partials are moved out of the workers.
+     * With numa the workers running on the same NUMA node are paired first,
+     * each leaf is given to the worker that computed it.
+     */
+    template<typename FReduction>
+    inline int reduce_tree(Tres_t& var, const FReduction& F, const bool numa=false) {
+        const size_t n = getnw();
+        if (n==1) { F(var, getres(0)); return 0; }
+        const svector<ff_node*> &nodes = getWorkers();
+        std::vector<size_t> order(n);   // leaf -> worker
+        for(size_t i=0;i<n;++i) order[i]=i;
+        if (numa) {
+            const ff_topology& topo = ff_topology::instance();
+            auto node = [&](size_t i) {
+                const ff_cpuinfo* c = topo.cpu(nodes[i]->getCPUId());
+                return c ? c->node : -1;
+            };
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return node(a) < node(b); });
+        }
+        std::vector<size_t> leaf(n);    // worker -> leaf
+        std::vector<Tres_t> parts;
+        parts.reserve(n);
+        for(size_t i=0;i<n;++i) {
+            leaf[order[i]] = i;
+            parts.push_back(std::move(((Worker_t*)nodes[order[i]])->getres()));
+        }
+        std::vector<std::atomic<int>> arrived(n);
+        // one iteration per worker: with the static scheduling the worker i
+        // has the iteration i
+        auto B = [&](const long start, const long stop, const int, Tres_t&) {
+            for(long i=start;i<stop;++i) forall_treecombine(parts, arrived.data(), leaf[i], F);
+        };
+        setloop(0,(long)n,1,0,(long)n);
+        setBody(B);
+        int r = run_then_freeze(getnw());
+        if (r>=0) r = wait_freezing();
+        if (r<0) return r;
+        F(var, parts[0]);
+        return 0;
     }
     /* NOTE: - chunk>0   means dynamic scheduling with grain equal to chunk, that is,
      *                   no more than chunk iterations at a time is computed by 
@@ -1205,17 +1486,21 @@ public:
      *                   than chunk iterations. Then chunks are assigned to the threads 
      *                   in a round-robin fashion.
      */
-    inline void setloop(long begin,long end,long step,long chunk,long nw) {
+    inline void setloop(long begin,long end,long step,long chunk,long nw,bool guided=false) {
         if (nw>(ssize_t)getNWorkers()) {
             error("The number of threads specified is greater than the number set in the ParallelFor* constructor, it will be downsized\n");
             nw = getNWorkers();
         }
         assert(nw<=(ssize_t)getNWorkers());
         forall_Scheduler *sched = (forall_Scheduler*)getEmitter();
-        sched->setloop(begin,end,step,chunk,(nw<=0)?getNWorkers():(size_t)nw);
+        sched->setloop(begin,end,step,chunk,(nw<=0)?getNWorkers():(size_t)nw,guided);
     }
     // return the number of workers running or supposed to run
     inline size_t getnw() { return ((const forall_Scheduler*)getEmitter())->running(); }
+    // the number of workers of a loop set with nw workers (FF_AUTO means all)
+    inline size_t loopnw(const long nw) const {
+        return (nw<=0 || nw>(long)getNWorkers()) ? getNWorkers() : (size_t)nw;
+    }
     
     inline const Tres_t& getres(int i) {
         //return  ((forallreduce_W<Tres>*)(getWorkers()[i]))->getres();
@@ -1227,12 +1512,270 @@ public:
 
     void resetskipwarmup() { assert(skipwarmup); skipwarmup=false;}
 protected:
+    // decides if the scheduler thread is started for the loop set, it returns
+    // the aggressive mode of the workers
+    inline bool setSchedRunning() {
+        // NOTE: in case of static scheduling, the scheduler is never started !
+        schedRunning = (!removeSched && startScheduler(getnw(), ((forall_Scheduler*)getEmitter())->getnumtasks()));
+#ifdef FF_PARFOR_PASSIVE_NOSTEALING
+        globalSchedRunning = schedRunning;
+#endif
+        // aggressive mode enabled if the number of threads is less than
+        // or equal to the number of cores
+        return (getnw() <= numCores);
+    }
+
     bool   removeSched = false;
     bool   schedRunning= true;
+    std::map<const void*, forall_autograin> autograins;  // by call site
+    forall_autograin* autosite = nullptr;               // the loop set by setloop_auto
     bool   skipwarmup  = false;
     bool   spinwait    = false;
 };
 
+
+/*
+ * The iteration space of parallel_for_2d/3d divided in tiles.
+ *
+ * The data accessed by the iterations of a tile (itembytes bytes each) fit
+ * the budget, by default half of the L2 cache. The last dimension is the
+ * innermost one: its side is a multiple of the cache line.
+ * The tiles are numbered following the Morton (Z-order) curve of their
+ * coordinates and the numbers are scheduled as the indexes of a 1D loop:
+ * the contiguous ranges initially assigned to the workers, and those stolen,
+ * are compact blocks of tiles.
+ * The tiles are computed again only if the loop changes.
+ */
+template<int D>
+class forall_tiles {
+    static_assert(D==2 || D==3, "forall_tiles: 2 or 3 dimensions");
+public:
+    // it returns the number of tiles, 0 if the iteration space is empty
+    size_t setup(const long (&first)[D], const long (&last)[D],
+                 size_t itembytes, size_t budget, size_t nw) {
+        if (budget == 0) {
+            const size_t l2 = ff_topology::instance().cacheSize(2);
+            budget = l2 ? l2/2 : PARFOR_TILE_BUDGET;
+        }
+        if (itembytes == 0) itembytes = 1;
+        if (std::equal(first, first+D, _first) && std::equal(last, last+D, _last) &&
+            itembytes == _itembytes && budget == _budget && nw == _nw)
+            return order.size();
+        std::copy(first, first+D, _first);
+        std::copy(last,  last+D,  _last);
+        _itembytes = itembytes, _budget = budget, _nw = nw;
+        order.clear();
+
+        long n[D];
+        for(int d=0;d<D;++d) {
+            n[d] = last[d]-first[d];
+            if (n[d] <= 0) return 0;
+        }
+        double points  = (std::max)(1.0, budget/(double)itembytes);
+        const long line = (std::max)(1L, (long)(CACHE_LINE_SIZE/itembytes));
+        long side = std::lrint(std::floor(std::pow(points, 1.0/D)));
+        side = ((side+line-1)/line)*line;
+        _tile[D-1] = (std::min)(side, n[D-1]);
+        points /= _tile[D-1];
+        for(int d=D-2;d>=0;--d) {
+            const long s = std::lrint(std::floor(std::pow(points, 1.0/(d+1))));
+            _tile[d] = (std::max)(1L, (std::min)(s, n[d]));
+            points /= _tile[d];
+        }
+
+        // load balancing, the outer dimensions are split first
+        for(;;) {
+            size_t ntiles = 1;
+            for(int d=0;d<D;++d) ntiles *= _ntiles[d] = (n[d]+_tile[d]-1)/_tile[d];
+            if (ntiles >= PARFOR_TILES_PER_WORKER*nw) break;
+            int d = 0;
+            while(d<D && _tile[d]==1) ++d;
+            if (d==D) break;
+            _tile[d] = (_tile[d]+1)/2;
+        }
+
+        // tiles sorted by the Morton code of their coordinates
+        size_t ntiles = 1;
+        for(int d=0;d<D;++d) ntiles *= _ntiles[d];
+        std::vector<std::pair<uint64_t,size_t> > codes(ntiles);
+        for(size_t t=0;t<ntiles;++t) {
+            size_t idx = t;
+            uint64_t c[D], code = 0;
+            for(int d=D-1;d>=0;--d) c[d] = idx % _ntiles[d], idx /= _ntiles[d];
+            for(int b=0;b<64/D;++b)
+                for(int d=0;d<D;++d)
+                    code |= ((c[d]>>b) & 1ULL) << (b*D + (D-1-d));
+            codes[t] = std::make_pair(code, t);
+        }
+        std::sort(codes.begin(), codes.end());
+        order.resize(ntiles);
+        for(size_t t=0;t<ntiles;++t) order[t] = codes[t].second;
+        return ntiles;
+    }
+
+    inline size_t size() const { return order.size(); }
+    // the side of the tiles in each dimension
+    inline const long* tile() const { return _tile; }
+
+    // the bounds of the t-th tile (in Morton order)
+    inline void bounds(size_t t, long (&lo)[D], long (&hi)[D]) const {
+        size_t idx = order[t];
+        for(int d=D-1;d>=0;--d) {
+            lo[d] = _first[d] + (long)(idx % _ntiles[d])*_tile[d];
+            hi[d] = (std::min)(lo[d]+_tile[d], _last[d]);
+            idx  /= _ntiles[d];
+        }
+    }
+
+    // calls f(i,j) (f(i,j,k) in 3D) for all the iterations of the tiles [start,stop(
+    template<typename Function>
+    inline void run(long start, long stop, const Function& f) const {
+        long lo[D], hi[D];
+        for(long t=start;t<stop;++t) {
+            bounds(t, lo, hi);
+            if constexpr (D==2) {
+                for(long i=lo[0];i<hi[0];++i) {
+                    PRAGMA_IVDEP;
+                    for(long j=lo[1];j<hi[1];++j) f(i,j);
+                }
+            } else {
+                for(long i=lo[0];i<hi[0];++i)
+                    for(long j=lo[1];j<hi[1];++j) {
+                        PRAGMA_IVDEP;
+                        for(long k=lo[2];k<hi[2];++k) f(i,j,k);
+                    }
+            }
+        }
+    }
+
+protected:
+    long   _first[D] = {}, _last[D] = {};
+    long   _tile[D] = {}, _ntiles[D] = {};
+    size_t _itembytes = 0, _budget = 0, _nw = 0;
+    std::vector<size_t> order;  // Morton order -> row-major index of the tile
+};
+
+/*
+ * Scan and sort on the worker threads of a ParallelFor/ParallelForReduce
+ * object (pf), see ParallelFor::parallel_scan and ParallelFor::parallel_sort.
+ * The parallel phases are parallel_for loops of pf over blocks of the input.
+ */
+
+/*
+ * Two-pass blocked scan: the reduction of each block is computed in
+ * parallel, the reductions are scanned sequentially giving the offset of
+ * each block, then the blocks are scanned in parallel starting from their
+ * offsets. op must be associative, the input can be the output.
+ */
+template<typename PF, typename InIt, typename OutIt, typename T, typename Op>
+static inline void forall_scan(PF& pf, InIt first, InIt last, OutIt out,
+                               const T& identity, const Op& op, const bool inclusive, const long nw) {
+    auto scan = [&](long lo, long hi, T acc) {
+        if (inclusive)
+            for(long i=lo;i<hi;++i) { acc = op(acc, first[i]); out[i] = acc; }
+        else
+            for(long i=lo;i<hi;++i) { T x = op(acc, first[i]); out[i] = acc; acc = x; }
+    };
+    const long n  = last - first;
+    const long wn = (long)pf.loopnw(nw);
+    if (n <= 0) return;
+    if (wn <= 1 || n < PARFOR_SEQ_THRESHOLD) { scan(0, n, identity); return; }
+
+    long nb = wn*PARFOR_SCAN_BLOCKS_PER_WORKER;
+    const long bs = (n + nb - 1) / nb;
+    nb = (n + bs - 1) / bs;
+    std::vector<T> offs(nb, identity);
+    // 1st pass: the reduction of blocks 0..nb-2 (that of the last one is not needed)
+    pf.parallel_for(0, nb-1, 1, 1, [&](const long b) {
+            T acc = identity;
+            const long hi = (b+1)*bs;
+            for(long i=b*bs;i<hi;++i) acc = op(acc, first[i]);
+            offs[b+1] = acc;
+        }, wn);
+    for(long b=1;b<nb;++b) offs[b] = op(offs[b-1], offs[b]);
+    // 2nd pass
+    pf.parallel_for(0, nb, 1, 1, [&](const long b) {
+            scan(b*bs, (std::min)(n, (b+1)*bs), offs[b]);
+        }, wn);
+}
+
+/*
+ * Co-rank of the merge path: the number of elements of a[0,m( among the
+ * first k elements of the stable merge of a and b (on equal elements those
+ * of a come first).
+ */
+template<typename It, typename Compare>
+static inline long forall_corank(long k, It a, long m, It b, long n, const Compare& comp) {
+    long lo = (std::max)(0L, k-n), hi = (std::min)(k, m);
+    while(lo < hi) {
+        const long i = lo + (hi-lo)/2;
+        // a[i] precedes b[k-i-1]: too few elements taken from a
+        if (!comp(b[k-i-1], a[i])) lo = i+1;
+        else hi = i;
+    }
+    return lo;
+}
+
+/*
+ * Stable merge sort. The input is divided in one block per worker, the
+ * blocks are sorted in parallel and then merged pairwise in log2(nw) rounds
+ * alternating between the input and a temporary buffer. The output of each
+ * round is divided in PARFOR_SORT_PARTS_PER_WORKER parts per worker, each
+ * part is merged by one thread from the positions given by forall_corank:
+ * all the workers are busy also in the last rounds, with few long runs.
+ * The elements must be default constructible and movable.
+ */
+template<typename PF, typename It, typename Compare>
+static inline void forall_sort(PF& pf, It first, It last, const Compare& comp, const long nw) {
+    typedef typename std::iterator_traits<It>::value_type V;
+    const long n  = last - first;
+    const long wn = (long)pf.loopnw(nw);
+    if (wn <= 1 || n < PARFOR_SEQ_THRESHOLD) { std::stable_sort(first, last, comp); return; }
+
+    // the boundaries of the sorted runs
+    std::vector<long> runs;
+    for(long b=0;b<=wn;++b) runs.push_back(n*b/wn);
+    pf.parallel_for(0, wn, 1, 1, [&](const long b) {
+            std::stable_sort(first+runs[b], first+runs[b+1], comp);
+        }, wn);
+
+    std::vector<V> tmp(n);
+    const long parts = wn*PARFOR_SORT_PARTS_PER_WORKER;
+    bool intmp = false;     // where the runs are
+    while(runs.size() > 2) {
+        const long nr = (long)runs.size()-1;
+        auto round = [&](auto src, auto dst) {
+            pf.parallel_for(0, parts, 1, 1, [&](const long p) {
+                    const long lo = n*p/parts, hi = n*(p+1)/parts;
+                    // the pairs of runs overlapping [lo,hi(
+                    long r = (long)(std::upper_bound(runs.begin(), runs.end(), lo) - runs.begin()) - 1;
+                    r &= ~1L;
+                    for(;r<nr && runs[r]<hi;r+=2) {
+                        const long s  = runs[r], e = runs[(std::min)(r+2, nr)];
+                        const long mid = runs[(std::min)(r+1, nr)];
+                        const long k0 = (std::max)(lo, s) - s, k1 = (std::min)(hi, e) - s;
+                        const long m = mid - s, mb = e - mid;
+                        const long i0 = forall_corank(k0, src+s, m, src+mid, mb, comp);
+                        const long i1 = forall_corank(k1, src+s, m, src+mid, mb, comp);
+                        std::merge(std::make_move_iterator(src+s+i0),   std::make_move_iterator(src+s+i1),
+                                   std::make_move_iterator(src+mid+k0-i0), std::make_move_iterator(src+mid+k1-i1),
+                                   dst+s+k0, comp);
+                    }
+                }, wn);
+        };
+        if (intmp) round(tmp.begin(), first);
+        else round(first, tmp.begin());
+        intmp = !intmp;
+        std::vector<long> next;
+        for(long r=0;r<nr;r+=2) next.push_back(runs[r]);
+        next.push_back(n);
+        runs.swap(next);
+    }
+    if (intmp)
+        pf.parallel_for(0, parts, 1, 1, [&](const long p) {
+                std::move(tmp.begin()+n*p/parts, tmp.begin()+n*(p+1)/parts, first+n*p/parts);
+            }, wn);
+}
     
 } // namespace ff
 
@@ -0,0 +1,239 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \file parking.hpp
+ * \ingroup building_blocks
+ *
+ * \brief Waiting strategies used by the blocking run-time protocol
+ *
+ */
+
+#ifndef FF_PARKING_HPP
+#define FF_PARKING_HPP
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * In blocking mode (see BLOCKING_MODE in config.hpp) a node that finds its
+ * input channels empty (or its output channel full) waits on a condition
+ * variable with a timeout of FF_TIMEDWAIT_NS. The producer signals the
+ * consumer's condition variable only when the channel was empty.
+ *
+ * This file adds a second waiting strategy (spin-then-park) that can be
+ * selected per node with ff_node::spinpark_mode():
+ *   - the waiting thread first polls the channels for a bounded number of
+ *     attempts (the budget adapts between FF_SPINPARK_MIN and FF_SPINPARK_MAX
+ *     depending on whether the last waits were satisfied while spinning);
+ *   - then it raises the "sleeper present" flag, polls the channels once
+ *     more and parks on the futex word associated with its condition variable;
+ *   - the producer, after each push, wakes the consumer up only if the
+ *     "sleeper present" flag is set.
+ *
+ * The futex word lives in the same memory block of the condition variable
+ * (see ff_blkcond_t), therefore the blocking protocol does not change:
+ * each consumer has one condition variable, shared by all its input
+ * channels, and the producers get it through set_output_blocking.
+ *
+ * On platforms without futexes the park phase is a timed condition-variable
+ * wait as in the default strategy.
+ *
+ */
+
+#include <atomic>
+#include <algorithm>
+#include <ff/config.hpp>
+#include <ff/sysdep.h>
+#include <ff/platforms/platform.h>
+#include <ff/utils.hpp>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace ff {
+
+/*
+ * The condition variable used in the blocking protocol.
+ * The pthread_cond_t MUST be the first field: the run-time passes around
+ * pointers to the condition variable (pthread_cond_t*) and gets back the
+ * extra fields with ff_blkcond.
+ */
+struct ff_blkcond_t {
+    pthread_cond_t         cond;
+    std::atomic<unsigned>  seq;        // futex word, bumped by the producer at each wake-up
+    std::atomic<unsigned>  sleeping;   // "sleeper present" flag
+    std::atomic<unsigned>  parking;    // the consumer uses the spin-then-park strategy
+    unsigned long          budget;     // current spinning budget (accessed by the waiting thread only)
+};
+
+static inline ff_blkcond_t* ff_blkcond(pthread_cond_t *c) {
+    return reinterpret_cast<ff_blkcond_t*>(c);
+}
+
+/*
+ * Initializes a condition variable allocated with
+ *    malloc(sizeof(ff_blkcond_t))
+ * returns 0 on success.
+ */
+static inline int ff_blkcond_init(pthread_cond_t *c) {
+    if (pthread_cond_init(c, NULL) != 0) return -1;
+    ff_blkcond_t *b = ff_blkcond(c);
+    b->seq.store(0);
+    b->sleeping.store(0);
+    b->parking.store(0);
+    b->budget = FF_SPINPARK_MIN;
+    return 0;
+}
+
+#if defined(__linux__)
+static inline void ff_futex_wait(std::atomic<unsigned> *word, unsigned val, const struct timespec *ts) {
+    syscall(SYS_futex, reinterpret_cast<unsigned*>(word), FUTEX_WAIT_PRIVATE, val, ts, NULL, 0);
+}
+static inline void ff_futex_wake(std::atomic<unsigned> *word) {
+    syscall(SYS_futex, reinterpret_cast<unsigned*>(word), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#endif
+
+/*
+ * Producer side, to be called after a successful push into one of the
+ * input channels of the consumer owning the condition variable 'c'.
+ * 'wasempty' is true if the channel was empty before the push.
+ */
+static inline void ff_blkcond_signal(pthread_cond_t *c, bool wasempty=true) {
+    ff_blkcond_t *b = ff_blkcond(c);
+#if defined(__linux__)
+    if (b->parking.load(std::memory_order_relaxed)) {
+        // orders the push with the load of the flag (see ff_blkwait::wait)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (b->sleeping.load(std::memory_order_relaxed)) {
+            b->seq.fetch_add(1, std::memory_order_release);
+            ff_futex_wake(&b->seq);
+        }
+        return;
+    }
+#endif
+    if (wasempty) pthread_cond_signal(c);
+}
+
+
+/*!
+ *  \class ff_blkwait
+ *  \ingroup building_blocks
+ *
+ *  \brief A waiting episode in blocking mode.
+ *
+ *  It is a stack object created before a polling loop on the channels.
+ *  The wait method has to be called each time the polling fails,
+ *  the destructor ends the episode.
+ *  Usage:
+ *
+ *    ff_blkwait w(m, c, spinpark);
+ *    while(!channel->pop(&task)) w.wait();
+ *
+ *  If spinpark is false, the wait method is the timed condition-variable wait
+ *  of the default blocking protocol.
+ *  The timeout is used for the park phase, the producers waiting for a full
+ *  channel are never woken up so they should use FF_TIMEDWAIT_NS.
+ *
+ */
+class ff_blkwait {
+public:
+    ff_blkwait(pthread_mutex_t *m, pthread_cond_t *c, bool spinpark,
+               long timeout_ns=FF_SPINPARK_TIMEOUT_NS):
+        m(m),c(c),b(nullptr),timeout_ns(timeout_ns),spins(0),snapshot(0),
+        announced(false),parked(false) {
+        if (spinpark && c) {
+            b = ff_blkcond(c);
+            if (!b->parking.load(std::memory_order_relaxed))
+                b->parking.store(1);
+        }
+    }
+
+    ~ff_blkwait() {
+        if (!b) return;
+        if (announced) b->sleeping.store(0, std::memory_order_relaxed);
+        if (parked) {
+            // we had to park, next time we spin less
+            b->budget = (std::max)(b->budget>>1, (unsigned long)FF_SPINPARK_MIN);
+        } else if (spins) {
+            // we got something while spinning, next time we can spin a bit longer
+            b->budget = (std::min)(b->budget<<1, (unsigned long)FF_SPINPARK_MAX);
+        }
+    }
+
+    inline void wait() {
+        if (!b) { timedwait(FF_TIMEDWAIT_NS); return; }
+
+        if (spins < b->budget) {  // spinning phase
+            ++spins;
+            PAUSE();
+            return;
+        }
+#if defined(__linux__)
+        if (!announced) {
+            // the caller polls again the channels after this store,
+            // so that a push done before the store is not lost
+            snapshot = b->seq.load(std::memory_order_acquire);
+            b->sleeping.store(1, std::memory_order_seq_cst);
+            announced = true;
+            return;
+        }
+        struct timespec ts = {timeout_ns / 1000000000L, timeout_ns % 1000000000L};
+        ff_futex_wait(&b->seq, snapshot, &ts);
+        snapshot = b->seq.load(std::memory_order_acquire);
+#else
+        timedwait(FF_TIMEDWAIT_NS);
+#endif
+        parked = true;
+    }
+
+protected:
+    inline void timedwait(long ns) {
+        struct timespec tv;
+        clock_gettime(CLOCK_REALTIME, &tv);
+        tv.tv_nsec += ns % 1000000000L;
+        tv.tv_sec  += ns / 1000000000L;
+        if (tv.tv_nsec>=1e+9) {
+            tv.tv_sec+=1;
+            tv.tv_nsec-=1e+9;
+        }
+        pthread_mutex_lock(m);
+        pthread_cond_timedwait(c, m, &tv);
+        pthread_mutex_unlock(m);
+    }
+
+private:
+    pthread_mutex_t *m;
+    pthread_cond_t  *c;
+    ff_blkcond_t    *b;
+    const long       timeout_ns;
+    unsigned long    spins;
+    unsigned         snapshot;
+    bool             announced;
+    bool             parked;
+};
+
+} // namespace ff
+
+#endif /* FF_PARKING_HPP */
@@ -1176,6 +1176,11 @@ public:
     void blocking_mode(bool blk=true) {
         blocking_in = blocking_out = blk;
     }
+    void spinpark_mode(bool sp=true) {
+        spinpark = sp;
+        for(size_t i=0;i<nodes_list.size();++i)
+            nodes_list[i]->spinpark_mode(sp);
+    }
     void no_barrier() {
         initial_barrier = false;
     }
@@ -1409,16 +1414,13 @@ public:
          assert(inbuffer != NULL);
 
          if (ff_node::blocking_out) {
+             ff_blkwait w(prod_m, prod_c, spinpark, FF_TIMEDWAIT_NS);
          _retry:
              if (inbuffer->push(task)) {
-                 pthread_cond_signal(p_cons_c);
+                 ff_blkcond_signal(p_cons_c);
                  return true;
              } 
-             struct timespec tv;
-             timedwait_timeout(tv);             
-             pthread_mutex_lock(prod_m);
-             pthread_cond_timedwait(prod_c, prod_m, &tv);
-             pthread_mutex_unlock(prod_m);
+             w.wait();
              goto _retry;
          }
          for(unsigned long i=0;i<retry;++i) {
@@ -1455,16 +1457,13 @@ public:
         }
 
         if (ff_node::blocking_in) {
+            ff_blkwait w(cons_m, cons_c, spinpark);
         _retry:
             if (outbuffer->pop(task)) {
                 if ((*task != (void *)FF_EOS)) return true;
                 else return false;
             }
-            struct timespec tv;
-            timedwait_timeout(tv);
-            pthread_mutex_lock(cons_m);
-            pthread_cond_timedwait(cons_c, cons_m, &tv);
-            pthread_mutex_unlock(cons_m);
+            w.wait();
             goto _retry;
         }
         for(unsigned long i=0;i<retry;++i) {
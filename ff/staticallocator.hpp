@@ -32,89 +32,268 @@
 #define FF_STATIC_ALLOCATOR_HPP
 
 #include <sys/mman.h>
+#include <time.h>
+#include <sched.h>
 #include <cstdlib>
 #include <cstdio>
+#include <cassert>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <iostream>
 #include <ff/config.hpp>
+#include <ff/sysdep.h>
 #include <new>
 
 /* Author: Massimo Torquati
  * December 2020
  */
 
+/*
+ * The StaticAllocator is a slab pool used by a single producer node to
+ * allocate the data elements it sends out, the elements are released with
+ * StaticAllocator::dealloc by the node receiving them (one or more).
+ *
+ * The slots are partitioned among 'nchannels' sub data segments (typically
+ * one for each output channel of the producer), each sub data segment is
+ * scanned in round-robin looking for a free slot.
+ * It is possible to have more than one size class (the first one big
+ * enough for the type allocated is used), each one with its own slots.
+ *
+ * When all the slots of a channel are in use:
+ *  - if the allocator can grow (see set_max_segments) a new segment of
+ *    slots is mapped for that channel;
+ *  - try_alloc returns false;
+ *  - alloc spins for a while and then waits with an increasing back-off
+ *    (in blocking mode, see BLOCKING_MODE in config.hpp, it does not spin),
+ *    until a slot is released.
+ *
+ * For each channel the number of slots in use and its maximum value
+ * (high-water mark) are tracked.
+ */
 
 namespace ff {
 
 class StaticAllocator {
+    // header of each slot: FF_GO_ON if the slot is free, otherwise the
+    // channel the slot belongs to
+    typedef std::atomic<void*> slot_t;
+
+    struct channel_t {
+        std::vector<char*>  segs;            // segments of the sub data segment
+        size_t              cnt       = 0;   // round-robin counter
+        size_t              ssize     = 0;   // size of a data slot of the channel
+        size_t              allocated = 0;   // accessed by the producer only
+        std::atomic<size_t> highwater{0};
+        char                padding[CACHE_LINE_SIZE];
+        std::atomic<size_t> freed{0};        // updated by the consumers
+    };
+
+    enum { SPIN_ROUNDS=16, YIELD_ROUNDS=32 };
+
 public:
 	StaticAllocator(const size_t _nslot, const size_t slotsize, const int nchannels=1):
-		ssize(slotsize), nchannels(nchannels), cnts(nchannels,0), segment(nullptr) {
+        StaticAllocator(_nslot, std::vector<size_t>(1,slotsize), nchannels) {}
+
+    /*
+     * Allocator with more size classes, 'slotsizes' are the sizes of the
+     * slots of each class. Each class has '_nslot' slots.
+     */
+	StaticAllocator(const size_t _nslot, std::vector<size_t> slotsizes, const int nchannels=1):
+		nchannels(nchannels), maxsegs(1) {
 
         assert(nchannels>0);
-        assert(slotsize>0);
-        ssize  = slotsize + sizeof(long*);
+        assert(slotsizes.size()>0);
+        std::sort(slotsizes.begin(), slotsizes.end());
+        for(size_t i=0;i<slotsizes.size();++i) {
+            assert(slotsizes[i]>0);
+            // the header is followed by the data, sizes are multiple of the word size
+            ssizes.push_back(((slotsizes[i] + sizeof(long*) -1) / sizeof(long*)) * sizeof(long*) + sizeof(slot_t));
+        }
         
         // rounding up nslot to be multiple of nchannels
         nslot = ((_nslot + nchannels -1) / nchannels) * nchannels;
         slotsxchannel = nslot / nchannels;
+
+        chans.reset(new channel_t[ssizes.size()*nchannels]);
+        for(size_t c=0;c<ssizes.size();++c)
+            for(int i=0;i<nchannels;++i)
+                chans[c*nchannels+i].ssize = ssizes[c];
     }
 
 	~StaticAllocator() {
-		if (segment) munmap(segment, nslot*ssize);
-		segment=nullptr;
+        for(size_t i=0;i<segments.size();++i)
+            munmap(segments[i].first, segments[i].second);
+        segments.clear();
 	}
 
+    /*
+     * Sets the maximum number of segments of slots of each channel, a new
+     * segment (of the same size of the first one) is mapped when all the
+     * slots of the channel are in use. By default the allocator does not
+     * grow (1 segment).
+     */
+    void set_max_segments(size_t n) { maxsegs = (std::max)(n, (size_t)1); }
+
     int init() {
-		void* result = 0;
-        result = mmap(NULL, nslot*ssize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-        if (result == MAP_FAILED) return -1;
-        segment = (char*)result;
-        
-        // initialize the "header"
-        char* p = segment;
-        for(size_t i=0; i<nslot;++i) {
-            long** _p = (long**)p;
-            _p[0] = (long*)FF_GO_ON;  // this tells me that the slot is free!
-            p+=ssize;
+        if (segments.size()) return 0;  // already initialized
+        for(size_t c=0;c<ssizes.size();++c) {
+            const size_t ssize = ssizes[c];
+            char *segment = newsegment(nslot*ssize);
+            if (!segment) return -1;
+            // initialize the "header"
+            initslots(segment, nslot, ssize);
+            for(int i=0;i<nchannels;++i)
+                chans[c*nchannels+i].segs.push_back(segment + i*slotsxchannel*ssize);
         }
         return 0;
     }
     
+    // waits until a slot is available
 	template<typename T>
 	void alloc(T*& p, int channel=0) {
-        assert(channel>=0 && channel<nchannels) ;
-        do {
-            size_t m  = cnts[channel]++ % slotsxchannel;
-            char  *mp = segment + (channel*slotsxchannel + m)*ssize;
-            long** _p = (long**)mp;
-            if (_p[0] == (long*)FF_GO_ON) {
-                _p[0] = (long*)FF_EOS;    // the slot is occupied 
-                p = new (mp+sizeof(long*)) T();
-                return;
-            }
-        } while(1);
+        char *mp = getslot(sizeof(T), channel, true);
+        p = new (mp+sizeof(slot_t)) T();
+	}
+
+    // returns false if there are no free slots
+	template<typename T>
+	bool try_alloc(T*& p, int channel=0) {
+        char *mp = getslot(sizeof(T), channel, false);
+        if (!mp) return false;
+        p = new (mp+sizeof(slot_t)) T();
+        return true;
 	}
 
 	template<typename T>
 	static inline void dealloc(T* p) {
 		p->~T();
-        long** _p = (long**)((char*)p-sizeof(long*));
-        _p[0] = (long*)FF_GO_ON;  // the slot is free and can be re-used
+        slot_t *s = (slot_t*)((char*)p-sizeof(slot_t));
+        channel_t *ch = (channel_t*)s->load(std::memory_order_relaxed);
+        ch->freed.fetch_add(1, std::memory_order_relaxed);
+        s->store(FF_GO_ON, std::memory_order_release);  // the slot is free and can be re-used
 	}
     
 	template<typename T, typename S>
 	void realloc(T* in, S*& out) {
+        assert(sizeof(S) + sizeof(slot_t) <=
+               ((channel_t*)((slot_t*)((char*)in-sizeof(slot_t)))->load())->ssize);
         in->~T();
         char* mp = reinterpret_cast<char*>(in);
         out = new (mp) S();
 	}
+
+    // number of size classes
+    size_t nclasses() const { return ssizes.size(); }
+
+    // current number of slots of the channel (it changes if the allocator grows)
+    size_t nslots(int channel=0, size_t sclass=0) const {
+        return getchannel(sclass, channel).segs.size()*slotsxchannel;
+    }
+    // number of slots in use (approximated if read while the allocator is used)
+    size_t inuse(int channel=0, size_t sclass=0) const {
+        const channel_t &ch = getchannel(sclass, channel);
+        const size_t freed = ch.freed.load(std::memory_order_relaxed);
+        return (ch.allocated > freed) ? ch.allocated - freed : 0;
+    }
+    // maximum number of slots in use at the same time
+    size_t highwater(int channel=0, size_t sclass=0) const {
+        return getchannel(sclass, channel).highwater.load(std::memory_order_relaxed);
+    }
+
+    void printstats(std::ostream & out = std::cout) const {
+        for(size_t c=0;c<ssizes.size();++c)
+            for(int i=0;i<nchannels;++i)
+                out << "StaticAllocator slot size " << ssizes[c]-sizeof(slot_t)
+                    << " channel " << i << ": slots " << nslots(i,c)
+                    << ", in use " << inuse(i,c)
+                    << ", high-water mark " << highwater(i,c) << "\n";
+    }
+
+protected:
+    inline const channel_t& getchannel(size_t sclass, int channel) const {
+        assert(sclass<ssizes.size() && channel>=0 && channel<nchannels);
+        return chans[sclass*nchannels+channel];
+    }
+
+    // the first size class whose slots can contain 'size' bytes
+    inline size_t sizeclass(size_t size) const {
+        size_t c=0;
+        while(c<ssizes.size() && ssizes[c] < size+sizeof(slot_t)) ++c;
+        assert(c<ssizes.size());
+        return c;
+    }
+
+    char* newsegment(size_t size) {
+        void* result = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (result == MAP_FAILED) return nullptr;
+        char *segment = (char*)result;
+        segments.push_back(std::make_pair(segment, size));
+        return segment;
+    }
+
+    static inline void initslots(char *p, size_t n, size_t ssize) {
+        for(size_t i=0; i<n;++i) {
+            new (p) slot_t(FF_GO_ON);  // this tells me that the slot is free!
+            p+=ssize;
+        }
+    }
+
+    // waiting strategy used by alloc when all the slots are in use
+    static inline void backoff(unsigned round) {
+        if (!FF_RUNTIME_MODE && round < SPIN_ROUNDS) {
+            for(int i=0;i<64;++i) PAUSE();
+            return;
+        }
+        if (round < YIELD_ROUNDS) { sched_yield(); return; }
+        const unsigned e = (std::min)(round-YIELD_ROUNDS, 8u);
+        struct timespec ts = {0, (std::min)(1000L<<e, (long)FF_TIMEDWAIT_NS)};
+        nanosleep(&ts, NULL);
+    }
+
+    char* getslot(size_t size, int channel, bool wait) {
+        assert(channel>=0 && channel<nchannels);
+        channel_t &ch = chans[sizeclass(size)*nchannels+channel];
+        assert(ch.segs.size()>0); // init has not been called
+        for(unsigned round=0;;++round) {
+            const size_t n = ch.segs.size()*slotsxchannel;
+            for(size_t i=0;i<n;++i) {
+                const size_t m  = ch.cnt++ % n;
+                char  *mp = ch.segs[m / slotsxchannel] + (m % slotsxchannel)*ch.ssize;
+                slot_t *s = (slot_t*)mp;
+                if (s->load(std::memory_order_acquire) == FF_GO_ON) {
+                    s->store(&ch, std::memory_order_relaxed);   // the slot is occupied
+                    const size_t u = ++ch.allocated - ch.freed.load(std::memory_order_relaxed);
+                    if (u > ch.highwater.load(std::memory_order_relaxed))
+                        ch.highwater.store(u, std::memory_order_relaxed);
+                    return mp;
+                }
+            }
+            // all the slots are in use
+            if (ch.segs.size() < maxsegs) {
+                char *segment = newsegment(slotsxchannel*ch.ssize);
+                if (segment) {
+                    initslots(segment, slotsxchannel, ch.ssize);
+                    ch.segs.push_back(segment);
+                    ch.cnt = n;          // starts from the new segment
+                    continue;
+                }
+            }
+            if (!wait) return nullptr;
+            backoff(round);
+        }
+        return nullptr; // not reached
+    }
         
 private:
 	size_t nslot;                // total number of slots in the data segment
     size_t slotsxchannel;        // how many slots for each sub data segment
-	size_t ssize;                // size of a data slot (real size + sizeof(long*)) 
     int    nchannels;            // number of sub data segments
-    std::vector<size_t> cnts;    // counters
-	char *segment;               // data segment
+    size_t maxsegs;              // max number of segments of each sub data segment
+    std::vector<size_t> ssizes;  // size of a data slot (real size + header) of each size class
+    std::unique_ptr<channel_t[]> chans;  // sub data segments (nclasses x nchannels)
+    std::vector<std::pair<char*,size_t> > segments;  // mapped memory
 };
 
 };
@@ -0,0 +1,316 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \file topology.hpp
+ *  \ingroup shared_memory_fastflow
+ *  \brief Topology of the machine (sockets, cores, SMT contexts, caches,
+ *  NUMA nodes)
+ *
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * The topology is read once from sysfs (/sys/devices/system/cpu and
+ * /sys/devices/system/node) the first time ff_topology::instance() is
+ * called, no external command is executed.
+ * On the systems without sysfs the topology is not valid (see valid())
+ * and the functions in mapping_utils.hpp use their own methods.
+ *
+ */
+
+#ifndef FF_TOPOLOGY_HPP
+#define FF_TOPOLOGY_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <ff/config.hpp>
+#include <ff/platforms/platform.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ctype.h>
+#endif
+
+namespace ff {
+
+/*
+ * A logical core (processing unit) of the machine.
+ * core is the index of the physical core (0..numCores()-1),
+ * smt is the index of the context in the physical core,
+ * l2 and l3 are the smallest id of the logical cores sharing the cache
+ * (-1 if there is no such cache), node is the NUMA node (-1 if unknown).
+ */
+struct ff_cpuinfo {
+    int  cpu;
+    int  socket;
+    int  core;
+    int  core_id;   // OS core id (unique within the socket)
+    int  smt;
+    int  node;
+    int  l2;
+    int  l3;
+    bool allowed;   // the process can run on it (affinity mask)
+};
+
+/*!
+ *  \class ff_topology
+ *  \ingroup shared_memory_fastflow
+ *
+ *  \brief Topology of the machine, computed once and cached.
+ */
+class ff_topology {
+public:
+    static inline const ff_topology& instance() {
+        static ff_topology topo;
+        return topo;
+    }
+
+    inline bool valid() const { return !cpus_.empty(); }
+
+    // number of online logical cores
+    inline size_t numCpus()    const { return cpus_.size(); }
+    // number of physical cores
+    inline size_t numCores()   const { return ncores; }
+    inline size_t numSockets() const { return nsockets; }
+    inline size_t numNodes()   const { return nnodes; }
+
+    // logical cores (and physical cores) the process is allowed to run on
+    inline size_t numAllowedCpus()  const { return nallowed; }
+    inline size_t numAllowedCores() const { return nallowedcores; }
+
+    // logical cores ordered by id
+    inline const std::vector<ff_cpuinfo>& cpus() const { return cpus_; }
+
+    // the logical core 'id', NULL if it is not online
+    inline const ff_cpuinfo* cpu(ssize_t id) const {
+        if (id<0 || (size_t)id>=index.size() || index[id]<0) return nullptr;
+        return &cpus_[index[id]];
+    }
+
+    /*
+     * The list of the allowed logical cores that are topologically
+     * contiguous: the first context of each physical core (socket by
+     * socket, NUMA node by NUMA node, cache by cache), then the second
+     * context of each core and so on.
+     * It is the same list produced by the mapping_string.sh script.
+     */
+    inline const std::vector<int>& mapping() const { return mapping_; }
+
+    // size in bytes of the data (or unified) cache of the given level of a
+    // core, 0 if unknown
+    inline size_t cacheSize(int level) const {
+        return (level>=1 && level<=3) ? cachesize[level] : 0;
+    }
+
+    // the mapping list as a comma-separated string (see FF_MAPPING_STRING)
+    std::string mapping_string() const {
+        std::string s;
+        for(size_t i=0;i<mapping_.size();++i) {
+            if (i) s += ",";
+            s += std::to_string(mapping_[i]);
+        }
+        return s;
+    }
+
+protected:
+    ff_topology():ncores(0),nsockets(0),nnodes(0),nallowed(0),nallowedcores(0),cachesize() {
+#if defined(__linux__)
+        discover();
+#endif
+    }
+
+#if defined(__linux__)
+    static bool readline(const char *path, char *buf, size_t len) {
+        FILE *f = fopen(path, "r");
+        if (!f) return false;
+        bool r = (fgets(buf, (int)len, f) != NULL);
+        fclose(f);
+        return r;
+    }
+    static int readint(const char *path, int dflt) {
+        char buf[32];
+        if (!readline(path, buf, sizeof(buf))) return dflt;
+        return atoi(buf);
+    }
+    // parses a cpu list like "0-3,8,10-11"
+    static std::vector<int> parselist(const char *str) {
+        std::vector<int> L;
+        const char *p = str;
+        while(*p) {
+            while(*p && !isdigit(*p)) ++p;
+            if (!*p) break;
+            char *end;
+            long first = strtol(p, &end, 10), last = first;
+            p = end;
+            if (*p == '-') last = strtol(p+1, &end, 10), p = end;
+            for(long i=first;i<=last;++i) L.push_back((int)i);
+        }
+        return L;
+    }
+    static int cpunode(int cpu) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+        DIR *d = opendir(path);
+        if (!d) return -1;
+        int node = -1;
+        struct dirent *e;
+        while((e=readdir(d)) != NULL)
+            if (strncmp(e->d_name, "node", 4)==0 && isdigit(e->d_name[4])) {
+                node = atoi(e->d_name+4);
+                break;
+            }
+        closedir(d);
+        return node;
+    }
+    // smallest logical core sharing the unified (or data) cache of the given level
+    static int cachegroup(int cpu, int level) {
+        char path[96], buf[1024];
+        for(int i=0;i<16;++i) {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, i);
+            const int l = readint(path, -1);
+            if (l<0) break;
+            if (l != level) continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/type", cpu, i);
+            if (readline(path, buf, sizeof(buf)) && strncmp(buf, "Instruction", 11)==0) continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, i);
+            if (!readline(path, buf, sizeof(buf))) return cpu;
+            std::vector<int> L = parselist(buf);
+            return L.empty() ? cpu : *std::min_element(L.begin(), L.end());
+        }
+        return -1;
+    }
+    // size of the unified (or data) cache of the given level, the size is like "2048K"
+    static size_t cachebytes(int cpu, int level) {
+        char path[96], buf[64];
+        for(int i=0;i<16;++i) {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, i);
+            const int l = readint(path, -1);
+            if (l<0) break;
+            if (l != level) continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/type", cpu, i);
+            if (readline(path, buf, sizeof(buf)) && strncmp(buf, "Instruction", 11)==0) continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/size", cpu, i);
+            if (!readline(path, buf, sizeof(buf))) return 0;
+            char *end;
+            size_t s = strtoul(buf, &end, 10);
+            if (*end == 'K') s <<= 10;
+            else if (*end == 'M') s <<= 20;
+            return s;
+        }
+        return 0;
+    }
+
+    void discover() {
+        char buf[1024], path[96];
+        if (!readline("/sys/devices/system/cpu/online", buf, sizeof(buf))) return;
+        const std::vector<int> online = parselist(buf);
+        if (online.empty()) return;
+
+        // the mask of the process (of its main thread): the calling thread
+        // may be already pinned on a single core
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        const bool hasmask = (sched_getaffinity(getpid(), sizeof(mask), &mask) == 0);
+
+        std::vector<std::pair<int,int> > cores;     // (socket, core_id)
+        std::vector<int> sockets, nodes;
+        std::vector<bool> allowedcore;
+        for(size_t i=0;i<online.size();++i) {
+            ff_cpuinfo c;
+            c.cpu = online[i];
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", c.cpu);
+            c.socket  = (std::max)(readint(path, 0), 0);
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", c.cpu);
+            c.core_id = readint(path, c.cpu);
+            c.node    = cpunode(c.cpu);
+            c.l2      = cachegroup(c.cpu, 2);
+            c.l3      = cachegroup(c.cpu, 3);
+            c.allowed = !hasmask || (c.cpu < CPU_SETSIZE && CPU_ISSET(c.cpu, &mask));
+
+            const std::pair<int,int> key(c.socket, c.core_id);
+            auto it = std::find(cores.begin(), cores.end(), key);
+            c.core = (int)(it - cores.begin());
+            if (it == cores.end()) {
+                cores.push_back(key);
+                allowedcore.push_back(false);
+            }
+            c.smt = 0;
+            for(size_t j=0;j<cpus_.size();++j)
+                if (cpus_[j].core == c.core) ++c.smt;
+            if (c.allowed) {
+                ++nallowed;
+                allowedcore[c.core] = true;
+            }
+            if (std::find(sockets.begin(), sockets.end(), c.socket) == sockets.end())
+                sockets.push_back(c.socket);
+            if (c.node>=0 && std::find(nodes.begin(), nodes.end(), c.node) == nodes.end())
+                nodes.push_back(c.node);
+            cpus_.push_back(c);
+
+            if ((size_t)c.cpu >= index.size()) index.resize(c.cpu+1, -1);
+            index[c.cpu] = (int)i;
+        }
+        ncores        = cores.size();
+        nsockets      = sockets.size();
+        nnodes        = (std::max)(nodes.size(), (size_t)1);
+        nallowedcores = std::count(allowedcore.begin(), allowedcore.end(), true);
+        for(int l=1;l<=3 && !cpus_.empty();++l) cachesize[l] = cachebytes(cpus_[0].cpu, l);
+
+        // mapping list
+        std::vector<ff_cpuinfo> V;
+        int maxsmt = 0;
+        for(size_t i=0;i<cpus_.size();++i)
+            if (cpus_[i].allowed) {
+                V.push_back(cpus_[i]);
+                maxsmt = (std::max)(maxsmt, cpus_[i].smt);
+            }
+        std::stable_sort(V.begin(), V.end(), [](const ff_cpuinfo &a, const ff_cpuinfo &b) {
+                if (a.socket != b.socket)   return a.socket < b.socket;
+                if (a.node != b.node)       return a.node < b.node;
+                if (a.l3 != b.l3)           return a.l3 < b.l3;
+                if (a.l2 != b.l2)           return a.l2 < b.l2;
+                return a.core_id < b.core_id;
+            });
+        for(int s=0;s<=maxsmt;++s)
+            for(size_t i=0;i<V.size();++i)
+                if (V[i].smt == s) mapping_.push_back(V[i].cpu);
+    }
+#endif
+
+private:
+    std::vector<ff_cpuinfo> cpus_;
+    std::vector<int>        index;     // cpu id -> position in cpus_
+    std::vector<int>        mapping_;
+    size_t ncores, nsockets, nnodes;
+    size_t nallowed, nallowedcores;
+    size_t cachesize[4];       // by level
+};
+
+} // namespace ff
+
+#endif /* FF_TOPOLOGY_HPP */
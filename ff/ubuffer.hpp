@@ -72,6 +72,7 @@
 #include <assert.h>
 #include <cassert>
 #include <new>
+#include <atomic>
 #include <ff/dynqueue.hpp>
 #include <ff/buffer.hpp>
 #include <ff/spin-lock.hpp>
@@ -88,7 +89,7 @@ namespace ff {
 class BufferPool {
 public:
     BufferPool(int cachesize, const bool fillcache=false, unsigned long size=-1)
-        :inuse(cachesize),bufcache(cachesize) {
+        :inuse(cachesize),bufcache(cachesize),numa_node(-1) {
         bufcache.init(); // initialise the internal buffer and allocates memory
 
         if (fillcache) {
@@ -133,10 +134,11 @@ public:
 #endif
             p.buf = (INTERNAL_BUFFER_T*)malloc(sizeof(INTERNAL_BUFFER_T));
             new (p.buf) INTERNAL_BUFFER_T(size);
+            const int node = numa_node.load(std::memory_order_relaxed);
 #if defined(uSWSR_MULTIPUSH)        
-            if (!p.buf->init(true)) return NULL;
+            if (!p.buf->init(true, node)) return NULL;
 #else
-            if (!p.buf->init()) return NULL;
+            if (!p.buf->init(false, node)) return NULL;
 #endif
         }
 #if defined(UBUFFER_STATS)
@@ -177,6 +179,11 @@ public:
     }
 #endif
 
+    // NUMA node where the new buffers are allocated (-1 no placement)
+    inline void set_numa_node(int node) {
+        numa_node.store(node, std::memory_order_relaxed);
+    }
+
     // just empties the inuse bucket putting data in the cache
     void reset() {
         union { INTERNAL_BUFFER_T * b1; void * b2;} p;
@@ -212,6 +219,7 @@ private:
                                  // SWSR unbounded queue.
                                  // No lock is needed around pop and push methods.
     INTERNAL_BUFFER_T  bufcache; // This is a bounded buffer
+    std::atomic<int>   numa_node;
 };
     
 // --------------------------------------------------------------------------------------
@@ -401,6 +409,32 @@ public:
         return (mcnt ? multipush() : true);
     }
 #endif /* uSWSR_MULTIPUSH */
+
+    /**
+     *  \brief Pushes a batch of elements
+     *
+     *  Pushes up to \p len elements of the array \p data. If the queue is
+     *  unbounded all the elements are pushed, possibly using more than one
+     *  internal buffer.
+     *
+     *  \return the number of elements pushed
+     */
+    inline size_t push_batch(void * const data[], size_t len) {
+        size_t n = buf_w->push_batch(data, len);
+        while(n<len) {
+            if (fixedsize) return n;
+            // try to get a new buffer
+            INTERNAL_BUFFER_T * t = pool.next_w(size);
+            assert(t); //if (!t) return n; // EWOULDBLOCK
+            buf_w = t;
+            in_use_buffers++;
+#if defined(UBUFFER_STATS)
+            ++numBuffers;
+#endif
+            n += buf_w->push_batch(data+n, len-n);
+        }
+        return n;
+    }
     
     /**
      *  \brief Pop
@@ -432,6 +466,34 @@ public:
         return buf_r->pop(data);
     }    
 
+    /**
+     *  \brief Pops a batch of elements
+     *
+     *  Pops up to \p max elements storing them in \p data. The elements
+     *  may come from more than one internal buffer.
+     *
+     *  \return the number of elements popped (0 if the queue is empty)
+     */
+    inline size_t pop_batch(void ** data, size_t max) {
+        size_t n = buf_r->pop_batch(data, max);
+        while((n<max) && (buf_r != buf_w)) {
+            // the producer moved to another buffer, we have to check again
+            // the current one before releasing it (see pop)
+            n += buf_r->pop_batch(data+n, max-n);
+            if (n==max) break;
+            INTERNAL_BUFFER_T * tmp = pool.next_r();
+            if (!tmp) break;
+            pool.release(buf_r);
+            in_use_buffers--;
+            buf_r = tmp;
+#if defined(UBUFFER_STATS)
+            --numBuffers;
+#endif
+            n += buf_r->pop_batch(data+n, max-n);
+        }
+        return n;
+    }
+
 
 #if defined(UBUFFER_STATS)
     inline unsigned long queue_status() {
@@ -506,6 +568,24 @@ public:
 
     inline bool isFixedSize() const { return fixedsize; }
 
+    /**
+     * \brief Places the buffer on the NUMA node \p node.
+     *
+     * It has to be called by the consumer. The internal buffers currently
+     * in use are moved to the node, the ones allocated later by the producer
+     * are placed there before being touched.
+     *
+     * \return 0 if successful, -1 otherwise.
+     */
+    inline int numa_place(const int node) {
+        if (!buf_r) return -1;
+        pool.set_numa_node(node);
+        INTERNAL_BUFFER_T * w = buf_w;
+        int r = buf_r->numa_place(node);
+        if (w != buf_r) r |= w->numa_place(node);
+        return r;
+    }
+
     inline void reset() {
         if (buf_r) buf_r->reset();
         if (buf_w) buf_w->reset();
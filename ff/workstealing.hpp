@@ -0,0 +1,268 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \file workstealing.hpp
+ *  \ingroup building_blocks
+ *  \brief Work-stealing scheduling for the farm workers
+ *
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * Work-stealing scheduling (see ff_farm::set_scheduling_workstealing).
+ *
+ * Each worker is wrapped by a ff_wsworker that owns a bounded Chase-Lev
+ * deque (ff_wsdeque). The Emitter hands ranges of consecutive tasks to the
+ * (bounded) input channels of the workers (see
+ * ff_loadbalancer::schedule_batch), each worker moves all the tasks present
+ * in its channel into its deque and executes them from the bottom of the
+ * deque. A worker that finds both its deque and its channel empty steals
+ * from the top of the deque of the other workers starting from a random one.
+ *
+ * Special values (EOS, GO_OUT, ...) are never moved into the deques, they are
+ * delivered to the worker once its deque is empty and a stealing round failed,
+ * so that at the end of the stream the workers help each other before
+ * terminating.
+ *
+ * The results produced by a stolen task are sent out by the thief, hence
+ * the ordered farm uses the same ordering policy of the on-demand scheduling
+ * (see ordering_policies.hpp).
+ *
+ */
+
+#ifndef FF_WORKSTEALING_HPP
+#define FF_WORKSTEALING_HPP
+
+#include <atomic>
+#include <vector>
+#include <ff/node.hpp>
+
+namespace ff {
+
+/*!
+ *  \class ff_wsdeque
+ *  \ingroup building_blocks
+ *
+ *  \brief Bounded Chase-Lev work-stealing deque
+ *
+ *  push and pop can be called only by the owner thread (bottom of the deque),
+ *  steal can be called by any thread (top of the deque).
+ *  The implementation follows "Correct and Efficient Work-Stealing for Weak
+ *  Memory Models" (Le, Pop, Cohen, Zappa Nardelli, PPoPP'13) without the
+ *  resizing of the circular array.
+ */
+class ff_wsdeque {
+public:
+    ff_wsdeque(size_t n=64):top(0),bottom(0),buf(nullptr),mask(0) {
+        const size_t sz = capacity(n);
+        buf  = new std::atomic<void*>[sz];
+        mask = sz-1;
+    }
+
+    // the capacity of a deque created with size n (a power of 2)
+    static inline size_t capacity(size_t n) {
+        size_t sz=2;
+        while(sz<n) sz <<= 1;
+        return sz;
+    }
+    ~ff_wsdeque() { delete [] buf; }
+
+    ff_wsdeque(const ff_wsdeque&) = delete;
+    ff_wsdeque& operator=(const ff_wsdeque&) = delete;
+
+    inline size_t capacity() const { return mask+1; }
+
+    inline bool empty() const {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+    inline bool full() const {
+        return (bottom.load(std::memory_order_relaxed) -
+                top.load(std::memory_order_acquire)) > (long)mask;
+    }
+
+    // owner only
+    inline bool push(void *task) {
+        const long b = bottom.load(std::memory_order_relaxed);
+        const long t = top.load(std::memory_order_acquire);
+        if ((b-t) > (long)mask) return false;   // full
+        buf[b & mask].store(task, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b+1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // owner only
+    inline bool pop(void **task) {
+        const long b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = top.load(std::memory_order_relaxed);
+        if (t <= b) {
+            *task = buf[b & mask].load(std::memory_order_relaxed);
+            if (t == b) { // last element, racing with the thieves
+                const bool r = top.compare_exchange_strong(t, t+1,
+                                                           std::memory_order_seq_cst,
+                                                           std::memory_order_relaxed);
+                bottom.store(b+1, std::memory_order_relaxed);
+                return r;
+            }
+            return true;
+        }
+        bottom.store(b+1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // any thread
+    inline bool steal(void **task) {
+        long t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const long b = bottom.load(std::memory_order_acquire);
+        if (t < b) {
+            void *v = buf[t & mask].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t+1,
+                                             std::memory_order_seq_cst,
+                                             std::memory_order_relaxed))
+                return false;
+            *task = v;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    ALIGN_TO_PRE(CACHE_LINE_SIZE)
+    std::atomic<long>   top;
+    ALIGN_TO_POST(CACHE_LINE_SIZE)
+
+    ALIGN_TO_PRE(CACHE_LINE_SIZE)
+    std::atomic<long>   bottom;
+    ALIGN_TO_POST(CACHE_LINE_SIZE)
+
+    std::atomic<void*> *buf;
+    size_t              mask;
+};
+
+
+/*
+ * Worker wrapper used by the farm when the work-stealing scheduling is set.
+ * 'deques' contains the deques of all the workers of the farm, the one of
+ * index 'id' is owned by this worker.
+ */
+class ff_wsworker: public ff_node {
+public:
+    ff_wsworker(ff_node* worker, size_t id, std::vector<ff_wsdeque*> *deques, bool cleanup=false):
+        worker(worker),id(id),deques(deques),cleanup(cleanup),pending(nullptr),seed(id*2654435761UL+1) {
+        set_barrier(worker->get_barrier());
+        worker->set_barrier(nullptr);
+        if (worker->getCPUId()>=0) setAffinity(worker->getCPUId());
+        set_id(id);
+        set_input_batch(worker->get_input_batch());
+        // the tasks sent out by the worker go through the wrapper
+        worker->registerCallback(ff_send_out_wsworker, this);
+    }
+    ~ff_wsworker() {
+        if (cleanup) delete worker;
+    }
+
+    void *svc(void *t)   { return worker->svc(t); }
+    void *svc_batch(void **t, size_t n) { return worker->svc_batch(t, n); }
+    int  svc_init()      { pending = nullptr; return worker->svc_init(); }
+    void svc_end()       { worker->svc_end(); }
+    void eosnotify(ssize_t id) { worker->eosnotify(id); }
+
+    ff_node* getWorker() const { return worker; }
+
+protected:
+    static inline bool ff_send_out_wsworker(void * task, int id,
+                                            unsigned long retry,
+                                            unsigned long ticks, void *obj) {
+        return ((ff_wsworker*)obj)->ff_send_out(task, id, retry, ticks);
+    }
+
+    // moves the tasks of the input channel into the deque, it stops at the
+    // first special value (EOS, GO_OUT, ...) that will be delivered later
+    inline bool refill(ff_wsdeque &dq) {
+        if (pending) return false;
+        bool r=false;
+        void *task;
+        while(!dq.full() && ff_node::pop(&task)) {
+            if (task >= FF_TAG_MIN) { pending = task; break; }
+            dq.push(task);
+            r=true;
+        }
+        return r;
+    }
+
+    inline bool steal(void **task) {
+        const size_t nw = deques->size();
+        if (nw<2) return false;
+        // xorshift
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        const size_t start = seed % nw;
+        for(size_t i=0;i<nw;++i) {
+            const size_t victim = (start+i) % nw;
+            if (victim == id) continue;
+            if ((*deques)[victim]->steal(task)) return true;
+        }
+        return false;
+    }
+
+    bool Pop(void **task, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
+        ff_wsdeque &dq = *(*deques)[id];
+        ff_blkwait w(cons_m, cons_c, blocking_in && spinpark);
+        for(unsigned long i=0;i<retry;++i) {
+            if (dq.pop(task)) return true;
+            if (refill(dq))   continue;
+            if (steal(task))  return true;
+            if (pending) {
+                *task = pending;
+                pending = nullptr;
+                return true;
+            }
+            if (blocking_in) w.wait();
+            else losetime_in(ticks);
+        }
+        return false;
+    }
+
+    // the tasks come from the deques as in Pop, not from the input channel
+    size_t Pop_batch(void **task, size_t max, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
+        if (!max || !Pop(task, retry, ticks)) return 0;
+        if (task[0] >= FF_TAG_MIN) return 1;
+        ff_wsdeque &dq = *(*deques)[id];
+        size_t n=1;
+        while(n<max && dq.pop(&task[n])) ++n;
+        return n;
+    }
+
+protected:
+    ff_node                   *worker;
+    const size_t               id;
+    std::vector<ff_wsdeque*>  *deques;
+    bool                       cleanup;
+    void                      *pending;
+    unsigned long              seed;
+};
+
+} // namespace ff
+
+#endif /* FF_WORKSTEALING_HPP */
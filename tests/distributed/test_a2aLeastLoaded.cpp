@@ -0,0 +1,127 @@
+/* 
+ * FastFlow concurrent network:
+ * 
+ *                          |--> MiNode (fast)
+ *             |-> MoNode-->|           
+ *   MoNode -->|            |           
+ *             |-> MoNode-->|           
+ *                          |--> MiNode (slow)
+ *
+ *            /<-------- a2a -------->/
+ * /<----------- pipeMain ------------->/
+ *
+ *  distributed version:
+ *                                         G2
+ *                     G1             -----------
+ *     G0         --------------     | -> MiNode |
+ *   --------    | -> MoNode -> |     -----------
+ *  | MoNode |-->|              | -->     G3
+ *   --------    | -> MoNode -> |     -----------
+ *                --------------     | -> MiNode |
+ *                                    -----------
+ *
+ *  The MoNodes of G1 do not choose the destination, the sender of G1
+ *  dispatches the messages to the least loaded group (see
+ *  ff_dsender::leastLoaded): the slow MiNode of G3 keeps the credits of
+ *  G1 (the slots of the channel with SHM) while it is busy, so it receives
+ *  only a small part of the stream.
+ */
+
+
+#include <ff/dff.hpp>
+#include <iostream>
+#include <mutex>
+#include <chrono>
+#include <thread>
+
+using namespace ff;
+
+struct DataType {
+	long x;
+	long y;
+
+	template<class Archive>
+	void serialize(Archive & archive) {
+		archive(x,y);
+	}	
+};
+
+struct MoNode : ff::ff_monode_t<DataType>{
+    MoNode(int itemsToGenerate):items(itemsToGenerate) {}
+	
+    DataType* svc(DataType* in){
+		if (items) {
+			for(int i=0; i< items; i++){
+				auto d = new DataType;
+				d->x=i, d->y=i+1;
+				ff_send_out(d);
+			}        
+			return this->EOS;
+		}
+		return in;
+    }
+    long items;
+};
+
+struct MiNode : ff::ff_minode_t<DataType>{
+    MiNode(int execTime, long maxItems): execTime(execTime), maxItems(maxItems) {}
+
+    DataType* svc(DataType* in){
+		if (in->y != in->x+1) abort();
+		if (execTime) std::this_thread::sleep_for(std::chrono::milliseconds(execTime));
+		++processedItems;
+		delete in;
+		return this->GO_ON;
+    }
+	
+    void svc_end(){
+        std::cout << "[MiNode" << this->get_my_id() << "] Processed Items: " << processedItems << std::endl;
+		if (maxItems) {
+			if (processedItems == 0 || processedItems > maxItems) abort();
+			ff::cout << "RESULT OK\n";
+		}
+    }
+    int  execTime;
+    long maxItems;
+    long processedItems = 0;
+};
+
+int main(int argc, char*argv[]){
+    
+    if (DFF_Init(argc, argv)<0 ) {
+		error("DFF_Init\n");
+		return -1;
+	}
+	long items = 2000;
+	if (argc>1) {
+		items = std::stol(argv[1]);
+	}
+	
+    ff_pipeline mainPipe;
+	MoNode generator(items);
+	mainPipe.add_stage(&generator);
+	ff_a2a a2a;
+    mainPipe.add_stage(&a2a);
+
+	MoNode sx1(0), sx2(0);
+	// with a balanced dispatching the slow node would receive half of the items
+	MiNode fast(0, 0), slow(5, items/4);
+	
+    a2a.add_firstset<MoNode>({&sx1, &sx2}, 1);
+    a2a.add_secondset<MiNode>({&fast, &slow});
+	
+	//----- defining the distributed groups ------
+
+	generator.createGroup("G0");
+    a2a.createGroup("G1") << &sx1 << &sx2;
+    a2a.createGroup("G2") << &fast;
+    a2a.createGroup("G3") << &slow;
+
+    // -------------------------------------------
+	
+    if (mainPipe.run_and_wait_end()<0) {
+		error("running mainPipe\n");
+		return -1;
+	}
+    return 0;
+}
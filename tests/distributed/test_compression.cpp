@@ -0,0 +1,137 @@
+/*  
+ *
+ *                    | -> Worker -->|  |--> Collector -->|
+ *             Source | -> Worker -->|--|--> Collector -->| -> Sink
+ *                    
+ *   /<- pipe0 ->/    /<------------- a2a ------------>/   /<- pipe1 ->/
+ *         G1         /<- G2: Worker, Collector ------>/        G4
+ *                    /<- G3: Worker, Collector ------>/
+ *   /<-------------------------- pipe ------------------------------>/
+ *
+ *  Compressed batches (see ff_batchPolicy): the tasks carry JSON-like text,
+ *  which compresses well, or random bytes, which do not (those batches are
+ *  sent as they are). Small batches stay under the threshold.
+ */
+
+
+#include <iostream>
+#include <string>
+#include <random>
+#include <ff/dff.hpp>
+
+using namespace ff;
+
+struct myTask_t {
+	long id;
+	std::string text;
+
+	template<class Archive>
+	void serialize(Archive & archive) {
+		archive(id, text);
+	}
+};
+
+static inline std::string makeText(long id) {
+	std::string s;
+	if (id % 5 == 0) {
+		std::mt19937 rng(id);
+		s.resize((id*31) % 3000);
+		for(char& c : s) c = (char)rng();
+		return s;
+	}
+	for(long i = 0; i < (id % 50); ++i)
+		s += "{\"word\":\"w" + std::to_string((id+i) % 97) + "\",\"count\":" + std::to_string(i) + "},";
+	return s;
+}
+
+static inline bool check(const myTask_t* t) {
+	return t->text == makeText(t->id);
+}
+
+struct Source: ff_monode_t<myTask_t>{
+	Source(long ntasks):ntasks(ntasks) {}
+    myTask_t* svc(myTask_t*){
+        for(long i=0; i< ntasks; i++) {
+			myTask_t* task = new myTask_t;
+			task->id   = i;
+			task->text = makeText(i);
+            ff_send_out(task);
+		}        
+        return EOS;
+    }
+	const long ntasks;
+};
+
+struct Worker: ff_monode_t<myTask_t>{ 
+    myTask_t* svc(myTask_t* t){
+		if (!check(t)) abort();
+        return t;
+    }
+};
+
+struct Collector: ff_minode_t<myTask_t>{ 
+    myTask_t* svc(myTask_t* t){
+		if (!check(t)) abort();
+        return t;
+    }
+};
+
+struct Sink: ff_minode_t<myTask_t>{
+	Sink(long ntasks):ntasks(ntasks) {}
+    myTask_t* svc(myTask_t* t){
+		if (!check(t)) abort();
+		++processed;
+		delete t;
+        return GO_ON;
+    }
+	void svc_end() {
+		if (processed != ntasks) {
+			abort();
+		}
+		ff::cout << "RESULT OK\n";
+	}
+	long ntasks;
+	long processed=0;
+};
+
+
+int main(int argc, char*argv[]){
+    if (DFF_Init(argc, argv)<0 ) {
+		error("DFF_Init\n");
+		return -1;
+	}	
+	long ntasks = 3000;
+	if (argc>1) {
+		ntasks = std::stol(argv[1]);
+	}
+		
+    ff_pipeline pipe;
+	Source source(ntasks);
+	Worker w1, w2;
+	Collector c1, c2;
+	Sink sink(ntasks);
+	ff_pipeline pipe0, pipe1;
+	pipe0.add_stage(&source);
+	pipe1.add_stage(&sink);
+	ff_a2a      a2a;
+	a2a.add_firstset<Worker>({&w1, &w2});
+    a2a.add_secondset<Collector>({&c1, &c2});
+	pipe.add_stage(&pipe0);
+	pipe.add_stage(&a2a);
+	pipe.add_stage(&pipe1);
+	
+    //----- defining the distributed groups ------
+
+    pipe0.createGroup("G1");
+    a2a.createGroup("G2") << &w1 << &c1;
+    a2a.createGroup("G3") << &w2 << &c2;
+    pipe1.createGroup("G4");
+	
+    // -------------------------------------------
+
+	if (pipe.run_and_wait_end()<0) {
+		error("running the main pipe\n");
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,109 @@
+/*  
+ *
+ *     Source ---> Sink
+ *
+ *   /<- G1 ->/   /<- G2 ->/
+ *
+ *  Counters of the connections (see ff_dstats.hpp): at the end of the run
+ *  each group reads the dump of its own connections and checks the number
+ *  of messages sent and received.
+ */
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <ff/dff.hpp>
+
+using namespace ff;
+
+struct myTask_t {
+	long id;
+	std::vector<long> V;
+
+	template<class Archive>
+	void serialize(Archive & archive) {
+		archive(id, V);
+	}
+};
+
+struct Source: ff_node_t<myTask_t>{
+	Source(long ntasks):ntasks(ntasks) {}
+    myTask_t* svc(myTask_t*){
+        for(long i=0; i< ntasks; i++) {
+			myTask_t* task = new myTask_t;
+			task->id = i;
+			task->V.resize(i % 100, i);
+            ff_send_out(task);
+		}        
+        return EOS;
+    }
+	const long ntasks;
+};
+
+struct Sink: ff_node_t<myTask_t>{
+    myTask_t* svc(myTask_t* t){
+		if (t->V.size() != (size_t)(t->id % 100)) abort();
+		delete t;
+        return GO_ON;
+    }
+};
+
+// value of the field name= in the line
+static double field(const std::string& line, const std::string& name) {
+	const size_t p = line.find(" " + name + "=");
+	if (p == std::string::npos) abort();
+	return std::stod(line.substr(p + name.size() + 2));
+}
+
+int main(int argc, char*argv[]){
+    if (DFF_Init(argc, argv)<0 ) {
+		error("DFF_Init\n");
+		return -1;
+	}	
+	long ntasks = 1000;
+	if (argc>1) {
+		ntasks = std::stol(argv[1]);
+	}
+		
+    ff_pipeline pipe;
+	Source source(ntasks);
+	Sink sink;
+	pipe.add_stage(&source);
+	pipe.add_stage(&sink);
+	
+    //----- defining the distributed groups ------
+
+    source.createGroup("G1");
+    sink.createGroup("G2");
+	
+    // -------------------------------------------
+
+	if (pipe.run_and_wait_end()<0) {
+		error("running the main pipe\n");
+		return -1;
+	}
+
+	const std::string g = DFF_getMyGroup();
+	std::ifstream f("/tmp/test_dstats." + g);
+	std::string line, expected = (g == "G1") ? "G1 > G2 FWD " : "G2 < G1 FWD ";
+	bool found = false;
+	while(std::getline(f, line)) {
+		if (line.rfind(expected, 0) != 0) continue;
+		found = true;
+		std::cout << line << std::endl;
+		if (g == "G1") {
+			// the EOS messages are counted as well
+			if (field(line, "msgs") <= ntasks) abort();
+			if (field(line, "fill") <= 0 || field(line, "fill") > 1) abort();
+		} else {
+			if (field(line, "msgs") != ntasks) abort();
+			if (field(line, "depth") != 0) abort();
+		}
+		if (field(line, "bytes") <= 0) abort();
+	}
+	if (!found) abort();
+	unlink(("/tmp/test_dstats." + g).c_str());
+	ff::cout << "RESULT OK\n";
+	return 0;
+}
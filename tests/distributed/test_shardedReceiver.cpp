@@ -0,0 +1,106 @@
+/*  
+ *
+ *    Source -->|
+ *    Source -->|      | --> Sink
+ *      ...     | ---> |
+ *    Source -->|      | --> Sink
+ *
+ *   /<------------- mainA2A ------------->/
+ *    G1 ... Gn          G0: Sink, Sink
+ *
+ *  High fan-in group: G0 receives from all the source groups using more
+ *  receiver threads ("receiverThreads" in the configuration file). The tasks
+ *  of each source must arrive in order to each sink, and all of them must be
+ *  received before the EOS.
+ */
+
+
+#include <iostream>
+#include <atomic>
+#include <ff/dff.hpp>
+
+using namespace ff;
+
+struct myTask_t {
+	long source;
+	long id;
+	std::vector<long> V;
+
+	template<class Archive>
+	void serialize(Archive & archive) {
+		archive(source, id, V);
+	}
+};
+
+struct Source: ff_monode_t<myTask_t>{
+	Source(long source, long ntasks):source(source), ntasks(ntasks) {}
+    myTask_t* svc(myTask_t*){
+        for(long i=0; i< ntasks; i++) {
+			myTask_t* task = new myTask_t;
+			task->source = source;
+			task->id = i;
+			task->V.resize(i % 512, i);
+            ff_send_out(task);
+		}        
+        return EOS;
+    }
+	const long source, ntasks;
+};
+
+static std::atomic<long> received{0};
+static std::atomic<long> running{0};
+
+struct Sink: ff_minode_t<myTask_t>{
+	Sink(long nsources, long ntasks):last(nsources, -1), ntasks(ntasks) {}
+	int svc_init() { ++running; return 0; }
+    myTask_t* svc(myTask_t* t){
+		if (t->id <= last[t->source] || t->V.size() != (size_t)(t->id % 512)) abort();
+		for(long v : t->V) if (v != t->id) abort();
+		last[t->source] = t->id;
+		++received;
+		delete t;
+        return GO_ON;
+    }
+	void svc_end() {
+		if (--running) return;
+		if (received != (long)last.size()*ntasks) abort();
+		ff::cout << "RESULT OK\n";
+	}
+	std::vector<long> last;
+	long ntasks;
+};
+
+
+int main(int argc, char*argv[]){
+    if (DFF_Init(argc, argv)<0 ) {
+		error("DFF_Init\n");
+		return -1;
+	}
+	long ntasks   = 20000;
+	long nsources = 8;
+	if (argc>1) {
+		if (argc != 3) {
+			std::cerr << "usage: " << argv[0] << " ntasks nsources\n";
+			return -1;
+		}
+		ntasks   = std::stol(argv[1]);
+		nsources = std::stol(argv[2]);
+	}
+
+	ff_a2a mainA2A;
+	std::vector<Source*> sources;
+	for(long i=0; i<nsources; ++i) {
+		sources.push_back(new Source(i, ntasks));
+		mainA2A.createGroup("G"+std::to_string(i+1)) << sources.back();
+	}
+	Sink s1(nsources, ntasks), s2(nsources, ntasks);
+	mainA2A.add_firstset(sources, 0, true);
+	mainA2A.add_secondset<Sink>({&s1, &s2});
+	mainA2A.createGroup("G0") << &s1 << &s2;
+
+	if (mainA2A.run_and_wait_end()<0) {
+		error("running the main All-to-All\n");
+		return -1;
+	}
+	return 0;
+}
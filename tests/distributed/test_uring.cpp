@@ -0,0 +1,129 @@
+/*  
+ *
+ *                    | -> Worker -->|  |--> Collector -->|
+ *             Source | -> Worker -->|--|--> Collector -->| -> Sink
+ *                    
+ *   /<- pipe0 ->/    /<------------- a2a ------------>/   /<- pipe1 ->/
+ *         G1         /<- G2: Worker, Collector ------>/        G4
+ *                    /<- G3: Worker, Collector ------>/
+ *   /<-------------------------- pipe ------------------------------>/
+ *
+ *  The groups communicate with the URING transport (see ff_dsenderURING.hpp
+ *  and ff_dreceiverURING.hpp), TCP if io_uring is not available: the size of
+ *  the tasks ranges from a few bytes (received in the slab) to hundreds of KB
+ *  (received directly in the payload).
+ *  G2 and G3 are horizontal groups, they also exchange tasks through the
+ *  internal channels.
+ */
+
+
+#include <iostream>
+#include <ff/dff.hpp>
+
+using namespace ff;
+
+struct myTask_t {
+	long id;
+	std::vector<long> V;
+
+	template<class Archive>
+	void serialize(Archive & archive) {
+		archive(id, V);
+	}
+};
+
+static inline bool check(const myTask_t* t) {
+	if (t->V.size() != (size_t)((t->id*97) % 24000)) return false;
+	for(size_t j=0;j<t->V.size();++j)
+		if (t->V[j] != t->id+(long)j) return false;
+	return true;
+}
+
+struct Source: ff_monode_t<myTask_t>{
+	Source(long ntasks):ntasks(ntasks) {}
+    myTask_t* svc(myTask_t*){
+        for(long i=0; i< ntasks; i++) {
+			myTask_t* task = new myTask_t;
+			task->id = i;
+			task->V.resize((i*97) % 24000);
+			for(size_t j=0;j<task->V.size();++j) task->V[j] = i+j;
+            ff_send_out(task);
+		}        
+        return EOS;
+    }
+	const long ntasks;
+};
+
+struct Worker: ff_monode_t<myTask_t>{ 
+    myTask_t* svc(myTask_t* t){
+		if (!check(t)) abort();
+        return t;
+    }
+};
+
+struct Collector: ff_minode_t<myTask_t>{ 
+    myTask_t* svc(myTask_t* t){
+		if (!check(t)) abort();
+        return t;
+    }
+};
+
+struct Sink: ff_minode_t<myTask_t>{
+	Sink(long ntasks):ntasks(ntasks) {}
+    myTask_t* svc(myTask_t* t){
+		if (!check(t)) abort();
+		++processed;
+		delete t;
+        return GO_ON;
+    }
+	void svc_end() {
+		if (processed != ntasks) {
+			abort();
+		}
+		ff::cout << "RESULT OK\n";
+	}
+	long ntasks;
+	long processed=0;
+};
+
+
+int main(int argc, char*argv[]){
+    if (DFF_Init(argc, argv)<0 ) {
+		error("DFF_Init\n");
+		return -1;
+	}	
+	long ntasks = 3000;
+	if (argc>1) {
+		ntasks = std::stol(argv[1]);
+	}
+		
+    ff_pipeline pipe;
+	Source source(ntasks);
+	Worker w1, w2;
+	Collector c1, c2;
+	Sink sink(ntasks);
+	ff_pipeline pipe0, pipe1;
+	pipe0.add_stage(&source);
+	pipe1.add_stage(&sink);
+	ff_a2a      a2a;
+	a2a.add_firstset<Worker>({&w1, &w2});
+    a2a.add_secondset<Collector>({&c1, &c2});
+	pipe.add_stage(&pipe0);
+	pipe.add_stage(&a2a);
+	pipe.add_stage(&pipe1);
+	
+    //----- defining the distributed groups ------
+
+    pipe0.createGroup("G1");
+    a2a.createGroup("G2") << &w1 << &c1;
+    a2a.createGroup("G3") << &w2 << &c2;
+    pipe1.createGroup("G4");
+	
+    // -------------------------------------------
+
+	if (pipe.run_and_wait_end()<0) {
+		error("running the main pipe\n");
+		return -1;
+	}
+	return 0;
+}
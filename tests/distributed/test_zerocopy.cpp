@@ -0,0 +1,120 @@
+/*  
+ *
+ *    Source ---> Worker ---> Sink
+ *      G1          G2         G3
+ *
+ *  Tasks sent without archives (see ff_zerocopy.hpp):
+ *   - rawTask_t is trivially copyable and opts in, it is sent as it is;
+ *   - spanTask_t has a header, a vector and a string exposed with spans(),
+ *     the sender writes them from the memory of the task.
+ */
+
+
+#include <iostream>
+#include <ff/dff.hpp>
+
+using namespace ff;
+
+struct rawTask_t {
+	long   id;
+	double values[512];
+};
+template<> struct ff::traits::is_raw_copyable<rawTask_t>: std::true_type {};
+static_assert(traits::is_zerocopy_v<rawTask_t>);
+// without the opt in a trivially copyable type keeps its serialization
+struct plain_t { long id; };
+static_assert(!traits::is_zerocopy_v<plain_t>);
+
+struct spanTask_t {
+	struct header_t {
+		long id;
+		int  kind;
+	} h;
+	std::vector<double> values;
+	std::string         name;
+
+	template<class S> void spans(S& s) { s(h, values, name); }
+};
+static_assert(traits::has_spans_v<spanTask_t>);
+
+struct Source: ff_node_t<rawTask_t>{
+	Source(long ntasks):ntasks(ntasks) {}
+    rawTask_t* svc(rawTask_t*){
+        for(long i=0; i< ntasks; i++) {
+			rawTask_t* task = new rawTask_t;
+			task->id = i;
+			for(long j=0;j<512;++j) task->values[j] = i+j;
+            ff_send_out(task);
+		}        
+        return EOS;
+    }
+	const long ntasks;
+};
+
+struct Worker: ff_node_t<rawTask_t, spanTask_t>{
+    spanTask_t* svc(rawTask_t* t){
+		for(long j=0;j<512;++j)
+			if (t->values[j] != t->id+j) abort();
+		spanTask_t* out = new spanTask_t;
+		out->h.id   = t->id;
+		out->h.kind = t->id % 3;
+		out->values.assign(t->values, t->values + (t->id % 512));
+		out->name   = "task" + std::to_string(t->id);
+		delete t;
+        return out;
+    }
+};
+
+struct Sink: ff_node_t<spanTask_t>{
+	Sink(long ntasks):ntasks(ntasks) {}
+    spanTask_t* svc(spanTask_t* t){
+		if (t->h.id != expected || t->h.kind != t->h.id % 3) abort();
+		if (t->values.size() != (size_t)(t->h.id % 512)) abort();
+		for(size_t j=0;j<t->values.size();++j)
+			if (t->values[j] != t->h.id+(long)j) abort();
+		if (t->name != "task" + std::to_string(t->h.id)) abort();
+		++expected;
+		delete t;
+        return GO_ON;
+    }
+	void svc_end() {
+		if (expected != ntasks) abort();
+		ff::cout << "RESULT OK\n";
+	}
+	long ntasks;
+	long expected=0;
+};
+
+
+int main(int argc, char*argv[]){
+    if (DFF_Init(argc, argv)<0 ) {
+		error("DFF_Init\n");
+		return -1;
+	}
+	long ntasks = 10000;
+	if (argc>1) {
+		ntasks = std::stol(argv[1]);
+	}
+
+	ff_pipeline pipe;
+	Source source(ntasks);
+	Worker worker;
+	Sink   sink(ntasks);
+	pipe.add_stage(&source);
+	pipe.add_stage(&worker);
+	pipe.add_stage(&sink);
+
+    //----- defining the distributed groups ------
+
+	source.createGroup("G1");
+	worker.createGroup("G2");
+	sink.createGroup("G3");
+
+    // -------------------------------------------
+
+	if (pipe.run_and_wait_end()<0) {
+		error("running the main pipe\n");
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,111 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing the FFAllocator with buffers freed by threads different from the
+ * allocating one
+ *
+ *  farm(Emitter, Worker x 3) 
+ *
+ *  The Emitter allocates buffers of different sizes (up to the largest size
+ *  class, 1MB) and the Workers free them, so that the buffers are returned
+ *  in chunks to the Emitter's allocator. The counters of the size classes
+ *  have to account for all the allocations.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <ff/ff.hpp>
+#include <ff/allocator.hpp>
+using namespace ff;
+
+const long   NTASKS  = 5000;
+const size_t sizes[] = { 48, 1000, 8192, 20000, 300000, 1048576 };
+const int    NSIZES  = sizeof(sizes)/sizeof(sizes[0]);
+
+struct Task {
+    size_t size;
+    long   id;
+};
+
+struct Emitter: ff_node_t<Task> {
+    Task *svc(Task *) {
+        for(long i=0;i<NTASKS;++i) {
+            const size_t sz = sizes[i % NSIZES];
+            Task *t = (Task*)ff_malloc(sz);
+            if (!t) { error("Emitter: ff_malloc fails\n"); return EOS; }
+            t->size = sz;
+            t->id   = i;
+            memset((char*)t+sizeof(Task), (int)(i & 0x7f), sz-sizeof(Task));
+            ff_send_out(t);
+        }
+        return EOS;
+    }
+};
+
+struct Worker: ff_node_t<Task> {
+    Task *svc(Task *t) {
+        const char *p = (char*)t+sizeof(Task);
+        if (p[0] != (char)(t->id & 0x7f) || p[t->size-sizeof(Task)-1] != (char)(t->id & 0x7f)) {
+            error("Worker: wrong data in task %ld\n", t->id);
+            abort();
+        }
+        ff_free(t);
+        return GO_ON;
+    }
+};
+
+int main() {
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(int i=0;i<3;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<Task> farm(std::move(W));
+    Emitter E;
+    farm.add_emitter(E);
+    farm.remove_collector();
+    if (farm.run_and_wait_end()<0) {
+        error("running farm\n");
+        return -1;
+    }
+    FFAllocator::instance()->printclassstats();
+
+    size_t allocs=0, remote=0;
+    for(int i=0;i<N_SLABCLASSES;++i) {
+        const slab_counters c = FFAllocator::instance()->getstats(i);
+        allocs += c.hit + c.miss;
+        remote += c.remote;
+    }
+    // the allocations of the run-time are counted too
+    if (allocs < (size_t)NTASKS || remote == 0) {
+        printf("TEST FAILED, allocations %zu, remote chunks %zu\n", allocs, remote);
+        return -1;
+    }
+    const slab_counters c = FFAllocator::instance()->getstats(N_SLABCLASSES-1);
+    if (c.size != 1048576 || c.hit + c.miss < NTASKS/NSIZES) {
+        printf("TEST FAILED, wrong counters for the 1MB size class\n");
+        return -1;
+    }
+    printf("TEST OK\n");
+    return 0;
+}
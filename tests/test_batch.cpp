@@ -0,0 +1,155 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing batched push/pop on the channels and the svc_batch method
+ *
+ *  pipe(First, Second, Farm(Emitter, 3 Workers, Collector), Last)
+ *
+ *  Second, Emitter and Collector receive their input in batches,
+ *  Second implements svc_batch, the others use the default one.
+ *  The Collector pushes its results in batches.
+ */
+
+#include <cstdio>
+#include <ff/ff.hpp>
+using namespace ff;
+
+const long N     = 100000;
+const long BATCH = 32;
+
+// batched push/pop on the queues, crossing the end of the circular buffer
+// and, for the unbounded queue, the internal buffers
+template<typename Q>
+static bool testqueue(Q &q) {
+    void *in[BATCH], *out[BATCH];
+    long next=1, expected=1;
+    for(long k=0;k<1000;++k) {
+        const size_t n = (k % BATCH)+1;
+        for(size_t i=0;i<n;++i) in[i] = (void*)(next+i);
+        size_t m = q.push_batch(in, n);
+        next += m;
+        size_t r = q.pop_batch(out, (k%3) ? BATCH : 1);
+        for(size_t i=0;i<r;++i)
+            if (out[i] != (void*)(expected++)) return false;
+    }
+    size_t r;
+    while((r=q.pop_batch(out, BATCH)))
+        for(size_t i=0;i<r;++i)
+            if (out[i] != (void*)(expected++)) return false;
+    return (expected == next);
+}
+
+struct First: ff_node_t<long> {
+    long *svc(long *) {
+        for(long i=1;i<=N;++i)
+            ff_send_out((long*)i);
+        return EOS;
+    }
+};
+
+struct Second: ff_node_t<long> {
+    void *svc_batch(void **tasks, size_t n) {
+        ++nbatches;
+        for(size_t i=0;i<n;++i) ff_send_out(tasks[i]);
+        return GO_ON;
+    }
+    long *svc(long *task) { return task; }
+    long nbatches=0;
+};
+
+struct Emitter: ff_node_t<long> {
+    long *svc(long *task) { return task; }
+};
+
+struct Worker: ff_node_t<long> {
+    long *svc(long *task) { return task; }
+};
+
+struct Collector: ff_node_t<long> {
+    long *svc(long *task) { return task; }
+};
+
+// it stops at the second task
+struct Stop: ff_node_t<long> {
+    long *svc(long *task) {
+        ++cnt;
+        return (reinterpret_cast<long>(task) == 2) ? EOS : GO_ON;
+    }
+    long cnt=0;
+};
+
+struct Last: ff_node_t<long> {
+    long *svc(long *task) {
+        sum += reinterpret_cast<long>(task);
+        ++cnt;
+        return GO_ON;
+    }
+    long sum=0, cnt=0;
+};
+
+int main() {
+    SWSR_Ptr_Buffer  q1(100);
+    uSWSR_Ptr_Buffer q2(40);
+    if (!q1.init() || !q2.init()) abort();
+    if (!testqueue(q1) || !testqueue(q2)) {
+        printf("TEST FAILED, batched push/pop on the queues\n");
+        return -1;
+    }
+    // the tasks following an EOS in the same batch are delivered too
+    Stop  stop;
+    void *tasks[4] = { (void*)1, (void*)2, (void*)3, (void*)4 };
+    if (stop.svc_batch(tasks, 4) != FF_EOS || stop.cnt != 4) {
+        printf("TEST FAILED, svc_batch lost the tasks after EOS\n");
+        return -1;
+    }
+
+    const size_t nworkers = 3;
+    First     first;
+    Second    second;
+    Emitter   E;
+    Collector C;
+    Last      last;
+    second.set_input_batch(BATCH);
+    E.set_input_batch(BATCH);
+    C.set_input_batch(BATCH);
+
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(size_t i=0;i<nworkers;++i)  W.push_back(make_unique<Worker>());
+    ff_Farm<long,long> farm(std::move(W), E, C);
+
+    ff_Pipe<> pipe(first, second, farm, last);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    if (last.cnt != N || last.sum != N*(N+1)/2) {
+        printf("TEST FAILED, wrong result %ld (expected %ld)\n", last.sum, N*(N+1)/2);
+        return -1;
+    }
+    printf("Second received %ld tasks in %ld batches\n", N, second.nbatches);
+    printf("TEST OK\n");
+    return 0;
+}
@@ -0,0 +1,128 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/*  
+ *  pipe(First, Farm(Emitter, 4 Workers, Collector), OFarm(3 Workers), Last)
+ *
+ *  testing the topology-aware mapping (OptLevel::topology_mapping).
+ *  The threads are pinned in data-flow order on the cores listed by
+ *  ff_topology::mapping():
+ *
+ *    First  Emitter  W0 W1 W2 W3  Collector  (lb)  OW0 OW1 OW2  (gt)  Last
+ *      0       1      2  3  4  5      6        7    8   9   10   11    12
+ *
+ *  (modulo the number of cores). Each node checks the core it is running on.
+ */
+
+#include <cstdio>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NTASKS = 1000;
+
+static std::atomic<long> wrong{0};
+
+template<typename T>
+struct Node: ff_node_t<T> {
+    Node(int pos):pos(pos) {}
+    int svc_init() {
+        const std::vector<int> &M = ff_topology::instance().mapping();
+        if (M.size()) {
+            const int expected = M[pos % M.size()];
+            if (this->getCPUId() != expected || ff_getMyCore() != expected) {
+                printf("node %d: expected core %d, mapped on %d, running on %ld\n",
+                       pos, expected, this->getCPUId(), ff_getMyCore());
+                ++wrong;
+            }
+        }
+        return 0;
+    }
+    const int pos;
+};
+
+struct First: Node<long> {
+    First():Node<long>(0) {}
+    long* svc(long*) {
+        for(long i=1;i<=NTASKS;++i)
+            ff_send_out((long*)i);
+        return EOS;
+    }
+};
+struct Stage: Node<long> {
+    Stage(int pos):Node<long>(pos) {}
+    long* svc(long*in) { return in; }
+};
+struct Last: Node<long> { 
+    Last():Node<long>(12) {}
+    long* svc(long*in) {
+        sum += (long)in;
+        return GO_ON;
+    }
+    long sum=0;
+};
+
+int main() {
+    if (!ff_topology::instance().valid()) {
+        printf("topology not available on this system\n");
+        return 0;
+    }
+    First first;
+    Stage E(1), C(6);
+    Last  last;
+
+    std::vector<std::unique_ptr<ff_node> > W1;
+    for(int i=0;i<4;++i) W1.push_back(make_unique<Stage>(2+i));
+    ff_Farm<long,long> farm(std::move(W1), E, C);
+
+    std::vector<std::unique_ptr<ff_node> > W2;
+    for(int i=0;i<3;++i) W2.push_back(make_unique<Stage>(8+i));
+    ff_OFarm<long,long> ofarm(std::move(W2));
+    
+    ff_Pipe<> pipe(first, farm, ofarm, last);
+
+    OptLevel opt;
+    opt.verbose_level=1;
+    opt.topology_mapping=true;
+    if (optimize_static(pipe,opt)<0) {
+        error("optimize_static\n");
+        return -1;
+    }
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipeline\n");
+        return -1;
+    }
+    if (last.sum != NTASKS*(NTASKS+1)/2) {
+        printf("TEST FAILED, wrong result\n");
+        return -1;
+    }
+    if (wrong) {
+        printf("TEST FAILED, %ld nodes not mapped as expected\n", wrong.load());
+        return -1;
+    }
+    printf("TEST OK\n");
+    return 0;
+}
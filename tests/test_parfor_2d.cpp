@@ -0,0 +1,128 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing the tiled 2D/3D parallel loops
+ *
+ *  - every iteration is executed exactly once, with tiles of different sizes
+ *    and sizes of the iteration space that are not multiple of the tiles
+ *  - parallel_reduce_2d/3d
+ *  - the tiles are consecutive in Morton order
+ */
+
+#include <cstdio>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+using namespace ff;
+
+static bool check2d(const std::vector<long> &A, long n0, long n1, long f0, long f1, long k, const char *what) {
+    for(long i=0;i<n0;++i)
+        for(long j=0;j<n1;++j) {
+            const long expected = (i>=f0 && j>=f1) ? k : 0;
+            if (A[i*n1+j] != expected) {
+                printf("TEST FAILED (%s), A[%ld][%ld]=%ld (expected %ld)\n", what, i, j, A[i*n1+j], expected);
+                return false;
+            }
+        }
+    return true;
+}
+
+int main() {
+    const long nw = 4;
+    const long N0 = 517, N1 = 389;
+    const long M0 = 37, M1 = 41, M2 = 75;
+    std::vector<long> A(N0*N1), B(M0*M1*M2);
+
+    ParallelForReduce<long> pfr(nw);
+    // budgets: tiny (many small tiles), default (L2), larger than the data
+    const size_t budgets[] = { 1024, 0, 64*1024*1024 };
+    for(size_t b=0;b<3;++b) {
+        std::fill(A.begin(), A.end(), 0);
+        for(long k=1;k<=3;++k) {
+            pfr.parallel_for_2d(3,N0,5,N1,[&](const long i, const long j) { A[i*N1+j]+=1; }, nw, sizeof(long), budgets[b]);
+            if (!check2d(A,N0,N1,3,5,k,"parallel_for_2d")) return -1;
+        }
+        long sum = 0;
+        pfr.parallel_reduce_2d(sum, 0L, 0,N0,0,N1, [&](const long i, const long j, long &s) { s += i*N1+j; },
+                               [](long &v, const long elem) { v += elem; }, nw, sizeof(long), budgets[b]);
+        if (sum != (N0*N1)*(N0*N1-1)/2) {
+            printf("TEST FAILED (parallel_reduce_2d), sum=%ld\n", sum);
+            return -1;
+        }
+
+        std::fill(B.begin(), B.end(), 0);
+        pfr.parallel_for_3d(0,M0,0,M1,0,M2,[&](const long i, const long j, const long k) {
+                B[(i*M1+j)*M2+k] += 1;
+            }, nw, sizeof(long), budgets[b]);
+        for(size_t i=0;i<B.size();++i)
+            if (B[i] != 1) {
+                printf("TEST FAILED (parallel_for_3d), B[%ld]=%ld\n", (long)i, B[i]);
+                return -1;
+            }
+        sum = 0;
+        pfr.parallel_reduce_3d(sum, 0L, 0,M0,0,M1,0,M2, [&](const long i, const long j, const long k, long &s) {
+                s += B[(i*M1+j)*M2+k];
+            }, [](long &v, const long elem) { v += elem; }, nw, sizeof(long), budgets[b]);
+        if (sum != M0*M1*M2) {
+            printf("TEST FAILED (parallel_reduce_3d), sum=%ld\n", sum);
+            return -1;
+        }
+    }
+    {
+        // one worker and an empty iteration space
+        ParallelFor pf(nw, true);
+        std::fill(A.begin(), A.end(), 0);
+        pf.parallel_for_2d(0,N0,0,N1,[&](const long i, const long j) { A[i*N1+j]=1; }, 1);
+        if (!check2d(A,N0,N1,0,0,1,"one worker")) return -1;
+        pf.parallel_for_2d(0,N0,7,7,[&](const long i, const long j) { A[i*N1+j]=2; });
+        pf.parallel_for_3d(0,0,0,N0,0,N1,[&](const long, const long, const long) { A[0]=2; });
+        if (!check2d(A,N0,N1,0,0,1,"empty")) return -1;
+        pf.parallel_for_2d(0,N0,0,N1,[&](const long i, const long j) { A[i*N1+j]=3; }, nw, sizeof(long), 4096);
+        if (!check2d(A,N0,N1,0,0,3,"spinwait")) return -1;
+    }
+    {
+        // the tiles are in Morton order: (0,0) (0,1) (1,0) (1,1) (0,2) ...
+        forall_tiles<2> tl;
+        const size_t n = tl.setup({0,0}, {1024,1024}, sizeof(double), 32*32*sizeof(double), 1);
+        const long *t = tl.tile();
+        if (n != size_t((1024/t[0])*(1024/t[1])) || t[1] % (CACHE_LINE_SIZE/sizeof(double))) {
+            printf("TEST FAILED (tiles), %ld tiles of %ldx%ld\n", (long)n, t[0], t[1]);
+            return -1;
+        }
+        const long expected[5][2] = { {0,0}, {0,1}, {1,0}, {1,1}, {0,2} };
+        long lo[2], hi[2];
+        for(size_t i=0;i<5;++i) {
+            tl.bounds(i, lo, hi);
+            if (lo[0] != expected[i][0]*t[0] || lo[1] != expected[i][1]*t[1]) {
+                printf("TEST FAILED (Morton order), tile %ld at (%ld,%ld)\n", (long)i, lo[0], lo[1]);
+                return -1;
+            }
+        }
+        printf("%ld tiles of %ldx%ld\n", (long)n, t[0], t[1]);
+    }
+    printf("TEST OK\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing the auto grain of ParallelFor/ParallelForReduce
+ *
+ *  - guided chunks: every iteration is executed once, for several sizes,
+ *    steps and numbers of workers
+ *  - the grain of a loop with cheap iterations grows after the first call,
+ *    the grain of a loop with expensive iterations stays small
+ *  - parallel_reduce_auto
+ */
+
+#include <cstdio>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+using namespace ff;
+
+int main() {
+    const long nw = 4;
+    {
+        ParallelFor pf(nw);
+        const long sizes[] = { 1, 2, 3, 5, 17, 100, 1001, 9999 };
+        std::vector<long> C(10000);
+        for(long n : sizes)
+            for(long step=1; step<=3; step+=2)
+                for(long w=1; w<=nw; ++w)
+                    for(int k=0;k<3;++k) {   // the grain changes after the first call
+                        std::fill(C.begin(), C.end(), 0);
+                        pf.parallel_for_auto(0,n,step,[&](const long i) { C[i]++; }, w);
+                        for(long i=0;i<n;++i)
+                            if (C[i] != ((i%step)==0)) {
+                                printf("TEST FAILED, n=%ld step=%ld nw=%ld: C[%ld]=%ld\n", n, step, w, i, C[i]);
+                                return -1;
+                            }
+                    }
+    }
+
+    const long N = 1000000;
+    std::vector<double> A(N);
+    {
+        ParallelFor pf(nw, true);
+        auto cheap = [&](const long i) { A[i] = i*0.5; };
+        auto costly = [&](const long i) { ticks_wait(50000); A[i] = i; };
+        for(int k=0;k<5;++k) {
+            pf.parallel_for_auto(0,N,1,cheap);
+            pf.parallel_for_auto(0,100,1,costly);
+        }
+        const long gcheap  = pf.autoGrain(forall_site<decltype(cheap)>());
+        const long gcostly = pf.autoGrain(forall_site<decltype(costly)>());
+        printf("auto grain: cheap loop %ld, costly loop %ld\n", gcheap, gcostly);
+        if (gcheap <= 16 || gcostly != 1) {
+            printf("TEST FAILED, wrong grain\n");
+            return -1;
+        }
+        for(long i=0;i<N;++i)
+            if (A[i] != (i<100 ? i : i*0.5)) {
+                printf("TEST FAILED, A[%ld]=%g\n", i, A[i]);
+                return -1;
+            }
+    }
+    {
+        ParallelForReduce<double> pfr(nw);
+        double expected = 0;  // the values are integers, the sum is exact
+        for(long i=0;i<N;i+=2) expected += A[i];
+        for(int k=0;k<3;++k) {
+            pfr.disableScheduler(k==1);
+            double sum = 0;
+            pfr.parallel_reduce_auto(sum, 0.0, 0, N, 2, [&](const long i, double &s) { s += A[i]; },
+                                     [](double &v, const double elem) { v += elem; });
+            if (sum != expected) {
+                printf("TEST FAILED (reduce), sum=%g (expected %g)\n", sum, expected);
+                return -1;
+            }
+        }
+    }
+    printf("TEST OK\n");
+    return 0;
+}
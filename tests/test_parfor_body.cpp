@@ -0,0 +1,133 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing the loop bodies called without std::function (setBody)
+ *
+ *  - ParallelFor with and without the scheduler thread, static and dynamic
+ *  - ParallelFor with spinwait
+ *  - ParallelForReduce
+ *  - ff_forall_farm with setF and setBody on the same object
+ *
+ *  The time of the same fine-grained loop with setF and with setBody is printed.
+ */
+
+#include <cstdio>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+using namespace ff;
+
+const long N = 100000;
+
+static bool check(const std::vector<long> &A, long k, const char *what) {
+    for(long i=0;i<N;++i)
+        if (A[i] != i*k) {
+            printf("TEST FAILED (%s), A[%ld]=%ld (expected %ld)\n", what, i, A[i], i*k);
+            return false;
+        }
+    return true;
+}
+
+int main() {
+    const long nw = 4;
+    std::vector<long> A(N);
+    {
+        ParallelFor pf(nw);
+        pf.parallel_for(0,N,[&](const long i) { A[i]=i; });
+        if (!check(A,1,"static")) return -1;
+        pf.parallel_for(0,N,1,100,[&](const long i) { A[i]=2*i; });
+        if (!check(A,2,"dynamic")) return -1;
+        pf.disableScheduler(true);
+        pf.parallel_for(0,N,1,100,[&](const long i) { A[i]=3*i; });
+        if (!check(A,3,"dynamic, no scheduler")) return -1;
+        pf.parallel_for_static(0,N,1,64,[&](const long i) { A[i]=4*i; });
+        if (!check(A,4,"static grain")) return -1;
+        pf.disableScheduler(false);
+        pf.parallel_for_idx(0,N,1,300,[&](const long start, const long stop, const int) {
+                for(long i=start;i<stop;++i) A[i]=5*i;
+            });
+        if (!check(A,5,"idx")) return -1;
+    }
+    {
+        ParallelFor pf(nw, true);
+        for(long k=1;k<=10;++k) {
+            pf.parallel_for(0,N,1,200,[&](const long i) { A[i]=k*i; });
+            if (!check(A,k,"spinwait")) return -1;
+        }
+    }
+    {
+        ParallelForReduce<long> pfr(nw);
+        for(int s=0;s<2;++s) {
+            pfr.disableScheduler(s==1);
+            long sum = 0;
+            pfr.parallel_reduce(sum, 0L, 0, N, 1, 100, [](const long i, long &sum) { sum += i; },
+                                [](long &v, const long elem) { v += elem; });
+            if (sum != N*(N-1)/2) {
+                printf("TEST FAILED (reduce), sum=%ld (expected %ld)\n", sum, N*(N-1)/2);
+                return -1;
+            }
+        }
+    }
+    {
+        // the two ways of setting the body on the same farm
+        ff_forall_farm<forallreduce_W<int> > farm(nw);
+        auto body = [&](const long start, const long stop, const int, int&) {
+            for(long i=start;i<stop;++i) A[i]+=i;
+        };
+        std::fill(A.begin(), A.end(), 0);
+        for(int k=0;k<3;++k) {
+            farm.setloop(0,N,1,256,nw);
+            if (k==1) farm.setBody(body);
+            else      farm.setF(body);
+            if (farm.run_then_freeze(farm.getnw())<0 || farm.wait_freezing()<0) {
+                error("running the forall farm\n");
+                return -1;
+            }
+        }
+        if (!check(A,3,"setF/setBody")) return -1;
+
+        const int ntimes = 20;
+        double t[2];
+        for(int k=0;k<2;++k) {
+            ffTime(START_TIME);
+            for(int j=0;j<ntimes;++j) {
+                farm.setloop(0,N,1,256,nw);
+                if (k) farm.setBody(body);
+                else   farm.setF(body);
+                farm.run_then_freeze(farm.getnw());
+                farm.wait_freezing();
+            }
+            ffTime(STOP_TIME);
+            t[k] = ffTime(GET_TIME);
+        }
+        printf("grain 256: setF %g (ms), setBody %g (ms)\n", t[0], t[1]);
+        farm.stop();
+        farm.wait();
+        if (!check(A,3+2*ntimes,"timing")) return -1;
+    }
+    printf("TEST OK\n");
+    return 0;
+}
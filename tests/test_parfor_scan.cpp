@@ -0,0 +1,122 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing parallel_scan and parallel_sort of ParallelFor/ParallelForReduce
+ *
+ *  - inclusive and exclusive scan, also in place, with a sum and with a
+ *    non commutative operator (composition of affine maps)
+ *  - the sort is stable: the result is the same as std::stable_sort
+ */
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+using namespace ff;
+
+// x -> a*x+b modulo P
+struct affine { long a, b; };
+static const long P = 1000003;
+static affine compose(const affine& f, const affine& g) {  // g after f
+    return { (g.a*f.a) % P, (g.a*f.b + g.b) % P };
+}
+static bool operator!=(const affine& x, const affine& y) { return x.a!=y.a || x.b!=y.b; }
+
+template<typename PF, typename V, typename Op>
+static bool checkScan(PF& pf, const std::vector<V>& in, const V& identity, const Op& op, long nw) {
+    for(int inclusive=0; inclusive<2; ++inclusive) {
+        std::vector<V> expected(in.size()), out(in.size());
+        V acc = identity;
+        for(size_t i=0;i<in.size();++i) {
+            if (inclusive) { acc = op(acc, in[i]); expected[i] = acc; }
+            else { expected[i] = acc; acc = op(acc, in[i]); }
+        }
+        pf.parallel_scan(in.begin(), in.end(), out.begin(), identity, op, inclusive, nw);
+        std::vector<V> inplace(in);
+        pf.parallel_scan(inplace.begin(), inplace.end(), inplace.begin(), identity, op, inclusive, nw);
+        for(size_t i=0;i<in.size();++i)
+            if (out[i] != expected[i] || inplace[i] != expected[i]) {
+                printf("TEST FAILED, scan n=%zu nw=%ld inclusive=%d at %zu\n", in.size(), nw, inclusive, i);
+                return false;
+            }
+    }
+    return true;
+}
+
+struct item { long key, pos; };
+
+template<typename PF>
+static bool checkSort(PF& pf, size_t n, long keys, long nw) {
+    std::vector<item> v(n);
+    unsigned long s = 12345 + n;
+    for(size_t i=0;i<n;++i) {
+        s = s*6364136223846793005UL + 1442695040888963407UL;
+        v[i] = { (long)((s>>33) % keys), (long)i };
+    }
+    std::vector<item> expected(v);
+    auto comp = [](const item& x, const item& y) { return x.key < y.key; };
+    std::stable_sort(expected.begin(), expected.end(), comp);
+    pf.parallel_sort(v.begin(), v.end(), comp, nw);
+    for(size_t i=0;i<n;++i)
+        if (v[i].key != expected[i].key || v[i].pos != expected[i].pos) {
+            printf("TEST FAILED, sort n=%zu keys=%ld nw=%ld at %zu\n", n, keys, nw, i);
+            return false;
+        }
+    return true;
+}
+
+int main() {
+    const long nw = 4;
+    const size_t sizes[] = { 0, 1, 7, 5000, 100003 };
+    ParallelFor pf(nw);
+    ParallelForReduce<long> pfr(nw);
+    for(size_t n : sizes) {
+        std::vector<long>   A(n);
+        std::vector<affine> F(n);
+        for(size_t i=0;i<n;++i) {
+            A[i] = (long)(i%13) - 6;
+            F[i] = { (long)(i%7)+1, (long)(i%11) };
+        }
+        for(long w=1; w<=nw; ++w) {
+            if (!checkScan(pf, A, 0L, [](long x, long y) { return x+y; }, w)) return -1;
+            if (!checkScan(pfr, A, 0L, [](long x, long y) { return x+y; }, w)) return -1;
+            if (!checkScan(pf, F, affine{1,0}, compose, w)) return -1;
+            if (!checkSort(pf, n, 10, w)) return -1;
+            if (!checkSort(pfr, n, 1000000, w)) return -1;
+        }
+    }
+    // sort with the default comparison
+    std::vector<double> D(200000);
+    for(size_t i=0;i<D.size();++i) D[i] = (double)((i*7919) % 100003);
+    pf.parallel_sort(D.begin(), D.end());
+    if (!std::is_sorted(D.begin(), D.end())) {
+        printf("TEST FAILED, sort of doubles\n");
+        return -1;
+    }
+    printf("TEST OK\n");
+    return 0;
+}
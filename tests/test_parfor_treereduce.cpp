@@ -0,0 +1,122 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing the final reductions of ParallelForReduce
+ *
+ *  - tree reduction (parallel_reduce_tree and FF_PARFORREDUCE_TREE_STOP),
+ *    also NUMA-aware, of a sum and of a histogram
+ *  - deterministic reduction (parallel_reduce_det): the floating point sum is
+ *    bitwise the same for any number of workers
+ */
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+using namespace ff;
+
+int main() {
+    const long nw = 4;
+    const long N  = 100000;
+    const long bins = 64;
+    std::vector<long> A(N);
+    for(long i=0;i<N;++i) A[i] = (i*7919) % 1000;
+
+    std::vector<long> expected(bins, 0);
+    long sum = 0;
+    for(long i=0;i<N;++i) { expected[A[i]%bins]++; sum += A[i]; }
+
+    ParallelForReduce<long> pfr(nw);
+    ParallelForReduce<std::vector<long> > pfh(nw);
+    for(long w=1; w<=nw; ++w)
+        for(int numa=0; numa<2; ++numa) {
+            long s = 10;
+            pfr.parallel_reduce_tree(s, 0L, 0, N, 1, 100, [&](const long i, long& s) { s += A[i]; },
+                                     [](long& a, const long b) { a += b; }, w, numa);
+            if (s != sum+10) {
+                printf("TEST FAILED, tree sum nw=%ld: %ld instead of %ld\n", w, s, sum+10);
+                return -1;
+            }
+            std::vector<long> H(bins, 0);
+            pfh.parallel_reduce_tree(H, std::vector<long>(bins, 0), 0, N, 1, 100,
+                                     [&](const long i, std::vector<long>& h) { h[A[i]%bins]++; },
+                                     [](std::vector<long>& a, const std::vector<long>& b) {
+                                         for(size_t k=0;k<a.size();++k) a[k] += b[k];
+                                     }, w, numa);
+            if (H != expected) {
+                printf("TEST FAILED, tree histogram nw=%ld\n", w);
+                return -1;
+            }
+            // the macros
+            auto p = &pfr;
+            s = 0;
+            FF_PARFORREDUCE_START(p, s, 0L, i, 0, N, 1, PARFOR_DYNAMIC(50), w) {
+                s += A[i];
+            } FF_PARFORREDUCE_TREE_STOP(p, s, [](long& a, const long b) { a += b; }, numa);
+            long s2 = 0;
+            for(long i=0;i<N;++i) s2 += A[i];
+            if (s != s2) {
+                printf("TEST FAILED, FF_PARFORREDUCE_TREE_STOP nw=%ld: %ld instead of %ld\n", w, s, s2);
+                return -1;
+            }
+        }
+
+    // values of very different magnitude: the sum depends on the order
+    std::vector<double> D(N);
+    for(long i=0;i<N;++i) D[i] = std::pow(10.0, (double)((i*37)%17) - 8) * ((i%3) ? 1 : -1);
+    ParallelForReduce<double> pfd(nw);
+    double ref = 0;
+    for(long w=1; w<=nw; ++w)
+        for(int k=0;k<3;++k) {
+            double s = 0;
+            pfd.parallel_reduce_det(s, 0.0, 0, N, 1, 1000, [&](const long i, double& s) { s += D[i]; },
+                                    [](double& a, const double b) { a += b; }, w);
+            if (w==1 && k==0) ref = s;
+            else if (s != ref) {
+                printf("TEST FAILED, deterministic sum nw=%ld: %.17g instead of %.17g\n", w, s, ref);
+                return -1;
+            }
+        }
+    double seq = 0;
+    for(long i=0;i<N;++i) seq += D[i];
+    if (std::fabs(seq-ref) > 1e-6*std::fabs(seq)) {
+        printf("TEST FAILED, deterministic sum %.17g, sequential %.17g\n", ref, seq);
+        return -1;
+    }
+    // the step and an incomplete last block
+    long s = 0;
+    pfr.parallel_reduce_det(s, 0L, 3, N, 7, 333, [&](const long i, long& s) { s += A[i]; },
+                            [](long& a, const long b) { a += b; }, nw);
+    long s3 = 0;
+    for(long i=3;i<N;i+=7) s3 += A[i];
+    if (s != s3) {
+        printf("TEST FAILED, deterministic sum with step: %ld instead of %ld\n", s, s3);
+        return -1;
+    }
+    printf("TEST OK\n");
+    return 0;
+}
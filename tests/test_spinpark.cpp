@@ -0,0 +1,90 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing the spin-then-park waiting strategy in blocking mode
+ *
+ *  pipe(First, Farm(4), Last)
+ *
+ *  First produces bursts of tasks separated by idle periods so that
+ *  the other nodes alternate spinning and parking.
+ */
+
+#include <cstdio>
+#include <ff/ff.hpp>
+using namespace ff;
+
+const long NBURSTS   = 50;
+const long BURSTSIZE = 200;
+
+struct First: ff_node_t<long> {
+    long *svc(long *) {
+        long k=1;
+        for(long i=0;i<NBURSTS;++i) {
+            for(long j=0;j<BURSTSIZE;++j)
+                ff_send_out((long*)(k++));
+            usleep((i%5)*1000);
+        }
+        return EOS;
+    }
+};
+
+struct Worker: ff_node_t<long> {
+    long *svc(long *task) { return task; }
+};
+
+struct Last: ff_node_t<long> {
+    long *svc(long *task) {
+        sum += reinterpret_cast<long>(task);
+        return GO_ON;
+    }
+    long sum=0;
+};
+
+int main() {
+    const size_t nworkers = 4;
+    First first;
+    Last  last;
+
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(size_t i=0;i<nworkers;++i)  W.push_back(make_unique<Worker>());
+    ff_Farm<long,long> farm(std::move(W));
+    farm.setInputQueueLength(nworkers*2, true);
+
+    ff_Pipe<> pipe(first,farm,last);
+    pipe.blocking_mode(true);
+    pipe.spinpark_mode(true);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    const long N = NBURSTS*BURSTSIZE;
+    if (last.sum != N*(N+1)/2) {
+        printf("TEST FAILED, wrong result %ld (expected %ld)\n", last.sum, N*(N+1)/2);
+        return -1;
+    }
+    printf("TEST OK\n");
+    return 0;
+}
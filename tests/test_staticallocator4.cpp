@@ -0,0 +1,123 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing the StaticAllocator with more size classes, growth and try_alloc
+ *
+ *   Source ---> Sink
+ *
+ * The Source allocates two different types (two size classes) and the Sink
+ * releases them slowly, so that the allocator of the Source has to grow up
+ * to the maximum number of segments and then to wait for free slots.
+ */
+
+#include <iostream>
+#include <ff/ff.hpp>
+#include <ff/staticallocator.hpp>
+
+using namespace ff;
+
+struct Small_t { long id; };
+struct Big_t   { long id; char payload[200]; };
+
+const long   ntasks = 2000;
+const size_t nslots = 4;
+const size_t maxsegs= 3;
+
+struct Source: ff_node_t<long> {
+    Source(StaticAllocator *SAlloc): SAlloc(SAlloc) {}
+    int svc_init() { return SAlloc->init(); }
+    long* svc(long*) {
+        for(long i=0;i<ntasks;++i) {
+            if (i & 1) {
+                Big_t *p; SAlloc->alloc(p);
+                p->id = i; p->payload[199] = (char)i;
+                ff_send_out((long*)p);
+            } else {
+                Small_t *p; SAlloc->alloc(p);
+                p->id = i;
+                ff_send_out((long*)p);
+            }
+        }
+        return EOS;
+    }
+    StaticAllocator *SAlloc;
+};
+
+struct Sink: ff_node_t<long> {
+    long* svc(long* in) {
+        const long id = *in;   // both types start with the id
+        if (id != expected++) {
+            std::cerr << "Sink ERROR, received " << id << "\n";
+            abort();
+        }
+        if ((id % 100) == 0) usleep(1000);
+        if (id & 1) {
+            if (((Big_t*)in)->payload[199] != (char)id) abort();
+            StaticAllocator::dealloc((Big_t*)in);
+        } else StaticAllocator::dealloc((Small_t*)in);
+        return GO_ON;
+    }
+    long expected = 0;
+};
+
+int main() {
+    // try_alloc on an allocator that cannot grow
+    {
+        StaticAllocator A(nslots, sizeof(Small_t));
+        if (A.init()<0) return -1;
+        std::vector<Small_t*> V(nslots);
+        for(size_t i=0;i<nslots;++i)
+            if (!A.try_alloc(V[i])) { std::cerr << "TEST FAILED, try_alloc\n"; return -1; }
+        Small_t *p;
+        if (A.try_alloc(p)) { std::cerr << "TEST FAILED, the allocator should be full\n"; return -1; }
+        StaticAllocator::dealloc(V[0]);
+        if (!A.try_alloc(p) || A.highwater() != nslots || A.inuse() != nslots) {
+            std::cerr << "TEST FAILED, wrong counters\n"; return -1;
+        }
+    }
+
+    StaticAllocator *SAlloc = new StaticAllocator(nslots, {sizeof(Big_t), sizeof(Small_t)});
+    SAlloc->set_max_segments(maxsegs);
+    Source Sc(SAlloc);
+    Sink   Sk;
+    ff_Pipe<> pipe(Sc, Sk);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    SAlloc->printstats();
+    for(size_t c=0;c<SAlloc->nclasses();++c) {
+        if (SAlloc->inuse(0,c) != 0 || SAlloc->highwater(0,c) == 0 ||
+            SAlloc->highwater(0,c) > SAlloc->nslots(0,c) ||
+            SAlloc->nslots(0,c) > nslots*maxsegs) {
+            std::cerr << "TEST FAILED, wrong counters for the size class " << c << "\n";
+            return -1;
+        }
+    }
+    delete SAlloc;
+    std::cout << "TEST OK\n";
+    return 0;
+}
@@ -0,0 +1,79 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing the topology discovery (topology.hpp)
+ *
+ * It prints the topology of the machine and checks that it is consistent
+ * with the values returned by the functions in mapping_utils.hpp.
+ * The topology-based mapping string is then used by the threadMapper.
+ */
+
+#include <cstdio>
+#include <ff/ff.hpp>
+using namespace ff;
+
+#define CHECK(c) if (!(c)) { printf("TEST FAILED, %s\n", #c); return -1; }
+
+int main() {
+    const ff_topology &topo = ff_topology::instance();
+    if (!topo.valid()) {
+        printf("topology not available on this system\n");
+        printf("TEST OK\n");
+        return 0;
+    }
+    printf("cpus %ld, cores %ld, sockets %ld, NUMA nodes %ld\n",
+           topo.numCpus(), topo.numCores(), topo.numSockets(), topo.numNodes());
+    printf("%4s %6s %4s %3s %4s %4s %4s\n", "cpu", "socket", "core", "smt", "node", "L2", "L3");
+    for(const ff_cpuinfo &c: topo.cpus())
+        printf("%4d %6d %4d %3d %4d %4d %4d%s\n", c.cpu, c.socket, c.core, c.smt,
+               c.node, c.l2, c.l3, c.allowed?"":" (not allowed)");
+    printf("mapping string: \"%s\"\n", topo.mapping_string().c_str());
+
+    CHECK(topo.numCores()>0 && topo.numCores() <= topo.numCpus());
+    CHECK(topo.numSockets()>0 && topo.numSockets() <= topo.numCores());
+    CHECK(ff_realNumCores() == (ssize_t)topo.numAllowedCores());
+    CHECK(ff_numSockets() == (ssize_t)topo.numSockets());
+    CHECK(ff_numaNodes() == (ssize_t)topo.numNodes());
+    CHECK(topo.mapping().size() == topo.numAllowedCpus());
+
+    // each allowed cpu appears once, and the first contexts come first
+    std::vector<int> M(topo.mapping());
+    for(size_t i=0;i<M.size();++i) {
+        const ff_cpuinfo *c = topo.cpu(M[i]);
+        CHECK(c && c->allowed);
+        if (i) CHECK(topo.cpu(M[i-1])->smt <= c->smt);
+    }
+    std::sort(M.begin(), M.end());
+    CHECK(std::unique(M.begin(), M.end()) == M.end());
+
+    threadMapper *tm = threadMapper::instance();
+    CHECK(tm->setMappingList(topo.mapping_string().c_str()) == (int)topo.numAllowedCpus());
+    for(size_t i=0;i<topo.mapping().size();++i)
+        CHECK(tm->getCoreId() == topo.mapping()[i]);
+
+    printf("TEST OK\n");
+    return 0;
+}
@@ -0,0 +1,142 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ***************************************************************************
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ *  As a special exception, you may use this file as part of a free software
+ *  library without restriction.  Specifically, if other files instantiate
+ *  templates or use macros or inline functions from this file, or you compile
+ *  this file and link it with other files to produce an executable, this
+ *  file does not by itself cause the resulting executable to be covered by
+ *  the GNU General Public License.  This exception does not however
+ *  invalidate any other reasons why the executable file might be covered by
+ *  the GNU General Public License.
+ *
+ ****************************************************************************
+ */
+/* testing the work-stealing scheduling of the farm
+ *
+ *  pipe(Source, Farm(4), Sink)      with the default collector, the workers
+ *                                   receive their input in batches
+ *  pipe(Source, OFarm(4), Sink)     the ordering has to be preserved
+ *  Farm(Source, 4, Sink)            the emitter generates the stream
+ *
+ *  The tasks scheduled to the first worker are much more expensive than
+ *  the others, so the other workers steal them.
+ */
+
+#include <cstdio>
+#include <ff/ff.hpp>
+using namespace ff;
+
+const long NTASKS = 2000;
+
+struct Source: ff_node_t<long> {
+    long *svc(long *) {
+        for(long i=1;i<=NTASKS;++i)
+            ff_send_out((long*)i);
+        return EOS;
+    }
+};
+
+struct Worker: ff_node_t<long> {
+    long *svc(long *task) {
+        if (get_my_id()==0) usleep(200);
+        ++ntasks;
+        return task;
+    }
+    long ntasks=0;
+};
+
+struct Sink: ff_node_t<long> {
+    Sink(bool ordered):ordered(ordered) {}
+    long *svc(long *task) {
+        const long t = reinterpret_cast<long>(task);
+        if (ordered && t != expected) {
+            printf("TEST FAILED, wrong ordering %ld (expected %ld)\n", t, expected);
+            abort();
+        }
+        ++expected;
+        sum += t;
+        return GO_ON;
+    }
+    bool ordered;
+    long expected=1, sum=0;
+};
+
+template<typename Farm>
+static int run(Farm &farm, bool ordered, const std::vector<Worker*> &W) {
+    Source source;
+    Sink   sink(ordered);
+    farm.set_scheduling_workstealing(16);
+    ff_Pipe<> pipe(source, farm, sink);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    if (sink.sum != NTASKS*(NTASKS+1)/2) {
+        printf("TEST FAILED, wrong result %ld (expected %ld)\n", sink.sum, NTASKS*(NTASKS+1)/2);
+        return -1;
+    }
+    printf("%s farm, tasks executed by each worker:", ordered?"ordered":"standard");
+    for(size_t i=0;i<W.size();++i) printf(" %ld", W[i]->ntasks);
+    printf("\n");
+    return 0;
+}
+
+int main() {
+    const size_t nworkers = 4;
+    {
+        std::vector<std::unique_ptr<ff_node> > V;
+        std::vector<Worker*> W;
+        for(size_t i=0;i<nworkers;++i) {
+            W.push_back(new Worker);
+            V.push_back(std::unique_ptr<ff_node>(W.back()));
+        }
+        Source source;
+        Sink   sink(false);
+        ff_Farm<long,long> farm(std::move(V), source, sink);
+        farm.set_scheduling_workstealing(16);
+        if (farm.run_and_wait_end()<0) {
+            error("running farm\n");
+            return -1;
+        }
+        if (sink.sum != NTASKS*(NTASKS+1)/2) {
+            printf("TEST FAILED, wrong result %ld (expected %ld)\n", sink.sum, NTASKS*(NTASKS+1)/2);
+            return -1;
+        }
+    }
+    {
+        std::vector<std::unique_ptr<ff_node> > V;
+        std::vector<Worker*> W;
+        for(size_t i=0;i<nworkers;++i) {
+            W.push_back(new Worker);
+            W.back()->set_input_batch(8);
+            V.push_back(std::unique_ptr<ff_node>(W.back()));
+        }
+        ff_Farm<long,long> farm(std::move(V));
+        if (run(farm, false, W)<0) return -1;
+    }
+    {
+        std::vector<std::unique_ptr<ff_node> > V;
+        std::vector<Worker*> W;
+        for(size_t i=0;i<nworkers;++i) {
+            W.push_back(new Worker);
+            V.push_back(std::unique_ptr<ff_node>(W.back()));
+        }
+        ff_OFarm<long,long> ofarm(std::move(V));
+        if (run(ofarm, true, W)<0) return -1;
+    }
+    printf("TEST OK\n");
+    return 0;
+}